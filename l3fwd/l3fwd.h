@@ -7,6 +7,13 @@
 
 #include <rte_ethdev.h>
 #include <rte_vect.h>
+#include <rte_cycles.h>
+#include <rte_ring.h>
+#include <rte_ring_peek.h>
+#include <rte_ip.h>
+#include <rte_hash_crc.h>
+
+#include "l3fwd_trace.h"
 
 #define DO_RFC_1812_CHECKS
 
@@ -35,6 +42,24 @@
 
 #define NB_SOCKETS        8
 
+/* What to do with packets the PMD does not accept, see --tx-policy. */
+enum l3fwd_tx_policy {
+	L3FWD_TX_DROP = 0,	/* free them */
+	L3FWD_TX_RETRY,		/* retry until the TSC budget is spent */
+	L3FWD_TX_PARK,		/* park them, retry on the next drain tick */
+};
+
+#define BURST_TX_RETRY_US 10	/* default retry budget */
+#define L3FWD_TX_PARK_SZ  1024	/* per lcore and tx port */
+
+/* Software RSS (--sw-rss) ring sizes. */
+#define SWRSS_RING_SZ     1024	/* per rx lcore and worker */
+#define SWRSS_TX_RING_SZ  1024	/* per port with a single tx queue */
+
+/* Pipeline mode (--pipeline) ring and reorder window sizes. */
+#define PIPELINE_RING_SZ     1024	/* per rx queue and worker/tx lcore */
+#define PIPELINE_REORDER_SZ  1024	/* per rx queue, power of 2 */
+
 /* Configure how many packets ahead to prefetch, when reading packets */
 #define PREFETCH_OFFSET	  3
 
@@ -56,10 +81,53 @@
 #endif
 #define HASH_ENTRY_NUMBER_DEFAULT	4
 
-struct mbuf_table {
-	uint16_t len;
+/*
+ * Tx staging of one lcore for one egress port. The lcore holds one per
+ * enabled port, packed in tx_port[] in port order, so that the few ports
+ * in use share a handful of cache lines.
+ */
+struct l3fwd_tx_port {
+	uint16_t len;		/**< packets staged in m_table */
+	uint16_t port_id;
+	uint16_t queue_id;
+	struct rte_ring *park;	/**< --tx-policy=park */
+	struct rte_ring *ring;	/**< shared tx, --sw-rss */
 	struct rte_mbuf *m_table[MAX_PKT_BURST];
-};
+} __rte_cache_aligned;
+
+/* rx burst size histogram buckets: 1, 2-3, 4-7, 8-15, 16-31, 32. */
+#define L3FWD_BURST_HIST_SZ	6
+
+/*
+ * Per-lcore forwarding counters. Each entry is written only by its own
+ * lcore and read by telemetry with plain 64-bit loads, so no locking.
+ */
+struct l3fwd_lcore_stats {
+	uint64_t rx_pkts;
+	uint64_t tx_pkts;
+	uint64_t tx_drops;	/**< not accepted by rte_eth_tx_burst() */
+	uint64_t lookup_miss;	/**< no route, sent back out of rx port */
+	uint64_t bad_port_drops; /**< invalid or non-IP, freed unsent */
+	uint64_t dist_drops;	/**< worker ring full, --sw-rss only */
+	uint64_t empty_polls;
+	uint64_t busy_cycles;	/**< loop iterations that received packets */
+	uint64_t idle_cycles;	/**< loop iterations that received nothing */
+	uint64_t flow_cache_hits;	/**< --flow-cache */
+	uint64_t flow_cache_misses;	/**< looked up in the table instead */
+	uint64_t idle_sleeps;	/**< --adaptive-poll, rx interrupt sleeps */
+	uint64_t idle_sleep_cycles;
+	uint64_t idle_wakeups;	/**< interrupt wake-ups that got packets */
+	uint64_t idle_wake_cycles;	/**< wake-up to first burst forwarded */
+	uint64_t idle_wake_max_cycles;
+	uint64_t drain_ticks;	/**< --adaptive-drain, tx drain ticks */
+	uint64_t drain_cycles;	/**< current drain interval */
+	uint64_t drain_avg_burst;	/**< rx burst average, in 1/16 packets */
+	uint64_t burst_hist[L3FWD_BURST_HIST_SZ];
+	/* tx backpressure, per egress port */
+	uint64_t tx_port_drops[RTE_MAX_ETHPORTS];
+	uint64_t tx_port_retries[RTE_MAX_ETHPORTS];
+	uint64_t tx_port_parked[RTE_MAX_ETHPORTS];
+} __rte_cache_aligned;
 
 struct lcore_rx_queue {
 	uint16_t port_id;
@@ -70,11 +138,19 @@ struct lcore_conf {
 	uint16_t n_rx_queue;
 	struct lcore_rx_queue rx_queue_list[MAX_RX_QUEUE_PER_LCORE];
 	uint16_t n_tx_port;
-	uint16_t tx_port_id[RTE_MAX_ETHPORTS];
-	uint16_t tx_queue_id[RTE_MAX_ETHPORTS];
-	struct mbuf_table tx_mbufs[RTE_MAX_ETHPORTS];
+	uint32_t tx_pending; /**< bit per tx_port[] entry with staged packets */
+	struct l3fwd_tx_port *tx_port; /**< n_tx_port entries */
+	uint8_t tx_port_idx[RTE_MAX_ETHPORTS]; /**< port id to tx_port[] */
+	struct rte_ring *tx_pipe; /**< --pipeline worker: all tx goes here */
+	uint8_t tx_stub; /**< --bench: tx takes the packets and drops them */
+	struct l3fwd_flow_cache *flow_cache; /**< NULL without --flow-cache */
+	struct l3fwd_idle *idle; /**< NULL without --adaptive-poll */
+	struct l3fwd_drain *drain; /**< NULL without --adaptive-drain */
 	void *ipv4_lookup_struct;
 	void *ipv6_lookup_struct;
+	void *acl4_ctx;	/**< NULL when no IPv4 ACL rules are loaded */
+	void *acl6_ctx;	/**< NULL when no IPv6 ACL rules are loaded */
+	struct l3fwd_lcore_stats *stats;
 } __rte_cache_aligned;
 
 extern volatile bool force_quit;
@@ -92,27 +168,394 @@ extern uint32_t hash_entry_number;
 
 extern xmm_t val_eth[RTE_MAX_ETHPORTS];
 
+extern enum l3fwd_tx_policy tx_policy;
+extern uint64_t tx_retry_tsc;
+
 extern struct lcore_conf lcore_conf[RTE_MAX_LCORE];
 
+extern struct l3fwd_lcore_stats l3fwd_lcore_stats[RTE_MAX_LCORE];
+
+/* Account one rx poll. */
+static __rte_always_inline void
+l3fwd_stats_rx(struct l3fwd_lcore_stats *st, uint16_t nb_rx)
+{
+	if (nb_rx == 0) {
+		st->empty_polls++;
+		return;
+	}
+
+	st->rx_pkts += nb_rx;
+	st->burst_hist[rte_fls_u32(nb_rx) - 1]++;
+}
+
+/* Charge the cycles since *last to busy or idle time, restart at now. */
+static __rte_always_inline void
+l3fwd_stats_loop(struct l3fwd_lcore_stats *st, uint64_t now, uint64_t *last,
+		int busy)
+{
+	if (busy)
+		st->busy_cycles += now - *last;
+	else
+		st->idle_cycles += now - *last;
+	*last = now;
+}
+
+/*
+ * Next-hop adjacencies.
+ * Route lookups return an adjacency id rather than an egress port:
+ * - ids below L3FWD_ADJ_NH_BASE are the per-port adjacencies, built from
+ *   the port MAC and --eth-dest, so id == port;
+ * - ids from L3FWD_ADJ_NH_BASE are the next hops configured with --nh;
+ * - ids with L3FWD_ADJ_ECMP_FLAG set name an ECMP group (--ecmp).
+ * The flag is kept below 0x8000 so ids survive the signed 32 to 16 bit
+ * packs in the vector LPM paths.
+ */
+#define L3FWD_MAX_NH		256
+#define L3FWD_ADJ_NH_BASE	RTE_MAX_ETHPORTS
+#define L3FWD_MAX_ADJ		(L3FWD_ADJ_NH_BASE + L3FWD_MAX_NH)
+#define L3FWD_MAX_ECMP_GROUPS	64
+#define L3FWD_MAX_ECMP_MEMBERS	16
+#define L3FWD_ADJ_ECMP_FLAG	0x4000
+#define L3FWD_ADJ_ECMP_MASK	(L3FWD_ADJ_ECMP_FLAG - 1)
+
+struct l3fwd_adj {
+	xmm_t val_eth;	/**< dst MAC in bytes 0-5, src MAC in bytes 6-11 */
+	uint16_t port;	/**< egress port */
+};
+
+struct l3fwd_ecmp_group {
+	uint16_t nb_members;
+	uint16_t members[L3FWD_MAX_ECMP_MEMBERS]; /**< adjacency ids */
+};
+
+extern struct l3fwd_adj l3fwd_adj_tbl[L3FWD_MAX_ADJ];
+extern struct l3fwd_ecmp_group l3fwd_ecmp_tbl[L3FWD_MAX_ECMP_GROUPS];
+extern const struct l3fwd_adj l3fwd_adj_drop;
+
+/*
+ * 5-tuple hash. A hash already computed by the NIC is reused; otherwise
+ * CRC32 over addresses, protocol and, for unfragmented TCP/UDP, ports.
+ * The result is stored as the RSS hash, so a packet is hashed once even
+ * when both sw-rss and ECMP need it.
+ */
+static __rte_always_inline uint32_t
+l3fwd_flow_hash(struct rte_mbuf *m)
+{
+	struct rte_ipv4_hdr *ipv4_hdr;
+	struct rte_ipv6_hdr *ipv6_hdr;
+	const uint32_t *ports;
+	uint32_t h;
+
+	if (m->ol_flags & PKT_RX_RSS_HASH)
+		return m->hash.rss;
+
+	if (RTE_ETH_IS_IPV4_HDR(m->packet_type)) {
+		ipv4_hdr = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *,
+				sizeof(struct rte_ether_hdr));
+		h = rte_hash_crc_8byte(*(const uint64_t *)&ipv4_hdr->src_addr,
+				ipv4_hdr->next_proto_id);
+		if ((ipv4_hdr->next_proto_id == IPPROTO_TCP ||
+				ipv4_hdr->next_proto_id == IPPROTO_UDP) &&
+				(ipv4_hdr->fragment_offset &
+				rte_cpu_to_be_16(RTE_IPV4_HDR_OFFSET_MASK |
+				RTE_IPV4_HDR_MF_FLAG)) == 0) {
+			ports = (const uint32_t *)((const uint8_t *)ipv4_hdr +
+				(ipv4_hdr->version_ihl &
+				RTE_IPV4_HDR_IHL_MASK) *
+				RTE_IPV4_IHL_MULTIPLIER);
+			h = rte_hash_crc_4byte(*ports, h);
+		}
+	} else if (RTE_ETH_IS_IPV6_HDR(m->packet_type)) {
+		ipv6_hdr = rte_pktmbuf_mtod_offset(m, struct rte_ipv6_hdr *,
+				sizeof(struct rte_ether_hdr));
+		h = rte_hash_crc(ipv6_hdr->src_addr,
+				sizeof(ipv6_hdr->src_addr) +
+				sizeof(ipv6_hdr->dst_addr), ipv6_hdr->proto);
+		if (ipv6_hdr->proto == IPPROTO_TCP ||
+				ipv6_hdr->proto == IPPROTO_UDP) {
+			ports = (const uint32_t *)(ipv6_hdr + 1);
+			h = rte_hash_crc_4byte(*ports, h);
+		}
+	} else
+		return 0;
+
+	m->hash.rss = h;
+	m->ol_flags |= PKT_RX_RSS_HASH;
+	return h;
+}
+
+/*
+ * Resolve a lookup result to its adjacency. ECMP members are selected
+ * from the flow hash, so packets of one flow always take the same
+ * member. It is the RSS hash of the NIC when the mbuf carries one; the
+ * offload is missing on some devices and in event mode, there the flow
+ * is hashed in software.
+ */
+static __rte_always_inline const struct l3fwd_adj *
+l3fwd_adj_get(uint16_t nh, struct rte_mbuf *m)
+{
+	const struct l3fwd_ecmp_group *grp;
+
+	if (unlikely(nh & L3FWD_ADJ_ECMP_FLAG)) {
+		if (nh == BAD_PORT)
+			return &l3fwd_adj_drop;
+		grp = &l3fwd_ecmp_tbl[nh & L3FWD_ADJ_ECMP_MASK];
+		/* Scale the hash onto the member set without a division. */
+		nh = grp->members[((uint64_t)l3fwd_flow_hash(m) *
+				grp->nb_members) >> 32];
+	}
+
+	return &l3fwd_adj_tbl[nh];
+}
+
+/*
+ * Adjacency of nh for the x4 paths. An egress port outside the port mask
+ * falls back to the adjacency of the rx port in m->port, as in
+ * l3fwd_adj_forward(); BAD_PORT is kept, so the packet is dropped.
+ */
+static __rte_always_inline const struct l3fwd_adj *
+l3fwd_adj_get_enabled(uint16_t nh, struct rte_mbuf *m)
+{
+	const struct l3fwd_adj *adj = l3fwd_adj_get(nh, m);
+
+	if (unlikely(adj->port < RTE_MAX_ETHPORTS &&
+			(enabled_port_mask & 1 << adj->port) == 0))
+		adj = &l3fwd_adj_tbl[m->port];
+
+	return adj;
+}
+
+/*
+ * Scalar forwarding: resolve nh, fall back to the adjacency of portid if
+ * the egress port is not usable, and rewrite both ethernet addresses.
+ * Returns the egress port.
+ */
+static __rte_always_inline uint16_t
+l3fwd_adj_forward(struct rte_mbuf *m, uint16_t nh, uint16_t portid)
+{
+	const struct l3fwd_adj *adj;
+
+	adj = l3fwd_adj_get(nh, m);
+	if (adj->port >= RTE_MAX_ETHPORTS ||
+			(enabled_port_mask & 1 << adj->port) == 0)
+		adj = &l3fwd_adj_tbl[portid];
+
+	memcpy(rte_pktmbuf_mtod(m, void *), &adj->val_eth,
+			2 * RTE_ETHER_ADDR_LEN);
+
+	return adj->port;
+}
+
+/* Tx staging of the lcore for an enabled port. */
+static __rte_always_inline struct l3fwd_tx_port *
+l3fwd_tx_port(struct lcore_conf *qconf, uint16_t port)
+{
+	return &qconf->tx_port[qconf->tx_port_idx[port]];
+}
+
+/*
+ * Free n dropped packets. A pipeline worker passes them on to its tx
+ * stage with BAD_PORT in mbuf->port instead: the reorder buffer there
+ * has to see their sequence numbers, or every drop leaves a hole that
+ * holds the rx queue back. Only what the ring refuses is freed here.
+ */
+static inline void
+l3fwd_drop_bulk(const struct lcore_conf *qconf, struct rte_mbuf **m,
+		unsigned int n)
+{
+	unsigned int i, sent;
+
+	if (unlikely(qconf->tx_pipe != NULL)) {
+		for (i = 0; i < n; i++)
+			m[i]->port = BAD_PORT;
+		sent = rte_ring_mp_enqueue_burst(qconf->tx_pipe,
+				(void **)m, n, NULL);
+		m += sent;
+		n -= sent;
+	}
+
+	if (n != 0)
+		rte_pktmbuf_free_bulk(m, n);
+}
+
+/*
+ * Hand packets to the PMD. Ports whose single tx queue is owned by
+ * another lcore (--sw-rss) go through that lcore's tx ring instead.
+ * Pipeline workers pass everything to their tx stage, with the egress
+ * port in mbuf->port.
+ */
+static __rte_always_inline uint16_t
+l3fwd_eth_tx_burst(struct lcore_conf *qconf, uint16_t port,
+		struct rte_mbuf **m, uint16_t n)
+{
+	struct l3fwd_tx_port *txp;
+	uint16_t i;
+
+	if (unlikely(qconf->tx_pipe != NULL)) {
+		for (i = 0; i < n; i++)
+			m[i]->port = port;
+		return rte_ring_mp_enqueue_burst(qconf->tx_pipe,
+				(void **)m, n, NULL);
+	}
+
+	txp = l3fwd_tx_port(qconf, port);
+	if (unlikely(txp->ring != NULL))
+		return rte_ring_mp_enqueue_burst(txp->ring,
+				(void **)m, n, NULL);
+
+	/* the bench owns and replays the mbufs, nothing to free */
+	if (unlikely(qconf->tx_stub))
+		return n;
+
+	return rte_eth_tx_burst(port, txp->queue_id, m, n);
+}
+
+/*
+ * Send what is parked for a port, oldest first. Packets the PMD does not
+ * take stay at the head of the ring. Returns the number still parked.
+ */
+static inline unsigned int
+l3fwd_tx_park_drain(struct lcore_conf *qconf, uint16_t port)
+{
+	struct rte_ring *r = l3fwd_tx_port(qconf, port)->park;
+	struct rte_mbuf *m[MAX_PKT_BURST];
+	unsigned int n, sent, left;
+
+	do {
+		n = rte_ring_dequeue_burst_start(r, (void **)m,
+				MAX_PKT_BURST, &left);
+		if (n == 0)
+			return 0;
+		sent = l3fwd_eth_tx_burst(qconf, port, m, n);
+		rte_ring_dequeue_finish(r, sent);
+		qconf->stats->tx_pkts += sent;
+	} while (sent == n && left != 0);
+
+	return left + n - sent;
+}
+
+/* Apply --tx-policy to the n packets in m the PMD did not accept. */
+static inline void
+l3fwd_tx_unsent(struct lcore_conf *qconf, uint16_t port,
+		struct rte_mbuf **m, uint16_t n)
+{
+	struct l3fwd_lcore_stats *st = qconf->stats;
+	uint64_t deadline;
+	uint16_t sent;
+
+	if (tx_policy == L3FWD_TX_RETRY) {
+		deadline = rte_rdtsc() + tx_retry_tsc;
+		do {
+			st->tx_port_retries[port]++;
+			sent = l3fwd_eth_tx_burst(qconf, port, m, n);
+			st->tx_pkts += sent;
+			m += sent;
+			n -= sent;
+		} while (n != 0 && rte_rdtsc() < deadline);
+	} else if (tx_policy == L3FWD_TX_PARK) {
+		sent = rte_ring_enqueue_burst(l3fwd_tx_port(qconf, port)->park,
+				(void **)m, n, NULL);
+		st->tx_port_parked[port] += sent;
+		m += sent;
+		n -= sent;
+	}
+
+	if (n != 0) {
+		st->tx_drops += n;
+		st->tx_port_drops[port] += n;
+		rte_pktmbuf_free_bulk(m, n);
+	}
+}
+
+/* Transmit n packets on port, applying --tx-policy to what is left over */
+static inline void
+l3fwd_tx_burst(struct lcore_conf *qconf, uint16_t port,
+		struct rte_mbuf **m, uint16_t n)
+{
+	uint16_t sent;
+
+	/* Keep packet order: queue behind anything still parked. */
+	if (unlikely(tx_policy == L3FWD_TX_PARK) &&
+			!rte_ring_empty(l3fwd_tx_port(qconf, port)->park) &&
+			l3fwd_tx_park_drain(qconf, port) != 0) {
+		l3fwd_tx_unsent(qconf, port, m, n);
+		return;
+	}
+
+	sent = l3fwd_eth_tx_burst(qconf, port, m, n);
+	l3fwd_trace_tx_burst(port, n, sent);
+	qconf->stats->tx_pkts += sent;
+	if (unlikely(sent < n))
+		l3fwd_tx_unsent(qconf, port, m + sent, n - sent);
+}
+
 /* Send burst of packets on an output interface */
 static inline int
 send_burst(struct lcore_conf *qconf, uint16_t n, uint16_t port)
 {
 	struct rte_mbuf **m_table;
-	int ret;
-	uint16_t queueid;
 
-	queueid = qconf->tx_queue_id[port];
-	m_table = (struct rte_mbuf **)qconf->tx_mbufs[port].m_table;
+	m_table = l3fwd_tx_port(qconf, port)->m_table;
+	l3fwd_tx_burst(qconf, port, m_table, n);
 
-	ret = rte_eth_tx_burst(port, queueid, m_table, n);
-	if (unlikely(ret < n)) {
-		do {
-			rte_pktmbuf_free(m_table[ret]);
-		} while (++ret < n);
+	return 0;
+}
+
+/*
+ * Drain tick: flush whatever is parked, then the tx buffers. Only the
+ * ports flagged in tx_pending can hold staged packets.
+ */
+static inline void
+l3fwd_tx_drain(struct lcore_conf *qconf)
+{
+	struct l3fwd_tx_port *txp;
+	uint32_t pending;
+	uint16_t i;
+
+	if (unlikely(tx_policy == L3FWD_TX_PARK))
+		for (i = 0; i < qconf->n_tx_port; ++i)
+			l3fwd_tx_park_drain(qconf, qconf->tx_port[i].port_id);
+
+	pending = qconf->tx_pending;
+	l3fwd_trace_tx_drain(pending);
+	qconf->tx_pending = 0;
+	while (pending != 0) {
+		txp = &qconf->tx_port[rte_bsf32(pending)];
+		pending &= pending - 1;
+		if (txp->len == 0)
+			continue;
+		send_burst(qconf, txp->len, txp->port_id);
+		txp->len = 0;
 	}
+}
 
-	return 0;
+/*
+ * Final drain when a poll loop exits, on the lcore that owns the tx
+ * staging: the buffers are sent and whatever the PMD still does not take
+ * from the park rings is freed, before a warm restart hands the tx
+ * queues to the next generation.
+ */
+static inline void
+l3fwd_tx_flush(struct lcore_conf *qconf)
+{
+	struct rte_mbuf *m[MAX_PKT_BURST];
+	struct l3fwd_tx_port *txp;
+	unsigned int n;
+	uint16_t i;
+
+	l3fwd_tx_drain(qconf);
+	if (likely(tx_policy != L3FWD_TX_PARK))
+		return;
+
+	for (i = 0; i < qconf->n_tx_port; ++i) {
+		txp = &qconf->tx_port[i];
+		while ((n = rte_ring_dequeue_burst(txp->park, (void **)m,
+				MAX_PKT_BURST, NULL)) != 0) {
+			qconf->stats->tx_drops += n;
+			qconf->stats->tx_port_drops[txp->port_id] += n;
+			rte_pktmbuf_free_bulk(m, n);
+		}
+	}
 }
 
 /* Enqueue a single packet, and send burst if queue is filled */
@@ -120,10 +563,12 @@ static inline int
 send_single_packet(struct lcore_conf *qconf,
 		   struct rte_mbuf *m, uint16_t port)
 {
+	uint8_t idx = qconf->tx_port_idx[port];
+	struct l3fwd_tx_port *txp = &qconf->tx_port[idx];
 	uint16_t len;
 
-	len = qconf->tx_mbufs[port].len;
-	qconf->tx_mbufs[port].m_table[len] = m;
+	len = txp->len;
+	txp->m_table[len] = m;
 	len++;
 
 	/* enough pkts to be sent */
@@ -132,7 +577,8 @@ send_single_packet(struct lcore_conf *qconf,
 		len = 0;
 	}
 
-	qconf->tx_mbufs[port].len = len;
+	txp->len = len;
+	qconf->tx_pending |= (uint32_t)(len != 0) << idx;
 	return 0;
 }
 
@@ -187,6 +633,18 @@ setup_lpm(const int socketid);
 void
 setup_hash(const int socketid);
 
+void
+em_setup_flows(void);
+
+void
+em_free_flows(void);
+
+void
+setup_fib(const int socketid);
+
+void
+attach_lpm(const int socketid);
+
 int
 em_check_ptype(int portid);
 
@@ -201,11 +659,62 @@ uint16_t
 lpm_cb_parse_ptype(uint16_t port, uint16_t queue, struct rte_mbuf *pkts[],
 		   uint16_t nb_pkts, uint16_t max_pkts, void *user_param);
 
-int
-em_main_loop(__rte_unused void *dummy);
+/*
+ * Poll mode main loops, one instance per configuration. The loop body of
+ * a lookup method is an always inline function of constant flags, so
+ * each instance is compiled without the branches of the others. The
+ * instance is picked from <method>_main_loops[flags] once at startup.
+ */
+#define L3FWD_LOOP_IPV4		0x1	/* IPv4 fast path */
+#define L3FWD_LOOP_IPV6		0x2	/* IPv6 fast path */
+#define L3FWD_LOOP_AF		(L3FWD_LOOP_IPV4 | L3FWD_LOOP_IPV6)
+#define L3FWD_LOOP_SW_PTYPE	0x4	/* --parse-ptype done in the loop */
+#define L3FWD_LOOP_EXTRA	0x8	/* ACL, flow cache, adaptive poll */
+#define L3FWD_LOOP_NB		0x10
+
+typedef int (*l3fwd_main_loop_t)(void *dummy);
+
+/* <method>_main_loop_<name>() running <method>_poll_loop(flags) */
+#define L3FWD_LOOP_DEFINE(method, name, flags)				\
+static int								\
+method##_main_loop_##name(__rte_unused void *dummy)			\
+{									\
+	return method##_poll_loop(flags);				\
+}
 
-int
-lpm_main_loop(__rte_unused void *dummy);
+/* The four instances of one address family. */
+#define L3FWD_LOOP_DEFINE_AF(method, af, flags)				\
+	L3FWD_LOOP_DEFINE(method, af, (flags))				\
+	L3FWD_LOOP_DEFINE(method, af##_pt, (flags) | L3FWD_LOOP_SW_PTYPE) \
+	L3FWD_LOOP_DEFINE(method, af##_x, (flags) | L3FWD_LOOP_EXTRA)	\
+	L3FWD_LOOP_DEFINE(method, af##_pt_x, (flags) |			\
+			L3FWD_LOOP_SW_PTYPE | L3FWD_LOOP_EXTRA)
+
+/* Their entries in <method>_main_loops[]. */
+#define L3FWD_LOOP_ENTRIES_AF(method, af, flags)			\
+	[(flags)] = method##_main_loop_##af,				\
+	[(flags) | L3FWD_LOOP_SW_PTYPE] = method##_main_loop_##af##_pt,	\
+	[(flags) | L3FWD_LOOP_EXTRA] = method##_main_loop_##af##_x,	\
+	[(flags) | L3FWD_LOOP_SW_PTYPE | L3FWD_LOOP_EXTRA] =		\
+		method##_main_loop_##af##_pt_x
+
+/* NULL entries: the method has no instance of that address family. */
+extern const l3fwd_main_loop_t em_main_loops[L3FWD_LOOP_NB];
+extern const l3fwd_main_loop_t lpm_main_loops[L3FWD_LOOP_NB];
+extern const l3fwd_main_loop_t fib_main_loops[L3FWD_LOOP_NB];
+
+/* Forward one burst received on portid, used by the --sw-rss workers. */
+void
+lpm_process_burst(int nb_rx, struct rte_mbuf **pkts_burst, uint16_t portid,
+		struct lcore_conf *qconf);
+
+void
+em_process_burst(int nb_rx, struct rte_mbuf **pkts_burst, uint16_t portid,
+		struct lcore_conf *qconf);
+
+void
+fib_process_burst(int nb_rx, struct rte_mbuf **pkts_burst, uint16_t portid,
+		struct lcore_conf *qconf);
 
 int
 lpm_event_main_loop_tx_d(__rte_unused void *dummy);
@@ -226,6 +735,175 @@ int
 em_event_main_loop_tx_q_burst(__rte_unused void *dummy);
 
 
+/* Next-hop adjacency and ECMP configuration. */
+int
+l3fwd_adj_parse_nh(const char *arg);
+
+int
+l3fwd_adj_parse_ecmp(const char *arg);
+
+int
+l3fwd_adj_parse_route(const char *arg);
+
+int
+l3fwd_adj_nh_usable(uint16_t nh);
+
+int
+l3fwd_adj_has_ecmp(void);
+
+void
+l3fwd_adj_setup(void);
+
+/* Optional ACL stage in front of the route lookup. */
+int
+l3fwd_acl_load_rules(const char *path);
+
+void
+setup_acl(const int socketid);
+
+void
+attach_acl(const int socketid);
+
+void *
+acl_get_ipv4_ctx(const int socketid);
+
+void *
+acl_get_ipv6_ctx(const int socketid);
+
+uint16_t
+l3fwd_acl_filter(const struct lcore_conf *qconf, struct rte_mbuf **pkts,
+		uint16_t nb_rx);
+
+void
+l3fwd_acl_print_stats(void);
+
+/* Software RSS: rx lcores hash flows onto worker lcores. */
+typedef void (*l3fwd_process_burst_t)(int nb_rx, struct rte_mbuf **pkts_burst,
+		uint16_t portid, struct lcore_conf *qconf);
+
+struct rte_ring *
+l3fwd_swrss_tx_ring(uint16_t portid, int socketid);
+
+void
+l3fwd_swrss_setup(l3fwd_process_burst_t process_burst, int numa_on);
+
+int
+swrss_main_loop(__rte_unused void *dummy);
+
+/* Pipeline mode: rx, worker and tx lcores with order restoration. */
+int
+l3fwd_pipeline_parse(const char *arg);
+
+void
+l3fwd_pipeline_setup(l3fwd_process_burst_t process_burst, int numa_on);
+
+int
+pipeline_main_loop(__rte_unused void *dummy);
+
+void
+l3fwd_pipeline_print_stats(void);
+
+/*
+ * Warm restart: a secondary l3fwd attaches to the tables and ports of the
+ * running primary and takes forwarding over from the current instance.
+ */
+void
+l3fwd_warm_init(int argc, char **argv);
+
+int
+l3fwd_warm_secondary(void);
+
+void
+l3fwd_warm_takeover(void);
+
+int
+l3fwd_warm_stop(void);
+
+/* Offline lookup benchmark: synthetic bursts, tx stubbed out. */
+struct l3fwd_bench_flow {
+	uint32_t ip_dst;	/**< host byte order */
+	uint32_t ip_src;
+	uint16_t port_dst;
+	uint16_t port_src;
+	uint8_t proto;
+};
+
+typedef void (*l3fwd_bench_flow_t)(uint32_t i, struct l3fwd_bench_flow *f);
+
+void
+lpm_bench_flow(uint32_t i, struct l3fwd_bench_flow *f);
+
+void
+em_bench_flow(uint32_t i, struct l3fwd_bench_flow *f);
+
+int
+l3fwd_bench_parse(const char *arg);
+
+void
+l3fwd_bench_setup(l3fwd_process_burst_t process_burst,
+		l3fwd_bench_flow_t bench_flow, int numa_on);
+
+int
+bench_main_loop(__rte_unused void *dummy);
+
+void
+l3fwd_bench_print_stats(void);
+
+/* Per-lcore flow cache in front of the LPM/EM lookups. */
+extern uint32_t l3fwd_flow_cache_gen;
+
+int
+l3fwd_flow_cache_parse(const char *arg);
+
+void
+l3fwd_flow_cache_setup(int numa_on);
+
+void
+l3fwd_flow_cache_invalidate(void);
+
+void
+l3fwd_flow_cache_print_stats(void);
+
+/* Adaptive polling: pause, then sleep on rx interrupts when idle. */
+int
+l3fwd_idle_parse(const char *arg);
+
+void
+l3fwd_idle_setup(int numa_on);
+
+void
+l3fwd_idle_start(struct lcore_conf *qconf);
+
+void
+l3fwd_idle_print_stats(void);
+
+/* Adaptive tx drain: drain interval follows the rx burst sizes. */
+int
+l3fwd_drain_parse(const char *arg);
+
+void
+l3fwd_drain_setup(int numa_on);
+
+void
+l3fwd_drain_print_stats(void);
+
+/* Sampled rx to tx latency inside the application. */
+int
+l3fwd_latency_parse(const char *arg);
+
+void
+l3fwd_latency_setup(void);
+
+void
+l3fwd_latency_attach(uint16_t portid);
+
+void
+l3fwd_latency_print_stats(void);
+
+/* Telemetry for the per-lcore counters. */
+void
+l3fwd_stats_init(void);
+
 /* Return ipv4/ipv6 fwd lookup struct for LPM or EM. */
 void *
 em_get_ipv4_l3fwd_lookup_struct(const int socketid);
@@ -239,4 +917,10 @@ lpm_get_ipv4_l3fwd_lookup_struct(const int socketid);
 void *
 lpm_get_ipv6_l3fwd_lookup_struct(const int socketid);
 
+void *
+fib_get_ipv4_l3fwd_lookup_struct(const int socketid);
+
+void *
+fib_get_ipv6_l3fwd_lookup_struct(const int socketid);
+
 #endif  /* __L3_FWD_H__ */
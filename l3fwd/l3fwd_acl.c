@@ -0,0 +1,606 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <rte_common.h>
+#include <rte_byteorder.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_mbuf.h>
+#include <rte_ip.h>
+#include <rte_acl.h>
+
+#include "l3fwd.h"
+
+/*
+ * Optional ACL stage run on every rx burst before the route lookup.
+ *
+ * Rule file format, one rule per line, '#' starts a comment:
+ *   <permit|deny> SRC/DEPTH DST/DEPTH SPORT_LO:SPORT_HI DPORT_LO:DPORT_HI
+ *   PROTO/MASK
+ * SRC and DST are both IPv4 or both IPv6 addresses. Rules are matched
+ * in file order and the first matching rule wins. Packets that match
+ * no rule are permitted.
+ */
+
+#define L3FWD_ACL_MAX_RULES	1024
+#define L3FWD_ACL_NUM_CATEGORIES	1
+
+enum {
+	PROTO_FIELD_IPV4,
+	SRC_FIELD_IPV4,
+	DST_FIELD_IPV4,
+	SRCP_FIELD_IPV4,
+	DSTP_FIELD_IPV4,
+	NUM_FIELDS_IPV4
+};
+
+enum {
+	PROTO_FIELD_IPV6,
+	SRC1_FIELD_IPV6,
+	SRC2_FIELD_IPV6,
+	SRC3_FIELD_IPV6,
+	SRC4_FIELD_IPV6,
+	DST1_FIELD_IPV6,
+	DST2_FIELD_IPV6,
+	DST3_FIELD_IPV6,
+	DST4_FIELD_IPV6,
+	SRCP_FIELD_IPV6,
+	DSTP_FIELD_IPV6,
+	NUM_FIELDS_IPV6
+};
+
+/*
+ * Classification input starts at the protocol field of the IP header.
+ * Port offsets assume an IPv4 header without options and an IPv6
+ * header without extension headers.
+ */
+#define IPV4_ACL_OFS(f)	\
+	(offsetof(struct rte_ipv4_hdr, f) - \
+	 offsetof(struct rte_ipv4_hdr, next_proto_id))
+#define IPV4_ACL_L4_OFS	\
+	(sizeof(struct rte_ipv4_hdr) - \
+	 offsetof(struct rte_ipv4_hdr, next_proto_id))
+#define IPV6_ACL_OFS(f)	\
+	(offsetof(struct rte_ipv6_hdr, f) - offsetof(struct rte_ipv6_hdr, proto))
+#define IPV6_ACL_L4_OFS	\
+	(sizeof(struct rte_ipv6_hdr) - offsetof(struct rte_ipv6_hdr, proto))
+
+static const struct rte_acl_field_def ipv4_acl_defs[NUM_FIELDS_IPV4] = {
+	{
+		.type = RTE_ACL_FIELD_TYPE_BITMASK,
+		.size = sizeof(uint8_t),
+		.field_index = PROTO_FIELD_IPV4,
+		.input_index = PROTO_FIELD_IPV4,
+		.offset = 0,
+	},
+	{
+		.type = RTE_ACL_FIELD_TYPE_MASK,
+		.size = sizeof(uint32_t),
+		.field_index = SRC_FIELD_IPV4,
+		.input_index = SRC_FIELD_IPV4,
+		.offset = IPV4_ACL_OFS(src_addr),
+	},
+	{
+		.type = RTE_ACL_FIELD_TYPE_MASK,
+		.size = sizeof(uint32_t),
+		.field_index = DST_FIELD_IPV4,
+		.input_index = DST_FIELD_IPV4,
+		.offset = IPV4_ACL_OFS(dst_addr),
+	},
+	{
+		.type = RTE_ACL_FIELD_TYPE_RANGE,
+		.size = sizeof(uint16_t),
+		.field_index = SRCP_FIELD_IPV4,
+		.input_index = SRCP_FIELD_IPV4,
+		.offset = IPV4_ACL_L4_OFS,
+	},
+	{
+		.type = RTE_ACL_FIELD_TYPE_RANGE,
+		.size = sizeof(uint16_t),
+		.field_index = DSTP_FIELD_IPV4,
+		.input_index = SRCP_FIELD_IPV4,
+		.offset = IPV4_ACL_L4_OFS + sizeof(uint16_t),
+	},
+};
+
+#define IPV6_ACL_ADDR_DEF(fld, idx, ofs) {	\
+	.type = RTE_ACL_FIELD_TYPE_MASK,	\
+	.size = sizeof(uint32_t),		\
+	.field_index = (fld),			\
+	.input_index = (fld),			\
+	.offset = (ofs) + (idx) * sizeof(uint32_t),	\
+}
+
+static const struct rte_acl_field_def ipv6_acl_defs[NUM_FIELDS_IPV6] = {
+	{
+		.type = RTE_ACL_FIELD_TYPE_BITMASK,
+		.size = sizeof(uint8_t),
+		.field_index = PROTO_FIELD_IPV6,
+		.input_index = PROTO_FIELD_IPV6,
+		.offset = 0,
+	},
+	IPV6_ACL_ADDR_DEF(SRC1_FIELD_IPV6, 0, IPV6_ACL_OFS(src_addr)),
+	IPV6_ACL_ADDR_DEF(SRC2_FIELD_IPV6, 1, IPV6_ACL_OFS(src_addr)),
+	IPV6_ACL_ADDR_DEF(SRC3_FIELD_IPV6, 2, IPV6_ACL_OFS(src_addr)),
+	IPV6_ACL_ADDR_DEF(SRC4_FIELD_IPV6, 3, IPV6_ACL_OFS(src_addr)),
+	IPV6_ACL_ADDR_DEF(DST1_FIELD_IPV6, 0, IPV6_ACL_OFS(dst_addr)),
+	IPV6_ACL_ADDR_DEF(DST2_FIELD_IPV6, 1, IPV6_ACL_OFS(dst_addr)),
+	IPV6_ACL_ADDR_DEF(DST3_FIELD_IPV6, 2, IPV6_ACL_OFS(dst_addr)),
+	IPV6_ACL_ADDR_DEF(DST4_FIELD_IPV6, 3, IPV6_ACL_OFS(dst_addr)),
+	{
+		.type = RTE_ACL_FIELD_TYPE_RANGE,
+		.size = sizeof(uint16_t),
+		.field_index = SRCP_FIELD_IPV6,
+		.input_index = SRCP_FIELD_IPV6,
+		.offset = IPV6_ACL_L4_OFS,
+	},
+	{
+		.type = RTE_ACL_FIELD_TYPE_RANGE,
+		.size = sizeof(uint16_t),
+		.field_index = DSTP_FIELD_IPV6,
+		.input_index = SRCP_FIELD_IPV6,
+		.offset = IPV6_ACL_L4_OFS + sizeof(uint16_t),
+	},
+};
+
+RTE_ACL_RULE_DEF(acl4_rule, NUM_FIELDS_IPV4);
+RTE_ACL_RULE_DEF(acl6_rule, NUM_FIELDS_IPV6);
+
+static struct acl4_rule acl4_rules[L3FWD_ACL_MAX_RULES];
+static struct acl6_rule acl6_rules[L3FWD_ACL_MAX_RULES];
+static unsigned int nb_acl4_rules, nb_acl6_rules;
+
+/* Indexed by rule id, which is the ACL userdata minus one. */
+static struct {
+	uint32_t line;
+	uint8_t deny;
+} acl_rule_info[L3FWD_ACL_MAX_RULES];
+static unsigned int nb_acl_rules;
+
+static struct rte_acl_ctx *ipv4_acl_ctx[NB_SOCKETS];
+static struct rte_acl_ctx *ipv6_acl_ctx[NB_SOCKETS];
+
+struct acl_lcore_stats {
+	uint64_t pkts;
+	uint64_t cycles;
+	uint64_t hits[L3FWD_ACL_MAX_RULES];
+} __rte_cache_aligned;
+
+static struct acl_lcore_stats acl_stats[RTE_MAX_LCORE];
+
+/* Classify methods in order of preference, the first supported wins. */
+static const struct {
+	enum rte_acl_classify_alg alg;
+	const char *name;
+} acl_algs[] = {
+	{ RTE_ACL_CLASSIFY_AVX512X32, "avx512x32" },
+	{ RTE_ACL_CLASSIFY_AVX512X16, "avx512x16" },
+	{ RTE_ACL_CLASSIFY_AVX2, "avx2" },
+	{ RTE_ACL_CLASSIFY_SSE, "sse" },
+	{ RTE_ACL_CLASSIFY_NEON, "neon" },
+	{ RTE_ACL_CLASSIFY_ALTIVEC, "altivec" },
+	{ RTE_ACL_CLASSIFY_SCALAR, "scalar" },
+};
+
+static int
+parse_prefix(char *str, int af, void *addr, uint32_t max_depth,
+		uint32_t *depth)
+{
+	char *slash, *end;
+	unsigned long val;
+
+	slash = strchr(str, '/');
+	if (slash == NULL)
+		return -1;
+	*slash++ = '\0';
+
+	if (inet_pton(af, str, addr) != 1)
+		return -1;
+
+	errno = 0;
+	val = strtoul(slash, &end, 10);
+	if (errno != 0 || end == slash || *end != '\0' || val > max_depth)
+		return -1;
+
+	*depth = val;
+	return 0;
+}
+
+static int
+parse_range(char *str, char sep, unsigned long max,
+		unsigned long *lo, unsigned long *hi)
+{
+	char *end;
+
+	errno = 0;
+	*lo = strtoul(str, &end, 0);
+	if (errno != 0 || end == str || *end != sep || *lo > max)
+		return -1;
+
+	str = end + 1;
+	*hi = strtoul(str, &end, 0);
+	if (errno != 0 || end == str || *end != '\0' || *hi > max)
+		return -1;
+
+	return 0;
+}
+
+/* Split an IPv6 prefix into the four 32-bit ACL fields. */
+static void
+set_ipv6_addr_fields(struct rte_acl_field *fld, const uint8_t *addr,
+		uint32_t depth)
+{
+	uint32_t i, d;
+
+	for (i = 0; i < 4; i++) {
+		d = RTE_MIN(depth, 32u);
+		depth -= d;
+		fld[i].value.u32 = rte_be_to_cpu_32(
+			*(const unaligned_uint32_t *)(addr + i * 4));
+		fld[i].mask_range.u32 = d;
+	}
+}
+
+enum {
+	FLD_ACTION = 0,
+	FLD_SRC,
+	FLD_DST,
+	FLD_SPORT,
+	FLD_DPORT,
+	FLD_PROTO,
+	_NUM_FLD
+};
+
+static int
+parse_rule(char *line, uint32_t lineno)
+{
+	char *str_fld[_NUM_FLD];
+	struct rte_acl_rule_data data;
+	unsigned long sp_lo, sp_hi, dp_lo, dp_hi, proto, proto_mask;
+	uint8_t src6[16], dst6[16];
+	uint32_t src4, dst4, src_depth, dst_depth;
+	char *saveptr = NULL;
+	int i, deny;
+
+	for (i = 0; i < _NUM_FLD; i++) {
+		str_fld[i] = strtok_r(i == 0 ? line : NULL, " \t\r\n",
+				&saveptr);
+		if (str_fld[i] == NULL)
+			return -1;
+	}
+	if (strtok_r(NULL, " \t\r\n", &saveptr) != NULL)
+		return -1;
+
+	if (strcmp(str_fld[FLD_ACTION], "deny") == 0)
+		deny = 1;
+	else if (strcmp(str_fld[FLD_ACTION], "permit") == 0)
+		deny = 0;
+	else
+		return -1;
+
+	if (parse_range(str_fld[FLD_SPORT], ':', UINT16_MAX,
+			&sp_lo, &sp_hi) < 0 ||
+			parse_range(str_fld[FLD_DPORT], ':', UINT16_MAX,
+				&dp_lo, &dp_hi) < 0 ||
+			parse_range(str_fld[FLD_PROTO], '/', UINT8_MAX,
+				&proto, &proto_mask) < 0)
+		return -1;
+
+	if (nb_acl_rules >= L3FWD_ACL_MAX_RULES)
+		return -1;
+
+	/* First rule in the file gets the highest priority. */
+	data.category_mask = 1;
+	data.priority = RTE_ACL_MAX_PRIORITY - nb_acl_rules;
+	data.userdata = nb_acl_rules + 1;
+
+	if (strchr(str_fld[FLD_SRC], ':') == NULL) {
+		struct acl4_rule *r = &acl4_rules[nb_acl4_rules];
+
+		if (parse_prefix(str_fld[FLD_SRC], AF_INET, &src4, 32,
+				&src_depth) < 0 ||
+				parse_prefix(str_fld[FLD_DST], AF_INET, &dst4,
+					32, &dst_depth) < 0)
+			return -1;
+
+		memset(r, 0, sizeof(*r));
+		r->data = data;
+		r->field[PROTO_FIELD_IPV4].value.u8 = proto;
+		r->field[PROTO_FIELD_IPV4].mask_range.u8 = proto_mask;
+		r->field[SRC_FIELD_IPV4].value.u32 = rte_be_to_cpu_32(src4);
+		r->field[SRC_FIELD_IPV4].mask_range.u32 = src_depth;
+		r->field[DST_FIELD_IPV4].value.u32 = rte_be_to_cpu_32(dst4);
+		r->field[DST_FIELD_IPV4].mask_range.u32 = dst_depth;
+		r->field[SRCP_FIELD_IPV4].value.u16 = sp_lo;
+		r->field[SRCP_FIELD_IPV4].mask_range.u16 = sp_hi;
+		r->field[DSTP_FIELD_IPV4].value.u16 = dp_lo;
+		r->field[DSTP_FIELD_IPV4].mask_range.u16 = dp_hi;
+		nb_acl4_rules++;
+	} else {
+		struct acl6_rule *r = &acl6_rules[nb_acl6_rules];
+
+		if (parse_prefix(str_fld[FLD_SRC], AF_INET6, src6, 128,
+				&src_depth) < 0 ||
+				parse_prefix(str_fld[FLD_DST], AF_INET6, dst6,
+					128, &dst_depth) < 0)
+			return -1;
+
+		memset(r, 0, sizeof(*r));
+		r->data = data;
+		r->field[PROTO_FIELD_IPV6].value.u8 = proto;
+		r->field[PROTO_FIELD_IPV6].mask_range.u8 = proto_mask;
+		set_ipv6_addr_fields(&r->field[SRC1_FIELD_IPV6], src6,
+				src_depth);
+		set_ipv6_addr_fields(&r->field[DST1_FIELD_IPV6], dst6,
+				dst_depth);
+		r->field[SRCP_FIELD_IPV6].value.u16 = sp_lo;
+		r->field[SRCP_FIELD_IPV6].mask_range.u16 = sp_hi;
+		r->field[DSTP_FIELD_IPV6].value.u16 = dp_lo;
+		r->field[DSTP_FIELD_IPV6].mask_range.u16 = dp_hi;
+		nb_acl6_rules++;
+	}
+
+	acl_rule_info[nb_acl_rules].line = lineno;
+	acl_rule_info[nb_acl_rules].deny = deny;
+	nb_acl_rules++;
+
+	return 0;
+}
+
+/* Load and check the rule file given with --acl-rules. */
+int
+l3fwd_acl_load_rules(const char *path)
+{
+	char line[256], *p;
+	uint32_t lineno = 0;
+	FILE *f;
+
+	f = fopen(path, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Cannot open ACL rule file %s: %s\n",
+			path, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f) != NULL) {
+		lineno++;
+
+		p = strchr(line, '#');
+		if (p != NULL)
+			*p = '\0';
+		p = line + strspn(line, " \t\r\n");
+		if (*p == '\0')
+			continue;
+
+		if (parse_rule(p, lineno) < 0) {
+			fprintf(stderr, "%s:%u: invalid ACL rule\n",
+				path, lineno);
+			fclose(f);
+			return -1;
+		}
+	}
+
+	fclose(f);
+	printf("ACL: loaded %u IPv4 and %u IPv6 rules from %s\n",
+		nb_acl4_rules, nb_acl6_rules, path);
+	return 0;
+}
+
+static void
+acl_select_alg(struct rte_acl_ctx *ctx, const char *name)
+{
+	unsigned int i;
+
+	for (i = 0; i < RTE_DIM(acl_algs); i++) {
+		if (rte_acl_set_ctx_classify(ctx, acl_algs[i].alg) == 0) {
+			printf("ACL: %s classifies with %s\n",
+				name, acl_algs[i].name);
+			return;
+		}
+	}
+}
+
+static struct rte_acl_ctx *
+acl_build_ctx(const char *name, int socketid, const void *rules,
+		unsigned int nb_rules, const struct rte_acl_field_def *defs,
+		unsigned int nb_fields)
+{
+	struct rte_acl_param param;
+	struct rte_acl_config cfg;
+	struct rte_acl_ctx *ctx;
+	int ret;
+
+	memset(&param, 0, sizeof(param));
+	param.name = name;
+	param.socket_id = socketid;
+	param.rule_size = RTE_ACL_RULE_SZ(nb_fields);
+	param.max_rule_num = nb_rules;
+
+	ctx = rte_acl_create(&param);
+	if (ctx == NULL)
+		rte_exit(EXIT_FAILURE,
+			"Unable to create the l3fwd ACL %s on socket %d\n",
+			name, socketid);
+
+	ret = rte_acl_add_rules(ctx, rules, nb_rules);
+	if (ret < 0)
+		rte_exit(EXIT_FAILURE,
+			"Unable to add rules to the l3fwd ACL %s: %d\n",
+			name, ret);
+
+	memset(&cfg, 0, sizeof(cfg));
+	cfg.num_categories = L3FWD_ACL_NUM_CATEGORIES;
+	cfg.num_fields = nb_fields;
+	memcpy(cfg.defs, defs, nb_fields * sizeof(defs[0]));
+
+	ret = rte_acl_build(ctx, &cfg);
+	if (ret < 0)
+		rte_exit(EXIT_FAILURE,
+			"Unable to build the l3fwd ACL %s: %d\n", name, ret);
+
+	acl_select_alg(ctx, name);
+	return ctx;
+}
+
+void
+setup_acl(const int socketid)
+{
+	char s[64];
+
+	if (nb_acl4_rules != 0) {
+		snprintf(s, sizeof(s), "IPV4_L3FWD_ACL_%d", socketid);
+		ipv4_acl_ctx[socketid] = acl_build_ctx(s, socketid,
+			acl4_rules, nb_acl4_rules, ipv4_acl_defs,
+			RTE_DIM(ipv4_acl_defs));
+	}
+
+	if (nb_acl6_rules != 0) {
+		snprintf(s, sizeof(s), "IPV6_L3FWD_ACL_%d", socketid);
+		ipv6_acl_ctx[socketid] = acl_build_ctx(s, socketid,
+			acl6_rules, nb_acl6_rules, ipv6_acl_defs,
+			RTE_DIM(ipv6_acl_defs));
+	}
+}
+
+/* Warm restart: the contexts setup_acl() of the primary built. */
+void
+attach_acl(const int socketid)
+{
+	char s[64];
+
+	if (nb_acl4_rules != 0) {
+		snprintf(s, sizeof(s), "IPV4_L3FWD_ACL_%d", socketid);
+		ipv4_acl_ctx[socketid] = rte_acl_find_existing(s);
+		if (ipv4_acl_ctx[socketid] == NULL)
+			rte_exit(EXIT_FAILURE, "Unable to find ACL %s\n", s);
+	}
+
+	if (nb_acl6_rules != 0) {
+		snprintf(s, sizeof(s), "IPV6_L3FWD_ACL_%d", socketid);
+		ipv6_acl_ctx[socketid] = rte_acl_find_existing(s);
+		if (ipv6_acl_ctx[socketid] == NULL)
+			rte_exit(EXIT_FAILURE, "Unable to find ACL %s\n", s);
+	}
+}
+
+void *
+acl_get_ipv4_ctx(const int socketid)
+{
+	return ipv4_acl_ctx[socketid];
+}
+
+void *
+acl_get_ipv6_ctx(const int socketid)
+{
+	return ipv6_acl_ctx[socketid];
+}
+
+/*
+ * Classify a burst with at most one call per address family, drop the
+ * denied packets in one go and compact the permitted ones in place.
+ * Returns the number of packets left in pkts.
+ */
+uint16_t
+l3fwd_acl_filter(const struct lcore_conf *qconf, struct rte_mbuf **pkts,
+		uint16_t nb_rx)
+{
+	const uint8_t *data4[MAX_PKT_BURST], *data6[MAX_PKT_BURST];
+	uint32_t res4[MAX_PKT_BURST], res6[MAX_PKT_BURST];
+	uint8_t type[MAX_PKT_BURST];
+	struct rte_mbuf *drop[MAX_PKT_BURST];
+	struct acl_lcore_stats *st = &acl_stats[rte_lcore_id()];
+	uint32_t n4 = 0, n6 = 0, j4 = 0, j6 = 0, res;
+	uint16_t i, nb_fwd = 0, nb_drop = 0;
+	uint64_t start;
+
+	start = rte_rdtsc();
+
+	for (i = 0; i < nb_rx; i++) {
+		struct rte_mbuf *m = pkts[i];
+
+		type[i] = 0;
+		if (RTE_ETH_IS_IPV4_HDR(m->packet_type)) {
+			if (qconf->acl4_ctx == NULL)
+				continue;
+			data4[n4++] = rte_pktmbuf_mtod_offset(m,
+				const uint8_t *, sizeof(struct rte_ether_hdr) +
+				offsetof(struct rte_ipv4_hdr, next_proto_id));
+			type[i] = 4;
+		} else if (RTE_ETH_IS_IPV6_HDR(m->packet_type)) {
+			if (qconf->acl6_ctx == NULL)
+				continue;
+			data6[n6++] = rte_pktmbuf_mtod_offset(m,
+				const uint8_t *, sizeof(struct rte_ether_hdr) +
+				offsetof(struct rte_ipv6_hdr, proto));
+			type[i] = 6;
+		}
+	}
+
+	if (n4 != 0)
+		rte_acl_classify(qconf->acl4_ctx, data4, res4, n4,
+			L3FWD_ACL_NUM_CATEGORIES);
+	if (n6 != 0)
+		rte_acl_classify(qconf->acl6_ctx, data6, res6, n6,
+			L3FWD_ACL_NUM_CATEGORIES);
+
+	for (i = 0; i < nb_rx; i++) {
+		if (type[i] == 4)
+			res = res4[j4++];
+		else if (type[i] == 6)
+			res = res6[j6++];
+		else
+			res = 0;
+
+		if (res != 0) {
+			st->hits[res - 1]++;
+			if (acl_rule_info[res - 1].deny) {
+				drop[nb_drop++] = pkts[i];
+				continue;
+			}
+		}
+		pkts[nb_fwd++] = pkts[i];
+	}
+
+	if (nb_drop != 0)
+		l3fwd_drop_bulk(qconf, drop, nb_drop);
+
+	st->pkts += nb_rx;
+	st->cycles += rte_rdtsc() - start;
+
+	return nb_fwd;
+}
+
+/* Print per-rule hit counters and the cost of the ACL stage. */
+void
+l3fwd_acl_print_stats(void)
+{
+	uint64_t hits, pkts = 0, cycles = 0;
+	unsigned int lcore_id, i;
+
+	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+		pkts += acl_stats[lcore_id].pkts;
+		cycles += acl_stats[lcore_id].cycles;
+	}
+
+	printf("\nACL stats: %" PRIu64 " packets, %.1f cycles/packet\n",
+		pkts, pkts != 0 ? (double)cycles / pkts : 0.0);
+
+	for (i = 0; i < nb_acl_rules; i++) {
+		hits = 0;
+		for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++)
+			hits += acl_stats[lcore_id].hits[i];
+		printf("  rule %u (line %u, %s): %" PRIu64 " hits\n",
+			i, acl_rule_info[i].line,
+			acl_rule_info[i].deny ? "deny" : "permit", hits);
+	}
+}
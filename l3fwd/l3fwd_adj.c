@@ -0,0 +1,312 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <rte_common.h>
+#include <rte_ether.h>
+#include <rte_ethdev.h>
+#include <rte_string_fns.h>
+
+#include <cmdline_parse.h>
+#include <cmdline_parse_etheraddr.h>
+
+#include "l3fwd.h"
+#include "l3fwd_route.h"
+
+struct l3fwd_adj l3fwd_adj_tbl[L3FWD_MAX_ADJ] __rte_cache_aligned;
+struct l3fwd_ecmp_group l3fwd_ecmp_tbl[L3FWD_MAX_ECMP_GROUPS]
+	__rte_cache_aligned;
+
+/* Returned for BAD_PORT, so callers keep dropping the packet. */
+const struct l3fwd_adj l3fwd_adj_drop = {
+	.port = BAD_PORT,
+};
+
+struct ipv4_l3fwd_nh_route ipv4_l3fwd_nh_route_array[L3FWD_MAX_NH_ROUTES];
+unsigned int ipv4_l3fwd_nh_route_num;
+struct ipv6_l3fwd_nh_route ipv6_l3fwd_nh_route_array[L3FWD_MAX_NH_ROUTES];
+unsigned int ipv6_l3fwd_nh_route_num;
+
+/* Next hops as given on the command line with --nh. */
+static struct {
+	struct rte_ether_addr dst;
+	uint16_t port;
+	uint8_t valid;
+} nh_cfg[L3FWD_MAX_NH];
+
+static int nb_ecmp_groups;
+
+static int
+parse_uint(const char *str, unsigned long max, unsigned long *val)
+{
+	char *end;
+
+	errno = 0;
+	*val = strtoul(str, &end, 10);
+	if (errno != 0 || end == str || *end != '\0' || *val > max)
+		return -1;
+
+	return 0;
+}
+
+/* --nh=N,PORT,MM:MM:MM:MM:MM:MM */
+int
+l3fwd_adj_parse_nh(const char *arg)
+{
+	enum fieldnames {
+		FLD_NH = 0,
+		FLD_PORT,
+		FLD_MAC,
+		_NUM_FLD
+	};
+	char *str_fld[_NUM_FLD];
+	unsigned long nh, port;
+	char s[64];
+
+	if (strlcpy(s, arg, sizeof(s)) >= sizeof(s))
+		return -1;
+	if (rte_strsplit(s, sizeof(s), str_fld, _NUM_FLD, ',') != _NUM_FLD)
+		return -1;
+
+	if (parse_uint(str_fld[FLD_NH], L3FWD_MAX_NH - 1, &nh) < 0 ||
+			parse_uint(str_fld[FLD_PORT], RTE_MAX_ETHPORTS - 1,
+				&port) < 0)
+		return -1;
+
+	if (cmdline_parse_etheraddr(NULL, str_fld[FLD_MAC], &nh_cfg[nh].dst,
+			sizeof(nh_cfg[nh].dst)) < 0)
+		return -1;
+
+	nh_cfg[nh].port = port;
+	nh_cfg[nh].valid = 1;
+	return 0;
+}
+
+/* --ecmp=G,N[,N...] */
+int
+l3fwd_adj_parse_ecmp(const char *arg)
+{
+	char *str_fld[L3FWD_MAX_ECMP_MEMBERS + 1];
+	struct l3fwd_ecmp_group *grp;
+	unsigned long gid, nh;
+	char s[256];
+	int i, n;
+
+	if (strlcpy(s, arg, sizeof(s)) >= sizeof(s))
+		return -1;
+	n = rte_strsplit(s, sizeof(s), str_fld, RTE_DIM(str_fld), ',');
+	if (n < 2)
+		return -1;
+
+	if (parse_uint(str_fld[0], L3FWD_MAX_ECMP_GROUPS - 1, &gid) < 0)
+		return -1;
+
+	grp = &l3fwd_ecmp_tbl[gid];
+	if (grp->nb_members != 0) {
+		printf("ECMP group %lu is defined twice\n", gid);
+		return -1;
+	}
+
+	for (i = 1; i < n; i++) {
+		if (parse_uint(str_fld[i], L3FWD_MAX_NH - 1, &nh) < 0)
+			return -1;
+		grp->members[i - 1] = L3FWD_ADJ_NH_BASE + nh;
+	}
+	grp->nb_members = n - 1;
+	nb_ecmp_groups++;
+
+	return 0;
+}
+
+/* Route target: PORT, nhN or ecmpG. */
+static int
+parse_route_target(const char *str, uint16_t *nh)
+{
+	unsigned long val;
+
+	if (strncmp(str, "nh", 2) == 0) {
+		if (parse_uint(str + 2, L3FWD_MAX_NH - 1, &val) < 0)
+			return -1;
+		*nh = L3FWD_ADJ_NH_BASE + val;
+	} else if (strncmp(str, "ecmp", 4) == 0) {
+		if (parse_uint(str + 4, L3FWD_MAX_ECMP_GROUPS - 1, &val) < 0)
+			return -1;
+		*nh = L3FWD_ADJ_ECMP_FLAG | val;
+	} else {
+		if (parse_uint(str, RTE_MAX_ETHPORTS - 1, &val) < 0)
+			return -1;
+		*nh = val;
+	}
+
+	return 0;
+}
+
+/* --route=PREFIX/DEPTH,TARGET for both IPv4 and IPv6 prefixes. */
+int
+l3fwd_adj_parse_route(const char *arg)
+{
+	enum fieldnames {
+		FLD_PREFIX = 0,
+		FLD_TARGET,
+		_NUM_FLD
+	};
+	char *str_fld[_NUM_FLD];
+	unsigned long depth;
+	uint8_t ip6[16];
+	uint32_t ip4;
+	uint16_t nh;
+	char *slash;
+	char s[128];
+
+	if (strlcpy(s, arg, sizeof(s)) >= sizeof(s))
+		return -1;
+	if (rte_strsplit(s, sizeof(s), str_fld, _NUM_FLD, ',') != _NUM_FLD)
+		return -1;
+
+	slash = strchr(str_fld[FLD_PREFIX], '/');
+	if (slash == NULL)
+		return -1;
+	*slash++ = '\0';
+
+	if (parse_route_target(str_fld[FLD_TARGET], &nh) < 0)
+		return -1;
+
+	if (inet_pton(AF_INET, str_fld[FLD_PREFIX], &ip4) == 1) {
+		struct ipv4_l3fwd_nh_route *r;
+
+		if (parse_uint(slash, 32, &depth) < 0 || depth == 0)
+			return -1;
+		if (ipv4_l3fwd_nh_route_num >= L3FWD_MAX_NH_ROUTES)
+			return -1;
+		r = &ipv4_l3fwd_nh_route_array[ipv4_l3fwd_nh_route_num++];
+		r->ip = rte_be_to_cpu_32(ip4);
+		r->depth = depth;
+		r->nh = nh;
+	} else if (inet_pton(AF_INET6, str_fld[FLD_PREFIX], ip6) == 1) {
+		struct ipv6_l3fwd_nh_route *r;
+
+		if (parse_uint(slash, 128, &depth) < 0 || depth == 0)
+			return -1;
+		if (ipv6_l3fwd_nh_route_num >= L3FWD_MAX_NH_ROUTES)
+			return -1;
+		r = &ipv6_l3fwd_nh_route_array[ipv6_l3fwd_nh_route_num++];
+		memcpy(r->ip, ip6, sizeof(r->ip));
+		r->depth = depth;
+		r->nh = nh;
+	} else
+		return -1;
+
+	return 0;
+}
+
+/*
+ * Return 1 if an adjacency id can be installed as a route next hop:
+ * it must be defined and all egress ports behind it must be enabled.
+ */
+int
+l3fwd_adj_nh_usable(uint16_t nh)
+{
+	const struct l3fwd_ecmp_group *grp;
+	uint16_t i, n;
+
+	if (nh & L3FWD_ADJ_ECMP_FLAG) {
+		if ((nh & L3FWD_ADJ_ECMP_MASK) >= L3FWD_MAX_ECMP_GROUPS)
+			return 0;
+		grp = &l3fwd_ecmp_tbl[nh & L3FWD_ADJ_ECMP_MASK];
+		if (grp->nb_members == 0)
+			return 0;
+		for (i = 0; i < grp->nb_members; i++)
+			if (!l3fwd_adj_nh_usable(grp->members[i]))
+				return 0;
+		return 1;
+	}
+
+	if (nh < L3FWD_ADJ_NH_BASE)
+		return (enabled_port_mask & 1 << nh) != 0;
+
+	n = nh - L3FWD_ADJ_NH_BASE;
+	if (n >= L3FWD_MAX_NH || !nh_cfg[n].valid)
+		return 0;
+
+	return (enabled_port_mask & 1 << nh_cfg[n].port) != 0;
+}
+
+int
+l3fwd_adj_has_ecmp(void)
+{
+	return nb_ecmp_groups != 0;
+}
+
+static void
+print_adj(const char *name, unsigned int id, const struct l3fwd_adj *adj)
+{
+	char buf[RTE_ETHER_ADDR_FMT_SIZE];
+
+	rte_ether_format_addr(buf, sizeof(buf),
+			(const struct rte_ether_addr *)&adj->val_eth);
+	printf("%s %u: port %u dst %s\n", name, id, adj->port, buf);
+}
+
+/*
+ * Build the adjacency table. Must run after the ports are initialised,
+ * since the source MAC of every adjacency is the MAC of its egress port.
+ */
+void
+l3fwd_adj_setup(void)
+{
+	struct l3fwd_adj *adj;
+	uint16_t portid;
+	unsigned int i, j;
+
+	/* Per-port adjacencies mirror val_eth[]. */
+	for (portid = 0; portid < RTE_MAX_ETHPORTS; portid++) {
+		adj = &l3fwd_adj_tbl[portid];
+		adj->val_eth = val_eth[portid];
+		adj->port = portid;
+	}
+
+	for (i = 0; i < L3FWD_MAX_NH; i++) {
+		adj = &l3fwd_adj_tbl[L3FWD_ADJ_NH_BASE + i];
+		if (!nh_cfg[i].valid) {
+			/* Unused ids fall back to port 0, like a failed lookup. */
+			*adj = l3fwd_adj_tbl[0];
+			continue;
+		}
+
+		portid = nh_cfg[i].port;
+		rte_ether_addr_copy(&nh_cfg[i].dst,
+			(struct rte_ether_addr *)&adj->val_eth);
+		rte_ether_addr_copy(&ports_eth_addr[portid],
+			(struct rte_ether_addr *)&adj->val_eth + 1);
+		adj->port = portid;
+		print_adj("Next hop", i, adj);
+	}
+
+	for (i = 0; i < L3FWD_MAX_ECMP_GROUPS; i++) {
+		const struct l3fwd_ecmp_group *grp = &l3fwd_ecmp_tbl[i];
+
+		if (grp->nb_members == 0)
+			continue;
+
+		printf("ECMP group %u:", i);
+		for (j = 0; j < grp->nb_members; j++) {
+			if (!nh_cfg[grp->members[j] -
+					L3FWD_ADJ_NH_BASE].valid)
+				rte_exit(EXIT_FAILURE,
+					"ECMP group %u uses undefined next hop %u\n",
+					i, grp->members[j] -
+					L3FWD_ADJ_NH_BASE);
+			printf(" nh%u", grp->members[j] - L3FWD_ADJ_NH_BASE);
+		}
+		printf("\n");
+	}
+}
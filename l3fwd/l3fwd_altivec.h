@@ -17,6 +17,7 @@
 static inline void
 processx4_step3(struct rte_mbuf *pkt[FWDSTEP], uint16_t dst_port[FWDSTEP])
 {
+	const struct l3fwd_adj *adj[FWDSTEP];
 	vector unsigned int te[FWDSTEP];
 	vector unsigned int ve[FWDSTEP];
 	vector unsigned int *p[FWDSTEP];
@@ -26,16 +27,27 @@ processx4_step3(struct rte_mbuf *pkt[FWDSTEP], uint16_t dst_port[FWDSTEP])
 	p[2] = rte_pktmbuf_mtod(pkt[2], vector unsigned int *);
 	p[3] = rte_pktmbuf_mtod(pkt[3], vector unsigned int *);
 
-	ve[0] = (vector unsigned int)val_eth[dst_port[0]];
+	/* Resolve next hops to adjacencies and their egress ports. */
+	adj[0] = l3fwd_adj_get_enabled(dst_port[0], pkt[0]);
+	adj[1] = l3fwd_adj_get_enabled(dst_port[1], pkt[1]);
+	adj[2] = l3fwd_adj_get_enabled(dst_port[2], pkt[2]);
+	adj[3] = l3fwd_adj_get_enabled(dst_port[3], pkt[3]);
+
+	dst_port[0] = adj[0]->port;
+	dst_port[1] = adj[1]->port;
+	dst_port[2] = adj[2]->port;
+	dst_port[3] = adj[3]->port;
+
+	ve[0] = (vector unsigned int)adj[0]->val_eth;
 	te[0] = *p[0];
 
-	ve[1] = (vector unsigned int)val_eth[dst_port[1]];
+	ve[1] = (vector unsigned int)adj[1]->val_eth;
 	te[1] = *p[1];
 
-	ve[2] = (vector unsigned int)val_eth[dst_port[2]];
+	ve[2] = (vector unsigned int)adj[2]->val_eth;
 	te[2] = *p[2];
 
-	ve[3] = (vector unsigned int)val_eth[dst_port[3]];
+	ve[3] = (vector unsigned int)adj[3]->val_eth;
 	te[3] = *p[3];
 
 	/* Update first 12 bytes, keep rest bytes intact. */
@@ -125,13 +137,17 @@ port_groupx4(uint16_t pn[FWDSTEP + 1], uint16_t *lp, vector unsigned short dp1,
 static inline void
 process_packet(struct rte_mbuf *pkt, uint16_t *dst_port)
 {
+	const struct l3fwd_adj *adj;
 	struct rte_ether_hdr *eth_hdr;
 	vector unsigned int te, ve;
 
 	eth_hdr = rte_pktmbuf_mtod(pkt, struct rte_ether_hdr *);
 
+	adj = l3fwd_adj_get_enabled(dst_port[0], pkt);
+	dst_port[0] = adj->port;
+
 	te = *(vector unsigned int *)eth_hdr;
-	ve = (vector unsigned int)val_eth[dst_port[0]];
+	ve = (vector unsigned int)adj->val_eth;
 
 	rfc1812_process((struct rte_ipv4_hdr *)(eth_hdr + 1), dst_port,
 			pkt->packet_type);
@@ -237,11 +253,10 @@ send_packets_multi(struct lcore_conf *qconf, struct rte_mbuf **pkts_burst,
 	 * Consecutive packets with the same destination port
 	 * are already grouped together.
 	 * If destination port for the packet equals BAD_PORT,
-	 * then free the packet without sending it out.
+	 * then drop the packet without sending it out.
 	 */
 	for (j = 0; j < nb_rx; j += k) {
 
-		int32_t m;
 		uint16_t pn;
 
 		pn = dst_port[j];
@@ -249,9 +264,10 @@ send_packets_multi(struct lcore_conf *qconf, struct rte_mbuf **pkts_burst,
 
 		if (likely(pn != BAD_PORT))
 			send_packetsx4(qconf, pn, pkts_burst + j, k);
-		else
-			for (m = j; m != j + k; m++)
-				rte_pktmbuf_free(pkts_burst[m]);
+		else {
+			qconf->stats->bad_port_drops += k;
+			l3fwd_drop_bulk(qconf, pkts_burst + j, k);
+		}
 
 	}
 }
@@ -0,0 +1,566 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+/*
+ * Offline lookup benchmark (--bench=DIST[,FLOWS[,SECONDS]]).
+ *
+ * The lcores of --config do not poll their rx queues. Each replays a
+ * ring of synthetic IPv4 packets through the burst path of the selected
+ * lookup method (and the ACL stage, if rules are loaded), with tx
+ * stubbed out, and stops after SECONDS. The destinations come from the
+ * routes or keys the lookup setup installed, so every packet hits.
+ *
+ * DIST selects the flow of each packet among FLOWS:
+ *   seq        0, 1, ..., FLOWS - 1, 0, ...
+ *   uniform    uniformly random
+ *   zipf[:S]   zipf with exponent S (default 0.99), flow 0 the hottest
+ *
+ * Only process_burst() is timed; the header rewrite that stands in for
+ * rx is not. On Linux the L1D and LLC accesses and misses of the timed
+ * part are counted with perf events, when the kernel allows it: the
+ * counters are enabled around process_burst() only. The rewrite still
+ * pre-warms the header lines that process_burst() reads, so the misses
+ * counted are mostly those of the lookup tables.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#ifdef RTE_EXEC_ENV_LINUX
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_random.h>
+#include <rte_string_fns.h>
+#include <rte_tcp.h>
+#include <rte_udp.h>
+
+#include "l3fwd.h"
+
+#define BENCH_DEF_FLOWS		1024
+#define BENCH_MAX_FLOWS		(1 << 24)
+#define BENCH_DEF_SECONDS	10
+#define BENCH_DEF_ZIPF_S	0.99
+#define BENCH_SEQ_SZ		(1 << 16)	/* flow index sequence, pow2 */
+#define BENCH_RING_SZ		(8 * MAX_PKT_BURST)
+#define BENCH_PKT_LEN		60
+
+enum bench_dist {
+	BENCH_SEQ,
+	BENCH_UNIFORM,
+	BENCH_ZIPF,
+};
+
+enum bench_perf {
+	BENCH_L1D_ACCESS,
+	BENCH_L1D_MISS,
+	BENCH_LLC_ACCESS,
+	BENCH_LLC_MISS,
+	BENCH_PERF_NUM,
+};
+
+static const char * const bench_perf_name[BENCH_PERF_NUM] = {
+	[BENCH_L1D_ACCESS] = "L1D loads",
+	[BENCH_L1D_MISS] = "L1D misses",
+	[BENCH_LLC_ACCESS] = "LLC refs",
+	[BENCH_LLC_MISS] = "LLC misses",
+};
+
+struct bench_lcore {
+	struct rte_mbuf *m[BENCH_RING_SZ];
+	uint32_t *seq;		/**< flow of each packet, BENCH_SEQ_SZ */
+	uint16_t portid;	/**< rx port the packets claim to come from */
+	uint8_t active;
+	uint8_t perf_ok;
+	uint64_t pkts;
+	uint64_t cycles;	/**< in process_burst() */
+	uint64_t elapsed;	/**< whole loop */
+	uint64_t perf[BENCH_PERF_NUM];
+} __rte_cache_aligned;
+
+static struct bench_lcore bench_lcore[RTE_MAX_LCORE];
+
+static enum bench_dist bench_dist = BENCH_UNIFORM;
+static double bench_zipf_s = BENCH_DEF_ZIPF_S;
+static uint32_t bench_nb_flows = BENCH_DEF_FLOWS;
+static uint32_t bench_seconds = BENCH_DEF_SECONDS;
+
+static struct l3fwd_bench_flow *bench_flows;
+static l3fwd_process_burst_t bench_process_burst;
+
+static const char * const bench_dist_name[] = {
+	[BENCH_SEQ] = "seq",
+	[BENCH_UNIFORM] = "uniform",
+	[BENCH_ZIPF] = "zipf",
+};
+
+static int
+bench_parse_u32(const char *s, uint32_t min, uint32_t max, uint32_t *val)
+{
+	unsigned long v;
+	char *end;
+
+	errno = 0;
+	v = strtoul(s, &end, 10);
+	if (errno != 0 || end == s || *end != '\0' || v < min || v > max)
+		return -1;
+
+	*val = v;
+	return 0;
+}
+
+/* --bench=DIST[,FLOWS[,SECONDS]] */
+int
+l3fwd_bench_parse(const char *arg)
+{
+	char *str_fld[3];
+	char s[64];
+	char *end;
+	int n;
+
+	if (strlcpy(s, arg, sizeof(s)) >= sizeof(s))
+		return -1;
+	n = rte_strsplit(s, sizeof(s), str_fld, RTE_DIM(str_fld), ',');
+	if (n <= 0)
+		return -1;
+
+	if (!strcmp(str_fld[0], "seq"))
+		bench_dist = BENCH_SEQ;
+	else if (!strcmp(str_fld[0], "uniform"))
+		bench_dist = BENCH_UNIFORM;
+	else if (!strncmp(str_fld[0], "zipf", 4)) {
+		bench_dist = BENCH_ZIPF;
+		if (str_fld[0][4] == ':') {
+			errno = 0;
+			bench_zipf_s = strtod(str_fld[0] + 5, &end);
+			if (errno != 0 || end == str_fld[0] + 5 ||
+					*end != '\0' || bench_zipf_s <= 0)
+				return -1;
+		} else if (str_fld[0][4] != '\0')
+			return -1;
+	} else
+		return -1;
+
+	if (n > 1 && bench_parse_u32(str_fld[1], 1, BENCH_MAX_FLOWS,
+			&bench_nb_flows) < 0)
+		return -1;
+	if (n > 2 && bench_parse_u32(str_fld[2], 1, UINT32_MAX / 2,
+			&bench_seconds) < 0)
+		return -1;
+
+	return 0;
+}
+
+/* Flow index sequence of one lcore. */
+static void
+bench_seq_fill(uint32_t *seq, const double *cdf)
+{
+	uint32_t i, lo, hi, mid;
+	double u;
+
+	for (i = 0; i < BENCH_SEQ_SZ; i++) {
+		switch (bench_dist) {
+		case BENCH_SEQ:
+			seq[i] = i % bench_nb_flows;
+			break;
+		case BENCH_UNIFORM:
+			seq[i] = rte_rand_max(bench_nb_flows);
+			break;
+		case BENCH_ZIPF:
+			/* first flow whose cdf reaches u */
+			u = (double)(rte_rand() >> 11) / (1ULL << 53);
+			lo = 0;
+			hi = bench_nb_flows - 1;
+			while (lo < hi) {
+				mid = lo + (hi - lo) / 2;
+				if (cdf[mid] < u)
+					lo = mid + 1;
+				else
+					hi = mid;
+			}
+			seq[i] = lo;
+			break;
+		}
+	}
+}
+
+static double *
+bench_zipf_cdf(void)
+{
+	double *cdf, sum = 0;
+	uint32_t i;
+
+	cdf = malloc(sizeof(*cdf) * bench_nb_flows);
+	if (cdf == NULL)
+		rte_exit(EXIT_FAILURE, "bench: cannot allocate zipf table\n");
+
+	for (i = 0; i < bench_nb_flows; i++) {
+		sum += 1.0 / pow(i + 1, bench_zipf_s);
+		cdf[i] = sum;
+	}
+	for (i = 0; i < bench_nb_flows; i++)
+		cdf[i] /= sum;
+
+	return cdf;
+}
+
+/* Ether + IPv4 + UDP/TCP with everything the rewrite does not touch. */
+static void
+bench_pkt_init(struct rte_mbuf *m, uint16_t portid)
+{
+	struct rte_ether_hdr *eth_hdr;
+	struct rte_ipv4_hdr *ipv4_hdr;
+
+	eth_hdr = (struct rte_ether_hdr *)rte_pktmbuf_append(m,
+			BENCH_PKT_LEN);
+	memset(eth_hdr, 0, BENCH_PKT_LEN);
+	rte_ether_addr_copy(&ports_eth_addr[portid], &eth_hdr->d_addr);
+	eth_hdr->s_addr.addr_bytes[0] = 0x02;
+	eth_hdr->ether_type = rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+
+	ipv4_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
+	ipv4_hdr->version_ihl = RTE_IPV4_VHL_DEF;
+	ipv4_hdr->total_length = rte_cpu_to_be_16(BENCH_PKT_LEN -
+			sizeof(struct rte_ether_hdr));
+
+	m->port = portid;
+	m->l2_len = sizeof(struct rte_ether_hdr);
+	m->l3_len = sizeof(struct rte_ipv4_hdr);
+}
+
+/*
+ * Stand-in for rx: point the n packets at the next flows of the
+ * sequence. The lookup path rewrites the MACs and TTL, and may free a
+ * packet (ACL deny); the extra reference keeps it in the ring.
+ */
+static inline void
+bench_pkt_refresh(struct bench_lcore *bl, struct rte_mbuf **m, uint16_t n,
+		uint32_t *pos)
+{
+	const struct l3fwd_bench_flow *f;
+	struct rte_ipv4_hdr *ipv4_hdr;
+	struct rte_udp_hdr *udp_hdr;
+	uint32_t flow;
+	uint16_t i;
+
+	for (i = 0; i < n; i++) {
+		flow = bl->seq[(*pos)++ & (BENCH_SEQ_SZ - 1)];
+		f = &bench_flows[flow];
+
+		ipv4_hdr = rte_pktmbuf_mtod_offset(m[i],
+				struct rte_ipv4_hdr *,
+				sizeof(struct rte_ether_hdr));
+		ipv4_hdr->time_to_live = 64;
+		ipv4_hdr->next_proto_id = f->proto;
+		ipv4_hdr->src_addr = rte_cpu_to_be_32(f->ip_src);
+		ipv4_hdr->dst_addr = rte_cpu_to_be_32(f->ip_dst);
+		ipv4_hdr->hdr_checksum = 0;
+		ipv4_hdr->hdr_checksum = rte_ipv4_cksum(ipv4_hdr);
+
+		/* ports sit at the same offset in UDP and TCP */
+		udp_hdr = (struct rte_udp_hdr *)(ipv4_hdr + 1);
+		udp_hdr->src_port = rte_cpu_to_be_16(f->port_src);
+		udp_hdr->dst_port = rte_cpu_to_be_16(f->port_dst);
+
+		m[i]->packet_type = RTE_PTYPE_L2_ETHER | RTE_PTYPE_L3_IPV4 |
+			(f->proto == IPPROTO_TCP ? RTE_PTYPE_L4_TCP :
+			 RTE_PTYPE_L4_UDP);
+		m[i]->hash.rss = flow * 2654435761u;
+		m[i]->ol_flags = PKT_RX_RSS_HASH;
+		rte_mbuf_refcnt_set(m[i], 2);
+	}
+}
+
+#ifdef RTE_EXEC_ENV_LINUX
+static int
+bench_perf_open(uint32_t type, uint64_t config)
+{
+	struct perf_event_attr attr;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = type;
+	attr.config = config;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+
+	/* this thread, any cpu */
+	return syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Open the counters, disabled until bench_perf_count(). */
+static void
+bench_perf_start(int fd[BENCH_PERF_NUM])
+{
+	static const uint64_t l1d = PERF_COUNT_HW_CACHE_L1D |
+		PERF_COUNT_HW_CACHE_OP_READ << 8;
+
+	fd[BENCH_L1D_ACCESS] = bench_perf_open(PERF_TYPE_HW_CACHE,
+		l1d | PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16);
+	fd[BENCH_L1D_MISS] = bench_perf_open(PERF_TYPE_HW_CACHE,
+		l1d | PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+	fd[BENCH_LLC_ACCESS] = bench_perf_open(PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_CACHE_REFERENCES);
+	fd[BENCH_LLC_MISS] = bench_perf_open(PERF_TYPE_HARDWARE,
+		PERF_COUNT_HW_CACHE_MISSES);
+}
+
+/* Count from now on (on != 0) or pause, the counters keep their value. */
+static inline void
+bench_perf_count(const int fd[BENCH_PERF_NUM], int on)
+{
+	unsigned int i;
+
+	for (i = 0; i < BENCH_PERF_NUM; i++)
+		if (fd[i] >= 0)
+			ioctl(fd[i], on ? PERF_EVENT_IOC_ENABLE :
+				PERF_EVENT_IOC_DISABLE, 0);
+}
+
+static void
+bench_perf_stop(int fd[BENCH_PERF_NUM], struct bench_lcore *bl)
+{
+	unsigned int i;
+	uint64_t v;
+
+	bl->perf_ok = 1;
+	for (i = 0; i < BENCH_PERF_NUM; i++) {
+		if (fd[i] < 0 || read(fd[i], &v, sizeof(v)) != sizeof(v)) {
+			bl->perf_ok = 0;
+		} else
+			bl->perf[i] = v;
+		if (fd[i] >= 0)
+			close(fd[i]);
+	}
+}
+#else
+static void
+bench_perf_start(int fd[BENCH_PERF_NUM])
+{
+	unsigned int i;
+
+	for (i = 0; i < BENCH_PERF_NUM; i++)
+		fd[i] = -1;
+}
+
+static inline void
+bench_perf_count(const int fd[BENCH_PERF_NUM] __rte_unused,
+		int on __rte_unused)
+{
+}
+
+static void
+bench_perf_stop(int fd[BENCH_PERF_NUM] __rte_unused, struct bench_lcore *bl)
+{
+	bl->perf_ok = 0;
+}
+#endif
+
+/*
+ * Build the flows and the per-lcore packet rings. Called after the
+ * ports and lookup tables are set up.
+ */
+void
+l3fwd_bench_setup(l3fwd_process_burst_t process_burst,
+		l3fwd_bench_flow_t bench_flow, int numa_on)
+{
+	struct rte_mempool *pool[NB_SOCKETS] = { NULL };
+	struct lcore_conf *qconf;
+	struct bench_lcore *bl;
+	unsigned int lcore_id, nb_lcores = 0;
+	double *cdf = NULL;
+	uint32_t i;
+	int socketid;
+	char s[64];
+
+	bench_process_burst = process_burst;
+
+	bench_flows = rte_malloc("bench_flows",
+			sizeof(*bench_flows) * bench_nb_flows, 0);
+	if (bench_flows == NULL)
+		rte_exit(EXIT_FAILURE, "bench: cannot allocate flows\n");
+	for (i = 0; i < bench_nb_flows; i++)
+		bench_flow(i, &bench_flows[i]);
+
+	if (bench_dist == BENCH_ZIPF)
+		cdf = bench_zipf_cdf();
+
+	RTE_LCORE_FOREACH(lcore_id) {
+		qconf = &lcore_conf[lcore_id];
+		if (qconf->n_rx_queue == 0)
+			continue;
+
+		bl = &bench_lcore[lcore_id];
+		bl->portid = qconf->rx_queue_list[0].port_id;
+		socketid = numa_on ? (int)rte_lcore_to_socket_id(lcore_id) : 0;
+
+		if (pool[socketid] == NULL) {
+			snprintf(s, sizeof(s), "bench_pool_%d", socketid);
+			pool[socketid] = rte_pktmbuf_pool_create(s,
+				rte_lcore_count() * BENCH_RING_SZ, 0, 0,
+				RTE_MBUF_DEFAULT_BUF_SIZE, socketid);
+			if (pool[socketid] == NULL)
+				rte_exit(EXIT_FAILURE,
+					"bench: cannot create pool %s\n", s);
+		}
+		for (i = 0; i < BENCH_RING_SZ; i++) {
+			bl->m[i] = rte_pktmbuf_alloc(pool[socketid]);
+			if (bl->m[i] == NULL)
+				rte_exit(EXIT_FAILURE,
+					"bench: cannot allocate mbuf\n");
+			bench_pkt_init(bl->m[i], bl->portid);
+		}
+
+		bl->seq = rte_malloc_socket("bench_seq",
+			sizeof(*bl->seq) * BENCH_SEQ_SZ, 0, socketid);
+		if (bl->seq == NULL)
+			rte_exit(EXIT_FAILURE, "bench: cannot allocate seq\n");
+		bench_seq_fill(bl->seq, cdf);
+
+		qconf->tx_stub = 1;
+		bl->active = 1;
+		nb_lcores++;
+	}
+	free(cdf);
+
+	if (nb_lcores == 0)
+		rte_exit(EXIT_FAILURE, "bench: no lcore in --config\n");
+
+	printf("bench: %u lcores, %u flows, %s", nb_lcores, bench_nb_flows,
+		bench_dist_name[bench_dist]);
+	if (bench_dist == BENCH_ZIPF)
+		printf(" s=%.2f", bench_zipf_s);
+	printf(", %u s\n", bench_seconds);
+}
+
+int
+bench_main_loop(__rte_unused void *dummy)
+{
+	const uint64_t drain_tsc = (rte_get_tsc_hz() + US_PER_S - 1) /
+		US_PER_S * BURST_TX_DRAIN_US;
+	struct lcore_conf *qconf;
+	struct bench_lcore *bl;
+	struct rte_mbuf **pkts;
+	uint64_t start_tsc, end_tsc, prev_tsc, loop_tsc, t0, t1;
+	int perf_fd[BENCH_PERF_NUM];
+	unsigned int lcore_id;
+	uint32_t pos = 0, r = 0;
+	int acl_on, nb_rx;
+
+	lcore_id = rte_lcore_id();
+	qconf = &lcore_conf[lcore_id];
+	bl = &bench_lcore[lcore_id];
+
+	if (!bl->active) {
+		RTE_LOG(INFO, L3FWD, "lcore %u has nothing to do\n", lcore_id);
+		return 0;
+	}
+
+	RTE_LOG(INFO, L3FWD, "entering bench loop on lcore %u\n", lcore_id);
+
+	acl_on = qconf->acl4_ctx != NULL || qconf->acl6_ctx != NULL;
+
+	bench_perf_start(perf_fd);
+	start_tsc = rte_rdtsc();
+	end_tsc = start_tsc + rte_get_tsc_hz() * bench_seconds;
+	prev_tsc = loop_tsc = start_tsc;
+
+	while (!force_quit && loop_tsc < end_tsc) {
+
+		pkts = &bl->m[r];
+		r = (r + MAX_PKT_BURST) % BENCH_RING_SZ;
+		bench_pkt_refresh(bl, pkts, MAX_PKT_BURST, &pos);
+
+		bench_perf_count(perf_fd, 1);
+		t0 = rte_rdtsc();
+		nb_rx = MAX_PKT_BURST;
+		if (acl_on)
+			nb_rx = l3fwd_acl_filter(qconf, pkts, nb_rx);
+		if (nb_rx != 0)
+			bench_process_burst(nb_rx, pkts, bl->portid, qconf);
+		t1 = rte_rdtsc();
+		bench_perf_count(perf_fd, 0);
+
+		bl->cycles += t1 - t0;
+		bl->pkts += MAX_PKT_BURST;
+		l3fwd_stats_rx(qconf->stats, MAX_PKT_BURST);
+		l3fwd_stats_loop(qconf->stats, t1, &loop_tsc, 1);
+
+		if (unlikely(t1 - prev_tsc > drain_tsc)) {
+			l3fwd_tx_drain(qconf);
+			prev_tsc = t1;
+		}
+	}
+
+	l3fwd_tx_drain(qconf);
+	bl->elapsed = rte_rdtsc() - start_tsc;
+	bench_perf_stop(perf_fd, bl);
+
+	return 0;
+}
+
+static void
+bench_print_perf(const struct bench_lcore *bl)
+{
+	unsigned int i;
+
+	for (i = 0; i < BENCH_PERF_NUM; i++) {
+		if (bl->perf_ok)
+			printf(" %s/pkt %.2f", bench_perf_name[i],
+				(double)bl->perf[i] / bl->pkts);
+		else
+			printf(" %s/pkt n/a", bench_perf_name[i]);
+	}
+}
+
+void
+l3fwd_bench_print_stats(void)
+{
+	const double hz = rte_get_tsc_hz();
+	const struct bench_lcore *bl;
+	uint64_t pkts = 0, cycles = 0;
+	double mpps = 0, lcore_mpps;
+	unsigned int lcore_id;
+
+	printf("\nBench (%s, %u flows):\n", bench_dist_name[bench_dist],
+		bench_nb_flows);
+	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+		bl = &bench_lcore[lcore_id];
+		if (!bl->active || bl->pkts == 0)
+			continue;
+
+		/* rate of the lookup path alone, not of the replay loop */
+		lcore_mpps = bl->pkts * hz / bl->cycles / 1e6;
+		printf("  lcore %u: pkts %"PRIu64" cycles/pkt %.1f "
+			"Mpps %.2f (loop %.2f)", lcore_id, bl->pkts,
+			(double)bl->cycles / bl->pkts, lcore_mpps,
+			bl->pkts * hz / bl->elapsed / 1e6);
+		bench_print_perf(bl);
+		printf("\n");
+
+		pkts += bl->pkts;
+		cycles += bl->cycles;
+		mpps += lcore_mpps;
+	}
+
+	if (pkts != 0)
+		printf("  total: pkts %"PRIu64" cycles/pkt %.1f Mpps %.2f\n",
+			pkts, (double)cycles / pkts, mpps);
+}
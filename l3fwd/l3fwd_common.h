@@ -181,21 +181,18 @@ static __rte_always_inline void
 send_packetsx4(struct lcore_conf *qconf, uint16_t port, struct rte_mbuf *m[],
 		uint32_t num)
 {
+	uint8_t idx = qconf->tx_port_idx[port];
+	struct l3fwd_tx_port *txp = &qconf->tx_port[idx];
 	uint32_t len, j, n;
 
-	len = qconf->tx_mbufs[port].len;
+	len = txp->len;
 
 	/*
 	 * If TX buffer for that queue is empty, and we have enough packets,
 	 * then send them straightway.
 	 */
 	if (num >= MAX_TX_BURST && len == 0) {
-		n = rte_eth_tx_burst(port, qconf->tx_queue_id[port], m, num);
-		if (unlikely(n < num)) {
-			do {
-				rte_pktmbuf_free(m[n]);
-			} while (++n < num);
-		}
+		l3fwd_tx_burst(qconf, port, m, num);
 		return;
 	}
 
@@ -210,19 +207,19 @@ send_packetsx4(struct lcore_conf *qconf, uint16_t port, struct rte_mbuf *m[],
 	switch (n % FWDSTEP) {
 	while (j < n) {
 	case 0:
-		qconf->tx_mbufs[port].m_table[len + j] = m[j];
+		txp->m_table[len + j] = m[j];
 		j++;
 		/* fallthrough */
 	case 3:
-		qconf->tx_mbufs[port].m_table[len + j] = m[j];
+		txp->m_table[len + j] = m[j];
 		j++;
 		/* fallthrough */
 	case 2:
-		qconf->tx_mbufs[port].m_table[len + j] = m[j];
+		txp->m_table[len + j] = m[j];
 		j++;
 		/* fallthrough */
 	case 1:
-		qconf->tx_mbufs[port].m_table[len + j] = m[j];
+		txp->m_table[len + j] = m[j];
 		j++;
 	}
 	}
@@ -240,25 +237,26 @@ send_packetsx4(struct lcore_conf *qconf, uint16_t port, struct rte_mbuf *m[],
 		switch (len % FWDSTEP) {
 		while (j < len) {
 		case 0:
-			qconf->tx_mbufs[port].m_table[j] = m[n + j];
+			txp->m_table[j] = m[n + j];
 			j++;
 			/* fallthrough */
 		case 3:
-			qconf->tx_mbufs[port].m_table[j] = m[n + j];
+			txp->m_table[j] = m[n + j];
 			j++;
 			/* fallthrough */
 		case 2:
-			qconf->tx_mbufs[port].m_table[j] = m[n + j];
+			txp->m_table[j] = m[n + j];
 			j++;
 			/* fallthrough */
 		case 1:
-			qconf->tx_mbufs[port].m_table[j] = m[n + j];
+			txp->m_table[j] = m[n + j];
 			j++;
 		}
 		}
 	}
 
-	qconf->tx_mbufs[port].len = len;
+	txp->len = len;
+	qconf->tx_pending |= (uint32_t)(len != 0) << idx;
 }
 
 #endif /* _L3FWD_COMMON_H_ */
@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+/*
+ * Setup and counters of the load-adaptive tx drain interval
+ * (--adaptive-drain); the per burst side is in l3fwd_drain.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_telemetry.h>
+
+#include "l3fwd.h"
+#include "l3fwd_drain.h"
+
+#define DRAIN_MAX_CAP_US	10000
+
+static uint32_t drain_cap_us;
+
+/* [CAP_US]: latency cap, the longest drain interval */
+int
+l3fwd_drain_parse(const char *arg)
+{
+	unsigned long n;
+	char *end;
+
+	drain_cap_us = BURST_TX_DRAIN_US;
+	if (arg == NULL)
+		return 0;
+
+	errno = 0;
+	n = strtoul(arg, &end, 10);
+	if (errno != 0 || *arg == '\0' || *end != '\0' || n == 0 ||
+			n > DRAIN_MAX_CAP_US)
+		return -1;
+
+	drain_cap_us = n;
+	return 0;
+}
+
+static uint64_t
+cycles_to_ns(uint64_t cycles)
+{
+	return (double)cycles * NS_PER_S / rte_get_tsc_hz();
+}
+
+static int
+handle_drain(const char *cmd __rte_unused, const char *params __rte_unused,
+		struct rte_tel_data *d)
+{
+	const struct l3fwd_lcore_stats *st;
+	struct rte_tel_data *ns, *burst;
+	unsigned int lcore_id;
+
+	ns = rte_tel_data_alloc();
+	burst = rte_tel_data_alloc();
+	if (ns == NULL || burst == NULL) {
+		rte_tel_data_free(ns);
+		rte_tel_data_free(burst);
+		return -ENOMEM;
+	}
+
+	/* effective values, one entry per lcore as in /l3fwd/lcores */
+	rte_tel_data_start_array(ns, RTE_TEL_U64_VAL);
+	rte_tel_data_start_array(burst, RTE_TEL_U64_VAL);
+	RTE_LCORE_FOREACH(lcore_id) {
+		st = &l3fwd_lcore_stats[lcore_id];
+		rte_tel_data_add_array_u64(ns, cycles_to_ns(st->drain_cycles));
+		/* in 1/100 packets, telemetry has no floating point values */
+		rte_tel_data_add_array_u64(burst, st->drain_avg_burst * 100 >>
+			L3FWD_DRAIN_AVG_SHIFT);
+	}
+
+	rte_tel_data_start_dict(d);
+	rte_tel_data_add_dict_u64(d, "cap_us", drain_cap_us);
+	rte_tel_data_add_dict_container(d, "drain_ns", ns, 0);
+	rte_tel_data_add_dict_container(d, "avg_burst_x100", burst, 0);
+
+	return 0;
+}
+
+/* Allocate the state of every lcore on its socket. */
+void
+l3fwd_drain_setup(int numa_on)
+{
+	struct l3fwd_drain *drain;
+	unsigned int lcore_id;
+	uint64_t cap_tsc;
+	int socketid;
+
+	if (drain_cap_us == 0)
+		return;
+
+	cap_tsc = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S * drain_cap_us;
+
+	RTE_LCORE_FOREACH(lcore_id) {
+		socketid = numa_on ? (int)rte_lcore_to_socket_id(lcore_id) : 0;
+		drain = rte_zmalloc_socket("drain", sizeof(*drain),
+			RTE_CACHE_LINE_SIZE, socketid);
+		if (drain == NULL)
+			rte_exit(EXIT_FAILURE,
+				"Cannot allocate the drain state of lcore %u\n",
+				lcore_id);
+		drain->cap_tsc = cap_tsc;
+		drain->min_tsc = RTE_MAX(cap_tsc / MAX_PKT_BURST, 1);
+		lcore_conf[lcore_id].drain = drain;
+		/* until the first tick, the loops start at the cap */
+		l3fwd_lcore_stats[lcore_id].drain_cycles = cap_tsc;
+	}
+
+	rte_telemetry_register_cmd("/l3fwd/drain", handle_drain,
+		"Returns the effective tx drain interval and rx burst average "
+		"of each lcore. No parameters");
+
+	printf("Adaptive tx drain: %u to %u us\n",
+		RTE_MAX(drain_cap_us / MAX_PKT_BURST, 1U), drain_cap_us);
+}
+
+void
+l3fwd_drain_print_stats(void)
+{
+	const struct l3fwd_lcore_stats *st;
+	unsigned int lcore_id;
+
+	if (drain_cap_us == 0)
+		return;
+
+	printf("\nAdaptive tx drain (cap %u us):\n", drain_cap_us);
+	RTE_LCORE_FOREACH(lcore_id) {
+		st = &l3fwd_lcore_stats[lcore_id];
+		if (st->drain_ticks == 0)
+			continue;
+		printf("  lcore %u: %" PRIu64 " ticks, interval %.1f us, "
+			"avg rx burst %.1f\n", lcore_id, st->drain_ticks,
+			cycles_to_ns(st->drain_cycles) / 1e3,
+			(double)st->drain_avg_burst /
+			(1 << L3FWD_DRAIN_AVG_SHIFT));
+	}
+}
@@ -0,0 +1,56 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+#ifndef __L3FWD_DRAIN_H__
+#define __L3FWD_DRAIN_H__
+
+/*
+ * Load-adaptive tx drain interval (--adaptive-drain) for the LPM, EM and
+ * FIB poll loops.
+ *
+ * The loop keeps a moving average of its rx burst sizes, empty polls
+ * included. At every drain tick the next deadline is set to the cap
+ * scaled by how full the average burst is: at low load the packets left
+ * in the tx buffers go out after cap / MAX_PKT_BURST, at full bursts the
+ * buffers fill and leave by themselves and the drain backs off to the
+ * cap. The cap bounds the time a packet can wait in a tx buffer.
+ */
+
+#define L3FWD_DRAIN_AVG_SHIFT	4	/* average in 1/16 packets */
+#define L3FWD_DRAIN_EWMA_SHIFT	3	/* weight 1/8 to the new burst */
+
+struct l3fwd_drain {
+	uint32_t avg;		/**< rx burst size, << L3FWD_DRAIN_AVG_SHIFT */
+	uint64_t min_tsc;	/**< deadline with empty polls only */
+	uint64_t cap_tsc;	/**< deadline with full bursts, latency cap */
+};
+
+/* Account one rx burst, empty or not. */
+static __rte_always_inline void
+l3fwd_drain_rx(struct l3fwd_drain *drain, uint16_t nb_rx)
+{
+	int32_t diff = ((uint32_t)nb_rx << L3FWD_DRAIN_AVG_SHIFT) - drain->avg;
+
+	drain->avg += diff / (1 << L3FWD_DRAIN_EWMA_SHIFT);
+}
+
+/* Called at a drain tick, returns the deadline of the next one. */
+static inline uint64_t
+l3fwd_drain_tick(struct lcore_conf *qconf)
+{
+	struct l3fwd_drain *drain = qconf->drain;
+	uint64_t tsc;
+
+	tsc = drain->cap_tsc * drain->avg /
+		(MAX_PKT_BURST << L3FWD_DRAIN_AVG_SHIFT);
+	tsc = RTE_MAX(RTE_MIN(tsc, drain->cap_tsc), drain->min_tsc);
+
+	qconf->stats->drain_ticks++;
+	qconf->stats->drain_cycles = tsc;
+	qconf->stats->drain_avg_burst = drain->avg;
+
+	return tsc;
+}
+
+#endif /* __L3FWD_DRAIN_H__ */
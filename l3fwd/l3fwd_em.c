@@ -27,6 +27,9 @@
 
 #include "l3fwd.h"
 #include "l3fwd_event.h"
+#include "l3fwd_idle.h"
+#include "l3fwd_drain.h"
+#include "l3fwd_ptype.h"
 
 #if defined(RTE_ARCH_X86) || defined(__ARM_FEATURE_CRC32)
 #define EM_HASH_CRC 1
@@ -208,6 +211,12 @@ ipv6_hash_crc(const void *data, __rte_unused uint32_t data_len,
 
 #define IPV6_L3FWD_EM_NUM_ROUTES RTE_DIM(ipv6_l3fwd_em_route_array)
 
+/*
+ * Shared by the hash tables of all sockets. em_setup_flows() fills them
+ * once, by flow number, before the tables are built: a new rte_hash
+ * hands out key positions in insertion order, so flow i lands at
+ * position i in every table.
+ */
 static uint8_t ipv4_l3fwd_out_if[L3FWD_HASH_ENTRIES] __rte_cache_aligned;
 static uint8_t ipv6_l3fwd_out_if[L3FWD_HASH_ENTRIES] __rte_cache_aligned;
 
@@ -244,12 +253,13 @@ em_mask_key(void *key, xmm_t mask)
 #endif
 
 static inline uint16_t
-em_get_ipv4_dst_port(void *ipv4_hdr, uint16_t portid, void *lookup_struct)
+em_get_ipv4_dst_port(void *ipv4_hdr, uint16_t portid,
+		const struct lcore_conf *qconf)
 {
 	int ret = 0;
 	union ipv4_5tuple_host key;
 	struct rte_hash *ipv4_l3fwd_lookup_struct =
-		(struct rte_hash *)lookup_struct;
+		(struct rte_hash *)qconf->ipv4_lookup_struct;
 
 	ipv4_hdr = (uint8_t *)ipv4_hdr +
 		offsetof(struct rte_ipv4_hdr, time_to_live);
@@ -262,16 +272,21 @@ em_get_ipv4_dst_port(void *ipv4_hdr, uint16_t portid, void *lookup_struct)
 
 	/* Find destination port */
 	ret = rte_hash_lookup(ipv4_l3fwd_lookup_struct, (const void *)&key);
-	return (ret < 0) ? portid : ipv4_l3fwd_out_if[ret];
+	if (ret < 0) {
+		qconf->stats->lookup_miss++;
+		return portid;
+	}
+	return ipv4_l3fwd_out_if[ret];
 }
 
 static inline uint16_t
-em_get_ipv6_dst_port(void *ipv6_hdr, uint16_t portid, void *lookup_struct)
+em_get_ipv6_dst_port(void *ipv6_hdr, uint16_t portid,
+		const struct lcore_conf *qconf)
 {
 	int ret = 0;
 	union ipv6_5tuple_host key;
 	struct rte_hash *ipv6_l3fwd_lookup_struct =
-		(struct rte_hash *)lookup_struct;
+		(struct rte_hash *)qconf->ipv6_lookup_struct;
 
 	ipv6_hdr = (uint8_t *)ipv6_hdr +
 		offsetof(struct rte_ipv6_hdr, payload_len);
@@ -300,7 +315,11 @@ em_get_ipv6_dst_port(void *ipv6_hdr, uint16_t portid, void *lookup_struct)
 
 	/* Find destination port */
 	ret = rte_hash_lookup(ipv6_l3fwd_lookup_struct, (const void *)&key);
-	return (ret < 0) ? portid : ipv6_l3fwd_out_if[ret];
+	if (ret < 0) {
+		qconf->stats->lookup_miss++;
+		return portid;
+	}
+	return ipv6_l3fwd_out_if[ret];
 }
 
 #if defined RTE_ARCH_X86 || defined __ARM_NEON
@@ -349,37 +368,27 @@ convert_ipv6_5tuple(struct ipv6_5tuple *key1,
 #define BIT_8_TO_15 0x0000ff00
 
 static inline void
-populate_ipv4_few_flow_into_table(const struct rte_hash *h)
+populate_ipv4_few_flows(union ipv4_5tuple_host *keys)
 {
 	uint32_t i;
-	int32_t ret;
 
 	mask0 = (rte_xmm_t){.u32 = {BIT_8_TO_15, ALL_32_BITS,
 				ALL_32_BITS, ALL_32_BITS} };
 
 	for (i = 0; i < IPV4_L3FWD_EM_NUM_ROUTES; i++) {
 		struct ipv4_l3fwd_em_route  entry;
-		union ipv4_5tuple_host newkey;
 
 		entry = ipv4_l3fwd_em_route_array[i];
-		convert_ipv4_5tuple(&entry.key, &newkey);
-		ret = rte_hash_add_key(h, (void *) &newkey);
-		if (ret < 0) {
-			rte_exit(EXIT_FAILURE, "Unable to add entry %" PRIu32
-				" to the l3fwd hash.\n", i);
-		}
-		ipv4_l3fwd_out_if[ret] = entry.if_out;
+		convert_ipv4_5tuple(&entry.key, &keys[i]);
+		ipv4_l3fwd_out_if[i] = entry.if_out;
 	}
-	printf("Hash: Adding 0x%" PRIx64 " keys\n",
-		(uint64_t)IPV4_L3FWD_EM_NUM_ROUTES);
 }
 
 #define BIT_16_TO_23 0x00ff0000
 static inline void
-populate_ipv6_few_flow_into_table(const struct rte_hash *h)
+populate_ipv6_few_flows(union ipv6_5tuple_host *keys)
 {
 	uint32_t i;
-	int32_t ret;
 
 	mask1 = (rte_xmm_t){.u32 = {BIT_16_TO_23, ALL_32_BITS,
 				ALL_32_BITS, ALL_32_BITS} };
@@ -388,25 +397,50 @@ populate_ipv6_few_flow_into_table(const struct rte_hash *h)
 
 	for (i = 0; i < IPV6_L3FWD_EM_NUM_ROUTES; i++) {
 		struct ipv6_l3fwd_em_route entry;
-		union ipv6_5tuple_host newkey;
 
 		entry = ipv6_l3fwd_em_route_array[i];
-		convert_ipv6_5tuple(&entry.key, &newkey);
-		ret = rte_hash_add_key(h, (void *) &newkey);
-		if (ret < 0) {
-			rte_exit(EXIT_FAILURE, "Unable to add entry %" PRIu32
-				" to the l3fwd hash.\n", i);
-		}
-		ipv6_l3fwd_out_if[ret] = entry.if_out;
+		convert_ipv6_5tuple(&entry.key, &keys[i]);
+		ipv6_l3fwd_out_if[i] = entry.if_out;
 	}
-	printf("Hash: Adding 0x%" PRIx64 "keys\n",
-		(uint64_t)IPV6_L3FWD_EM_NUM_ROUTES);
 }
 
 #define NUMBER_PORT_USED 4
+
+/* Flow i of the --hash-entry-num table, spread over the 4 base routes. */
 static inline void
-populate_ipv4_many_flow_into_table(const struct rte_hash *h,
-		unsigned int nr_flow)
+em_ipv4_many_flow(unsigned int i, struct ipv4_l3fwd_em_route *entry)
+{
+	uint8_t a = (uint8_t)
+		((i/NUMBER_PORT_USED)%BYTE_VALUE_MAX);
+	uint8_t b = (uint8_t)
+		(((i/NUMBER_PORT_USED)/BYTE_VALUE_MAX)%BYTE_VALUE_MAX);
+	uint8_t c = (uint8_t)
+		((i/NUMBER_PORT_USED)/(BYTE_VALUE_MAX*BYTE_VALUE_MAX));
+
+	/* Create the ipv4 exact match flow */
+	memset(entry, 0, sizeof(*entry));
+	switch (i & (NUMBER_PORT_USED - 1)) {
+	case 0:
+		*entry = ipv4_l3fwd_em_route_array[0];
+		entry->key.ip_dst = RTE_IPV4(101, c, b, a);
+		break;
+	case 1:
+		*entry = ipv4_l3fwd_em_route_array[1];
+		entry->key.ip_dst = RTE_IPV4(201, c, b, a);
+		break;
+	case 2:
+		*entry = ipv4_l3fwd_em_route_array[2];
+		entry->key.ip_dst = RTE_IPV4(111, c, b, a);
+		break;
+	case 3:
+		*entry = ipv4_l3fwd_em_route_array[3];
+		entry->key.ip_dst = RTE_IPV4(211, c, b, a);
+		break;
+	};
+}
+
+static inline void
+populate_ipv4_many_flows(union ipv4_5tuple_host *keys, unsigned int nr_flow)
 {
 	unsigned i;
 
@@ -415,50 +449,15 @@ populate_ipv4_many_flow_into_table(const struct rte_hash *h,
 
 	for (i = 0; i < nr_flow; i++) {
 		struct ipv4_l3fwd_em_route entry;
-		union ipv4_5tuple_host newkey;
-
-		uint8_t a = (uint8_t)
-			((i/NUMBER_PORT_USED)%BYTE_VALUE_MAX);
-		uint8_t b = (uint8_t)
-			(((i/NUMBER_PORT_USED)/BYTE_VALUE_MAX)%BYTE_VALUE_MAX);
-		uint8_t c = (uint8_t)
-			((i/NUMBER_PORT_USED)/(BYTE_VALUE_MAX*BYTE_VALUE_MAX));
-
-		/* Create the ipv4 exact match flow */
-		memset(&entry, 0, sizeof(entry));
-		switch (i & (NUMBER_PORT_USED - 1)) {
-		case 0:
-			entry = ipv4_l3fwd_em_route_array[0];
-			entry.key.ip_dst = RTE_IPV4(101, c, b, a);
-			break;
-		case 1:
-			entry = ipv4_l3fwd_em_route_array[1];
-			entry.key.ip_dst = RTE_IPV4(201, c, b, a);
-			break;
-		case 2:
-			entry = ipv4_l3fwd_em_route_array[2];
-			entry.key.ip_dst = RTE_IPV4(111, c, b, a);
-			break;
-		case 3:
-			entry = ipv4_l3fwd_em_route_array[3];
-			entry.key.ip_dst = RTE_IPV4(211, c, b, a);
-			break;
-		};
-		convert_ipv4_5tuple(&entry.key, &newkey);
-		int32_t ret = rte_hash_add_key(h, (void *) &newkey);
-
-		if (ret < 0)
-			rte_exit(EXIT_FAILURE, "Unable to add entry %u\n", i);
-
-		ipv4_l3fwd_out_if[ret] = (uint8_t) entry.if_out;
 
+		em_ipv4_many_flow(i, &entry);
+		convert_ipv4_5tuple(&entry.key, &keys[i]);
+		ipv4_l3fwd_out_if[i] = (uint8_t) entry.if_out;
 	}
-	printf("Hash: Adding 0x%x keys\n", nr_flow);
 }
 
 static inline void
-populate_ipv6_many_flow_into_table(const struct rte_hash *h,
-		unsigned int nr_flow)
+populate_ipv6_many_flows(union ipv6_5tuple_host *keys, unsigned int nr_flow)
 {
 	unsigned i;
 
@@ -468,7 +467,6 @@ populate_ipv6_many_flow_into_table(const struct rte_hash *h,
 
 	for (i = 0; i < nr_flow; i++) {
 		struct ipv6_l3fwd_em_route entry;
-		union ipv6_5tuple_host newkey;
 
 		uint8_t a = (uint8_t)
 			((i/NUMBER_PORT_USED)%BYTE_VALUE_MAX);
@@ -496,16 +494,123 @@ populate_ipv6_many_flow_into_table(const struct rte_hash *h,
 		entry.key.ip_dst[13] = c;
 		entry.key.ip_dst[14] = b;
 		entry.key.ip_dst[15] = a;
-		convert_ipv6_5tuple(&entry.key, &newkey);
-		int32_t ret = rte_hash_add_key(h, (void *) &newkey);
+		convert_ipv6_5tuple(&entry.key, &keys[i]);
+		ipv6_l3fwd_out_if[i] = (uint8_t) entry.if_out;
+	}
+}
 
-		if (ret < 0)
-			rte_exit(EXIT_FAILURE, "Unable to add entry %u\n", i);
+/*
+ * The flows of the hash tables in insertion order: key and hash
+ * signature of each. Generated once by em_setup_flows() for the tables
+ * of all sockets, which add them with the signature precomputed.
+ */
+static struct {
+	uint32_t nb;
+	uint32_t key_len;
+	uint8_t *keys;
+	hash_sig_t *sigs;
+} em_flows;
 
-		ipv6_l3fwd_out_if[ret] = (uint8_t) entry.if_out;
+/*
+ * Generate the flows and fill the out_if array of the address family
+ * in use. Called before the per-socket builds start, so they only read
+ * what is shared.
+ */
+void
+em_setup_flows(void)
+{
+	rte_hash_function hash;
+	const uint8_t *key;
+	uint64_t start;
+	uint32_t i;
+
+	if (em_flows.keys != NULL)
+		return;
 
+	start = rte_get_timer_cycles();
+
+	if (hash_entry_number != HASH_ENTRY_NUMBER_DEFAULT)
+		em_flows.nb = hash_entry_number;
+	else
+		em_flows.nb = ipv6 ? IPV6_L3FWD_EM_NUM_ROUTES :
+			IPV4_L3FWD_EM_NUM_ROUTES;
+	em_flows.key_len = ipv6 ? sizeof(union ipv6_5tuple_host) :
+		sizeof(union ipv4_5tuple_host);
+	hash = ipv6 ? ipv6_hash_crc : ipv4_hash_crc;
+
+	em_flows.keys = malloc((size_t)em_flows.nb * em_flows.key_len);
+	em_flows.sigs = malloc((size_t)em_flows.nb * sizeof(hash_sig_t));
+	if (em_flows.keys == NULL || em_flows.sigs == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot allocate %u hash keys\n",
+			em_flows.nb);
+
+	if (hash_entry_number != HASH_ENTRY_NUMBER_DEFAULT) {
+		/* For testing hash matching with a large number of flows we
+		 * generate millions of IP 5-tuples with an incremented dst
+		 * address to initialize the hash table. */
+		if (ipv6 == 0)
+			populate_ipv4_many_flows(
+				(union ipv4_5tuple_host *)em_flows.keys,
+				em_flows.nb);
+		else
+			populate_ipv6_many_flows(
+				(union ipv6_5tuple_host *)em_flows.keys,
+				em_flows.nb);
+	} else {
+		/*
+		 * Use data in ipv4/ipv6 l3fwd lookup table
+		 * directly to initialize the hash table.
+		 */
+		if (ipv6 == 0)
+			populate_ipv4_few_flows(
+				(union ipv4_5tuple_host *)em_flows.keys);
+		else
+			populate_ipv6_few_flows(
+				(union ipv6_5tuple_host *)em_flows.keys);
 	}
-	printf("Hash: Adding 0x%x keys\n", nr_flow);
+
+	key = em_flows.keys;
+	for (i = 0; i < em_flows.nb; i++, key += em_flows.key_len)
+		em_flows.sigs[i] = hash(key, em_flows.key_len, 0);
+
+	printf("Hash: generated 0x%x keys in %.3f ms\n", em_flows.nb,
+		(rte_get_timer_cycles() - start) * 1e3 / rte_get_timer_hz());
+}
+
+/* Release the flows once the tables of all sockets are built. */
+void
+em_free_flows(void)
+{
+	free(em_flows.keys);
+	free(em_flows.sigs);
+	em_flows.keys = NULL;
+	em_flows.sigs = NULL;
+}
+
+/* Add the flows to h, flow i at position i. */
+static void
+em_add_flows(const struct rte_hash *h, const int socketid)
+{
+	const uint8_t *key = em_flows.keys;
+	uint64_t start;
+	int32_t ret;
+	uint32_t i;
+
+	start = rte_get_timer_cycles();
+	for (i = 0; i < em_flows.nb; i++, key += em_flows.key_len) {
+		ret = rte_hash_add_key_with_hash(h, key, em_flows.sigs[i]);
+		if (ret < 0)
+			rte_exit(EXIT_FAILURE, "Unable to add entry %u to the "
+				"l3fwd hash on socket %d\n", i, socketid);
+		/* out_if is indexed by flow number */
+		if ((uint32_t)ret != i)
+			rte_exit(EXIT_FAILURE, "Entry %u took position %d in "
+				"the l3fwd hash on socket %d\n", i, ret,
+				socketid);
+	}
+	printf("Hash: Adding 0x%x keys on socket %d in %.3f ms\n",
+		em_flows.nb, socketid,
+		(rte_get_timer_cycles() - start) * 1e3 / rte_get_timer_hz());
 }
 
 /* Requirements:
@@ -607,17 +712,74 @@ em_cb_parse_ptype(uint16_t port __rte_unused, uint16_t queue __rte_unused,
 		  uint16_t max_pkts __rte_unused,
 		  void *user_param __rte_unused)
 {
+#ifdef L3FWD_PTYPE_VEC
+	l3fwd_parse_ptype_burst(pkts, nb_pkts, 1);
+#else
 	unsigned i;
 
 	for (i = 0; i < nb_pkts; ++i)
 		em_parse_ptype(pkts[i]);
+#endif
 
 	return nb_pkts;
 }
 
-/* main processing loop */
-int
-em_main_loop(__rte_unused void *dummy)
+#if defined RTE_ARCH_X86 || defined __ARM_NEON
+#include "l3fwd_flow_cache.h"
+
+/*
+ * l3fwd_em_send_packets() with the flow cache in front of the lookup,
+ * keyed by the 5-tuple as the hash.
+ */
+static inline void
+l3fwd_em_cached_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
+		uint16_t portid, struct lcore_conf *qconf)
+{
+	uint16_t dst_port[MAX_PKT_BURST];
+
+	l3fwd_flow_cache_process(nb_rx, pkts_burst, portid, dst_port, qconf,
+			1, l3fwd_em_process_packets);
+	l3fwd_trace_lookup(portid, nb_rx);
+	send_packets_multi(qconf, pkts_burst, dst_port, nb_rx);
+}
+#endif
+
+/* Forward one burst, as the poll loop instance given by flags. */
+static __rte_always_inline void
+em_poll_burst(int nb_rx, struct rte_mbuf **pkts_burst, uint16_t portid,
+		struct lcore_conf *qconf, const uint8_t flags)
+{
+#if defined RTE_ARCH_X86 || defined __ARM_NEON
+	uint16_t dst_port[MAX_PKT_BURST];
+
+	if ((flags & L3FWD_LOOP_EXTRA) && qconf->flow_cache != NULL) {
+		l3fwd_em_cached_send_packets(nb_rx, pkts_burst, portid, qconf);
+		return;
+	}
+
+	l3fwd_em_process_af(nb_rx, pkts_burst, portid, dst_port, qconf,
+			flags & L3FWD_LOOP_AF);
+	l3fwd_trace_lookup(portid, nb_rx);
+	send_packets_multi(qconf, pkts_burst, dst_port, nb_rx);
+#else
+	RTE_SET_USED(flags);
+	/* lookups and sends are interleaved, traced once done */
+	l3fwd_em_no_opt_send_packets(nb_rx, pkts_burst, portid, qconf);
+	l3fwd_trace_lookup(portid, nb_rx);
+#endif
+}
+
+void
+em_process_burst(int nb_rx, struct rte_mbuf **pkts_burst, uint16_t portid,
+		struct lcore_conf *qconf)
+{
+	em_poll_burst(nb_rx, pkts_burst, portid, qconf,
+			L3FWD_LOOP_AF | L3FWD_LOOP_EXTRA);
+}
+
+/* main processing loop, of the instance given by flags (L3FWD_LOOP_*) */
+static __rte_always_inline int
+em_poll_loop(const uint8_t flags)
 {
 	struct rte_mbuf *pkts_burst[MAX_PKT_BURST];
 	unsigned lcore_id;
@@ -626,13 +788,18 @@ em_main_loop(__rte_unused void *dummy)
 	uint8_t queueid;
 	uint16_t portid;
 	struct lcore_conf *qconf;
-	const uint64_t drain_tsc = (rte_get_tsc_hz() + US_PER_S - 1) /
+	int acl_on;
+	uint64_t loop_tsc;
+	int busy = 0;
+	uint64_t drain_tsc = (rte_get_tsc_hz() + US_PER_S - 1) /
 		US_PER_S * BURST_TX_DRAIN_US;
 
 	prev_tsc = 0;
 
 	lcore_id = rte_lcore_id();
 	qconf = &lcore_conf[lcore_id];
+	acl_on = (flags & L3FWD_LOOP_EXTRA) &&
+		(qconf->acl4_ctx != NULL || qconf->acl6_ctx != NULL);
 
 	if (qconf->n_rx_queue == 0) {
 		RTE_LOG(INFO, L3FWD, "lcore %u has nothing to do\n", lcore_id);
@@ -650,9 +817,17 @@ em_main_loop(__rte_unused void *dummy)
 			lcore_id, portid, queueid);
 	}
 
+	if ((flags & L3FWD_LOOP_EXTRA) && qconf->idle != NULL)
+		l3fwd_idle_start(qconf);
+	if ((flags & L3FWD_LOOP_EXTRA) && qconf->drain != NULL)
+		drain_tsc = qconf->drain->cap_tsc;
+
+	loop_tsc = rte_rdtsc();
 	while (!force_quit) {
 
 		cur_tsc = rte_rdtsc();
+		l3fwd_stats_loop(qconf->stats, cur_tsc, &loop_tsc, busy);
+		busy = 0;
 
 		/*
 		 * TX burst queue drain
@@ -660,15 +835,9 @@ em_main_loop(__rte_unused void *dummy)
 		diff_tsc = cur_tsc - prev_tsc;
 		if (unlikely(diff_tsc > drain_tsc)) {
 
-			for (i = 0; i < qconf->n_tx_port; ++i) {
-				portid = qconf->tx_port_id[i];
-				if (qconf->tx_mbufs[portid].len == 0)
-					continue;
-				send_burst(qconf,
-					qconf->tx_mbufs[portid].len,
-					portid);
-				qconf->tx_mbufs[portid].len = 0;
-			}
+			l3fwd_tx_drain(qconf);
+			if ((flags & L3FWD_LOOP_EXTRA) && qconf->drain != NULL)
+				drain_tsc = l3fwd_drain_tick(qconf);
 
 			prev_tsc = cur_tsc;
 		}
@@ -681,22 +850,48 @@ em_main_loop(__rte_unused void *dummy)
 			queueid = qconf->rx_queue_list[i].queue_id;
 			nb_rx = rte_eth_rx_burst(portid, queueid, pkts_burst,
 				MAX_PKT_BURST);
+			if (flags & L3FWD_LOOP_SW_PTYPE)
+				em_cb_parse_ptype(portid, queueid, pkts_burst,
+					nb_rx, MAX_PKT_BURST, NULL);
+			l3fwd_stats_rx(qconf->stats, nb_rx);
+			if ((flags & L3FWD_LOOP_EXTRA) && qconf->drain != NULL)
+				l3fwd_drain_rx(qconf->drain, nb_rx);
 			if (nb_rx == 0)
 				continue;
+			busy = 1;
+			l3fwd_trace_rx_burst(portid, queueid, nb_rx);
+
+			/* Optional ACL stage, denied packets are freed here. */
+			if (acl_on) {
+				nb_rx = l3fwd_acl_filter(qconf, pkts_burst,
+						nb_rx);
+				if (nb_rx == 0)
+					continue;
+			}
 
-#if defined RTE_ARCH_X86 || defined __ARM_NEON
-			l3fwd_em_send_packets(nb_rx, pkts_burst,
-							portid, qconf);
-#else
-			l3fwd_em_no_opt_send_packets(nb_rx, pkts_burst,
-							portid, qconf);
-#endif
+			em_poll_burst(nb_rx, pkts_burst, portid, qconf, flags);
 		}
+
+		if ((flags & L3FWD_LOOP_EXTRA) && qconf->idle != NULL)
+			l3fwd_idle_poll(qconf, busy);
 	}
 
+	/* nothing may stay staged when the tx queues change hands */
+	l3fwd_tx_flush(qconf);
+
 	return 0;
 }
 
+L3FWD_LOOP_DEFINE_AF(em, v4, L3FWD_LOOP_IPV4)
+L3FWD_LOOP_DEFINE_AF(em, v6, L3FWD_LOOP_IPV6)
+L3FWD_LOOP_DEFINE_AF(em, ds, L3FWD_LOOP_AF)
+
+const l3fwd_main_loop_t em_main_loops[L3FWD_LOOP_NB] = {
+	L3FWD_LOOP_ENTRIES_AF(em, v4, L3FWD_LOOP_IPV4),
+	L3FWD_LOOP_ENTRIES_AF(em, v6, L3FWD_LOOP_IPV6),
+	L3FWD_LOOP_ENTRIES_AF(em, ds, L3FWD_LOOP_AF),
+};
+
 static __rte_always_inline void
 em_event_loop_single(struct l3fwd_event_resources *evt_rsrc,
 		const uint8_t flags)
@@ -720,6 +915,9 @@ em_event_loop_single(struct l3fwd_event_resources *evt_rsrc,
 		if (!rte_event_dequeue_burst(event_d_id, event_p_id, &ev, 1, 0))
 			continue;
 
+		if (evt_rsrc->nb_prio > 1)
+			l3fwd_event_prio_account(&ev, 1);
+
 		struct rte_mbuf *mbuf = ev.mbuf;
 
 #if defined RTE_ARCH_X86 || defined __ARM_NEON
@@ -759,8 +957,9 @@ em_event_loop_burst(struct l3fwd_event_resources *evt_rsrc,
 	const uint8_t tx_q_id = evt_rsrc->evq.event_q_id[
 		evt_rsrc->evq.nb_queues - 1];
 	const uint8_t event_d_id = evt_rsrc->event_d_id;
-	const uint16_t deq_len = evt_rsrc->deq_depth;
+	const uint16_t deq_len = RTE_MIN(evt_rsrc->deq_depth, MAX_PKT_BURST);
 	struct rte_event events[MAX_PKT_BURST];
+	struct rte_event *ev[MAX_PKT_BURST];
 	struct lcore_conf *lconf;
 	unsigned int lcore_id;
 	int i, nb_enq, nb_deq;
@@ -772,6 +971,10 @@ em_event_loop_burst(struct l3fwd_event_resources *evt_rsrc,
 
 	lconf = &lcore_conf[lcore_id];
 
+	/* The bulk routines take an array of event pointers. */
+	for (i = 0; i < MAX_PKT_BURST; i++)
+		ev[i] = &events[i];
+
 	RTE_LOG(INFO, L3FWD, "entering %s on lcore %u\n", __func__, lcore_id);
 
 	while (!force_quit) {
@@ -783,14 +986,15 @@ em_event_loop_burst(struct l3fwd_event_resources *evt_rsrc,
 			continue;
 		}
 
+		if (evt_rsrc->nb_prio > 1)
+			l3fwd_event_prio_account(events, nb_deq);
+
 #if defined RTE_ARCH_X86 || defined __ARM_NEON
-		l3fwd_em_process_events(nb_deq, (struct rte_event **)&events,
-					lconf);
+		l3fwd_em_process_events(nb_deq, ev, lconf);
 #else
-		l3fwd_em_no_opt_process_events(nb_deq,
-					       (struct rte_event **)&events,
-					       lconf);
+		l3fwd_em_no_opt_process_events(nb_deq, ev, lconf);
 #endif
+		nb_deq = l3fwd_event_drop_bad_port(lconf, events, nb_deq);
 		for (i = 0; i < nb_deq; i++) {
 			if (flags & L3FWD_EVENT_TX_ENQ) {
 				events[i].queue_id = tx_q_id;
@@ -919,36 +1123,31 @@ setup_hash(const int socketid)
 			"Unable to create the l3fwd hash on socket %d\n",
 			socketid);
 
-	if (hash_entry_number != HASH_ENTRY_NUMBER_DEFAULT) {
-		/* For testing hash matching with a large number of flows we
-		 * generate millions of IP 5-tuples with an incremented dst
-		 * address to initialize the hash table. */
-		if (ipv6 == 0) {
-			/* populate the ipv4 hash */
-			populate_ipv4_many_flow_into_table(
-				ipv4_l3fwd_em_lookup_struct[socketid],
-				hash_entry_number);
-		} else {
-			/* populate the ipv6 hash */
-			populate_ipv6_many_flow_into_table(
-				ipv6_l3fwd_em_lookup_struct[socketid],
-				hash_entry_number);
-		}
-	} else {
-		/*
-		 * Use data in ipv4/ipv6 l3fwd lookup table
-		 * directly to initialize the hash table.
-		 */
-		if (ipv6 == 0) {
-			/* populate the ipv4 hash */
-			populate_ipv4_few_flow_into_table(
-				ipv4_l3fwd_em_lookup_struct[socketid]);
-		} else {
-			/* populate the ipv6 hash */
-			populate_ipv6_few_flow_into_table(
-				ipv6_l3fwd_em_lookup_struct[socketid]);
-		}
-	}
+	/* a no-op unless setup_lookup_tables() was bypassed */
+	em_setup_flows();
+	if (ipv6 == 0)
+		em_add_flows(ipv4_l3fwd_em_lookup_struct[socketid], socketid);
+	else
+		em_add_flows(ipv6_l3fwd_em_lookup_struct[socketid], socketid);
+}
+
+/* --bench: flow i of the IPv4 keys setup_hash() added. */
+void
+em_bench_flow(uint32_t i, struct l3fwd_bench_flow *f)
+{
+	struct ipv4_l3fwd_em_route entry;
+
+	if (hash_entry_number != HASH_ENTRY_NUMBER_DEFAULT)
+		em_ipv4_many_flow(i % hash_entry_number, &entry);
+	else
+		entry = ipv4_l3fwd_em_route_array[
+			i % IPV4_L3FWD_EM_NUM_ROUTES];
+
+	f->ip_dst = entry.key.ip_dst;
+	f->ip_src = entry.key.ip_src;
+	f->port_dst = entry.key.port_dst;
+	f->port_src = entry.key.port_src;
+	f->proto = entry.key.proto;
 }
 
 /* Return ipv4/ipv6 em fwd lookup struct. */
@@ -17,14 +17,11 @@ l3fwd_em_handle_ipv4(struct rte_mbuf *m, uint16_t portid,
 			sizeof(struct rte_ether_hdr));
 
 #ifdef DO_RFC_1812_CHECKS
-	/* Check to make sure the packet is valid (RFC1812) */
-	if (is_valid_ipv4_pkt(ipv4_hdr, m->pkt_len) < 0) {
-		rte_pktmbuf_free(m);
+	/* Check to make sure the packet is valid (RFC1812), the caller drops */
+	if (is_valid_ipv4_pkt(ipv4_hdr, m->pkt_len) < 0)
 		return BAD_PORT;
-	}
 #endif
-	dst_port = em_get_ipv4_dst_port(ipv4_hdr, portid,
-			qconf->ipv4_lookup_struct);
+	dst_port = em_get_ipv4_dst_port(ipv4_hdr, portid, qconf);
 
 	if (dst_port >= RTE_MAX_ETHPORTS ||
 			(enabled_port_mask & 1 << dst_port) == 0)
@@ -56,8 +53,7 @@ l3fwd_em_handle_ipv6(struct rte_mbuf *m, uint16_t portid,
 	ipv6_hdr = rte_pktmbuf_mtod_offset(m, struct rte_ipv6_hdr *,
 			sizeof(struct rte_ether_hdr));
 
-	dst_port = em_get_ipv6_dst_port(ipv6_hdr, portid,
-			qconf->ipv6_lookup_struct);
+	dst_port = em_get_ipv6_dst_port(ipv6_hdr, portid, qconf);
 
 	if (dst_port >= RTE_MAX_ETHPORTS ||
 			(enabled_port_mask & 1 << dst_port) == 0)
@@ -86,16 +82,20 @@ l3fwd_em_simple_forward(struct rte_mbuf *m, uint16_t portid,
 	tcp_or_udp = m->packet_type & (RTE_PTYPE_L4_TCP | RTE_PTYPE_L4_UDP);
 	l3_ptypes = m->packet_type & RTE_PTYPE_L3_MASK;
 
-	if (tcp_or_udp && (l3_ptypes == RTE_PTYPE_L3_IPV4)) {
+	if (tcp_or_udp && (l3_ptypes == RTE_PTYPE_L3_IPV4))
 		dst_port = l3fwd_em_handle_ipv4(m, portid, eth_hdr, qconf);
-		send_single_packet(qconf, m, dst_port);
-	} else if (tcp_or_udp && (l3_ptypes == RTE_PTYPE_L3_IPV6)) {
+	else if (tcp_or_udp && (l3_ptypes == RTE_PTYPE_L3_IPV6))
 		dst_port = l3fwd_em_handle_ipv6(m, portid, eth_hdr, qconf);
-		send_single_packet(qconf, m, dst_port);
-	} else {
-		/* Free the mbuf that contains non-IPV4/IPV6 packet */
-		rte_pktmbuf_free(m);
+	else
+		/* Drop the mbuf that contains non-IPV4/IPV6 packet */
+		dst_port = BAD_PORT;
+
+	if (unlikely(dst_port == BAD_PORT)) {
+		qconf->stats->bad_port_drops++;
+		l3fwd_drop_bulk(qconf, &m, 1);
+		return;
 	}
+	send_single_packet(qconf, m, dst_port);
 }
 
 static __rte_always_inline void
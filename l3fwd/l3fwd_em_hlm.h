@@ -39,6 +39,8 @@ em_get_dst_port_ipv4xN(struct lcore_conf *qconf, struct rte_mbuf *m[],
 			     EM_HASH_LOOKUP_COUNT, ret);
 
 	for (i = 0; i < EM_HASH_LOOKUP_COUNT; i++) {
+		if (unlikely(ret[i] < 0))
+			qconf->stats->lookup_miss++;
 		dst_port[i] = ((ret[i] < 0) ?
 				portid : ipv4_l3fwd_out_if[ret[i]]);
 
@@ -66,6 +68,8 @@ em_get_dst_port_ipv6xN(struct lcore_conf *qconf, struct rte_mbuf *m[],
 			     EM_HASH_LOOKUP_COUNT, ret);
 
 	for (i = 0; i < EM_HASH_LOOKUP_COUNT; i++) {
+		if (unlikely(ret[i] < 0))
+			qconf->stats->lookup_miss++;
 		dst_port[i] = ((ret[i] < 0) ?
 				portid : ipv6_l3fwd_out_if[ret[i]]);
 
@@ -93,6 +97,8 @@ em_get_dst_port_ipv4xN_events(struct lcore_conf *qconf, struct rte_mbuf *m[],
 			     EM_HASH_LOOKUP_COUNT, ret);
 
 	for (i = 0; i < EM_HASH_LOOKUP_COUNT; i++) {
+		if (unlikely(ret[i] < 0))
+			qconf->stats->lookup_miss++;
 		dst_port[i] = ((ret[i] < 0) ?
 				m[i]->port : ipv4_l3fwd_out_if[ret[i]]);
 
@@ -120,6 +126,8 @@ em_get_dst_port_ipv6xN_events(struct lcore_conf *qconf, struct rte_mbuf *m[],
 			     EM_HASH_LOOKUP_COUNT, ret);
 
 	for (i = 0; i < EM_HASH_LOOKUP_COUNT; i++) {
+		if (unlikely(ret[i] < 0))
+			qconf->stats->lookup_miss++;
 		dst_port[i] = ((ret[i] < 0) ?
 				m[i]->port : ipv6_l3fwd_out_if[ret[i]]);
 
@@ -148,8 +156,7 @@ em_get_dst_port(const struct lcore_conf *qconf, struct rte_mbuf *pkt,
 		ipv4_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *,
 				sizeof(struct rte_ether_hdr));
 
-		next_hop = em_get_ipv4_dst_port(ipv4_hdr, portid,
-				qconf->ipv4_lookup_struct);
+		next_hop = em_get_ipv4_dst_port(ipv4_hdr, portid, qconf);
 
 		if (next_hop >= RTE_MAX_ETHPORTS ||
 				(enabled_port_mask & 1 << next_hop) == 0)
@@ -163,8 +170,7 @@ em_get_dst_port(const struct lcore_conf *qconf, struct rte_mbuf *pkt,
 		ipv6_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv6_hdr *,
 				sizeof(struct rte_ether_hdr));
 
-		next_hop = em_get_ipv6_dst_port(ipv6_hdr, portid,
-				qconf->ipv6_lookup_struct);
+		next_hop = em_get_ipv6_dst_port(ipv6_hdr, portid, qconf);
 
 		if (next_hop >= RTE_MAX_ETHPORTS ||
 				(enabled_port_mask & 1 << next_hop) == 0)
@@ -178,15 +184,16 @@ em_get_dst_port(const struct lcore_conf *qconf, struct rte_mbuf *pkt,
 }
 
 /*
- * Buffer optimized handling of packets, invoked
- * from main_loop.
+ * Look up the next hop of every packet of a burst received on portid,
+ * into dst_port. Only the families in af (L3FWD_LOOP_IPV4/IPV6) get the
+ * bulk lookup, groups of the other one are looked up one by one.
  */
-static inline void
-l3fwd_em_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
-		uint16_t portid, struct lcore_conf *qconf)
+static __rte_always_inline void
+l3fwd_em_process_af(int nb_rx, struct rte_mbuf **pkts_burst,
+		uint16_t portid, uint16_t *dst_port, struct lcore_conf *qconf,
+		const uint8_t af)
 {
 	int32_t i, j, pos;
-	uint16_t dst_port[MAX_PKT_BURST];
 
 	/*
 	 * Send nb_rx - nb_rx % EM_HASH_LOOKUP_COUNT packets
@@ -218,12 +225,14 @@ l3fwd_em_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
 					struct rte_ether_hdr *) + 1);
 		}
 
-		if (tcp_or_udp && (l3_type == RTE_PTYPE_L3_IPV4)) {
+		if ((af & L3FWD_LOOP_IPV4) && tcp_or_udp &&
+				(l3_type == RTE_PTYPE_L3_IPV4)) {
 
 			em_get_dst_port_ipv4xN(qconf, &pkts_burst[j], portid,
 					       &dst_port[j]);
 
-		} else if (tcp_or_udp && (l3_type == RTE_PTYPE_L3_IPV6)) {
+		} else if ((af & L3FWD_LOOP_IPV6) && tcp_or_udp &&
+				(l3_type == RTE_PTYPE_L3_IPV6)) {
 
 			em_get_dst_port_ipv6xN(qconf, &pkts_burst[j], portid,
 					       &dst_port[j]);
@@ -237,9 +246,29 @@ l3fwd_em_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
 
 	for (; j < nb_rx; j++)
 		dst_port[j] = em_get_dst_port(qconf, pkts_burst[j], portid);
+}
 
-	send_packets_multi(qconf, pkts_burst, dst_port, nb_rx);
+/* Dual-stack l3fwd_em_process_af(). */
+static inline void
+l3fwd_em_process_packets(int nb_rx, struct rte_mbuf **pkts_burst,
+		uint16_t portid, uint16_t *dst_port, struct lcore_conf *qconf)
+{
+	l3fwd_em_process_af(nb_rx, pkts_burst, portid, dst_port, qconf,
+			L3FWD_LOOP_AF);
+}
+
+/*
+ * Buffer optimized handling of packets, invoked
+ * from main_loop.
+ */
+static inline void
+l3fwd_em_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
+		uint16_t portid, struct lcore_conf *qconf)
+{
+	uint16_t dst_port[MAX_PKT_BURST];
 
+	l3fwd_em_process_packets(nb_rx, pkts_burst, portid, dst_port, qconf);
+	send_packets_multi(qconf, pkts_burst, dst_port, nb_rx);
 }
 
 /*
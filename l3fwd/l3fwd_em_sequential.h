@@ -39,8 +39,7 @@ em_get_dst_port(const struct lcore_conf *qconf, struct rte_mbuf *pkt,
 		ipv4_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv4_hdr *,
 				sizeof(struct rte_ether_hdr));
 
-		next_hop = em_get_ipv4_dst_port(ipv4_hdr, portid,
-				qconf->ipv4_lookup_struct);
+		next_hop = em_get_ipv4_dst_port(ipv4_hdr, portid, qconf);
 
 		if (next_hop >= RTE_MAX_ETHPORTS ||
 				(enabled_port_mask & 1 << next_hop) == 0)
@@ -54,8 +53,7 @@ em_get_dst_port(const struct lcore_conf *qconf, struct rte_mbuf *pkt,
 		ipv6_hdr = rte_pktmbuf_mtod_offset(pkt, struct rte_ipv6_hdr *,
 				sizeof(struct rte_ether_hdr));
 
-		next_hop = em_get_ipv6_dst_port(ipv6_hdr, portid,
-				qconf->ipv6_lookup_struct);
+		next_hop = em_get_ipv6_dst_port(ipv6_hdr, portid, qconf);
 
 		if (next_hop >= RTE_MAX_ETHPORTS ||
 				(enabled_port_mask & 1 << next_hop) == 0)
@@ -69,15 +67,15 @@ em_get_dst_port(const struct lcore_conf *qconf, struct rte_mbuf *pkt,
 }
 
 /*
- * Buffer optimized handling of packets, invoked
- * from main_loop.
+ * Look up the next hop of every packet of a burst received on portid,
+ * into dst_port. One lookup per packet: af makes no difference here.
  */
-static inline void
-l3fwd_em_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
-			uint16_t portid, struct lcore_conf *qconf)
+static __rte_always_inline void
+l3fwd_em_process_af(int nb_rx, struct rte_mbuf **pkts_burst,
+			uint16_t portid, uint16_t *dst_port,
+			struct lcore_conf *qconf, const uint8_t af __rte_unused)
 {
 	int32_t i, j;
-	uint16_t dst_port[MAX_PKT_BURST];
 
 	if (nb_rx > 0) {
 		rte_prefetch0(rte_pktmbuf_mtod(pkts_burst[0],
@@ -92,7 +90,28 @@ l3fwd_em_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
 		}
 		dst_port[j] = em_get_dst_port(qconf, pkts_burst[j], portid);
 	}
+}
+
+static inline void
+l3fwd_em_process_packets(int nb_rx, struct rte_mbuf **pkts_burst,
+			uint16_t portid, uint16_t *dst_port,
+			struct lcore_conf *qconf)
+{
+	l3fwd_em_process_af(nb_rx, pkts_burst, portid, dst_port, qconf,
+			L3FWD_LOOP_AF);
+}
+
+/*
+ * Buffer optimized handling of packets, invoked
+ * from main_loop.
+ */
+static inline void
+l3fwd_em_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
+			uint16_t portid, struct lcore_conf *qconf)
+{
+	uint16_t dst_port[MAX_PKT_BURST];
 
+	l3fwd_em_process_packets(nb_rx, pkts_burst, portid, dst_port, qconf);
 	send_packets_multi(qconf, pkts_burst, dst_port, nb_rx);
 }
 
@@ -30,6 +30,10 @@ l3fwd_get_eventdev_rsrc(void)
 	if (rsrc != NULL) {
 		rsrc->sched_type = RTE_SCHED_TYPE_ATOMIC;
 		rsrc->eth_rx_queues = 1;
+		rsrc->port_deq_depth = L3FWD_EVENT_DEQ_DEPTH;
+		rsrc->port_enq_depth = L3FWD_EVENT_ENQ_DEPTH;
+		rsrc->new_event_threshold = L3FWD_EVENT_NEW_THRESHOLD;
+		rsrc->nb_prio = 1;
 		return rsrc;
 	}
 
@@ -239,6 +243,14 @@ l3fwd_event_resource_setup(struct rte_eth_conf *port_conf)
 	/* Setup eventdev capability callbacks */
 	l3fwd_event_capability_setup();
 
+	if (evt_rsrc->prio_mode != L3FWD_EVENT_PRIO_NONE) {
+		if (!evt_rsrc->tx_mode_q)
+			rte_exit(EXIT_FAILURE,
+				 "Priority queues are not supported with "
+				 "internal port Tx adapters\n");
+		l3fwd_event_prio_setup();
+	}
+
 	/* Ethernet device configuration */
 	l3fwd_eth_dev_port_setup(port_conf);
 
@@ -6,9 +6,11 @@
 #define __L3FWD_EVENTDEV_H__
 
 #include <rte_common.h>
+#include <rte_cycles.h>
 #include <rte_eventdev.h>
 #include <rte_event_eth_rx_adapter.h>
 #include <rte_event_eth_tx_adapter.h>
+#include <rte_mbuf_dyn.h>
 #include <rte_service.h>
 #include <rte_spinlock.h>
 
@@ -19,6 +21,21 @@
 #define L3FWD_EVENT_TX_DIRECT  0x4
 #define L3FWD_EVENT_TX_ENQ     0x8
 
+/* Event port defaults, capped by what the event device supports. */
+#define L3FWD_EVENT_DEQ_DEPTH		32	/* at most MAX_PKT_BURST */
+#define L3FWD_EVENT_ENQ_DEPTH		32
+#define L3FWD_EVENT_NEW_THRESHOLD	4096
+
+/* --event-prio classification and the queue classes of each port. */
+#define L3FWD_EVENT_PRIO_NONE	0
+#define L3FWD_EVENT_PRIO_DSCP	1
+#define L3FWD_EVENT_PRIO_PCP	2
+
+#define L3FWD_EVENT_PRIO_HIGH	0
+#define L3FWD_EVENT_PRIO_NORMAL	1
+#define L3FWD_EVENT_PRIO_LOW	2
+#define L3FWD_EVENT_NB_PRIO	3
+
 typedef uint32_t (*event_device_setup_cb)(void);
 typedef void (*event_queue_setup_cb)(uint32_t event_queue_cfg);
 typedef void (*event_port_setup_cb)(void);
@@ -71,16 +88,112 @@ struct l3fwd_event_resources {
 	uint8_t event_d_id;
 	uint8_t sched_type;
 	uint8_t tx_mode_q;
-	uint8_t deq_depth;
+	uint8_t deq_depth;	/**< effective port dequeue depth */
+	/* Event port tunables, see --event-deq-depth and friends. */
+	uint16_t port_deq_depth;
+	uint16_t port_enq_depth;
+	int32_t new_event_threshold;
+	uint8_t prio_mode;	/**< L3FWD_EVENT_PRIO_* */
+	uint8_t nb_prio;	/**< event queues per ethdev port */
 	uint8_t has_burst;
 	uint8_t enabled;
 	uint8_t eth_rx_queues;
 };
 
+/* Event queue wait of one priority class, written by the owning lcore. */
+struct l3fwd_event_prio_stats {
+	uint64_t pkts;
+	uint64_t cycles;
+	uint64_t max_cycles;
+};
+
+struct l3fwd_event_prio_lcore_stats {
+	struct l3fwd_event_prio_stats class[L3FWD_EVENT_NB_PRIO];
+} __rte_cache_aligned;
+
+extern int l3fwd_event_tsc_dynfield_offset;
+extern struct l3fwd_event_prio_lcore_stats
+	l3fwd_event_prio_stats[RTE_MAX_LCORE];
+
+/* Rx adapter timestamp of a packet, set when --event-prio is used. */
+static inline uint64_t *
+l3fwd_event_tsc(struct rte_mbuf *m)
+{
+	return RTE_MBUF_DYNFIELD(m, l3fwd_event_tsc_dynfield_offset,
+				 uint64_t *);
+}
+
+/*
+ * Account the time the dequeued events waited since the Rx adapter,
+ * per priority class (carried in sub_event_type).
+ */
+static inline void
+l3fwd_event_prio_account(const struct rte_event *events, int nb_deq)
+{
+	struct l3fwd_event_prio_stats *st =
+		l3fwd_event_prio_stats[rte_lcore_id()].class;
+	const uint64_t now = rte_rdtsc();
+	uint64_t wait;
+	int i;
+
+	for (i = 0; i < nb_deq; i++) {
+		wait = now - *l3fwd_event_tsc(events[i].mbuf);
+		st[events[i].sub_event_type].pkts++;
+		st[events[i].sub_event_type].cycles += wait;
+		if (wait > st[events[i].sub_event_type].max_cycles)
+			st[events[i].sub_event_type].max_cycles = wait;
+	}
+}
+
+/*
+ * Event queue of a port's class: with --event-prio each port owns
+ * nb_prio consecutive queues, otherwise one.
+ */
+static inline uint8_t
+l3fwd_event_port_queue(const struct l3fwd_event_resources *evt_rsrc,
+		uint16_t port_idx, uint8_t class)
+{
+	if (evt_rsrc->nb_prio <= 1)
+		return evt_rsrc->evq.event_q_id[port_idx];
+
+	return evt_rsrc->evq.event_q_id[port_idx * evt_rsrc->nb_prio + class];
+}
+
+/*
+ * Free the events whose packet has no egress port (mbuf->port is
+ * BAD_PORT after processing) and close the gaps, keeping the order of
+ * the others. Returns the number of events left.
+ */
+static inline int
+l3fwd_event_drop_bad_port(struct lcore_conf *lconf, struct rte_event *events,
+		int nb_deq)
+{
+	int i, n;
+
+	for (i = 0, n = 0; i < nb_deq; i++) {
+		if (unlikely(events[i].mbuf->port == BAD_PORT)) {
+			rte_pktmbuf_free(events[i].mbuf);
+			lconf->stats->bad_port_drops++;
+			continue;
+		}
+		if (n != i)
+			events[n] = events[i];
+		n++;
+	}
+
+	return n;
+}
+
 struct l3fwd_event_resources *l3fwd_get_eventdev_rsrc(void);
 void l3fwd_event_resource_setup(struct rte_eth_conf *port_conf);
 int l3fwd_get_free_event_port(struct l3fwd_event_resources *eventdev_rsrc);
 void l3fwd_event_set_generic_ops(struct l3fwd_event_setup_ops *ops);
 void l3fwd_event_set_internal_port_ops(struct l3fwd_event_setup_ops *ops);
+int l3fwd_event_prio_parse(const char *arg);
+uint8_t l3fwd_event_prio_level(uint8_t class);
+void l3fwd_event_prio_setup(void);
+void l3fwd_event_prio_rx_adapter_add(uint8_t rx_adptr_id, uint16_t port_id,
+		uint8_t base_q);
+void l3fwd_event_prio_print_stats(void);
 
 #endif /* __L3FWD_EVENTDEV_H__ */
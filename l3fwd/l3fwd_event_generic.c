@@ -40,10 +40,25 @@ l3fwd_event_device_setup_generic(void)
 	if (dev_info.event_dev_cap & RTE_EVENT_DEV_CAP_QUEUE_ALL_TYPES)
 		event_queue_cfg |= RTE_EVENT_QUEUE_CFG_ALL_TYPES;
 
-	/* One queue for each ethdev port + one Tx adapter Single link queue. */
-	event_d_conf.nb_event_queues = ethdev_count + 1;
-	if (dev_info.max_event_queues < event_d_conf.nb_event_queues)
+	/*
+	 * One queue for each ethdev port (per priority class with
+	 * --event-prio) + one Tx adapter Single link queue.
+	 */
+	event_d_conf.nb_event_queues = ethdev_count * evt_rsrc->nb_prio + 1;
+	if (dev_info.max_event_queues < event_d_conf.nb_event_queues) {
+		if (evt_rsrc->nb_prio > 1)
+			rte_panic("Event device has %u queues, %u needed for "
+				  "priority classes\n",
+				  dev_info.max_event_queues,
+				  event_d_conf.nb_event_queues);
 		event_d_conf.nb_event_queues = dev_info.max_event_queues;
+	}
+
+	if (evt_rsrc->nb_prio > 1 &&
+	    !(dev_info.event_dev_cap & (RTE_EVENT_DEV_CAP_QUEUE_QOS |
+					RTE_EVENT_DEV_CAP_EVENT_QOS)))
+		printf("Event device ignores priorities, classes only "
+		       "separate the queues\n");
 
 	if (dev_info.max_num_events < event_d_conf.nb_events_limit)
 		event_d_conf.nb_events_limit = dev_info.max_num_events;
@@ -87,9 +102,9 @@ l3fwd_event_port_setup_generic(void)
 	struct l3fwd_event_resources *evt_rsrc = l3fwd_get_eventdev_rsrc();
 	uint8_t event_d_id = evt_rsrc->event_d_id;
 	struct rte_event_port_conf event_p_conf = {
-		.dequeue_depth = 32,
-		.enqueue_depth = 32,
-		.new_event_threshold = 4096
+		.dequeue_depth = evt_rsrc->port_deq_depth,
+		.enqueue_depth = evt_rsrc->port_enq_depth,
+		.new_event_threshold = evt_rsrc->new_event_threshold
 	};
 	struct rte_event_port_conf def_p_conf;
 	uint8_t event_p_id;
@@ -120,7 +135,7 @@ l3fwd_event_port_setup_generic(void)
 		event_p_conf.event_port_cfg |=
 			RTE_EVENT_PORT_CFG_DISABLE_IMPL_REL;
 
-	evt_rsrc->deq_depth = def_p_conf.dequeue_depth;
+	evt_rsrc->deq_depth = event_p_conf.dequeue_depth;
 
 	for (event_p_id = 0; event_p_id < evt_rsrc->evp.nb_ports;
 								event_p_id++) {
@@ -175,6 +190,9 @@ l3fwd_event_queue_setup_generic(uint32_t event_queue_cfg)
 
 	for (event_q_id = 0; event_q_id < (evt_rsrc->evq.nb_queues - 1);
 								event_q_id++) {
+		if (evt_rsrc->nb_prio > 1)
+			event_q_conf.priority = l3fwd_event_prio_level(
+					event_q_id % evt_rsrc->nb_prio);
 		ret = rte_event_queue_setup(event_d_id, event_q_id,
 					    &event_q_conf);
 		if (ret < 0)
@@ -226,11 +244,15 @@ l3fwd_rx_tx_adapter_setup_generic(void)
 	RTE_ETH_FOREACH_DEV(port_id) {
 		if ((evt_rsrc->port_mask & (1 << port_id)) == 0)
 			continue;
-		eth_q_conf.ev.queue_id = evt_rsrc->evq.event_q_id[i];
+		eth_q_conf.ev.queue_id = l3fwd_event_port_queue(evt_rsrc, i,
+						L3FWD_EVENT_PRIO_NORMAL);
 		ret = rte_event_eth_rx_adapter_queue_add(rx_adptr_id, port_id,
 							 -1, &eth_q_conf);
 		if (ret)
 			rte_panic("Failed to add queues to Rx adapter\n");
+		if (evt_rsrc->nb_prio > 1)
+			l3fwd_event_prio_rx_adapter_add(rx_adptr_id, port_id,
+				l3fwd_event_port_queue(evt_rsrc, i, 0));
 		if (i < evt_rsrc->evq.nb_queues)
 			i++;
 	}
@@ -86,9 +86,9 @@ l3fwd_event_port_setup_internal_port(void)
 	struct l3fwd_event_resources *evt_rsrc = l3fwd_get_eventdev_rsrc();
 	uint8_t event_d_id = evt_rsrc->event_d_id;
 	struct rte_event_port_conf event_p_conf = {
-		.dequeue_depth = 32,
-		.enqueue_depth = 32,
-		.new_event_threshold = 4096
+		.dequeue_depth = evt_rsrc->port_deq_depth,
+		.enqueue_depth = evt_rsrc->port_enq_depth,
+		.new_event_threshold = evt_rsrc->new_event_threshold
 	};
 	struct rte_event_port_conf def_p_conf;
 	uint8_t event_p_id;
@@ -118,6 +118,8 @@ l3fwd_event_port_setup_internal_port(void)
 		event_p_conf.event_port_cfg |=
 			RTE_EVENT_PORT_CFG_DISABLE_IMPL_REL;
 
+	evt_rsrc->deq_depth = event_p_conf.dequeue_depth;
+
 	for (event_p_id = 0; event_p_id < evt_rsrc->evp.nb_ports;
 								event_p_id++) {
 		ret = rte_event_port_setup(event_d_id, event_p_id,
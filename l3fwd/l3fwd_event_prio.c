@@ -0,0 +1,254 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+/*
+ * Priority event queues (--event-prio=dscp|pcp).
+ *
+ * Each ethdev port feeds L3FWD_EVENT_NB_PRIO event queues of decreasing
+ * priority instead of one. A callback on the SW Rx adapter classifies
+ * every packet by the class selector bits of its DSCP, or by its VLAN
+ * PCP, and moves the event to the queue of that class. The workers are
+ * linked to all of them, so the scheduler serves control traffic ahead
+ * of bulk traffic when the workers fall behind.
+ *
+ * The callback also writes the TSC into an mbuf dynfield; the workers
+ * account the time each event waited before dequeue per class.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_errno.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_lcore.h>
+#include <rte_mbuf.h>
+#include <rte_mbuf_dyn.h>
+#include <rte_telemetry.h>
+#include <rte_time.h>
+
+#include "l3fwd.h"
+#include "l3fwd_event.h"
+
+int l3fwd_event_tsc_dynfield_offset = -1;
+struct l3fwd_event_prio_lcore_stats l3fwd_event_prio_stats[RTE_MAX_LCORE];
+
+static const char * const prio_class_name[L3FWD_EVENT_NB_PRIO] = {
+	"high", "normal", "low",
+};
+
+static const uint8_t prio_class_level[L3FWD_EVENT_NB_PRIO] = {
+	RTE_EVENT_DEV_PRIORITY_HIGHEST,
+	RTE_EVENT_DEV_PRIORITY_NORMAL,
+	RTE_EVENT_DEV_PRIORITY_LOWEST,
+};
+
+/*
+ * Class of a 3-bit PCP or DSCP class selector: 1 (background) is low,
+ * 5 and above (video/voice, EF, network control) is high.
+ */
+static const uint8_t prio_class_of_cs[8] = {
+	L3FWD_EVENT_PRIO_NORMAL, L3FWD_EVENT_PRIO_LOW,
+	L3FWD_EVENT_PRIO_NORMAL, L3FWD_EVENT_PRIO_NORMAL,
+	L3FWD_EVENT_PRIO_NORMAL, L3FWD_EVENT_PRIO_HIGH,
+	L3FWD_EVENT_PRIO_HIGH, L3FWD_EVENT_PRIO_HIGH,
+};
+
+/* First event queue of each ethdev port, the others follow by class. */
+static uint8_t prio_base_q[RTE_MAX_ETHPORTS];
+
+int
+l3fwd_event_prio_parse(const char *arg)
+{
+	struct l3fwd_event_resources *evt_rsrc = l3fwd_get_eventdev_rsrc();
+
+	if (!strcmp(arg, "dscp"))
+		evt_rsrc->prio_mode = L3FWD_EVENT_PRIO_DSCP;
+	else if (!strcmp(arg, "pcp"))
+		evt_rsrc->prio_mode = L3FWD_EVENT_PRIO_PCP;
+	else
+		return -1;
+
+	evt_rsrc->nb_prio = L3FWD_EVENT_NB_PRIO;
+	return 0;
+}
+
+uint8_t
+l3fwd_event_prio_level(uint8_t class)
+{
+	return prio_class_level[class];
+}
+
+static inline uint8_t
+prio_classify(struct rte_mbuf *m, uint8_t mode)
+{
+	struct rte_ether_hdr *eth_hdr;
+	struct rte_vlan_hdr *vlan_hdr;
+	struct rte_ipv4_hdr *ipv4_hdr;
+	struct rte_ipv6_hdr *ipv6_hdr;
+	uint16_t ether_type;
+	void *l3;
+
+	if (mode == L3FWD_EVENT_PRIO_PCP && (m->ol_flags & PKT_RX_VLAN_STRIPPED))
+		return prio_class_of_cs[m->vlan_tci >> 13];
+
+	eth_hdr = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+	ether_type = eth_hdr->ether_type;
+	l3 = eth_hdr + 1;
+	if (ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_VLAN)) {
+		vlan_hdr = l3;
+		if (mode == L3FWD_EVENT_PRIO_PCP)
+			return prio_class_of_cs[
+				rte_be_to_cpu_16(vlan_hdr->vlan_tci) >> 13];
+		ether_type = vlan_hdr->eth_proto;
+		l3 = vlan_hdr + 1;
+	}
+
+	if (mode == L3FWD_EVENT_PRIO_PCP)
+		return L3FWD_EVENT_PRIO_NORMAL;
+
+	if (ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4)) {
+		ipv4_hdr = l3;
+		return prio_class_of_cs[ipv4_hdr->type_of_service >> 5];
+	}
+
+	if (ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6)) {
+		ipv6_hdr = l3;
+		return prio_class_of_cs[
+			(rte_be_to_cpu_32(ipv6_hdr->vtc_flow) >> 25) & 0x7];
+	}
+
+	return L3FWD_EVENT_PRIO_NORMAL;
+}
+
+/* Rx adapter callback: runs on the adapter service before enqueue. */
+static uint16_t
+prio_rx_cb(uint16_t eth_dev_id, uint16_t queue_id __rte_unused,
+		uint32_t enqueue_buf_size __rte_unused,
+		uint32_t enqueue_buf_count __rte_unused,
+		struct rte_event *ev, uint16_t nb_event, void *cb_arg,
+		uint16_t *nb_dropped)
+{
+	const uint8_t mode = (uint8_t)(uintptr_t)cb_arg;
+	const uint8_t base_q = prio_base_q[eth_dev_id];
+	const uint64_t now = rte_rdtsc();
+	uint8_t class;
+	uint16_t i;
+
+	for (i = 0; i < nb_event; i++) {
+		class = prio_classify(ev[i].mbuf, mode);
+		ev[i].queue_id = base_q + class;
+		ev[i].priority = prio_class_level[class];
+		ev[i].sub_event_type = class;
+		*l3fwd_event_tsc(ev[i].mbuf) = now;
+	}
+
+	*nb_dropped = 0;
+	return nb_event;
+}
+
+void
+l3fwd_event_prio_rx_adapter_add(uint8_t rx_adptr_id, uint16_t port_id,
+		uint8_t base_q)
+{
+	struct l3fwd_event_resources *evt_rsrc = l3fwd_get_eventdev_rsrc();
+	int ret;
+
+	prio_base_q[port_id] = base_q;
+	ret = rte_event_eth_rx_adapter_cb_register(rx_adptr_id, port_id,
+			prio_rx_cb, (void *)(uintptr_t)evt_rsrc->prio_mode);
+	if (ret)
+		rte_exit(EXIT_FAILURE,
+			 "Priority queues need a SW Rx adapter, port %u: "
+			 "err=%d\n", port_id, ret);
+}
+
+static void
+prio_stats_sum(uint8_t class, struct l3fwd_event_prio_stats *sum)
+{
+	const struct l3fwd_event_prio_stats *st;
+	unsigned int lcore_id;
+
+	memset(sum, 0, sizeof(*sum));
+	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+		st = &l3fwd_event_prio_stats[lcore_id].class[class];
+		sum->pkts += st->pkts;
+		sum->cycles += st->cycles;
+		sum->max_cycles = RTE_MAX(sum->max_cycles, st->max_cycles);
+	}
+}
+
+static inline uint64_t
+cycles_to_ns(uint64_t cycles)
+{
+	return cycles * NS_PER_S / rte_get_tsc_hz();
+}
+
+static int
+handle_event_prio(const char *cmd __rte_unused,
+		const char *params __rte_unused, struct rte_tel_data *d)
+{
+	struct l3fwd_event_prio_stats sum;
+	struct rte_tel_data *st;
+	uint8_t class;
+
+	rte_tel_data_start_dict(d);
+	for (class = 0; class < L3FWD_EVENT_NB_PRIO; class++) {
+		st = rte_tel_data_alloc();
+		if (st == NULL)
+			return -ENOMEM;
+
+		prio_stats_sum(class, &sum);
+		rte_tel_data_start_dict(st);
+		rte_tel_data_add_dict_u64(st, "pkts", sum.pkts);
+		rte_tel_data_add_dict_u64(st, "avg_ns",
+			sum.pkts ? cycles_to_ns(sum.cycles / sum.pkts) : 0);
+		rte_tel_data_add_dict_u64(st, "max_ns",
+			cycles_to_ns(sum.max_cycles));
+		rte_tel_data_add_dict_container(d, prio_class_name[class],
+			st, 0);
+	}
+
+	return 0;
+}
+
+void
+l3fwd_event_prio_setup(void)
+{
+	static const struct rte_mbuf_dynfield tsc_dynfield_desc = {
+		.name = "l3fwd_dynfield_event_tsc",
+		.size = sizeof(uint64_t),
+		.align = __alignof__(uint64_t),
+	};
+
+	l3fwd_event_tsc_dynfield_offset =
+		rte_mbuf_dynfield_register(&tsc_dynfield_desc);
+	if (l3fwd_event_tsc_dynfield_offset < 0)
+		rte_exit(EXIT_FAILURE, "Cannot register mbuf field: %s\n",
+			 rte_strerror(rte_errno));
+
+	rte_telemetry_register_cmd("/l3fwd/event_prio", handle_event_prio,
+		"Returns event queue wait per priority class. No parameters");
+}
+
+void
+l3fwd_event_prio_print_stats(void)
+{
+	struct l3fwd_event_prio_stats sum;
+	uint8_t class;
+
+	printf("\nEvent queue wait per priority:\n");
+	for (class = 0; class < L3FWD_EVENT_NB_PRIO; class++) {
+		prio_stats_sum(class, &sum);
+		printf("  %-6s pkts %"PRIu64" avg %"PRIu64" ns max %"PRIu64
+			" ns\n", prio_class_name[class], sum.pkts,
+			sum.pkts ? cycles_to_ns(sum.cycles / sum.pkts) : 0,
+			cycles_to_ns(sum.max_cycles));
+	}
+}
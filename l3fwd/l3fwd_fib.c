@@ -0,0 +1,496 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <sys/types.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+#include <rte_debug.h>
+#include <rte_ether.h>
+#include <rte_ethdev.h>
+#include <rte_cycles.h>
+#include <rte_cpuflags.h>
+#include <rte_mbuf.h>
+#include <rte_ip.h>
+#include <rte_vect.h>
+#include <rte_fib.h>
+#include <rte_fib6.h>
+
+#include "l3fwd.h"
+#include "l3fwd_idle.h"
+#include "l3fwd_drain.h"
+#include "l3fwd_route.h"
+
+#if defined RTE_ARCH_X86
+#include "l3fwd_sse.h"
+#elif defined __ARM_NEON
+#include "l3fwd_neon.h"
+#elif defined RTE_ARCH_PPC_64
+#include "l3fwd_altivec.h"
+#endif
+
+#define IPV4_L3FWD_FIB_MAX_RULES	1024
+#define IPV4_L3FWD_FIB_NUMBER_TBL8S	(1 << 8)
+#define IPV6_L3FWD_FIB_MAX_RULES	1024
+#define IPV6_L3FWD_FIB_NUMBER_TBL8S	(1 << 16)
+
+/*
+ * Next hop returned by the FIB when no route matches. Must fit into the
+ * 15 bits a 2-byte DIR-24-8/trie entry leaves for the next hop.
+ */
+#define FIB_DEFAULT_HOP		999
+
+static struct rte_fib *ipv4_l3fwd_fib_lookup_struct[NB_SOCKETS];
+static struct rte_fib6 *ipv6_l3fwd_fib_lookup_struct[NB_SOCKETS];
+
+/*
+ * Sort the packets of a burst into an IPv4 and an IPv6 lane and collect
+ * their destination addresses, so each lane can be resolved with one
+ * bulk FIB lookup. ip_type records the lane of every packet for the merge.
+ */
+static inline void
+fib_parse_packet(struct rte_mbuf *mbuf,
+		uint32_t *ipv4, uint32_t *ipv4_cnt,
+		uint8_t ipv6[RTE_FIB6_IPV6_ADDR_SIZE], uint32_t *ipv6_cnt,
+		uint8_t *ip_type)
+{
+	struct rte_ether_hdr *eth_hdr;
+	struct rte_ipv4_hdr *ipv4_hdr;
+	struct rte_ipv6_hdr *ipv6_hdr;
+
+	eth_hdr = rte_pktmbuf_mtod(mbuf, struct rte_ether_hdr *);
+
+	if (RTE_ETH_IS_IPV4_HDR(mbuf->packet_type)) {
+		ipv4_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
+		*ipv4 = rte_be_to_cpu_32(ipv4_hdr->dst_addr);
+		*ip_type = RTE_PTYPE_L3_IPV4;
+		(*ipv4_cnt)++;
+	} else if (RTE_ETH_IS_IPV6_HDR(mbuf->packet_type)) {
+		ipv6_hdr = (struct rte_ipv6_hdr *)(eth_hdr + 1);
+		rte_mov16(ipv6, (const uint8_t *)ipv6_hdr->dst_addr);
+		*ip_type = RTE_PTYPE_L3_IPV6;
+		(*ipv6_cnt)++;
+	} else
+		*ip_type = 0;
+}
+
+#if !defined RTE_ARCH_X86 && !defined __ARM_NEON && !defined RTE_ARCH_PPC_64
+static inline void
+fib_process_packet(struct rte_mbuf *m, uint16_t *dst_port)
+{
+#ifdef DO_RFC_1812_CHECKS
+	if (RTE_ETH_IS_IPV4_HDR(m->packet_type)) {
+		struct rte_ipv4_hdr *ipv4_hdr;
+
+		ipv4_hdr = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *,
+				sizeof(struct rte_ether_hdr));
+		if (is_valid_ipv4_pkt(ipv4_hdr, m->pkt_len) < 0) {
+			*dst_port = BAD_PORT;
+			return;
+		}
+		/* Update time to live and header checksum */
+		--(ipv4_hdr->time_to_live);
+		++(ipv4_hdr->hdr_checksum);
+	}
+#endif
+	/* dst and src addr from the next hop adjacency */
+	*dst_port = l3fwd_adj_forward(m, *dst_port, m->port);
+}
+#endif
+
+/*
+ * Resolve a whole rx burst with at most one rte_fib_lookup_bulk() and one
+ * rte_fib6_lookup_bulk() call, then merge the next hops back in packet order.
+ */
+static inline void
+fib_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
+		uint16_t portid, struct lcore_conf *qconf)
+{
+	uint32_t ipv4_arr[MAX_PKT_BURST];
+	uint8_t ipv6_arr[MAX_PKT_BURST][RTE_FIB6_IPV6_ADDR_SIZE];
+	uint64_t hopsv4[MAX_PKT_BURST], hopsv6[MAX_PKT_BURST];
+	uint16_t hops[MAX_PKT_BURST];
+	uint8_t type_arr[MAX_PKT_BURST];
+	uint32_t ipv4_cnt = 0, ipv6_cnt = 0;
+	uint32_t ipv4_arr_assem = 0, ipv6_arr_assem = 0;
+	uint64_t nh;
+	int32_t i;
+
+	/* Prefetch first packets. */
+	for (i = 0; i < PREFETCH_OFFSET && i < nb_rx; i++)
+		rte_prefetch0(rte_pktmbuf_mtod(pkts_burst[i], void *));
+
+	/* Parse packet info and prefetch. */
+	for (i = 0; i < (nb_rx - PREFETCH_OFFSET); i++) {
+		rte_prefetch0(rte_pktmbuf_mtod(pkts_burst[
+				i + PREFETCH_OFFSET], void *));
+		fib_parse_packet(pkts_burst[i],
+				&ipv4_arr[ipv4_cnt], &ipv4_cnt,
+				ipv6_arr[ipv6_cnt], &ipv6_cnt,
+				&type_arr[i]);
+	}
+
+	/* Parse remaining packet info. */
+	for (; i < nb_rx; i++)
+		fib_parse_packet(pkts_burst[i],
+				&ipv4_arr[ipv4_cnt], &ipv4_cnt,
+				ipv6_arr[ipv6_cnt], &ipv6_cnt,
+				&type_arr[i]);
+
+	if (likely(ipv4_cnt > 0))
+		rte_fib_lookup_bulk(qconf->ipv4_lookup_struct,
+				ipv4_arr, hopsv4, ipv4_cnt);
+
+	if (ipv6_cnt > 0)
+		rte_fib6_lookup_bulk(qconf->ipv6_lookup_struct,
+				ipv6_arr, hopsv6, ipv6_cnt);
+
+	/* Merge the IPv4 and IPv6 next hops back in packet order. */
+	for (i = 0; i < nb_rx; i++) {
+		if (type_arr[i] == RTE_PTYPE_L3_IPV4)
+			nh = hopsv4[ipv4_arr_assem++];
+		else if (type_arr[i] == RTE_PTYPE_L3_IPV6)
+			nh = hopsv6[ipv6_arr_assem++];
+		else {
+			hops[i] = portid;
+			continue;
+		}
+
+		if (likely(nh != FIB_DEFAULT_HOP))
+			hops[i] = nh;
+		else {
+			hops[i] = portid;
+			qconf->stats->lookup_miss++;
+		}
+	}
+	l3fwd_trace_lookup(portid, nb_rx);
+
+#if defined RTE_ARCH_X86 || defined __ARM_NEON \
+			 || defined RTE_ARCH_PPC_64
+	send_packets_multi(qconf, pkts_burst, hops, nb_rx);
+#else
+	for (i = 0; i < nb_rx; i++) {
+		fib_process_packet(pkts_burst[i], &hops[i]);
+		if (unlikely(hops[i] == BAD_PORT)) {
+			qconf->stats->bad_port_drops++;
+			l3fwd_drop_bulk(qconf, pkts_burst + i, 1);
+			continue;
+		}
+		send_single_packet(qconf, pkts_burst[i], hops[i]);
+	}
+#endif
+}
+
+void
+fib_process_burst(int nb_rx, struct rte_mbuf **pkts_burst, uint16_t portid,
+		struct lcore_conf *qconf)
+{
+	fib_send_packets(nb_rx, pkts_burst, portid, qconf);
+}
+
+/* main processing loop, of the instance given by flags (L3FWD_LOOP_*) */
+static __rte_always_inline int
+fib_poll_loop(const uint8_t flags)
+{
+	struct rte_mbuf *pkts_burst[MAX_PKT_BURST];
+	unsigned int lcore_id;
+	uint64_t prev_tsc, diff_tsc, cur_tsc;
+	int i, nb_rx;
+	uint16_t portid;
+	uint8_t queueid;
+	struct lcore_conf *qconf;
+	int acl_on;
+	uint64_t loop_tsc;
+	int busy = 0;
+	uint64_t drain_tsc = (rte_get_tsc_hz() + US_PER_S - 1) /
+		US_PER_S * BURST_TX_DRAIN_US;
+
+	prev_tsc = 0;
+
+	lcore_id = rte_lcore_id();
+	qconf = &lcore_conf[lcore_id];
+	acl_on = (flags & L3FWD_LOOP_EXTRA) &&
+		(qconf->acl4_ctx != NULL || qconf->acl6_ctx != NULL);
+
+	if (qconf->n_rx_queue == 0) {
+		RTE_LOG(INFO, L3FWD, "lcore %u has nothing to do\n", lcore_id);
+		return 0;
+	}
+
+	RTE_LOG(INFO, L3FWD, "entering main loop on lcore %u\n", lcore_id);
+
+	for (i = 0; i < qconf->n_rx_queue; i++) {
+
+		portid = qconf->rx_queue_list[i].port_id;
+		queueid = qconf->rx_queue_list[i].queue_id;
+		RTE_LOG(INFO, L3FWD,
+			" -- lcoreid=%u portid=%u rxqueueid=%hhu\n",
+			lcore_id, portid, queueid);
+	}
+
+	if ((flags & L3FWD_LOOP_EXTRA) && qconf->idle != NULL)
+		l3fwd_idle_start(qconf);
+	if ((flags & L3FWD_LOOP_EXTRA) && qconf->drain != NULL)
+		drain_tsc = qconf->drain->cap_tsc;
+
+	loop_tsc = rte_rdtsc();
+	while (!force_quit) {
+
+		cur_tsc = rte_rdtsc();
+		l3fwd_stats_loop(qconf->stats, cur_tsc, &loop_tsc, busy);
+		busy = 0;
+
+		/*
+		 * TX burst queue drain
+		 */
+		diff_tsc = cur_tsc - prev_tsc;
+		if (unlikely(diff_tsc > drain_tsc)) {
+
+			l3fwd_tx_drain(qconf);
+			if ((flags & L3FWD_LOOP_EXTRA) && qconf->drain != NULL)
+				drain_tsc = l3fwd_drain_tick(qconf);
+
+			prev_tsc = cur_tsc;
+		}
+
+		/*
+		 * Read packet from RX queues
+		 */
+		for (i = 0; i < qconf->n_rx_queue; ++i) {
+			portid = qconf->rx_queue_list[i].port_id;
+			queueid = qconf->rx_queue_list[i].queue_id;
+			nb_rx = rte_eth_rx_burst(portid, queueid, pkts_burst,
+				MAX_PKT_BURST);
+			if (flags & L3FWD_LOOP_SW_PTYPE)
+				lpm_cb_parse_ptype(portid, queueid, pkts_burst,
+					nb_rx, MAX_PKT_BURST, NULL);
+			l3fwd_stats_rx(qconf->stats, nb_rx);
+			if ((flags & L3FWD_LOOP_EXTRA) && qconf->drain != NULL)
+				l3fwd_drain_rx(qconf->drain, nb_rx);
+			if (nb_rx == 0)
+				continue;
+			busy = 1;
+			l3fwd_trace_rx_burst(portid, queueid, nb_rx);
+
+			/* Optional ACL stage, denied packets are freed here. */
+			if (acl_on) {
+				nb_rx = l3fwd_acl_filter(qconf, pkts_burst,
+						nb_rx);
+				if (nb_rx == 0)
+					continue;
+			}
+
+			fib_send_packets(nb_rx, pkts_burst, portid, qconf);
+		}
+
+		if ((flags & L3FWD_LOOP_EXTRA) && qconf->idle != NULL)
+			l3fwd_idle_poll(qconf, busy);
+	}
+
+	/* nothing may stay staged when the tx queues change hands */
+	l3fwd_tx_flush(qconf);
+
+	return 0;
+}
+
+/* One rte_fib and one rte_fib6 bulk lookup per burst: dual-stack only. */
+L3FWD_LOOP_DEFINE_AF(fib, ds, L3FWD_LOOP_AF)
+
+const l3fwd_main_loop_t fib_main_loops[L3FWD_LOOP_NB] = {
+	L3FWD_LOOP_ENTRIES_AF(fib, ds, L3FWD_LOOP_AF),
+};
+
+/*
+ * Switch the FIBs to the AVX-512 lookup when the CPU has it and the EAL
+ * allows 512-bit vectors (--force-max-simd-bitwidth); keep the scalar
+ * lookup otherwise or if DPDK was built without AVX-512 support.
+ */
+static void
+fib_select_lookup(const int socketid)
+{
+#if defined RTE_ARCH_X86
+	if (!rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX512F) ||
+			rte_vect_get_max_simd_bitwidth() < RTE_VECT_SIMD_512) {
+		printf("FIB: Using scalar lookup on socket %d\n", socketid);
+		return;
+	}
+
+	if (rte_fib_select_lookup(ipv4_l3fwd_fib_lookup_struct[socketid],
+			RTE_FIB_DIR24_8_VECTOR_AVX512) == 0)
+		printf("FIB: Using AVX-512 DIR-24-8 lookup on socket %d\n",
+			socketid);
+	else
+		printf("FIB: AVX-512 DIR-24-8 lookup unavailable, "
+			"using scalar lookup on socket %d\n", socketid);
+
+	if (rte_fib6_select_lookup(ipv6_l3fwd_fib_lookup_struct[socketid],
+			RTE_FIB6_TRIE_VECTOR_AVX512) == 0)
+		printf("FIB: Using AVX-512 trie lookup on socket %d\n",
+			socketid);
+	else
+		printf("FIB: AVX-512 trie lookup unavailable, "
+			"using scalar lookup on socket %d\n", socketid);
+#else
+	printf("FIB: Using scalar lookup on socket %d\n", socketid);
+#endif
+}
+
+void
+setup_fib(const int socketid)
+{
+	struct rte_fib6_conf config;
+	struct rte_fib_conf config_ipv4;
+	unsigned int i;
+	int ret;
+	char s[64];
+	char abuf[INET6_ADDRSTRLEN];
+
+	/* create the IPv4 FIB (DIR-24-8) */
+	memset(&config_ipv4, 0, sizeof(config_ipv4));
+	config_ipv4.type = RTE_FIB_DIR24_8;
+	config_ipv4.max_routes = IPV4_L3FWD_FIB_MAX_RULES;
+	config_ipv4.default_nh = FIB_DEFAULT_HOP;
+	config_ipv4.dir24_8.nh_sz = RTE_FIB_DIR24_8_2B;
+	config_ipv4.dir24_8.num_tbl8 = IPV4_L3FWD_FIB_NUMBER_TBL8S;
+	snprintf(s, sizeof(s), "IPV4_L3FWD_FIB_%d", socketid);
+	ipv4_l3fwd_fib_lookup_struct[socketid] =
+			rte_fib_create(s, socketid, &config_ipv4);
+	if (ipv4_l3fwd_fib_lookup_struct[socketid] == NULL)
+		rte_exit(EXIT_FAILURE,
+			"Unable to create the l3fwd FIB table on socket %d\n",
+			socketid);
+
+	/* populate the IPv4 FIB */
+	for (i = 0; i < RTE_DIM(ipv4_l3fwd_route_array); i++) {
+		struct in_addr in;
+
+		/* skip unused ports */
+		if ((1 << ipv4_l3fwd_route_array[i].if_out &
+				enabled_port_mask) == 0)
+			continue;
+
+		ret = rte_fib_add(ipv4_l3fwd_fib_lookup_struct[socketid],
+			ipv4_l3fwd_route_array[i].ip,
+			ipv4_l3fwd_route_array[i].depth,
+			ipv4_l3fwd_route_array[i].if_out);
+
+		if (ret < 0) {
+			rte_exit(EXIT_FAILURE,
+				"Unable to add entry %u to the l3fwd FIB table on socket %d\n",
+				i, socketid);
+		}
+
+		in.s_addr = htonl(ipv4_l3fwd_route_array[i].ip);
+		printf("FIB: Adding route %s / %d (%d)\n",
+		       inet_ntop(AF_INET, &in, abuf, sizeof(abuf)),
+			ipv4_l3fwd_route_array[i].depth,
+			ipv4_l3fwd_route_array[i].if_out);
+	}
+
+	/* routes to next hops and ECMP groups given with --route */
+	for (i = 0; i < ipv4_l3fwd_nh_route_num; i++) {
+		const struct ipv4_l3fwd_nh_route *r =
+			&ipv4_l3fwd_nh_route_array[i];
+		struct in_addr in;
+
+		/* skip next hops behind unused ports */
+		if (!l3fwd_adj_nh_usable(r->nh))
+			continue;
+
+		ret = rte_fib_add(ipv4_l3fwd_fib_lookup_struct[socketid], r->ip, r->depth, r->nh);
+		if (ret < 0) {
+			rte_exit(EXIT_FAILURE,
+				"Unable to add route %u to the l3fwd FIB table on socket %d\n",
+				i, socketid);
+		}
+
+		in.s_addr = htonl(r->ip);
+		printf("FIB: Adding route %s / %d (nh %#x)\n",
+		       inet_ntop(AF_INET, &in, abuf, sizeof(abuf)),
+		       r->depth, r->nh);
+	}
+
+	/* create the IPv6 FIB (trie) */
+	memset(&config, 0, sizeof(config));
+	config.type = RTE_FIB6_TRIE;
+	config.max_routes = IPV6_L3FWD_FIB_MAX_RULES;
+	config.default_nh = FIB_DEFAULT_HOP;
+	config.trie.nh_sz = RTE_FIB6_TRIE_2B;
+	config.trie.num_tbl8 = IPV6_L3FWD_FIB_NUMBER_TBL8S;
+	snprintf(s, sizeof(s), "IPV6_L3FWD_FIB_%d", socketid);
+	ipv6_l3fwd_fib_lookup_struct[socketid] =
+			rte_fib6_create(s, socketid, &config);
+	if (ipv6_l3fwd_fib_lookup_struct[socketid] == NULL)
+		rte_exit(EXIT_FAILURE,
+			"Unable to create the l3fwd FIB6 table on socket %d\n",
+			socketid);
+
+	/* populate the IPv6 FIB */
+	for (i = 0; i < RTE_DIM(ipv6_l3fwd_route_array); i++) {
+
+		/* skip unused ports */
+		if ((1 << ipv6_l3fwd_route_array[i].if_out &
+				enabled_port_mask) == 0)
+			continue;
+
+		ret = rte_fib6_add(ipv6_l3fwd_fib_lookup_struct[socketid],
+			ipv6_l3fwd_route_array[i].ip,
+			ipv6_l3fwd_route_array[i].depth,
+			ipv6_l3fwd_route_array[i].if_out);
+
+		if (ret < 0) {
+			rte_exit(EXIT_FAILURE,
+				"Unable to add entry %u to the l3fwd FIB6 table on socket %d\n",
+				i, socketid);
+		}
+
+		printf("FIB: Adding route %s / %d (%d)\n",
+		       inet_ntop(AF_INET6, ipv6_l3fwd_route_array[i].ip,
+				 abuf, sizeof(abuf)),
+		       ipv6_l3fwd_route_array[i].depth,
+		       ipv6_l3fwd_route_array[i].if_out);
+	}
+
+	/* routes to next hops and ECMP groups given with --route */
+	for (i = 0; i < ipv6_l3fwd_nh_route_num; i++) {
+		const struct ipv6_l3fwd_nh_route *r =
+			&ipv6_l3fwd_nh_route_array[i];
+
+		/* skip next hops behind unused ports */
+		if (!l3fwd_adj_nh_usable(r->nh))
+			continue;
+
+		ret = rte_fib6_add(ipv6_l3fwd_fib_lookup_struct[socketid], r->ip, r->depth, r->nh);
+		if (ret < 0) {
+			rte_exit(EXIT_FAILURE,
+				"Unable to add route %u to the l3fwd FIB6 table on socket %d\n",
+				i, socketid);
+		}
+
+		printf("FIB: Adding route %s / %d (nh %#x)\n",
+		       inet_ntop(AF_INET6, r->ip, abuf, sizeof(abuf)),
+		       r->depth, r->nh);
+	}
+
+	fib_select_lookup(socketid);
+}
+
+/* Return ipv4/ipv6 fib fwd lookup struct. */
+void *
+fib_get_ipv4_l3fwd_lookup_struct(const int socketid)
+{
+	return ipv4_l3fwd_fib_lookup_struct[socketid];
+}
+
+void *
+fib_get_ipv6_l3fwd_lookup_struct(const int socketid)
+{
+	return ipv6_l3fwd_fib_lookup_struct[socketid];
+}
@@ -0,0 +1,160 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+/*
+ * Setup, invalidation and counters of the per-lcore flow cache
+ * (--flow-cache[=ENTRIES]); the lookup side is in l3fwd_flow_cache.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+
+#include <rte_common.h>
+#include <rte_ether.h>
+#include <rte_ip.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_mbuf.h>
+#include <rte_telemetry.h>
+
+#include "l3fwd.h"
+#include "l3fwd_flow_cache.h"
+
+#define FLOW_CACHE_DEF_ENTRIES	4096	/* 128 KB: stays in L2 */
+#define FLOW_CACHE_MAX_ENTRIES	(1 << 20)
+
+/* Generation 0 is that of the zeroed entries, never valid. */
+uint32_t l3fwd_flow_cache_gen = 1;
+
+static uint32_t flow_cache_entries;
+
+int
+l3fwd_flow_cache_parse(const char *arg)
+{
+	unsigned long n;
+	char *end;
+
+	if (arg == NULL) {
+		flow_cache_entries = FLOW_CACHE_DEF_ENTRIES;
+		return 0;
+	}
+
+	errno = 0;
+	n = strtoul(arg, &end, 0);
+	if (errno != 0 || *arg == '\0' || *end != '\0' || n == 0 ||
+			n > FLOW_CACHE_MAX_ENTRIES || !rte_is_power_of_2(n))
+		return -1;
+
+	flow_cache_entries = n;
+	return 0;
+}
+
+/* Drop the entries of every lcore, on the next burst of each. */
+void
+l3fwd_flow_cache_invalidate(void)
+{
+	uint32_t gen;
+
+	gen = __atomic_add_fetch(&l3fwd_flow_cache_gen, 1, __ATOMIC_RELEASE);
+	if (gen == 0)
+		__atomic_store_n(&l3fwd_flow_cache_gen, 1, __ATOMIC_RELEASE);
+}
+
+static void
+flow_cache_sum(uint64_t *hits, uint64_t *misses)
+{
+	unsigned int lcore_id;
+
+	*hits = 0;
+	*misses = 0;
+	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+		*hits += l3fwd_lcore_stats[lcore_id].flow_cache_hits;
+		*misses += l3fwd_lcore_stats[lcore_id].flow_cache_misses;
+	}
+}
+
+static int
+handle_flow_cache(const char *cmd __rte_unused,
+		const char *params __rte_unused, struct rte_tel_data *d)
+{
+	uint64_t hits, misses;
+
+	flow_cache_sum(&hits, &misses);
+
+	rte_tel_data_start_dict(d);
+	rte_tel_data_add_dict_u64(d, "entries", flow_cache_entries);
+	rte_tel_data_add_dict_u64(d, "generation",
+		__atomic_load_n(&l3fwd_flow_cache_gen, __ATOMIC_RELAXED));
+	rte_tel_data_add_dict_u64(d, "hits", hits);
+	rte_tel_data_add_dict_u64(d, "misses", misses);
+	/* in 1/10000, telemetry has no floating point values */
+	rte_tel_data_add_dict_u64(d, "hit_rate_bp",
+		hits + misses ? hits * 10000 / (hits + misses) : 0);
+
+	return 0;
+}
+
+static int
+handle_flow_cache_invalidate(const char *cmd __rte_unused,
+		const char *params __rte_unused, struct rte_tel_data *d)
+{
+	l3fwd_flow_cache_invalidate();
+
+	rte_tel_data_start_dict(d);
+	rte_tel_data_add_dict_u64(d, "generation",
+		__atomic_load_n(&l3fwd_flow_cache_gen, __ATOMIC_RELAXED));
+
+	return 0;
+}
+
+/* Allocate the cache of every lcore on its socket. */
+void
+l3fwd_flow_cache_setup(int numa_on)
+{
+	struct l3fwd_flow_cache *fc;
+	unsigned int lcore_id;
+	int socketid;
+
+	if (flow_cache_entries == 0)
+		return;
+
+	RTE_LCORE_FOREACH(lcore_id) {
+		socketid = numa_on ? (int)rte_lcore_to_socket_id(lcore_id) : 0;
+		fc = rte_zmalloc_socket("flow_cache", sizeof(*fc) +
+			sizeof(fc->entries[0]) * flow_cache_entries,
+			RTE_CACHE_LINE_SIZE, socketid);
+		if (fc == NULL)
+			rte_exit(EXIT_FAILURE,
+				"Cannot allocate the flow cache of lcore %u\n",
+				lcore_id);
+		fc->mask = flow_cache_entries - 1;
+		lcore_conf[lcore_id].flow_cache = fc;
+	}
+
+	rte_telemetry_register_cmd("/l3fwd/flow_cache", handle_flow_cache,
+		"Returns flow cache hits and misses of all lcores. No parameters");
+	rte_telemetry_register_cmd("/l3fwd/flow_cache_invalidate",
+		handle_flow_cache_invalidate,
+		"Drops the flow cache entries of all lcores. No parameters");
+
+	printf("Flow cache: %u entries per lcore\n", flow_cache_entries);
+}
+
+void
+l3fwd_flow_cache_print_stats(void)
+{
+	uint64_t hits, misses;
+
+	if (flow_cache_entries == 0)
+		return;
+
+	flow_cache_sum(&hits, &misses);
+	printf("\nFlow cache: hits %" PRIu64 " misses %" PRIu64
+		" hit rate %.2f%%\n", hits, misses,
+		hits + misses ? 100.0 * hits / (hits + misses) : 0.0);
+}
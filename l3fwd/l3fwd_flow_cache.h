@@ -0,0 +1,159 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+#ifndef __L3FWD_FLOW_CACHE_H__
+#define __L3FWD_FLOW_CACHE_H__
+
+/*
+ * Per-lcore flow cache (--flow-cache): a direct-mapped table in front of
+ * the LPM and EM lookups, indexed by the RSS hash of the packet and
+ * checked against its destination IPv4 address (LPM) or its 5-tuple
+ * (EM) and rx port. Hits take the next hop from the cache, the misses of
+ * a burst are compacted and looked up by the usual vector path, then
+ * written to the cache.
+ *
+ * Entries are only valid while their generation matches
+ * l3fwd_flow_cache_gen, so bumping it drops every cache at once.
+ */
+
+#include <rte_hash_crc.h>
+
+struct l3fwd_flow_cache_entry {
+	uint32_t gen;		/**< valid while equal to l3fwd_flow_cache_gen */
+	uint32_t ip_dst;	/**< key, network byte order */
+	uint32_t ip_src;	/**< key, EM only */
+	uint32_t ports;		/**< key, EM only */
+	uint16_t rx_port;	/**< key */
+	uint16_t hop;		/**< lookup result */
+	uint8_t proto;		/**< key, EM only */
+} __rte_aligned(32);
+
+struct l3fwd_flow_cache {
+	uint32_t mask;		/**< number of entries - 1 */
+	struct l3fwd_flow_cache_entry entries[] __rte_aligned(32);
+};
+
+/*
+ * Look up the next hops of a burst, as l3fwd_lpm_process_packets().
+ * portid is only used as the next hop of packets without a route.
+ */
+typedef void (*l3fwd_flow_cache_lookup_t)(int nb_rx,
+		struct rte_mbuf **pkts_burst, uint16_t portid,
+		uint16_t *dst_port, struct lcore_conf *qconf);
+
+/*
+ * Fill the key of an IPv4 packet; the 5-tuple only with full_key, else
+ * just the destination. Returns 0 for packets the cache does not take.
+ */
+static __rte_always_inline int
+l3fwd_flow_cache_key(struct rte_mbuf *m, int full_key,
+		struct l3fwd_flow_cache_entry *k, uint32_t *hash)
+{
+	const struct rte_ipv4_hdr *ipv4_hdr;
+
+	if (!RTE_ETH_IS_IPV4_HDR(m->packet_type))
+		return 0;
+	if (full_key && !(m->packet_type &
+			(RTE_PTYPE_L4_TCP | RTE_PTYPE_L4_UDP)))
+		return 0;
+
+	ipv4_hdr = rte_pktmbuf_mtod_offset(m, const struct rte_ipv4_hdr *,
+			sizeof(struct rte_ether_hdr));
+	k->ip_dst = ipv4_hdr->dst_addr;
+	if (full_key) {
+		/* as get_ipv4_5tuple(): ports right behind a 20 byte header */
+		k->ip_src = ipv4_hdr->src_addr;
+		k->ports = *(const uint32_t *)(ipv4_hdr + 1);
+		k->proto = ipv4_hdr->next_proto_id;
+	} else {
+		k->ip_src = 0;
+		k->ports = 0;
+		k->proto = 0;
+	}
+
+	if (m->ol_flags & PKT_RX_RSS_HASH)
+		*hash = m->hash.rss;
+	else
+		*hash = rte_hash_crc_4byte(k->ip_dst, k->ip_src ^ k->ports);
+
+	return 1;
+}
+
+static __rte_always_inline int
+l3fwd_flow_cache_match(const struct l3fwd_flow_cache_entry *e,
+		const struct l3fwd_flow_cache_entry *k, uint32_t gen,
+		uint16_t portid)
+{
+	return e->gen == gen && e->ip_dst == k->ip_dst &&
+		e->rx_port == portid && e->ip_src == k->ip_src &&
+		e->ports == k->ports && e->proto == k->proto;
+}
+
+/*
+ * Next hops of a burst received on portid into dst_port, from the cache
+ * of the lcore where possible, else from lookup().
+ */
+static __rte_always_inline void
+l3fwd_flow_cache_process(int nb_rx, struct rte_mbuf **pkts_burst,
+		uint16_t portid, uint16_t *dst_port, struct lcore_conf *qconf,
+		int full_key, l3fwd_flow_cache_lookup_t lookup)
+{
+	struct l3fwd_flow_cache *fc = qconf->flow_cache;
+	const uint32_t gen = __atomic_load_n(&l3fwd_flow_cache_gen,
+			__ATOMIC_RELAXED);
+	struct l3fwd_flow_cache_entry key[MAX_PKT_BURST];
+	struct l3fwd_flow_cache_entry *slot[MAX_PKT_BURST];
+	struct rte_mbuf *lane[MAX_PKT_BURST];
+	uint16_t idx[MAX_PKT_BURST];
+	uint16_t dst[MAX_PKT_BURST];
+	struct l3fwd_flow_cache_entry *e;
+	uint32_t hash, hits = 0;
+	int i, n;
+
+	for (i = 0, n = 0; i < nb_rx; i++) {
+		slot[n] = NULL;
+		if (l3fwd_flow_cache_key(pkts_burst[i], full_key, &key[n],
+				&hash)) {
+			e = &fc->entries[hash & fc->mask];
+			if (l3fwd_flow_cache_match(e, &key[n], gen, portid)) {
+				dst_port[i] = e->hop;
+				hits++;
+				continue;
+			}
+			slot[n] = e;
+		}
+		lane[n] = pkts_burst[i];
+		idx[n++] = i;
+	}
+
+	qconf->stats->flow_cache_hits += hits;
+	qconf->stats->flow_cache_misses += nb_rx - hits;
+	if (n == 0)
+		return;
+
+	/*
+	 * BAD_PORT as the rx port makes the packets without a route come
+	 * back as BAD_PORT. They are sent back out of the rx port as usual
+	 * but kept out of the cache, so that lookup_miss counts them all;
+	 * the other packets of the burst are cached.
+	 */
+	lookup(n, lane, BAD_PORT, dst, qconf);
+
+	for (i = 0; i < n; i++) {
+		if (unlikely(dst[i] == BAD_PORT)) {
+			dst_port[idx[i]] = portid;
+			continue;
+		}
+		dst_port[idx[i]] = dst[i];
+		e = slot[i];
+		if (e == NULL)
+			continue;
+		*e = key[i];
+		e->rx_port = portid;
+		e->hop = dst[i];
+		e->gen = gen;
+	}
+}
+
+#endif /* __L3FWD_FLOW_CACHE_H__ */
@@ -0,0 +1,264 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+/*
+ * Setup, rx interrupt sleep and counters of the adaptive polling
+ * (--adaptive-poll); the per iteration side is in l3fwd_idle.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_ethdev.h>
+#include <rte_interrupts.h>
+#include <rte_lcore.h>
+#include <rte_malloc.h>
+#include <rte_telemetry.h>
+
+#include "l3fwd.h"
+#include "l3fwd_idle.h"
+
+#define IDLE_DEF_PAUSE_POLLS	100
+#define IDLE_DEF_SLEEP_POLLS	1000
+#define IDLE_MAX_POLLS		(1 << 24)
+/*
+ * Upper bound of a sleep: a packet that arrived before the interrupt was
+ * armed may raise none, and the signal handler does not wake us either.
+ */
+#define IDLE_SLEEP_MS		10
+
+static uint32_t idle_pause_polls;
+static uint32_t idle_sleep_polls;
+
+static int
+parse_polls(const char *s, char **end, uint32_t *val)
+{
+	unsigned long n;
+
+	errno = 0;
+	n = strtoul(s, end, 10);
+	if (errno != 0 || *end == s || n == 0 || n > IDLE_MAX_POLLS)
+		return -1;
+
+	*val = n;
+	return 0;
+}
+
+/* [PAUSE[,SLEEP]]: empty polls before the pause back off and the sleep */
+int
+l3fwd_idle_parse(const char *arg)
+{
+	char *end;
+
+	idle_pause_polls = IDLE_DEF_PAUSE_POLLS;
+	idle_sleep_polls = IDLE_DEF_SLEEP_POLLS;
+	if (arg == NULL)
+		return 0;
+
+	if (parse_polls(arg, &end, &idle_pause_polls) < 0)
+		return -1;
+	if (*end == ',') {
+		arg = end + 1;
+		if (parse_polls(arg, &end, &idle_sleep_polls) < 0)
+			return -1;
+	} else if (idle_sleep_polls <= idle_pause_polls) {
+		idle_sleep_polls = idle_pause_polls * 10;
+	}
+
+	if (*end != '\0' || idle_sleep_polls <= idle_pause_polls)
+		return -1;
+
+	return 0;
+}
+
+static void
+idle_sum(struct l3fwd_lcore_stats *sum)
+{
+	const struct l3fwd_lcore_stats *st;
+	unsigned int lcore_id;
+
+	memset(sum, 0, sizeof(*sum));
+	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+		st = &l3fwd_lcore_stats[lcore_id];
+		sum->idle_sleeps += st->idle_sleeps;
+		sum->idle_wakeups += st->idle_wakeups;
+		sum->idle_sleep_cycles += st->idle_sleep_cycles;
+		sum->idle_wake_cycles += st->idle_wake_cycles;
+		sum->idle_wake_max_cycles = RTE_MAX(sum->idle_wake_max_cycles,
+			st->idle_wake_max_cycles);
+	}
+}
+
+static uint64_t
+cycles_to_ns(uint64_t cycles)
+{
+	return (double)cycles * NS_PER_S / rte_get_tsc_hz();
+}
+
+static int
+handle_idle(const char *cmd __rte_unused, const char *params __rte_unused,
+		struct rte_tel_data *d)
+{
+	struct l3fwd_lcore_stats sum;
+
+	idle_sum(&sum);
+
+	rte_tel_data_start_dict(d);
+	rte_tel_data_add_dict_u64(d, "pause_polls", idle_pause_polls);
+	rte_tel_data_add_dict_u64(d, "sleep_polls", idle_sleep_polls);
+	rte_tel_data_add_dict_u64(d, "sleeps", sum.idle_sleeps);
+	rte_tel_data_add_dict_u64(d, "wakeups", sum.idle_wakeups);
+	rte_tel_data_add_dict_u64(d, "sleep_ns",
+		cycles_to_ns(sum.idle_sleep_cycles));
+	rte_tel_data_add_dict_u64(d, "wake_avg_ns", sum.idle_wakeups ?
+		cycles_to_ns(sum.idle_wake_cycles) / sum.idle_wakeups : 0);
+	rte_tel_data_add_dict_u64(d, "wake_max_ns",
+		cycles_to_ns(sum.idle_wake_max_cycles));
+
+	return 0;
+}
+
+/* Allocate the state of every lcore on its socket. */
+void
+l3fwd_idle_setup(int numa_on)
+{
+	struct l3fwd_idle *idle;
+	unsigned int lcore_id;
+	int socketid;
+
+	if (idle_sleep_polls == 0)
+		return;
+
+	RTE_LCORE_FOREACH(lcore_id) {
+		socketid = numa_on ? (int)rte_lcore_to_socket_id(lcore_id) : 0;
+		idle = rte_zmalloc_socket("idle", sizeof(*idle),
+			RTE_CACHE_LINE_SIZE, socketid);
+		if (idle == NULL)
+			rte_exit(EXIT_FAILURE,
+				"Cannot allocate the idle state of lcore %u\n",
+				lcore_id);
+		idle->pause_polls = idle_pause_polls;
+		idle->sleep_polls = idle_sleep_polls;
+		lcore_conf[lcore_id].idle = idle;
+	}
+
+	rte_telemetry_register_cmd("/l3fwd/idle", handle_idle,
+		"Returns adaptive polling sleeps and wake-up latency. "
+		"No parameters");
+
+	printf("Adaptive polling: pause after %u, sleep after %u empty "
+		"polls\n", idle_pause_polls, idle_sleep_polls);
+}
+
+/*
+ * Called by each loop on its own lcore: the rx interrupts are added to
+ * the epoll instance of the calling thread. Without them on every queue
+ * the lcore only backs off with rte_pause().
+ */
+void
+l3fwd_idle_start(struct lcore_conf *qconf)
+{
+	uint16_t portid;
+	uint8_t queueid;
+	int i, ret;
+
+	qconf->idle->intr = 1;
+	for (i = 0; i < qconf->n_rx_queue; i++) {
+		portid = qconf->rx_queue_list[i].port_id;
+		queueid = qconf->rx_queue_list[i].queue_id;
+		ret = rte_eth_dev_rx_intr_ctl_q(portid, queueid,
+			RTE_EPOLL_PER_THREAD, RTE_INTR_EVENT_ADD, NULL);
+		if (ret < 0) {
+			RTE_LOG(WARNING, L3FWD, "lcore %u: no rx interrupt "
+				"on port %u queue %u (%d), pause only\n",
+				rte_lcore_id(), portid, queueid, ret);
+			qconf->idle->intr = 0;
+			return;
+		}
+	}
+}
+
+static void
+idle_intr_set(struct lcore_conf *qconf, int on)
+{
+	uint16_t portid;
+	uint8_t queueid;
+	int i;
+
+	for (i = 0; i < qconf->n_rx_queue; i++) {
+		portid = qconf->rx_queue_list[i].port_id;
+		queueid = qconf->rx_queue_list[i].queue_id;
+		if (on)
+			rte_eth_dev_rx_intr_enable(portid, queueid);
+		else
+			rte_eth_dev_rx_intr_disable(portid, queueid);
+	}
+}
+
+/* Sleep on the rx interrupts of the lcore, up to IDLE_SLEEP_MS. */
+void
+l3fwd_idle_sleep(struct lcore_conf *qconf)
+{
+	struct rte_epoll_event ev[MAX_RX_QUEUE_PER_LCORE];
+	struct l3fwd_lcore_stats *st = qconf->stats;
+	struct l3fwd_idle *idle = qconf->idle;
+	uint64_t start, wake;
+	int i, n;
+
+	/* nothing stays buffered while we sleep */
+	l3fwd_tx_drain(qconf);
+	/* the previous interrupt brought no packets */
+	idle->wake_tsc = 0;
+
+	idle_intr_set(qconf, 1);
+
+	/* do not sleep on packets that came in before the arming */
+	for (i = 0; i < qconf->n_rx_queue; i++) {
+		if (rte_eth_rx_queue_count(qconf->rx_queue_list[i].port_id,
+				qconf->rx_queue_list[i].queue_id) > 0) {
+			idle_intr_set(qconf, 0);
+			idle->empty_polls = 0;
+			return;
+		}
+	}
+
+	start = rte_rdtsc();
+	n = rte_epoll_wait(RTE_EPOLL_PER_THREAD, ev, qconf->n_rx_queue,
+		IDLE_SLEEP_MS);
+	wake = rte_rdtsc();
+
+	idle_intr_set(qconf, 0);
+
+	st->idle_sleeps++;
+	st->idle_sleep_cycles += wake - start;
+	if (n > 0) {
+		idle->wake_tsc = wake;
+		idle->empty_polls = 0;
+	}
+	/* on a timeout, poll once more and go straight back to sleep */
+}
+
+void
+l3fwd_idle_print_stats(void)
+{
+	struct l3fwd_lcore_stats sum;
+	uint64_t hz = rte_get_tsc_hz();
+
+	if (idle_sleep_polls == 0)
+		return;
+
+	idle_sum(&sum);
+	printf("\nAdaptive polling: %" PRIu64 " sleeps (%.3f s), %" PRIu64
+		" interrupt wake-ups, wake-up latency avg %.1f us max %.1f us\n",
+		sum.idle_sleeps, (double)sum.idle_sleep_cycles / hz,
+		sum.idle_wakeups, sum.idle_wakeups ?
+		1e6 * sum.idle_wake_cycles / sum.idle_wakeups / hz : 0.0,
+		1e6 * sum.idle_wake_max_cycles / hz);
+}
@@ -0,0 +1,80 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+#ifndef __L3FWD_IDLE_H__
+#define __L3FWD_IDLE_H__
+
+/*
+ * Adaptive polling (--adaptive-poll) for the LPM, EM and FIB poll loops.
+ *
+ * The loop counts its consecutive empty iterations: past pause_polls it
+ * backs off with a growing number of rte_pause(), past sleep_polls it
+ * flushes its tx buffers, arms the rx interrupts of its queues and
+ * sleeps in rte_epoll_wait(). Any received packet resets the count, so
+ * the loop is back to plain busy polling right after a wake-up.
+ *
+ * The wake-up latency is measured from the return of rte_epoll_wait() to
+ * the end of the first iteration that received packets, i.e. until the
+ * first burst after the interrupt has been forwarded. The interrupt
+ * delivery before it (NIC interrupt moderation, kernel, scheduler) is
+ * not visible to the application and comes on top.
+ */
+
+#include <rte_pause.h>
+
+#define L3FWD_IDLE_MAX_PAUSE	64	/* rte_pause() per empty poll */
+
+struct l3fwd_idle {
+	uint32_t empty_polls;	/**< consecutive iterations without packets */
+	uint32_t pause_polls;	/**< back off from this many empty polls */
+	uint32_t sleep_polls;	/**< sleep from this many empty polls */
+	int intr;		/**< rx interrupts usable on all queues */
+	uint64_t wake_tsc;	/**< interrupt wake-up not yet accounted, or 0 */
+};
+
+void
+l3fwd_idle_sleep(struct lcore_conf *qconf);
+
+/* An interrupt wake-up saw its first packets. */
+static inline void
+l3fwd_idle_woken(struct l3fwd_idle *idle, struct l3fwd_lcore_stats *st)
+{
+	uint64_t cycles = rte_rdtsc() - idle->wake_tsc;
+
+	st->idle_wakeups++;
+	st->idle_wake_cycles += cycles;
+	if (cycles > st->idle_wake_max_cycles)
+		st->idle_wake_max_cycles = cycles;
+	idle->wake_tsc = 0;
+}
+
+/* Called at the end of every loop iteration, busy if it got packets. */
+static __rte_always_inline void
+l3fwd_idle_poll(struct lcore_conf *qconf, int busy)
+{
+	struct l3fwd_idle *idle = qconf->idle;
+	uint32_t i, n;
+
+	if (busy) {
+		if (unlikely(idle->wake_tsc != 0))
+			l3fwd_idle_woken(idle, qconf->stats);
+		idle->empty_polls = 0;
+		return;
+	}
+
+	if (++idle->empty_polls < idle->pause_polls)
+		return;
+
+	if (idle->empty_polls >= idle->sleep_polls && idle->intr) {
+		l3fwd_idle_sleep(qconf);
+		return;
+	}
+
+	n = RTE_MIN((idle->empty_polls - idle->pause_polls) / 16 + 1,
+			(uint32_t)L3FWD_IDLE_MAX_PAUSE);
+	for (i = 0; i < n; i++)
+		rte_pause();
+}
+
+#endif /* __L3FWD_IDLE_H__ */
@@ -0,0 +1,367 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+/*
+ * Sampled rx to tx latency inside l3fwd (--latency[=N]).
+ *
+ * An rx callback stamps 1 in N received packets: the TSC goes into an
+ * mbuf dynfield and a dynflag marks the packet. The PMD rewrites
+ * ol_flags of every received mbuf, so a recycled mbuf never carries a
+ * stale mark. A tx callback takes the marked packets just before they
+ * are handed to the PMD and accounts their time in the histogram of the
+ * transmitting lcore, then clears the mark so that a retried packet is
+ * counted once.
+ *
+ * The callbacks work in every mode whose rx and tx go through
+ * rte_eth_rx_burst() and rte_eth_tx_burst(): poll, sw-rss, pipeline and
+ * eventdev with the SW adapters. The time in the NIC and on the wire is
+ * not included; compare with the listener, which measures end to end.
+ *
+ * librte_latencystats is not used: it stamps every packet, keeps one
+ * global set of counters behind a lock and has no percentiles.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+
+#include <rte_common.h>
+#include <rte_cycles.h>
+#include <rte_errno.h>
+#include <rte_ethdev.h>
+#include <rte_lcore.h>
+#include <rte_mbuf.h>
+#include <rte_mbuf_dyn.h>
+#include <rte_telemetry.h>
+
+#include "l3fwd.h"
+
+#define LAT_DEF_SAMPLE		1024
+#define LAT_MAX_SAMPLE		(1 << 24)
+
+/* log-linear histogram of TSC cycles: 2^LAT_SUB_BITS buckets per octave */
+#define LAT_SUB_BITS		3
+#define LAT_SUB			(1 << LAT_SUB_BITS)
+#define LAT_MAX_BITS		40	/* above, the last bucket */
+#define LAT_NB_BUCKETS		((LAT_MAX_BITS - LAT_SUB_BITS + 2) << \
+				 LAT_SUB_BITS)
+
+struct lat_lcore {
+	uint32_t countdown;	/**< received packets until the next sample */
+	uint64_t samples;
+	uint64_t sum_cycles;
+	uint64_t max_cycles;
+	uint64_t hist[LAT_NB_BUCKETS];
+} __rte_cache_aligned;
+
+static struct lat_lcore lat_lcore[RTE_MAX_LCORE];
+
+static uint32_t lat_sample;
+static int lat_tsc_offset = -1;
+static uint64_t lat_flag;
+
+static const double lat_pct[] = { 50, 90, 99, 99.9 };
+static const char * const lat_pct_name[] = {
+	"p50_ns", "p90_ns", "p99_ns", "p999_ns",
+};
+
+/* [N]: sample 1 in N received packets */
+int
+l3fwd_latency_parse(const char *arg)
+{
+	unsigned long n;
+	char *end;
+
+	lat_sample = LAT_DEF_SAMPLE;
+	if (arg == NULL)
+		return 0;
+
+	errno = 0;
+	n = strtoul(arg, &end, 10);
+	if (errno != 0 || *arg == '\0' || *end != '\0' || n == 0 ||
+			n > LAT_MAX_SAMPLE)
+		return -1;
+
+	lat_sample = n;
+	return 0;
+}
+
+static inline uint64_t *
+lat_tsc(struct rte_mbuf *m)
+{
+	return RTE_MBUF_DYNFIELD(m, lat_tsc_offset, uint64_t *);
+}
+
+static inline unsigned int
+lat_bucket(uint64_t cycles)
+{
+	unsigned int e;
+
+	if (cycles < LAT_SUB)
+		return cycles;
+	e = 63 - __builtin_clzll(cycles);
+	if (e > LAT_MAX_BITS)
+		return LAT_NB_BUCKETS - 1;
+	return ((e - LAT_SUB_BITS + 1) << LAT_SUB_BITS) +
+		((cycles >> (e - LAT_SUB_BITS)) & (LAT_SUB - 1));
+}
+
+/* Largest latency that falls in bucket b. */
+static uint64_t
+lat_bucket_max(unsigned int b)
+{
+	unsigned int e;
+
+	if (b < LAT_SUB)
+		return b;
+	e = (b >> LAT_SUB_BITS) + LAT_SUB_BITS - 1;
+	return (((uint64_t)LAT_SUB + (b & (LAT_SUB - 1)) + 1) <<
+		(e - LAT_SUB_BITS)) - 1;
+}
+
+static uint16_t
+lat_rx_cb(uint16_t port __rte_unused, uint16_t queue __rte_unused,
+		struct rte_mbuf *pkts[], uint16_t nb_pkts,
+		uint16_t max_pkts __rte_unused, void *arg __rte_unused)
+{
+	unsigned int lcore_id = rte_lcore_id();
+	struct lat_lcore *lat;
+	uint32_t i;
+	uint64_t now;
+
+	if (unlikely(lcore_id >= RTE_MAX_LCORE))
+		return nb_pkts;
+
+	lat = &lat_lcore[lcore_id];
+	i = lat->countdown;
+	if (i >= nb_pkts) {
+		lat->countdown = i - nb_pkts;
+		return nb_pkts;
+	}
+
+	now = rte_rdtsc();
+	for (; i < nb_pkts; i += lat_sample) {
+		*lat_tsc(pkts[i]) = now;
+		pkts[i]->ol_flags |= lat_flag;
+	}
+	lat->countdown = i - nb_pkts;
+
+	return nb_pkts;
+}
+
+static uint16_t
+lat_tx_cb(uint16_t port __rte_unused, uint16_t queue __rte_unused,
+		struct rte_mbuf *pkts[], uint16_t nb_pkts,
+		void *arg __rte_unused)
+{
+	unsigned int lcore_id = rte_lcore_id();
+	struct lat_lcore *lat;
+	uint64_t now = 0, cycles;
+	uint16_t i;
+
+	if (unlikely(lcore_id >= RTE_MAX_LCORE))
+		return nb_pkts;
+
+	lat = &lat_lcore[lcore_id];
+	for (i = 0; i < nb_pkts; i++) {
+		if (likely((pkts[i]->ol_flags & lat_flag) == 0))
+			continue;
+		pkts[i]->ol_flags &= ~lat_flag;
+		if (now == 0)
+			now = rte_rdtsc();
+		cycles = now - *lat_tsc(pkts[i]);
+		lat->samples++;
+		lat->sum_cycles += cycles;
+		if (cycles > lat->max_cycles)
+			lat->max_cycles = cycles;
+		lat->hist[lat_bucket(cycles)]++;
+	}
+
+	return nb_pkts;
+}
+
+static uint64_t
+cycles_to_ns(uint64_t cycles)
+{
+	return (double)cycles * NS_PER_S / rte_get_tsc_hz();
+}
+
+/* Counters of lcore_id, or summed over all lcores for RTE_MAX_LCORE. */
+static void
+lat_sum(struct lat_lcore *sum, unsigned int lcore_id)
+{
+	const struct lat_lcore *lat;
+	unsigned int i, b;
+
+	memset(sum, 0, sizeof(*sum));
+	for (i = 0; i < RTE_MAX_LCORE; i++) {
+		if (lcore_id != RTE_MAX_LCORE && i != lcore_id)
+			continue;
+		lat = &lat_lcore[i];
+		sum->samples += lat->samples;
+		sum->sum_cycles += lat->sum_cycles;
+		sum->max_cycles = RTE_MAX(sum->max_cycles, lat->max_cycles);
+		for (b = 0; b < LAT_NB_BUCKETS; b++)
+			sum->hist[b] += lat->hist[b];
+	}
+}
+
+/* Latency under which pct percent of the samples are, in cycles. */
+static uint64_t
+lat_percentile(const struct lat_lcore *sum, double pct)
+{
+	uint64_t rank, seen = 0;
+	unsigned int b;
+
+	if (sum->samples == 0)
+		return 0;
+	rank = (uint64_t)(sum->samples * pct / 100.0);
+	for (b = 0; b < LAT_NB_BUCKETS; b++) {
+		seen += sum->hist[b];
+		if (seen > rank)
+			return RTE_MIN(lat_bucket_max(b), sum->max_cycles);
+	}
+	return sum->max_cycles;
+}
+
+static int
+lat_to_dict(unsigned int lcore_id, struct rte_tel_data *d)
+{
+	struct lat_lcore sum;
+	unsigned int i;
+
+	lat_sum(&sum, lcore_id);
+
+	rte_tel_data_start_dict(d);
+	rte_tel_data_add_dict_u64(d, "sample", lat_sample);
+	rte_tel_data_add_dict_u64(d, "samples", sum.samples);
+	rte_tel_data_add_dict_u64(d, "avg_ns", sum.samples ?
+		cycles_to_ns(sum.sum_cycles / sum.samples) : 0);
+	for (i = 0; i < RTE_DIM(lat_pct); i++)
+		rte_tel_data_add_dict_u64(d, lat_pct_name[i],
+			cycles_to_ns(lat_percentile(&sum, lat_pct[i])));
+	rte_tel_data_add_dict_u64(d, "max_ns", cycles_to_ns(sum.max_cycles));
+
+	return 0;
+}
+
+static int
+handle_latency(const char *cmd __rte_unused, const char *params __rte_unused,
+		struct rte_tel_data *d)
+{
+	return lat_to_dict(RTE_MAX_LCORE, d);
+}
+
+static int
+handle_lcore_latency(const char *cmd __rte_unused, const char *params,
+		struct rte_tel_data *d)
+{
+	unsigned long lcore_id;
+	char *end;
+
+	if (params == NULL || *params == '\0')
+		return -EINVAL;
+
+	errno = 0;
+	lcore_id = strtoul(params, &end, 10);
+	if (errno != 0 || *end != '\0' || lcore_id >= RTE_MAX_LCORE ||
+			!rte_lcore_is_enabled(lcore_id))
+		return -EINVAL;
+
+	return lat_to_dict(lcore_id, d);
+}
+
+/* Register the timestamp field and flag. */
+void
+l3fwd_latency_setup(void)
+{
+	static const struct rte_mbuf_dynfield tsc_dynfield_desc = {
+		.name = "l3fwd_dynfield_latency_tsc",
+		.size = sizeof(uint64_t),
+		.align = __alignof__(uint64_t),
+	};
+	static const struct rte_mbuf_dynflag sampled_dynflag_desc = {
+		.name = "l3fwd_dynflag_latency_sampled",
+	};
+	unsigned int lcore_id;
+	int bit;
+
+	if (lat_sample == 0)
+		return;
+
+	lat_tsc_offset = rte_mbuf_dynfield_register(&tsc_dynfield_desc);
+	if (lat_tsc_offset < 0)
+		rte_exit(EXIT_FAILURE, "Cannot register mbuf field: %s\n",
+			 rte_strerror(rte_errno));
+	bit = rte_mbuf_dynflag_register(&sampled_dynflag_desc);
+	if (bit < 0)
+		rte_exit(EXIT_FAILURE, "Cannot register mbuf flag: %s\n",
+			 rte_strerror(rte_errno));
+	lat_flag = 1ULL << bit;
+
+	/* do not sample all lcores in step */
+	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++)
+		lat_lcore[lcore_id].countdown = lcore_id % lat_sample;
+
+	rte_telemetry_register_cmd("/l3fwd/latency", handle_latency,
+		"Returns rx to tx latency of the sampled packets, all lcores. "
+		"No parameters");
+	rte_telemetry_register_cmd("/l3fwd/lcore_latency", handle_lcore_latency,
+		"Returns rx to tx latency of the packets sent by an lcore. "
+		"Parameters: int lcore_id");
+
+	printf("Latency: sampling 1 in %u packets\n", lat_sample);
+}
+
+/* Add the callbacks to every rx and tx queue of a configured port. */
+void
+l3fwd_latency_attach(uint16_t portid)
+{
+	struct rte_eth_dev_info dev_info;
+	uint16_t queueid;
+	int ret;
+
+	if (lat_sample == 0)
+		return;
+
+	ret = rte_eth_dev_info_get(portid, &dev_info);
+	if (ret != 0)
+		rte_exit(EXIT_FAILURE,
+			"Error during getting device (port %u) info: %s\n",
+			portid, strerror(-ret));
+
+	for (queueid = 0; queueid < dev_info.nb_rx_queues; queueid++)
+		if (rte_eth_add_rx_callback(portid, queueid, lat_rx_cb,
+				NULL) == NULL)
+			rte_exit(EXIT_FAILURE, "Cannot add latency rx callback:"
+				" port=%u queue=%u\n", portid, queueid);
+
+	for (queueid = 0; queueid < dev_info.nb_tx_queues; queueid++)
+		if (rte_eth_add_tx_callback(portid, queueid, lat_tx_cb,
+				NULL) == NULL)
+			rte_exit(EXIT_FAILURE, "Cannot add latency tx callback:"
+				" port=%u queue=%u\n", portid, queueid);
+}
+
+void
+l3fwd_latency_print_stats(void)
+{
+	struct lat_lcore sum;
+
+	if (lat_sample == 0)
+		return;
+
+	lat_sum(&sum, RTE_MAX_LCORE);
+	printf("\nRx to tx latency (1 in %u packets): %" PRIu64 " samples, "
+		"avg %" PRIu64 " p50 %" PRIu64 " p99 %" PRIu64 " p99.9 %"
+		PRIu64 " max %" PRIu64 " ns\n", lat_sample, sum.samples,
+		sum.samples ? cycles_to_ns(sum.sum_cycles / sum.samples) : 0,
+		cycles_to_ns(lat_percentile(&sum, 50)),
+		cycles_to_ns(lat_percentile(&sum, 99)),
+		cycles_to_ns(lat_percentile(&sum, 99.9)),
+		cycles_to_ns(sum.max_cycles));
+}
@@ -29,21 +29,13 @@
 
 #include "l3fwd.h"
 #include "l3fwd_event.h"
-
-struct ipv4_l3fwd_lpm_route {
-	uint32_t ip;
-	uint8_t  depth;
-	uint8_t  if_out;
-};
-
-struct ipv6_l3fwd_lpm_route {
-	uint8_t ip[16];
-	uint8_t  depth;
-	uint8_t  if_out;
-};
+#include "l3fwd_idle.h"
+#include "l3fwd_drain.h"
+#include "l3fwd_ptype.h"
+#include "l3fwd_route.h"
 
 /* 198.18.0.0/16 are set aside for RFC2544 benchmarking (RFC5735). */
-static const struct ipv4_l3fwd_lpm_route ipv4_l3fwd_lpm_route_array[] = {
+const struct ipv4_l3fwd_route ipv4_l3fwd_route_array[] = {
 	{RTE_IPV4(198, 18, 0, 0), 24, 0},
 	{RTE_IPV4(198, 18, 1, 0), 24, 1},
 	{RTE_IPV4(198, 18, 2, 0), 24, 2},
@@ -55,7 +47,7 @@ static const struct ipv4_l3fwd_lpm_route ipv4_l3fwd_lpm_route_array[] = {
 };
 
 /* 2001:0200::/48 is IANA reserved range for IPv6 benchmarking (RFC5180) */
-static const struct ipv6_l3fwd_lpm_route ipv6_l3fwd_lpm_route_array[] = {
+const struct ipv6_l3fwd_route ipv6_l3fwd_route_array[] = {
 	{{32, 1, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0}, 48, 0},
 	{{32, 1, 2, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, 0, 0, 0}, 48, 1},
 	{{32, 1, 2, 0, 0, 0, 0, 0, 0, 2, 0, 0, 0, 0, 0, 0}, 48, 2},
@@ -74,32 +66,55 @@ static const struct ipv6_l3fwd_lpm_route ipv6_l3fwd_lpm_route_array[] = {
 static struct rte_lpm *ipv4_l3fwd_lpm_lookup_struct[NB_SOCKETS];
 static struct rte_lpm6 *ipv6_l3fwd_lpm_lookup_struct[NB_SOCKETS];
 
+/* Default next hop given to rte_lpm_lookupx4(), never a valid id. */
+#define LPM_LOOKUP_MISS UINT32_MAX
+
 static inline uint16_t
 lpm_get_ipv4_dst_port(const struct rte_ipv4_hdr *ipv4_hdr,
 		      uint16_t portid,
-		      struct rte_lpm *ipv4_l3fwd_lookup_struct)
+		      const struct lcore_conf *qconf)
 {
 	uint32_t dst_ip = rte_be_to_cpu_32(ipv4_hdr->dst_addr);
 	uint32_t next_hop;
 
-	if (rte_lpm_lookup(ipv4_l3fwd_lookup_struct, dst_ip, &next_hop) == 0)
+	if (rte_lpm_lookup(qconf->ipv4_lookup_struct, dst_ip, &next_hop) == 0)
 		return next_hop;
-	else
-		return portid;
+
+	qconf->stats->lookup_miss++;
+	return portid;
 }
 
 static inline uint16_t
 lpm_get_ipv6_dst_port(const struct rte_ipv6_hdr *ipv6_hdr,
 		      uint16_t portid,
-		      struct rte_lpm6 *ipv6_l3fwd_lookup_struct)
+		      const struct lcore_conf *qconf)
 {
 	const uint8_t *dst_ip = ipv6_hdr->dst_addr;
 	uint32_t next_hop;
 
-	if (rte_lpm6_lookup(ipv6_l3fwd_lookup_struct, dst_ip, &next_hop) == 0)
+	if (rte_lpm6_lookup(qconf->ipv6_lookup_struct, dst_ip, &next_hop) == 0)
 		return next_hop;
-	else
-		return portid;
+
+	qconf->stats->lookup_miss++;
+	return portid;
+}
+
+/*
+ * rte_lpm_lookupx4() is called with LPM_LOOKUP_MISS as default next hop:
+ * count the misses and send those packets back out of the rx port.
+ */
+static __rte_always_inline void
+lpm_fixup_missx4(const struct lcore_conf *qconf, uint32_t dst[FWDSTEP],
+		uint16_t portid)
+{
+	int i;
+
+	for (i = 0; i < FWDSTEP; i++) {
+		if (unlikely(dst[i] == LPM_LOOKUP_MISS)) {
+			dst[i] = portid;
+			qconf->stats->lookup_miss++;
+		}
+	}
 }
 
 static __rte_always_inline uint16_t
@@ -115,15 +130,13 @@ lpm_get_dst_port(const struct lcore_conf *qconf, struct rte_mbuf *pkt,
 		eth_hdr = rte_pktmbuf_mtod(pkt, struct rte_ether_hdr *);
 		ipv4_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
 
-		return lpm_get_ipv4_dst_port(ipv4_hdr, portid,
-					     qconf->ipv4_lookup_struct);
+		return lpm_get_ipv4_dst_port(ipv4_hdr, portid, qconf);
 	} else if (RTE_ETH_IS_IPV6_HDR(pkt->packet_type)) {
 
 		eth_hdr = rte_pktmbuf_mtod(pkt, struct rte_ether_hdr *);
 		ipv6_hdr = (struct rte_ipv6_hdr *)(eth_hdr + 1);
 
-		return lpm_get_ipv6_dst_port(ipv6_hdr, portid,
-					     qconf->ipv6_lookup_struct);
+		return lpm_get_ipv6_dst_port(ipv6_hdr, portid, qconf);
 	}
 
 	return portid;
@@ -143,18 +156,24 @@ lpm_get_dst_port_with_ipv4(const struct lcore_conf *qconf, struct rte_mbuf *pkt,
 	struct rte_ether_hdr *eth_hdr;
 
 	if (RTE_ETH_IS_IPV4_HDR(pkt->packet_type)) {
-		return (uint16_t) ((rte_lpm_lookup(qconf->ipv4_lookup_struct,
-						   dst_ipv4, &next_hop) == 0)
-				   ? next_hop : portid);
+		if (rte_lpm_lookup(qconf->ipv4_lookup_struct, dst_ipv4,
+				&next_hop) == 0)
+			return next_hop;
+
+		qconf->stats->lookup_miss++;
+		return portid;
 
 	} else if (RTE_ETH_IS_IPV6_HDR(pkt->packet_type)) {
 
 		eth_hdr = rte_pktmbuf_mtod(pkt, struct rte_ether_hdr *);
 		ipv6_hdr = (struct rte_ipv6_hdr *)(eth_hdr + 1);
 
-		return (uint16_t) ((rte_lpm6_lookup(qconf->ipv6_lookup_struct,
+		if (rte_lpm6_lookup(qconf->ipv6_lookup_struct,
 				ipv6_hdr->dst_addr, &next_hop) == 0)
-				? next_hop : portid);
+			return next_hop;
+
+		qconf->stats->lookup_miss++;
+		return portid;
 
 	}
 
@@ -171,9 +190,62 @@ lpm_get_dst_port_with_ipv4(const struct lcore_conf *qconf, struct rte_mbuf *pkt,
 #include "l3fwd_lpm.h"
 #endif
 
-/* main processing loop */
-int
-lpm_main_loop(__rte_unused void *dummy)
+#if defined RTE_ARCH_X86 || defined __ARM_NEON \
+			 || defined RTE_ARCH_PPC_64
+#include "l3fwd_flow_cache.h"
+
+/* l3fwd_lpm_send_packets() with the flow cache in front of the lookup. */
+static inline void
+l3fwd_lpm_cached_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
+			uint16_t portid, struct lcore_conf *qconf)
+{
+	uint16_t dst_port[MAX_PKT_BURST];
+
+	l3fwd_flow_cache_process(nb_rx, pkts_burst, portid, dst_port, qconf,
+			0, l3fwd_lpm_process_packets);
+	l3fwd_trace_lookup(portid, nb_rx);
+	send_packets_multi(qconf, pkts_burst, dst_port, nb_rx);
+}
+#endif
+
+/* Forward one burst, as the poll loop instance given by flags. */
+static __rte_always_inline void
+lpm_poll_burst(int nb_rx, struct rte_mbuf **pkts_burst, uint16_t portid,
+		struct lcore_conf *qconf, const uint8_t flags)
+{
+#if defined RTE_ARCH_X86 || defined __ARM_NEON \
+			 || defined RTE_ARCH_PPC_64
+	uint16_t dst_port[MAX_PKT_BURST];
+
+	if ((flags & L3FWD_LOOP_EXTRA) && qconf->flow_cache != NULL) {
+		l3fwd_lpm_cached_send_packets(nb_rx, pkts_burst, portid,
+				qconf);
+		return;
+	}
+
+	l3fwd_lpm_process_af(nb_rx, pkts_burst, portid, dst_port, qconf,
+			flags & L3FWD_LOOP_AF);
+	l3fwd_trace_lookup(portid, nb_rx);
+	send_packets_multi(qconf, pkts_burst, dst_port, nb_rx);
+#else
+	RTE_SET_USED(flags);
+	/* lookups and sends are interleaved, traced once done */
+	l3fwd_lpm_no_opt_send_packets(nb_rx, pkts_burst, portid, qconf);
+	l3fwd_trace_lookup(portid, nb_rx);
+#endif /* X86 */
+}
+
+void
+lpm_process_burst(int nb_rx, struct rte_mbuf **pkts_burst, uint16_t portid,
+		struct lcore_conf *qconf)
+{
+	lpm_poll_burst(nb_rx, pkts_burst, portid, qconf,
+			L3FWD_LOOP_AF | L3FWD_LOOP_EXTRA);
+}
+
+/* main processing loop, of the instance given by flags (L3FWD_LOOP_*) */
+static __rte_always_inline int
+lpm_poll_loop(const uint8_t flags)
 {
 	struct rte_mbuf *pkts_burst[MAX_PKT_BURST];
 	unsigned lcore_id;
@@ -182,20 +254,25 @@ lpm_main_loop(__rte_unused void *dummy)
 	uint16_t portid;
 	uint8_t queueid;
 	struct lcore_conf *qconf;
-	const uint64_t drain_tsc = (rte_get_tsc_hz() + US_PER_S - 1) /
+	int acl_on;
+	uint64_t loop_tsc;
+	int busy = 0;
+	uint64_t drain_tsc = (rte_get_tsc_hz() + US_PER_S - 1) /
 		US_PER_S * BURST_TX_DRAIN_US;
 
 	prev_tsc = 0;
 
 	lcore_id = rte_lcore_id();
 	qconf = &lcore_conf[lcore_id];
+	acl_on = (flags & L3FWD_LOOP_EXTRA) &&
+		(qconf->acl4_ctx != NULL || qconf->acl6_ctx != NULL);
 
 	if (qconf->n_rx_queue == 0) {
 		RTE_LOG(INFO, L3FWD, "lcore %u has nothing to do\n", lcore_id);
 		return 0;
 	}
 
-	RTE_LOG(INFO, L3FWD, "yockgen::entering main loop on lcore %u\n", lcore_id);
+	RTE_LOG(INFO, L3FWD, "entering main loop on lcore %u\n", lcore_id);
 
 	for (i = 0; i < qconf->n_rx_queue; i++) {
 
@@ -206,9 +283,17 @@ lpm_main_loop(__rte_unused void *dummy)
 			lcore_id, portid, queueid);
 	}
 
+	if ((flags & L3FWD_LOOP_EXTRA) && qconf->idle != NULL)
+		l3fwd_idle_start(qconf);
+	if ((flags & L3FWD_LOOP_EXTRA) && qconf->drain != NULL)
+		drain_tsc = qconf->drain->cap_tsc;
+
+	loop_tsc = rte_rdtsc();
 	while (!force_quit) {
 
 		cur_tsc = rte_rdtsc();
+		l3fwd_stats_loop(qconf->stats, cur_tsc, &loop_tsc, busy);
+		busy = 0;
 
 		/*
 		 * TX burst queue drain
@@ -216,15 +301,9 @@ lpm_main_loop(__rte_unused void *dummy)
 		diff_tsc = cur_tsc - prev_tsc;
 		if (unlikely(diff_tsc > drain_tsc)) {
 
-			for (i = 0; i < qconf->n_tx_port; ++i) {
-				portid = qconf->tx_port_id[i];
-				if (qconf->tx_mbufs[portid].len == 0)
-					continue;
-				send_burst(qconf,
-					qconf->tx_mbufs[portid].len,
-					portid);
-				qconf->tx_mbufs[portid].len = 0;
-			}
+			l3fwd_tx_drain(qconf);
+			if ((flags & L3FWD_LOOP_EXTRA) && qconf->drain != NULL)
+				drain_tsc = l3fwd_drain_tick(qconf);
 
 			prev_tsc = cur_tsc;
 		}
@@ -232,79 +311,64 @@ lpm_main_loop(__rte_unused void *dummy)
 		/*
 		 * Read packet from RX queues
 		 */
-                struct rte_ether_hdr *eth_hdr;
-                struct rte_ipv4_hdr *ipv4_hdr;
-        	for (i = 0; i < qconf->n_rx_queue; ++i) {
-                        //printf("\n\nyockgen before rx queue=%d\n\n",qconf->n_rx_queue);
-
+		for (i = 0; i < qconf->n_rx_queue; ++i) {
 			portid = qconf->rx_queue_list[i].port_id;
 			queueid = qconf->rx_queue_list[i].queue_id;
 			nb_rx = rte_eth_rx_burst(portid, queueid, pkts_burst,
 				MAX_PKT_BURST);
+			if (flags & L3FWD_LOOP_SW_PTYPE)
+				lpm_cb_parse_ptype(portid, queueid, pkts_burst,
+					nb_rx, MAX_PKT_BURST, NULL);
+			l3fwd_stats_rx(qconf->stats, nb_rx);
+			if ((flags & L3FWD_LOOP_EXTRA) && qconf->drain != NULL)
+				l3fwd_drain_rx(qconf->drain, nb_rx);
 			if (nb_rx == 0)
 				continue;
-                        else{
-                           printf("\nreceived packet - %d pkts arr len=%lu type=%d!!\n",nb_rx,sizeof(pkts_burst)/sizeof(pkts_burst[0]), pkts_burst[0]->packet_type); 
-                         
-                           eth_hdr = rte_pktmbuf_mtod(pkts_burst[0], struct rte_ether_hdr *);
-                           printf ("\n\nethernet type=%d\n\n",eth_hdr->ether_type);
-                           struct rte_ether_addr temp01 =  eth_hdr->s_addr;
-                           //printf ("\n\nsource mac addr size=%lu\n\n",sizeof(temp01));  
-
-                           printf("SOURCE MAC address: %02X:%02X:%02X:%02X:%02X:%02X\n\n",
-				temp01.addr_bytes[0],
-				temp01.addr_bytes[1],
-				temp01.addr_bytes[2],
-				temp01.addr_bytes[3],
-				temp01.addr_bytes[4],
-				temp01.addr_bytes[5]);
-
-                          if (RTE_ETH_IS_IPV4_HDR(pkts_burst[0]->packet_type)) {
-                              
-                                 ipv4_hdr = rte_pktmbuf_mtod_offset(pkts_burst[0], struct rte_ipv4_hdr *, sizeof(struct rte_ether_hdr));
-                                 rte_be32_t ipTmp = ipv4_hdr->src_addr;   
-                                 printf ("\n\nIPV4=%d\n\n",ipTmp);
-
-				 unsigned char bytes[4];
-				 bytes[0] = ipTmp & 0xFF;
-				 bytes[1] = (ipTmp >> 8) & 0xFF;
-				 bytes[2] = (ipTmp >> 16) & 0xFF;
-				 bytes[3] = (ipTmp >> 24) & 0xFF; 
-				 printf("\n\nIP:%d.%d.%d.%d\n\n", bytes[3], bytes[2], bytes[1], bytes[0]);        
-                          }
-                          else {
-			      printf("\n\nnot IPV4\n\n");
-                          }
-
-
-                        }
+			busy = 1;
+			l3fwd_trace_rx_burst(portid, queueid, nb_rx);
+
+			/* Optional ACL stage, denied packets are freed here. */
+			if (acl_on) {
+				nb_rx = l3fwd_acl_filter(qconf, pkts_burst,
+						nb_rx);
+				if (nb_rx == 0)
+					continue;
+			}
 
-#if defined RTE_ARCH_X86 || defined __ARM_NEON \
-			 || defined RTE_ARCH_PPC_64
-			l3fwd_lpm_send_packets(nb_rx, pkts_burst,
-						portid, qconf);
-#else
-			l3fwd_lpm_no_opt_send_packets(nb_rx, pkts_burst,
-							portid, qconf);
-#endif /* X86 */
+			lpm_poll_burst(nb_rx, pkts_burst, portid, qconf, flags);
 		}
+
+		if ((flags & L3FWD_LOOP_EXTRA) && qconf->idle != NULL)
+			l3fwd_idle_poll(qconf, busy);
 	}
 
+	/* nothing may stay staged when the tx queues change hands */
+	l3fwd_tx_flush(qconf);
+
 	return 0;
 }
 
+L3FWD_LOOP_DEFINE_AF(lpm, v4, L3FWD_LOOP_IPV4)
+L3FWD_LOOP_DEFINE_AF(lpm, v6, L3FWD_LOOP_IPV6)
+L3FWD_LOOP_DEFINE_AF(lpm, ds, L3FWD_LOOP_AF)
+
+const l3fwd_main_loop_t lpm_main_loops[L3FWD_LOOP_NB] = {
+	L3FWD_LOOP_ENTRIES_AF(lpm, v4, L3FWD_LOOP_IPV4),
+	L3FWD_LOOP_ENTRIES_AF(lpm, v6, L3FWD_LOOP_IPV6),
+	L3FWD_LOOP_ENTRIES_AF(lpm, ds, L3FWD_LOOP_AF),
+};
+
 static __rte_always_inline uint16_t
 lpm_process_event_pkt(const struct lcore_conf *lconf, struct rte_mbuf *mbuf)
 {
-	mbuf->port = lpm_get_dst_port(lconf, mbuf, mbuf->port);
+	uint16_t rx_port = mbuf->port;
+
+	mbuf->port = lpm_get_dst_port(lconf, mbuf, rx_port);
 
 #if defined RTE_ARCH_X86 || defined __ARM_NEON \
 	|| defined RTE_ARCH_PPC_64
 	process_packet(mbuf, &mbuf->port);
 #else
-
-	struct rte_ether_hdr *eth_hdr = rte_pktmbuf_mtod(mbuf,
-			struct rte_ether_hdr *);
 #ifdef DO_RFC_1812_CHECKS
 	struct rte_ipv4_hdr *ipv4_hdr;
 	if (RTE_ETH_IS_IPV4_HDR(mbuf->packet_type)) {
@@ -316,23 +380,67 @@ lpm_process_event_pkt(const struct lcore_conf *lconf, struct rte_mbuf *mbuf)
 		if (is_valid_ipv4_pkt(ipv4_hdr, mbuf->pkt_len)
 				< 0) {
 			mbuf->port = BAD_PORT;
-			continue;
+			return mbuf->port;
 		}
 		/* Update time to live and header checksum */
 		--(ipv4_hdr->time_to_live);
 		++(ipv4_hdr->hdr_checksum);
 	}
 #endif
-	/* dst addr */
-	*(uint64_t *)&eth_hdr->d_addr = dest_eth_addr[mbuf->port];
-
-	/* src addr */
-	rte_ether_addr_copy(&ports_eth_addr[mbuf->port],
-			&eth_hdr->s_addr);
+	/* dst and src addr from the next hop adjacency */
+	mbuf->port = l3fwd_adj_forward(mbuf, mbuf->port, rx_port);
 #endif
 	return mbuf->port;
 }
 
+#if defined RTE_ARCH_X86 || defined __ARM_NEON \
+	|| defined RTE_ARCH_PPC_64
+/*
+ * Bulk handling of a dequeued event burst. The rx adapter enqueues the
+ * packets of an rx burst back to back, so the x4 LPM lookup runs over
+ * each run of packets from one rx port; headers are then rewritten four
+ * at a time, as in poll mode.
+ */
+static __rte_always_inline void
+lpm_process_event_burst(struct lcore_conf *lconf, struct rte_event *events,
+		int nb_deq)
+{
+	struct rte_mbuf *pkts[MAX_PKT_BURST];
+	uint16_t dst_port[MAX_PKT_BURST];
+	int i, j, k;
+
+	for (i = 0; i < nb_deq; i++)
+		pkts[i] = events[i].mbuf;
+
+	for (i = 0; i < nb_deq; i = j) {
+		for (j = i + 1; j < nb_deq && pkts[j]->port == pkts[i]->port;
+				j++)
+			;
+		l3fwd_lpm_process_packets(j - i, &pkts[i], pkts[i]->port,
+				&dst_port[i], lconf);
+	}
+
+	k = RTE_ALIGN_FLOOR(nb_deq, FWDSTEP);
+	for (i = 0; i != k; i += FWDSTEP)
+		processx4_step3(&pkts[i], &dst_port[i]);
+	for (; i < nb_deq; i++)
+		process_packet(pkts[i], &dst_port[i]);
+
+	for (i = 0; i < nb_deq; i++)
+		pkts[i]->port = dst_port[i];
+}
+#else
+static __rte_always_inline void
+lpm_process_event_burst(struct lcore_conf *lconf, struct rte_event *events,
+		int nb_deq)
+{
+	int i;
+
+	for (i = 0; i < nb_deq; i++)
+		lpm_process_event_pkt(lconf, events[i].mbuf);
+}
+#endif
+
 static __rte_always_inline void
 lpm_event_loop_single(struct l3fwd_event_resources *evt_rsrc,
 		const uint8_t flags)
@@ -356,6 +464,9 @@ lpm_event_loop_single(struct l3fwd_event_resources *evt_rsrc,
 		if (!rte_event_dequeue_burst(event_d_id, event_p_id, &ev, 1, 0))
 			continue;
 
+		if (evt_rsrc->nb_prio > 1)
+			l3fwd_event_prio_account(&ev, 1);
+
 		if (lpm_process_event_pkt(lconf, ev.mbuf) == BAD_PORT) {
 			rte_pktmbuf_free(ev.mbuf);
 			continue;
@@ -387,7 +498,7 @@ lpm_event_loop_burst(struct l3fwd_event_resources *evt_rsrc,
 	const uint8_t tx_q_id = evt_rsrc->evq.event_q_id[
 		evt_rsrc->evq.nb_queues - 1];
 	const uint8_t event_d_id = evt_rsrc->event_d_id;
-	const uint16_t deq_len = evt_rsrc->deq_depth;
+	const uint16_t deq_len = RTE_MIN(evt_rsrc->deq_depth, MAX_PKT_BURST);
 	struct rte_event events[MAX_PKT_BURST];
 	struct lcore_conf *lconf;
 	unsigned int lcore_id;
@@ -411,6 +522,12 @@ lpm_event_loop_burst(struct l3fwd_event_resources *evt_rsrc,
 			continue;
 		}
 
+		if (evt_rsrc->nb_prio > 1)
+			l3fwd_event_prio_account(events, nb_deq);
+
+		lpm_process_event_burst(lconf, events, nb_deq);
+		nb_deq = l3fwd_event_drop_bad_port(lconf, events, nb_deq);
+
 		for (i = 0; i < nb_deq; i++) {
 			if (flags & L3FWD_EVENT_TX_ENQ) {
 				events[i].queue_id = tx_q_id;
@@ -420,8 +537,6 @@ lpm_event_loop_burst(struct l3fwd_event_resources *evt_rsrc,
 			if (flags & L3FWD_EVENT_TX_DIRECT)
 				rte_event_eth_tx_adapter_txq_set(events[i].mbuf,
 								 0);
-
-			lpm_process_event_pkt(lconf, events[i].mbuf);
 		}
 
 		if (flags & L3FWD_EVENT_TX_ENQ) {
@@ -495,6 +610,54 @@ lpm_event_main_loop_tx_q_burst(__rte_unused void *dummy)
 	return 0;
 }
 
+/*
+ * --bench: flow i goes to a host in one of the IPv4 routes setup_lpm()
+ * added, round-robin over the routes.
+ */
+void
+lpm_bench_flow(uint32_t i, struct l3fwd_bench_flow *f)
+{
+	static struct {
+		uint32_t ip;
+		uint8_t depth;
+	} routes[IPV4_L3FWD_NUM_ROUTES + L3FWD_MAX_NH_ROUTES];
+	static unsigned int nb_routes;
+	uint32_t host_mask;
+	unsigned int j;
+
+	if (nb_routes == 0) {
+		for (j = 0; j < RTE_DIM(ipv4_l3fwd_route_array); j++) {
+			if ((1 << ipv4_l3fwd_route_array[j].if_out &
+					enabled_port_mask) == 0)
+				continue;
+			routes[nb_routes].ip = ipv4_l3fwd_route_array[j].ip;
+			routes[nb_routes++].depth =
+				ipv4_l3fwd_route_array[j].depth;
+		}
+		for (j = 0; j < ipv4_l3fwd_nh_route_num; j++) {
+			if (!l3fwd_adj_nh_usable(ipv4_l3fwd_nh_route_array[j].nh))
+				continue;
+			routes[nb_routes].ip = ipv4_l3fwd_nh_route_array[j].ip;
+			routes[nb_routes++].depth =
+				ipv4_l3fwd_nh_route_array[j].depth;
+		}
+		if (nb_routes == 0)
+			rte_exit(EXIT_FAILURE, "No IPv4 route to benchmark\n");
+	}
+
+	j = i % nb_routes;
+	host_mask = routes[j].depth == 0 ? UINT32_MAX :
+		(uint32_t)((1ULL << (32 - routes[j].depth)) - 1);
+
+	/* spread the flows of a route over its hosts */
+	f->ip_dst = routes[j].ip |
+		((i / nb_routes) * 2654435761u & host_mask);
+	f->ip_src = RTE_IPV4(198, 19, 0, 1);
+	f->port_dst = 1024 + (i & 0x3ff);
+	f->port_src = 1024;
+	f->proto = IPPROTO_UDP;
+}
+
 void
 setup_lpm(const int socketid)
 {
@@ -505,6 +668,10 @@ setup_lpm(const int socketid)
 	char s[64];
 	char abuf[INET6_ADDRSTRLEN];
 
+#if defined(RTE_ARCH_X86)
+	lpm_simd_select();
+#endif
+
 	/* create the LPM table */
 	config_ipv4.max_rules = IPV4_L3FWD_LPM_MAX_RULES;
 	config_ipv4.number_tbl8s = IPV4_L3FWD_LPM_NUMBER_TBL8S;
@@ -518,18 +685,18 @@ setup_lpm(const int socketid)
 			socketid);
 
 	/* populate the LPM table */
-	for (i = 0; i < RTE_DIM(ipv4_l3fwd_lpm_route_array); i++) {
+	for (i = 0; i < RTE_DIM(ipv4_l3fwd_route_array); i++) {
 		struct in_addr in;
 
 		/* skip unused ports */
-		if ((1 << ipv4_l3fwd_lpm_route_array[i].if_out &
+		if ((1 << ipv4_l3fwd_route_array[i].if_out &
 				enabled_port_mask) == 0)
 			continue;
 
 		ret = rte_lpm_add(ipv4_l3fwd_lpm_lookup_struct[socketid],
-			ipv4_l3fwd_lpm_route_array[i].ip,
-			ipv4_l3fwd_lpm_route_array[i].depth,
-			ipv4_l3fwd_lpm_route_array[i].if_out);
+			ipv4_l3fwd_route_array[i].ip,
+			ipv4_l3fwd_route_array[i].depth,
+			ipv4_l3fwd_route_array[i].if_out);
 
 		if (ret < 0) {
 			rte_exit(EXIT_FAILURE,
@@ -537,11 +704,34 @@ setup_lpm(const int socketid)
 				i, socketid);
 		}
 
-		in.s_addr = htonl(ipv4_l3fwd_lpm_route_array[i].ip);
+		in.s_addr = htonl(ipv4_l3fwd_route_array[i].ip);
 		printf("LPM: Adding route %s / %d (%d)\n",
 		       inet_ntop(AF_INET, &in, abuf, sizeof(abuf)),
-			ipv4_l3fwd_lpm_route_array[i].depth,
-			ipv4_l3fwd_lpm_route_array[i].if_out);
+			ipv4_l3fwd_route_array[i].depth,
+			ipv4_l3fwd_route_array[i].if_out);
+	}
+
+	/* routes to next hops and ECMP groups given with --route */
+	for (i = 0; i < ipv4_l3fwd_nh_route_num; i++) {
+		const struct ipv4_l3fwd_nh_route *r =
+			&ipv4_l3fwd_nh_route_array[i];
+		struct in_addr in;
+
+		/* skip next hops behind unused ports */
+		if (!l3fwd_adj_nh_usable(r->nh))
+			continue;
+
+		ret = rte_lpm_add(ipv4_l3fwd_lpm_lookup_struct[socketid], r->ip, r->depth, r->nh);
+		if (ret < 0) {
+			rte_exit(EXIT_FAILURE,
+				"Unable to add route %u to the l3fwd LPM table on socket %d\n",
+				i, socketid);
+		}
+
+		in.s_addr = htonl(r->ip);
+		printf("LPM: Adding route %s / %d (nh %#x)\n",
+		       inet_ntop(AF_INET, &in, abuf, sizeof(abuf)),
+		       r->depth, r->nh);
 	}
 
 	/* create the LPM6 table */
@@ -558,17 +748,17 @@ setup_lpm(const int socketid)
 			socketid);
 
 	/* populate the LPM table */
-	for (i = 0; i < RTE_DIM(ipv6_l3fwd_lpm_route_array); i++) {
+	for (i = 0; i < RTE_DIM(ipv6_l3fwd_route_array); i++) {
 
 		/* skip unused ports */
-		if ((1 << ipv6_l3fwd_lpm_route_array[i].if_out &
+		if ((1 << ipv6_l3fwd_route_array[i].if_out &
 				enabled_port_mask) == 0)
 			continue;
 
 		ret = rte_lpm6_add(ipv6_l3fwd_lpm_lookup_struct[socketid],
-			ipv6_l3fwd_lpm_route_array[i].ip,
-			ipv6_l3fwd_lpm_route_array[i].depth,
-			ipv6_l3fwd_lpm_route_array[i].if_out);
+			ipv6_l3fwd_route_array[i].ip,
+			ipv6_l3fwd_route_array[i].depth,
+			ipv6_l3fwd_route_array[i].if_out);
 
 		if (ret < 0) {
 			rte_exit(EXIT_FAILURE,
@@ -577,10 +767,31 @@ setup_lpm(const int socketid)
 		}
 
 		printf("LPM: Adding route %s / %d (%d)\n",
-		       inet_ntop(AF_INET6, ipv6_l3fwd_lpm_route_array[i].ip,
+		       inet_ntop(AF_INET6, ipv6_l3fwd_route_array[i].ip,
 				 abuf, sizeof(abuf)),
-		       ipv6_l3fwd_lpm_route_array[i].depth,
-		       ipv6_l3fwd_lpm_route_array[i].if_out);
+		       ipv6_l3fwd_route_array[i].depth,
+		       ipv6_l3fwd_route_array[i].if_out);
+	}
+
+	/* routes to next hops and ECMP groups given with --route */
+	for (i = 0; i < ipv6_l3fwd_nh_route_num; i++) {
+		const struct ipv6_l3fwd_nh_route *r =
+			&ipv6_l3fwd_nh_route_array[i];
+
+		/* skip next hops behind unused ports */
+		if (!l3fwd_adj_nh_usable(r->nh))
+			continue;
+
+		ret = rte_lpm6_add(ipv6_l3fwd_lpm_lookup_struct[socketid], r->ip, r->depth, r->nh);
+		if (ret < 0) {
+			rte_exit(EXIT_FAILURE,
+				"Unable to add route %u to the l3fwd LPM table on socket %d\n",
+				i, socketid);
+		}
+
+		printf("LPM: Adding route %s / %d (nh %#x)\n",
+		       inet_ntop(AF_INET6, r->ip, abuf, sizeof(abuf)),
+		       r->depth, r->nh);
 	}
 }
 
@@ -641,6 +852,9 @@ lpm_cb_parse_ptype(uint16_t port __rte_unused, uint16_t queue __rte_unused,
 		   uint16_t max_pkts __rte_unused,
 		   void *user_param __rte_unused)
 {
+#ifdef L3FWD_PTYPE_VEC
+	l3fwd_parse_ptype_burst(pkts, nb_pkts, 0);
+#else
 	unsigned int i;
 
 	if (unlikely(nb_pkts == 0))
@@ -652,10 +866,41 @@ lpm_cb_parse_ptype(uint16_t port __rte_unused, uint16_t queue __rte_unused,
 		lpm_parse_ptype(pkts[i]);
 	}
 	lpm_parse_ptype(pkts[i]);
+#endif
 
 	return nb_pkts;
 }
 
+/*
+ * Warm restart: use the tables setup_lpm() of the running primary built,
+ * they hold no pointers into its code.
+ */
+void
+attach_lpm(const int socketid)
+{
+	char s[64];
+
+#if defined(RTE_ARCH_X86)
+	lpm_simd_select();
+#endif
+
+	snprintf(s, sizeof(s), "IPV4_L3FWD_LPM_%d", socketid);
+	ipv4_l3fwd_lpm_lookup_struct[socketid] = rte_lpm_find_existing(s);
+	if (ipv4_l3fwd_lpm_lookup_struct[socketid] == NULL)
+		rte_exit(EXIT_FAILURE,
+			"Unable to find the l3fwd LPM table on socket %d\n",
+			socketid);
+
+	snprintf(s, sizeof(s), "IPV6_L3FWD_LPM_%d", socketid);
+	ipv6_l3fwd_lpm_lookup_struct[socketid] = rte_lpm6_find_existing(s);
+	if (ipv6_l3fwd_lpm_lookup_struct[socketid] == NULL)
+		rte_exit(EXIT_FAILURE,
+			"Unable to find the l3fwd LPM6 table on socket %d\n",
+			socketid);
+
+	printf("LPM: attached to the tables on socket %d\n", socketid);
+}
+
 /* Return ipv4/ipv6 lpm fwd lookup struct. */
 void *
 lpm_get_ipv4_l3fwd_lookup_struct(const int socketid)
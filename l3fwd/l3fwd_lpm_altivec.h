@@ -74,7 +74,8 @@ processx4_step2(const struct lcore_conf *qconf,
 	/* if all 4 packets are IPV4. */
 	if (likely(ipv4_flag)) {
 		rte_lpm_lookupx4(qconf->ipv4_lookup_struct, (xmm_t)dip,
-			(uint32_t *)&dst, portid);
+			(uint32_t *)&dst, LPM_LOOKUP_MISS);
+		lpm_fixup_missx4(qconf, dst.u32, portid);
 		/* get rid of unused upper 16 bit for each dport. */
 		dst.x = (xmm_t)vec_packs(dst.x, dst.x);
 		*(uint64_t *)dprt = dst.u64[0];
@@ -92,15 +93,15 @@ processx4_step2(const struct lcore_conf *qconf,
 }
 
 /*
- * Buffer optimized handling of packets, invoked
- * from main_loop.
+ * Look up the next hop of every packet of a burst received on portid,
+ * into dst_port, 4 packets at a time.
  */
 static inline void
-l3fwd_lpm_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
-			uint8_t portid, struct lcore_conf *qconf)
+lpm_process_vector(int nb_rx, struct rte_mbuf **pkts_burst,
+			uint8_t portid, uint16_t *dst_port,
+			struct lcore_conf *qconf)
 {
 	int32_t j;
-	uint16_t dst_port[MAX_PKT_BURST];
 	vector unsigned int dip[MAX_PKT_BURST / FWDSTEP];
 	uint32_t ipv4_flag[MAX_PKT_BURST / FWDSTEP];
 	const int32_t k = RTE_ALIGN_FLOOR(nb_rx, FWDSTEP);
@@ -129,7 +130,21 @@ l3fwd_lpm_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
 		j++;
 		/* fall-through */
 	}
+}
+
+#include "l3fwd_lpm_lanes.h"
+
+/*
+ * Buffer optimized handling of packets, invoked
+ * from main_loop.
+ */
+static inline void
+l3fwd_lpm_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
+			uint8_t portid, struct lcore_conf *qconf)
+{
+	uint16_t dst_port[MAX_PKT_BURST];
 
+	l3fwd_lpm_process_packets(nb_rx, pkts_burst, portid, dst_port, qconf);
 	send_packets_multi(qconf, pkts_burst, dst_port, nb_rx);
 }
 
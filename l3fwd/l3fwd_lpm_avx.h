@@ -0,0 +1,241 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+#ifndef __L3FWD_LPM_AVX_H__
+#define __L3FWD_LPM_AVX_H__
+
+/*
+ * 8-wide AVX2 and 16-wide AVX-512 variants of the IPv4 lookup stage
+ * (processx4_step1 + processx4_step2). The tbl24 and tbl8 reads of
+ * rte_lpm_lookupx4() become one gather each. The kernels are built with
+ * target attributes and picked at startup by lpm_simd_select(), so the
+ * binary still runs on CPUs with SSE4.2 only.
+ *
+ * The header rewrite and port grouping stay 4-wide: they load one
+ * separate header per packet and index a table by the compare mask,
+ * so wider registers do not reduce their work.
+ */
+
+#include <rte_cpuflags.h>
+#include <rte_vect.h>
+
+enum lpm_simd {
+	LPM_SIMD_SSE,
+	LPM_SIMD_AVX2,
+	LPM_SIMD_AVX512,
+};
+
+static uint8_t lpm_simd = LPM_SIMD_SSE;
+
+/*
+ * rte_lpm_lookupx4() over 8 addresses (host byte order).
+ * Misses get defv.
+ */
+static __rte_noinline __attribute__((target("avx2"))) void
+lpm_lookupx8_avx2(const struct rte_lpm *lpm, __m256i ip, uint32_t hop[8],
+		uint32_t defv)
+{
+	const __m256i mask24 = _mm256_set1_epi32(0x00FFFFFF);
+	const __m256i mask8 = _mm256_set1_epi32(UINT8_MAX);
+	const __m256i xv = _mm256_set1_epi32(RTE_LPM_VALID_EXT_ENTRY_BITMASK);
+	const __m256i v = _mm256_set1_epi32(RTE_LPM_LOOKUP_SUCCESS);
+	__m256i tbl, ext, i8, valid;
+
+	tbl = _mm256_i32gather_epi32((const int *)lpm->tbl24,
+			_mm256_srli_epi32(ip, CHAR_BIT), sizeof(uint32_t));
+
+	/* second level for the entries that point to a tbl8 group */
+	ext = _mm256_cmpeq_epi32(_mm256_and_si256(tbl, xv), xv);
+	if (unlikely(!_mm256_testz_si256(ext, ext))) {
+		i8 = _mm256_add_epi32(_mm256_and_si256(ip, mask8),
+			_mm256_slli_epi32(_mm256_and_si256(tbl, mask24),
+				CHAR_BIT)); /* * RTE_LPM_TBL8_GROUP_NUM_ENTRIES */
+		tbl = _mm256_mask_i32gather_epi32(tbl,
+			(const int *)lpm->tbl8, i8, ext, sizeof(uint32_t));
+	}
+
+	valid = _mm256_cmpeq_epi32(_mm256_and_si256(tbl, v), v);
+	_mm256_storeu_si256((__m256i *)hop,
+		_mm256_blendv_epi8(_mm256_set1_epi32(defv),
+			_mm256_and_si256(tbl, mask24), valid));
+}
+
+/*
+ * Look up the IPv4 packets of the burst 8 at a time into dst_port.
+ * Returns the number of packets done, the rest is left to the SSE path.
+ */
+static __rte_noinline __attribute__((target("avx2"))) int
+lpm_process_x8_avx2(const struct lcore_conf *qconf,
+		struct rte_mbuf **pkts, int nb_rx, uint16_t portid,
+		uint16_t *dst_port)
+{
+	const __m128i bswap_mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+						4, 5, 6, 7, 0, 1, 2, 3);
+	const int k = RTE_ALIGN_FLOOR(nb_rx, 2 * FWDSTEP);
+	uint32_t ipv4_flag[2];
+	uint32_t hop[2 * FWDSTEP];
+	__m128i dip[2];
+	__m256i ip;
+	int i, j;
+
+	for (j = 0; j != k; j += 2 * FWDSTEP) {
+		processx4_step1(&pkts[j], &dip[0], &ipv4_flag[0]);
+		processx4_step1(&pkts[j + FWDSTEP], &dip[1], &ipv4_flag[1]);
+
+		if (unlikely(!ipv4_flag[0] || !ipv4_flag[1])) {
+			processx4_step2(qconf, dip[0], ipv4_flag[0], portid,
+					&pkts[j], &dst_port[j]);
+			processx4_step2(qconf, dip[1], ipv4_flag[1], portid,
+					&pkts[j + FWDSTEP],
+					&dst_port[j + FWDSTEP]);
+			continue;
+		}
+
+		ip = _mm256_inserti128_si256(_mm256_castsi128_si256(
+				_mm_shuffle_epi8(dip[0], bswap_mask)),
+				_mm_shuffle_epi8(dip[1], bswap_mask), 1);
+		lpm_lookupx8_avx2(qconf->ipv4_lookup_struct, ip, hop,
+				LPM_LOOKUP_MISS);
+		lpm_fixup_missx4(qconf, hop, portid);
+		lpm_fixup_missx4(qconf, hop + FWDSTEP, portid);
+		for (i = 0; i < 2 * FWDSTEP; i++)
+			dst_port[j + i] = hop[i];
+	}
+
+	return k;
+}
+
+#ifdef CC_AVX512_SUPPORT
+/* lpm_lookupx8_avx2() over 16 addresses. */
+static __rte_noinline __attribute__((target("avx512f"))) void
+lpm_lookupx16_avx512(const struct rte_lpm *lpm, __m512i ip, uint32_t hop[16],
+		uint32_t defv)
+{
+	const __m512i mask24 = _mm512_set1_epi32(0x00FFFFFF);
+	const __m512i mask8 = _mm512_set1_epi32(UINT8_MAX);
+	const __m512i xv = _mm512_set1_epi32(RTE_LPM_VALID_EXT_ENTRY_BITMASK);
+	const __m512i v = _mm512_set1_epi32(RTE_LPM_LOOKUP_SUCCESS);
+	__mmask16 ext, valid;
+	__m512i tbl, i8;
+
+	tbl = _mm512_i32gather_epi32(_mm512_srli_epi32(ip, CHAR_BIT),
+			(const void *)lpm->tbl24, sizeof(uint32_t));
+
+	ext = _mm512_cmpeq_epi32_mask(_mm512_and_epi32(tbl, xv), xv);
+	if (unlikely(ext != 0)) {
+		i8 = _mm512_add_epi32(_mm512_and_epi32(ip, mask8),
+			_mm512_slli_epi32(_mm512_and_epi32(tbl, mask24),
+				CHAR_BIT)); /* * RTE_LPM_TBL8_GROUP_NUM_ENTRIES */
+		tbl = _mm512_mask_i32gather_epi32(tbl, ext, i8,
+			(const void *)lpm->tbl8, sizeof(uint32_t));
+	}
+
+	valid = _mm512_test_epi32_mask(tbl, v);
+	_mm512_storeu_si512(hop, _mm512_mask_blend_epi32(valid,
+		_mm512_set1_epi32(defv), _mm512_and_epi32(tbl, mask24)));
+}
+
+/* lpm_process_x8_avx2() 16 packets at a time. */
+static __rte_noinline __attribute__((target("avx512f"))) int
+lpm_process_x16_avx512(const struct lcore_conf *qconf,
+		struct rte_mbuf **pkts, int nb_rx, uint16_t portid,
+		uint16_t *dst_port)
+{
+	const __m128i bswap_mask = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11,
+						4, 5, 6, 7, 0, 1, 2, 3);
+	const int k = RTE_ALIGN_FLOOR(nb_rx, 4 * FWDSTEP);
+	uint32_t ipv4_flag[4];
+	uint32_t hop[4 * FWDSTEP];
+	__m128i dip[4];
+	__m512i ip;
+	int i, j;
+
+	for (j = 0; j != k; j += 4 * FWDSTEP) {
+		for (i = 0; i < 4; i++)
+			processx4_step1(&pkts[j + i * FWDSTEP], &dip[i],
+					&ipv4_flag[i]);
+
+		if (unlikely(!ipv4_flag[0] || !ipv4_flag[1] ||
+				!ipv4_flag[2] || !ipv4_flag[3])) {
+			for (i = 0; i < 4; i++)
+				processx4_step2(qconf, dip[i], ipv4_flag[i],
+						portid, &pkts[j + i * FWDSTEP],
+						&dst_port[j + i * FWDSTEP]);
+			continue;
+		}
+
+		ip = _mm512_castsi128_si512(_mm_shuffle_epi8(dip[0],
+				bswap_mask));
+		ip = _mm512_inserti32x4(ip, _mm_shuffle_epi8(dip[1],
+				bswap_mask), 1);
+		ip = _mm512_inserti32x4(ip, _mm_shuffle_epi8(dip[2],
+				bswap_mask), 2);
+		ip = _mm512_inserti32x4(ip, _mm_shuffle_epi8(dip[3],
+				bswap_mask), 3);
+		lpm_lookupx16_avx512(qconf->ipv4_lookup_struct, ip, hop,
+				LPM_LOOKUP_MISS);
+		for (i = 0; i < 4; i++)
+			lpm_fixup_missx4(qconf, hop + i * FWDSTEP, portid);
+		for (i = 0; i < 4 * FWDSTEP; i++)
+			dst_port[j + i] = hop[i];
+	}
+
+	return k;
+}
+#endif /* CC_AVX512_SUPPORT */
+
+/*
+ * Pick the widest lookup kernel the CPU runs and the EAL allows
+ * (--force-max-simd-bitwidth). Done once, all sockets share it.
+ */
+static void
+lpm_simd_select(void)
+{
+	const uint16_t max_bits = rte_vect_get_max_simd_bitwidth();
+	static const char * const names[] = {
+		[LPM_SIMD_SSE] = "SSE (4-wide)",
+		[LPM_SIMD_AVX2] = "AVX2 (8-wide)",
+		[LPM_SIMD_AVX512] = "AVX-512 (16-wide)",
+	};
+	static int selected;
+
+	/* setup_lpm() of several sockets may run at once */
+	if (__atomic_exchange_n(&selected, 1, __ATOMIC_RELAXED))
+		return;
+
+	lpm_simd = LPM_SIMD_SSE;
+#ifdef CC_AVX512_SUPPORT
+	if (max_bits >= RTE_VECT_SIMD_512 &&
+			rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX512F) == 1)
+		lpm_simd = LPM_SIMD_AVX512;
+	else
+#endif
+	if (max_bits >= RTE_VECT_SIMD_256 &&
+			rte_cpu_get_flag_enabled(RTE_CPUFLAG_AVX2) == 1)
+		lpm_simd = LPM_SIMD_AVX2;
+
+	printf("LPM IPv4 lookup: %s\n", names[lpm_simd]);
+}
+
+/*
+ * Run the selected wide kernel over the start of the burst, returns the
+ * number of packets it did.
+ */
+static __rte_always_inline int
+lpm_process_wide(const struct lcore_conf *qconf, struct rte_mbuf **pkts,
+		int nb_rx, uint16_t portid, uint16_t *dst_port)
+{
+#ifdef CC_AVX512_SUPPORT
+	if (lpm_simd == LPM_SIMD_AVX512)
+		return lpm_process_x16_avx512(qconf, pkts, nb_rx, portid,
+				dst_port);
+#endif
+	if (lpm_simd == LPM_SIMD_AVX2)
+		return lpm_process_x8_avx2(qconf, pkts, nb_rx, portid,
+				dst_port);
+
+	return 0;
+}
+
+#endif /* __L3FWD_LPM_AVX_H__ */
@@ -0,0 +1,104 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+#ifndef __L3FWD_LPM_LANES_H__
+#define __L3FWD_LPM_LANES_H__
+
+/*
+ * Dual-stack bursts: the vector path only looks up groups of 4 packets
+ * that are all IPv4, any other group falls back to per packet lookups.
+ * A burst that is not IPv4 only is therefore split by packet_type into
+ * an IPv4 lane, run through the vector path, and an IPv6 lane, run
+ * through rte_lpm6_lookup_bulk_func(). Other packets go back out of
+ * the rx port, as in lpm_get_dst_port(). The next hops are written back
+ * in burst order, ready for send_packets_multi().
+ *
+ * Expects lpm_process_vector() from the including arch header.
+ */
+
+/*
+ * Look up the next hop of every packet of a burst received on portid,
+ * into dst_port. af (L3FWD_LOOP_IPV4/IPV6) names the families expected:
+ * IPv4 alone goes straight to the vector path, IPv6 alone skips the
+ * IPv4 only check. Any packet is still forwarded by any instance.
+ */
+static __rte_always_inline void
+l3fwd_lpm_process_af(int nb_rx, struct rte_mbuf **pkts_burst,
+			uint16_t portid, uint16_t *dst_port,
+			struct lcore_conf *qconf, const uint8_t af)
+{
+	uint8_t ip6[MAX_PKT_BURST][RTE_LPM6_IPV6_ADDR_SIZE];
+	struct rte_mbuf *lane4[MAX_PKT_BURST];
+	uint16_t dst4[MAX_PKT_BURST];
+	uint16_t idx4[MAX_PKT_BURST];
+	uint16_t idx6[MAX_PKT_BURST];
+	int32_t hop6[MAX_PKT_BURST];
+	struct rte_ipv6_hdr *ipv6_hdr;
+	uint32_t ptype;
+	int i, n4, n6;
+
+	if (af == L3FWD_LOOP_IPV4) {
+		lpm_process_vector(nb_rx, pkts_burst, portid, dst_port, qconf);
+		return;
+	}
+
+	if (af & L3FWD_LOOP_IPV4) {
+		for (i = 0, n4 = 0; i < nb_rx; i++)
+			n4 += RTE_ETH_IS_IPV4_HDR(
+					pkts_burst[i]->packet_type) != 0;
+
+		if (likely(n4 == nb_rx)) {
+			lpm_process_vector(nb_rx, pkts_burst, portid,
+					dst_port, qconf);
+			return;
+		}
+	}
+
+	for (i = 0, n4 = 0, n6 = 0; i < nb_rx; i++) {
+		ptype = pkts_burst[i]->packet_type;
+		if (RTE_ETH_IS_IPV4_HDR(ptype)) {
+			lane4[n4] = pkts_burst[i];
+			idx4[n4++] = i;
+		} else if (RTE_ETH_IS_IPV6_HDR(ptype)) {
+			ipv6_hdr = rte_pktmbuf_mtod_offset(pkts_burst[i],
+					struct rte_ipv6_hdr *,
+					sizeof(struct rte_ether_hdr));
+			memcpy(ip6[n6], ipv6_hdr->dst_addr,
+			       RTE_LPM6_IPV6_ADDR_SIZE);
+			idx6[n6++] = i;
+		} else
+			dst_port[i] = portid;
+	}
+
+	if (n4 != 0) {
+		lpm_process_vector(n4, lane4, portid, dst4, qconf);
+		for (i = 0; i < n4; i++)
+			dst_port[idx4[i]] = dst4[i];
+	}
+
+	if (n6 != 0) {
+		rte_lpm6_lookup_bulk_func(qconf->ipv6_lookup_struct, ip6,
+					  hop6, n6);
+		for (i = 0; i < n6; i++) {
+			if (likely(hop6[i] >= 0)) {
+				dst_port[idx6[i]] = hop6[i];
+			} else {
+				dst_port[idx6[i]] = portid;
+				qconf->stats->lookup_miss++;
+			}
+		}
+	}
+}
+
+/* Dual-stack l3fwd_lpm_process_af(). */
+static inline void
+l3fwd_lpm_process_packets(int nb_rx, struct rte_mbuf **pkts_burst,
+			uint16_t portid, uint16_t *dst_port,
+			struct lcore_conf *qconf)
+{
+	l3fwd_lpm_process_af(nb_rx, pkts_burst, portid, dst_port, qconf,
+			L3FWD_LOOP_AF);
+}
+
+#endif /* __L3FWD_LPM_LANES_H__ */
@@ -64,7 +64,8 @@ processx4_step2(const struct lcore_conf *qconf,
 	/* if all 4 packets are IPV4. */
 	if (likely(ipv4_flag)) {
 		rte_lpm_lookupx4(qconf->ipv4_lookup_struct, dip, dst.u32,
-			portid);
+			LPM_LOOKUP_MISS);
+		lpm_fixup_missx4(qconf, dst.u32, portid);
 		/* get rid of unused upper 16 bit for each dport. */
 		dst.x = _mm_packs_epi32(dst.x, dst.x);
 		*(uint64_t *)dprt = dst.u64[0];
@@ -77,25 +78,30 @@ processx4_step2(const struct lcore_conf *qconf,
 	}
 }
 
+#include "l3fwd_lpm_avx.h"
+
 /*
- * Buffer optimized handling of packets, invoked
- * from main_loop.
+ * Look up the next hop of every packet of a burst received on portid,
+ * into dst_port. The AVX2/AVX-512 kernel, if selected, takes the
+ * multiples of 8/16 packets first.
  */
 static inline void
-l3fwd_lpm_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
-			uint16_t portid, struct lcore_conf *qconf)
+lpm_process_vector(int nb_rx, struct rte_mbuf **pkts_burst,
+			uint16_t portid, uint16_t *dst_port,
+			struct lcore_conf *qconf)
 {
-	int32_t j;
-	uint16_t dst_port[MAX_PKT_BURST];
+	int32_t j, n;
 	__m128i dip[MAX_PKT_BURST / FWDSTEP];
 	uint32_t ipv4_flag[MAX_PKT_BURST / FWDSTEP];
 	const int32_t k = RTE_ALIGN_FLOOR(nb_rx, FWDSTEP);
 
-	for (j = 0; j != k; j += FWDSTEP)
+	n = lpm_process_wide(qconf, pkts_burst, nb_rx, portid, dst_port);
+
+	for (j = n; j != k; j += FWDSTEP)
 		processx4_step1(&pkts_burst[j], &dip[j / FWDSTEP],
 				&ipv4_flag[j / FWDSTEP]);
 
-	for (j = 0; j != k; j += FWDSTEP)
+	for (j = n; j != k; j += FWDSTEP)
 		processx4_step2(qconf, dip[j / FWDSTEP],
 				ipv4_flag[j / FWDSTEP], portid, &pkts_burst[j], &dst_port[j]);
 
@@ -113,7 +119,21 @@ l3fwd_lpm_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
 		dst_port[j] = lpm_get_dst_port(qconf, pkts_burst[j], portid);
 		j++;
 	}
+}
+
+#include "l3fwd_lpm_lanes.h"
+
+/*
+ * Buffer optimized handling of packets, invoked
+ * from main_loop.
+ */
+static inline void
+l3fwd_lpm_send_packets(int nb_rx, struct rte_mbuf **pkts_burst,
+			uint16_t portid, struct lcore_conf *qconf)
+{
+	uint16_t dst_port[MAX_PKT_BURST];
 
+	l3fwd_lpm_process_packets(nb_rx, pkts_burst, portid, dst_port, qconf);
 	send_packets_multi(qconf, pkts_burst, dst_port, nb_rx);
 }
 
@@ -10,12 +10,15 @@
 #include "l3fwd_common.h"
 
 /*
- * Update source and destination MAC addresses in the ethernet header.
+ * Resolve the next hops in dst_port to their adjacencies, replace them
+ * with the egress ports and update source and destination MAC addresses
+ * in the ethernet header from the adjacency.
  * Perform RFC1812 checks and updates for IPV4 packets.
  */
 static inline void
 processx4_step3(struct rte_mbuf *pkt[FWDSTEP], uint16_t dst_port[FWDSTEP])
 {
+	const struct l3fwd_adj *adj[FWDSTEP];
 	uint32x4_t te[FWDSTEP];
 	uint32x4_t ve[FWDSTEP];
 	uint32_t *p[FWDSTEP];
@@ -25,16 +28,27 @@ processx4_step3(struct rte_mbuf *pkt[FWDSTEP], uint16_t dst_port[FWDSTEP])
 	p[2] = rte_pktmbuf_mtod(pkt[2], uint32_t *);
 	p[3] = rte_pktmbuf_mtod(pkt[3], uint32_t *);
 
-	ve[0] = vreinterpretq_u32_s32(val_eth[dst_port[0]]);
+	/* Resolve next hops to adjacencies and their egress ports. */
+	adj[0] = l3fwd_adj_get_enabled(dst_port[0], pkt[0]);
+	adj[1] = l3fwd_adj_get_enabled(dst_port[1], pkt[1]);
+	adj[2] = l3fwd_adj_get_enabled(dst_port[2], pkt[2]);
+	adj[3] = l3fwd_adj_get_enabled(dst_port[3], pkt[3]);
+
+	dst_port[0] = adj[0]->port;
+	dst_port[1] = adj[1]->port;
+	dst_port[2] = adj[2]->port;
+	dst_port[3] = adj[3]->port;
+
+	ve[0] = vreinterpretq_u32_s32(adj[0]->val_eth);
 	te[0] = vld1q_u32(p[0]);
 
-	ve[1] = vreinterpretq_u32_s32(val_eth[dst_port[1]]);
+	ve[1] = vreinterpretq_u32_s32(adj[1]->val_eth);
 	te[1] = vld1q_u32(p[1]);
 
-	ve[2] = vreinterpretq_u32_s32(val_eth[dst_port[2]]);
+	ve[2] = vreinterpretq_u32_s32(adj[2]->val_eth);
 	te[2] = vld1q_u32(p[2]);
 
-	ve[3] = vreinterpretq_u32_s32(val_eth[dst_port[3]]);
+	ve[3] = vreinterpretq_u32_s32(adj[3]->val_eth);
 	te[3] = vld1q_u32(p[3]);
 
 	/* Update last 4 bytes */
@@ -102,19 +116,24 @@ port_groupx4(uint16_t pn[FWDSTEP + 1], uint16_t *lp, uint16x8_t dp1,
 
 /**
  * Process one packet:
+ * Resolve the next hop to its adjacency and egress port.
  * Update source and destination MAC addresses in the ethernet header.
  * Perform RFC1812 checks and updates for IPV4 packets.
  */
 static inline void
 process_packet(struct rte_mbuf *pkt, uint16_t *dst_port)
 {
+	const struct l3fwd_adj *adj;
 	struct rte_ether_hdr *eth_hdr;
 	uint32x4_t te, ve;
 
 	eth_hdr = rte_pktmbuf_mtod(pkt, struct rte_ether_hdr *);
 
+	adj = l3fwd_adj_get_enabled(dst_port[0], pkt);
+	dst_port[0] = adj->port;
+
 	te = vld1q_u32((uint32_t *)eth_hdr);
-	ve = vreinterpretq_u32_s32(val_eth[dst_port[0]]);
+	ve = vreinterpretq_u32_s32(adj->val_eth);
 
 
 	rfc1812_process((struct rte_ipv4_hdr *)(eth_hdr + 1), dst_port,
@@ -212,11 +231,10 @@ send_packets_multi(struct lcore_conf *qconf, struct rte_mbuf **pkts_burst,
 	 * Consecutive packets with the same destination port
 	 * are already grouped together.
 	 * If destination port for the packet equals BAD_PORT,
-	 * then free the packet without sending it out.
+	 * then drop the packet without sending it out.
 	 */
 	for (j = 0; j < nb_rx; j += k) {
 
-		int32_t m;
 		uint16_t pn;
 
 		pn = dst_port[j];
@@ -224,9 +242,10 @@ send_packets_multi(struct lcore_conf *qconf, struct rte_mbuf **pkts_burst,
 
 		if (likely(pn != BAD_PORT))
 			send_packetsx4(qconf, pn, pkts_burst + j, k);
-		else
-			for (m = j; m != j + k; m++)
-				rte_pktmbuf_free(pkts_burst[m]);
+		else {
+			qconf->stats->bad_port_drops += k;
+			l3fwd_drop_bulk(qconf, pkts_burst + j, k);
+		}
 
 	}
 }
@@ -0,0 +1,608 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+/*
+ * Pipeline mode (--pipeline): rx, lookup and tx run on separate lcores.
+ *
+ * - rx lcores (those in --config) number the packets of each rx queue
+ *   and hand bursts round-robin to the workers over SP/SC rings;
+ * - workers (enabled lcores in no other role) run the ACL stage and the
+ *   LPM/EM/FIB burst path; their output goes to the tx lcore of the
+ *   rx queue over an MP/SC ring, with the egress port in mbuf->port;
+ * - tx lcores (listed with --pipeline) restore the rx order of each rx
+ *   queue with an rte_reorder buffer and transmit.
+ *
+ * Workers do not free what they drop (ACL deny, bad port): it goes to
+ * the tx lcore with BAD_PORT in mbuf->port, takes its place in the
+ * reorder buffer and is freed when it drains. Packets lost on the way
+ * (a full done ring) leave holes in the sequence; a reorder buffer that
+ * made no progress for a whole drain period skips its oldest hole, so
+ * they do not hold traffic back.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+
+#include <rte_common.h>
+#include <rte_errno.h>
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_ethdev.h>
+#include <rte_mbuf.h>
+#include <rte_ring.h>
+#include <rte_reorder.h>
+#include <rte_string_fns.h>
+#include <rte_telemetry.h>
+
+#include "l3fwd.h"
+
+#define PIPELINE_MAX_WORKERS	32
+#define PIPELINE_MAX_TX		16
+#define PIPELINE_MAX_RXQ	64
+
+enum pipeline_role {
+	PIPELINE_NONE = 0,
+	PIPELINE_RX,
+	PIPELINE_WORKER,
+	PIPELINE_TX,
+};
+
+/* Per-lcore stage counters, written by the owning lcore only. */
+struct pipeline_stats {
+	uint64_t polls;		/**< input ring polls */
+	uint64_t occupancy;	/**< input ring entries summed over polls */
+	uint64_t stalls;	/**< packets the next stage did not accept */
+	uint64_t late;		/**< outside the reorder window, sent as is */
+	uint64_t gaps;		/**< sequence holes skipped */
+};
+
+/* One per rx queue. */
+struct pipeline_rxq {
+	struct rte_ring *work[PIPELINE_MAX_WORKERS];	/* rx -> worker */
+	struct rte_ring *done;				/* workers -> tx */
+	struct rte_reorder_buffer *buf;
+	uint32_t seqn;
+	uint16_t next_worker;
+	uint16_t port_id;
+};
+
+/* Worker input. */
+struct pipeline_in {
+	struct rte_ring *ring;
+	struct rte_ring *done;
+	uint16_t port_id;
+};
+
+/* Tx input. */
+struct pipeline_ord {
+	struct rte_ring *ring;
+	struct rte_reorder_buffer *buf;
+	uint32_t pending;		/* inserted, not yet drained */
+	rte_reorder_seqn_t next_seqn;	/* oldest sequence still expected */
+	uint8_t progress;		/* drained since the last drain tick */
+};
+
+struct pipeline_lcore {
+	enum pipeline_role role;
+	uint16_t n;
+	struct pipeline_rxq *rxq[MAX_RX_QUEUE_PER_LCORE];	/* rx */
+	struct pipeline_in in[PIPELINE_MAX_RXQ];		/* worker */
+	struct pipeline_ord ord[PIPELINE_MAX_RXQ];		/* tx */
+	struct rte_mbuf gap;	/* tx: stands in for a lost sequence */
+	struct pipeline_stats stats;
+} __rte_cache_aligned;
+
+static struct pipeline_lcore pipeline_lcore[RTE_MAX_LCORE];
+static struct pipeline_rxq pipeline_rxq[PIPELINE_MAX_RXQ];
+static unsigned int nb_pipeline_rxq;
+
+static unsigned int pipeline_worker[PIPELINE_MAX_WORKERS];
+static unsigned int nb_pipeline_workers;
+static unsigned int pipeline_tx[PIPELINE_MAX_TX];
+static unsigned int nb_pipeline_tx;
+
+static l3fwd_process_burst_t pipeline_process_burst;
+
+static const char * const pipeline_stage_name[] = {
+	[PIPELINE_RX] = "rx",
+	[PIPELINE_WORKER] = "worker",
+	[PIPELINE_TX] = "tx",
+};
+
+/* --pipeline=LCORE[,LCORE...]: the tx lcores. */
+int
+l3fwd_pipeline_parse(const char *arg)
+{
+	char *str_fld[PIPELINE_MAX_TX + 1];
+	unsigned long lcore;
+	char s[256];
+	char *end;
+	int i, n;
+
+	if (strlcpy(s, arg, sizeof(s)) >= sizeof(s))
+		return -1;
+	n = rte_strsplit(s, sizeof(s), str_fld, RTE_DIM(str_fld), ',');
+	if (n <= 0 || n > PIPELINE_MAX_TX)
+		return -1;
+
+	for (i = 0; i < n; i++) {
+		errno = 0;
+		lcore = strtoul(str_fld[i], &end, 10);
+		if (errno != 0 || end == str_fld[i] || *end != '\0' ||
+				lcore >= RTE_MAX_LCORE)
+			return -1;
+		pipeline_tx[i] = lcore;
+	}
+	nb_pipeline_tx = n;
+
+	return 0;
+}
+
+static void
+pipeline_stats_sum(enum pipeline_role role, struct pipeline_stats *sum,
+		uint64_t *tx_drops)
+{
+	const struct pipeline_lcore *pl;
+	unsigned int lcore_id;
+
+	memset(sum, 0, sizeof(*sum));
+	*tx_drops = 0;
+	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+		pl = &pipeline_lcore[lcore_id];
+		if (pl->role != role)
+			continue;
+		sum->polls += pl->stats.polls;
+		sum->occupancy += pl->stats.occupancy;
+		sum->stalls += pl->stats.stalls;
+		sum->late += pl->stats.late;
+		sum->gaps += pl->stats.gaps;
+		*tx_drops += l3fwd_lcore_stats[lcore_id].tx_drops;
+	}
+}
+
+/*
+ * Stage view: the input rings of the bottleneck stage run full and the
+ * stage in front of it stalls. Worker stalls are the packets the tx
+ * rings refused, which --tx-policy accounts as tx drops.
+ */
+static int
+handle_pipeline(const char *cmd __rte_unused, const char *params __rte_unused,
+		struct rte_tel_data *d)
+{
+	struct pipeline_stats sum;
+	struct rte_tel_data *st;
+	uint64_t tx_drops;
+	unsigned int role;
+
+	rte_tel_data_start_dict(d);
+	for (role = PIPELINE_RX; role <= PIPELINE_TX; role++) {
+		st = rte_tel_data_alloc();
+		if (st == NULL)
+			return -ENOMEM;
+
+		pipeline_stats_sum(role, &sum, &tx_drops);
+		rte_tel_data_start_dict(st);
+		if (role != PIPELINE_RX) {
+			rte_tel_data_add_dict_u64(st, "avg_occupancy",
+				sum.polls ? sum.occupancy / sum.polls : 0);
+			/* both sample their input ring: in, or done for tx */
+			rte_tel_data_add_dict_u64(st, "ring_size",
+				PIPELINE_RING_SZ);
+		}
+		rte_tel_data_add_dict_u64(st, "stalls",
+			sum.stalls + (role == PIPELINE_RX ? 0 : tx_drops));
+		if (role == PIPELINE_TX) {
+			rte_tel_data_add_dict_u64(st, "late", sum.late);
+			rte_tel_data_add_dict_u64(st, "gaps", sum.gaps);
+		}
+		rte_tel_data_add_dict_container(d, pipeline_stage_name[role],
+			st, 0);
+	}
+
+	return 0;
+}
+
+static struct rte_ring *
+pipeline_ring_create(const char *s, unsigned int flags, int socketid)
+{
+	struct rte_ring *r;
+
+	r = rte_ring_create(s, PIPELINE_RING_SZ, socketid, flags);
+	if (r == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot create ring %s\n", s);
+
+	return r;
+}
+
+/*
+ * Assign the lcore roles and connect the stages. Called after the ports
+ * are set up, with the burst function of the selected lookup method.
+ */
+void
+l3fwd_pipeline_setup(l3fwd_process_burst_t process_burst, int numa_on)
+{
+	struct pipeline_lcore *pl, *wk, *tx;
+	struct pipeline_rxq *rxq;
+	struct lcore_conf *qconf;
+	unsigned int lcore_id, i, w;
+	int socketid;
+	uint16_t q;
+	char s[64];
+
+	pipeline_process_burst = process_burst;
+
+	for (i = 0; i < nb_pipeline_tx; i++) {
+		lcore_id = pipeline_tx[i];
+		if (!rte_lcore_is_enabled(lcore_id) ||
+				lcore_conf[lcore_id].n_rx_queue != 0 ||
+				pipeline_lcore[lcore_id].role != PIPELINE_NONE)
+			rte_exit(EXIT_FAILURE,
+				"pipeline: tx lcore %u must be enabled, "
+				"unique and without rx queues\n", lcore_id);
+		pipeline_lcore[lcore_id].role = PIPELINE_TX;
+	}
+
+	RTE_LCORE_FOREACH(lcore_id) {
+		pl = &pipeline_lcore[lcore_id];
+		if (lcore_conf[lcore_id].n_rx_queue != 0)
+			pl->role = PIPELINE_RX;
+		else if (pl->role == PIPELINE_NONE) {
+			if (nb_pipeline_workers == PIPELINE_MAX_WORKERS)
+				rte_exit(EXIT_FAILURE,
+					"pipeline supports at most %u workers\n",
+					PIPELINE_MAX_WORKERS);
+			pl->role = PIPELINE_WORKER;
+			pipeline_worker[nb_pipeline_workers++] = lcore_id;
+		}
+	}
+	if (nb_pipeline_workers == 0)
+		rte_exit(EXIT_FAILURE, "pipeline needs at least one worker\n");
+
+	RTE_LCORE_FOREACH(lcore_id) {
+		qconf = &lcore_conf[lcore_id];
+		pl = &pipeline_lcore[lcore_id];
+
+		for (q = 0; q < qconf->n_rx_queue; q++) {
+			if (nb_pipeline_rxq == PIPELINE_MAX_RXQ)
+				rte_exit(EXIT_FAILURE,
+					"pipeline supports at most %u rx queues\n",
+					PIPELINE_MAX_RXQ);
+			rxq = &pipeline_rxq[nb_pipeline_rxq];
+			rxq->port_id = qconf->rx_queue_list[q].port_id;
+			pl->rxq[q] = rxq;
+
+			/* rx queues are spread over the tx lcores */
+			tx = &pipeline_lcore[
+				pipeline_tx[nb_pipeline_rxq % nb_pipeline_tx]];
+			socketid = numa_on ? (int)rte_lcore_to_socket_id(
+				pipeline_tx[nb_pipeline_rxq % nb_pipeline_tx]) : 0;
+
+			snprintf(s, sizeof(s), "pipe_done_%u", nb_pipeline_rxq);
+			rxq->done = pipeline_ring_create(s, RING_F_SC_DEQ,
+				socketid);
+
+			snprintf(s, sizeof(s), "pipe_reorder_%u",
+				nb_pipeline_rxq);
+			rxq->buf = rte_reorder_create(s, socketid,
+				PIPELINE_REORDER_SZ);
+			if (rxq->buf == NULL)
+				rte_exit(EXIT_FAILURE,
+					"Cannot create reorder buffer %s\n", s);
+
+			tx->ord[tx->n].ring = rxq->done;
+			tx->ord[tx->n].buf = rxq->buf;
+			tx->n++;
+
+			for (w = 0; w < nb_pipeline_workers; w++) {
+				wk = &pipeline_lcore[pipeline_worker[w]];
+				socketid = numa_on ? (int)rte_lcore_to_socket_id(
+					pipeline_worker[w]) : 0;
+
+				snprintf(s, sizeof(s), "pipe_work_%u_%u",
+					nb_pipeline_rxq, pipeline_worker[w]);
+				rxq->work[w] = pipeline_ring_create(s,
+					RING_F_SP_ENQ | RING_F_SC_DEQ,
+					socketid);
+
+				wk->in[wk->n].ring = rxq->work[w];
+				wk->in[wk->n].done = rxq->done;
+				wk->in[wk->n].port_id = rxq->port_id;
+				wk->n++;
+			}
+
+			nb_pipeline_rxq++;
+		}
+	}
+
+	rte_telemetry_register_cmd("/l3fwd/pipeline", handle_pipeline,
+		"Returns occupancy and stall counters per pipeline stage. "
+		"No parameters");
+
+	printf("pipeline: %u rx queues, %u workers, %u tx lcores\n",
+		nb_pipeline_rxq, nb_pipeline_workers, nb_pipeline_tx);
+}
+
+static int
+pipeline_rx_loop(struct lcore_conf *qconf, struct pipeline_lcore *pl)
+{
+	struct rte_mbuf *pkts_burst[MAX_PKT_BURST];
+	struct pipeline_rxq *rxq;
+	uint64_t loop_tsc;
+	unsigned int n;
+	uint16_t portid;
+	uint8_t queueid;
+	int i, j, nb_rx;
+	int busy = 0;
+
+	loop_tsc = rte_rdtsc();
+	while (!force_quit) {
+
+		l3fwd_stats_loop(qconf->stats, rte_rdtsc(), &loop_tsc, busy);
+		busy = 0;
+
+		for (i = 0; i < qconf->n_rx_queue; ++i) {
+			portid = qconf->rx_queue_list[i].port_id;
+			queueid = qconf->rx_queue_list[i].queue_id;
+			nb_rx = rte_eth_rx_burst(portid, queueid, pkts_burst,
+				MAX_PKT_BURST);
+			l3fwd_stats_rx(qconf->stats, nb_rx);
+			if (nb_rx == 0)
+				continue;
+			busy = 1;
+
+			rxq = pl->rxq[i];
+
+			/*
+			 * Only this lcore enqueues, so free space can only
+			 * grow: drop the excess before numbering, so drops
+			 * here do not leave holes in the sequence.
+			 */
+			n = rte_ring_free_count(rxq->work[rxq->next_worker]);
+			if (unlikely(n < (unsigned int)nb_rx)) {
+				pl->stats.stalls += nb_rx - n;
+				rte_pktmbuf_free_bulk(pkts_burst + n,
+					nb_rx - n);
+				nb_rx = n;
+			}
+
+			for (j = 0; j < nb_rx; j++)
+				*rte_reorder_seqn(pkts_burst[j]) = rxq->seqn++;
+
+			rte_ring_sp_enqueue_burst(rxq->work[rxq->next_worker],
+				(void **)pkts_burst, nb_rx, NULL);
+			if (++rxq->next_worker == nb_pipeline_workers)
+				rxq->next_worker = 0;
+		}
+	}
+
+	return 0;
+}
+
+static int
+pipeline_worker_loop(struct lcore_conf *qconf, struct pipeline_lcore *pl)
+{
+	struct rte_mbuf *pkts_burst[MAX_PKT_BURST];
+	uint64_t loop_tsc;
+	unsigned int avail;
+	int acl_on;
+	int i, nb_rx;
+	int busy = 0;
+
+	acl_on = qconf->acl4_ctx != NULL || qconf->acl6_ctx != NULL;
+
+	loop_tsc = rte_rdtsc();
+	while (!force_quit) {
+
+		l3fwd_stats_loop(qconf->stats, rte_rdtsc(), &loop_tsc, busy);
+		busy = 0;
+
+		for (i = 0; i < pl->n; ++i) {
+			nb_rx = rte_ring_sc_dequeue_burst(pl->in[i].ring,
+				(void **)pkts_burst, MAX_PKT_BURST, &avail);
+			pl->stats.polls++;
+			pl->stats.occupancy += nb_rx + avail;
+			if (nb_rx == 0)
+				continue;
+			busy = 1;
+
+			/*
+			 * Everything sent or dropped now goes to the tx lcore
+			 * of this rx queue; flush before the next queue to
+			 * keep it so.
+			 */
+			qconf->tx_pipe = pl->in[i].done;
+
+			/* Optional ACL stage, denied packets go as drops. */
+			if (acl_on) {
+				nb_rx = l3fwd_acl_filter(qconf, pkts_burst,
+						nb_rx);
+				if (nb_rx == 0)
+					continue;
+			}
+
+			pipeline_process_burst(nb_rx, pkts_burst,
+				pl->in[i].port_id, qconf);
+			l3fwd_tx_drain(qconf);
+		}
+	}
+
+	return 0;
+}
+
+/* Transmit what is in order in a reorder buffer, free the drops. */
+static inline void
+pipeline_ord_drain(struct lcore_conf *qconf, struct pipeline_ord *o,
+		const struct rte_mbuf *gap)
+{
+	struct rte_mbuf *m[MAX_PKT_BURST];
+	unsigned int i, n;
+
+	do {
+		n = rte_reorder_drain(o->buf, m, MAX_PKT_BURST);
+		for (i = 0; i < n; i++) {
+			o->next_seqn = *rte_reorder_seqn(m[i]) + 1;
+			if (m[i] == gap)
+				continue;
+			o->pending--;
+			o->progress = 1;
+			if (unlikely(m[i]->port == BAD_PORT))
+				rte_pktmbuf_free(m[i]);
+			else
+				send_single_packet(qconf, m[i], m[i]->port);
+		}
+	} while (n == MAX_PKT_BURST);
+}
+
+/*
+ * Drain tick: a buffer that holds packets but drained none since the
+ * last tick waits for a sequence that was lost upstream. Fill the hole
+ * with the gap mbuf until packets flow again.
+ */
+static inline void
+pipeline_ord_skip_gaps(struct lcore_conf *qconf, struct pipeline_ord *o,
+		struct rte_mbuf *gap, struct pipeline_stats *ps)
+{
+	rte_reorder_seqn_t seqn;
+
+	while (o->pending != 0 && !o->progress) {
+		seqn = o->next_seqn;
+		*rte_reorder_seqn(gap) = seqn;
+		if (rte_reorder_insert(o->buf, gap) != 0)
+			break;
+		ps->gaps++;
+		pipeline_ord_drain(qconf, o, gap);
+		if (o->next_seqn == seqn)
+			break;
+	}
+	o->progress = 0;
+}
+
+static int
+pipeline_tx_loop(struct lcore_conf *qconf, struct pipeline_lcore *pl)
+{
+	struct rte_mbuf *pkts_burst[MAX_PKT_BURST];
+	uint64_t prev_tsc, diff_tsc, cur_tsc;
+	struct pipeline_ord *o;
+	uint64_t loop_tsc;
+	unsigned int avail;
+	int i, j, nb_rx;
+	int busy = 0;
+	const uint64_t drain_tsc = (rte_get_tsc_hz() + US_PER_S - 1) /
+		US_PER_S * BURST_TX_DRAIN_US;
+
+	prev_tsc = 0;
+
+	loop_tsc = rte_rdtsc();
+	while (!force_quit) {
+
+		cur_tsc = rte_rdtsc();
+		l3fwd_stats_loop(qconf->stats, cur_tsc, &loop_tsc, busy);
+		busy = 0;
+
+		/*
+		 * TX burst queue drain
+		 */
+		diff_tsc = cur_tsc - prev_tsc;
+		if (unlikely(diff_tsc > drain_tsc)) {
+
+			for (i = 0; i < pl->n; ++i)
+				pipeline_ord_skip_gaps(qconf, &pl->ord[i],
+					&pl->gap, &pl->stats);
+			l3fwd_tx_drain(qconf);
+
+			prev_tsc = cur_tsc;
+		}
+
+		for (i = 0; i < pl->n; ++i) {
+			o = &pl->ord[i];
+			nb_rx = rte_ring_sc_dequeue_burst(o->ring,
+				(void **)pkts_burst, MAX_PKT_BURST, &avail);
+			pl->stats.polls++;
+			pl->stats.occupancy += nb_rx + avail;
+			if (nb_rx == 0)
+				continue;
+			busy = 1;
+
+			for (j = 0; j < nb_rx; j++) {
+				if (rte_reorder_insert(o->buf,
+						pkts_burst[j]) == 0) {
+					o->pending++;
+					continue;
+				}
+				if (pkts_burst[j]->port == BAD_PORT) {
+					/* a worker drop, nothing to keep */
+					rte_pktmbuf_free(pkts_burst[j]);
+				} else if (rte_errno == ERANGE) {
+					/* too late to reorder, send as is */
+					pl->stats.late++;
+					send_single_packet(qconf, pkts_burst[j],
+						pkts_burst[j]->port);
+				} else {
+					pl->stats.stalls++;
+					rte_pktmbuf_free(pkts_burst[j]);
+				}
+			}
+
+			pipeline_ord_drain(qconf, o, &pl->gap);
+		}
+	}
+
+	return 0;
+}
+
+/* main processing loop */
+int
+pipeline_main_loop(__rte_unused void *dummy)
+{
+	struct pipeline_lcore *pl;
+	struct lcore_conf *qconf;
+	unsigned int lcore_id;
+
+	lcore_id = rte_lcore_id();
+	qconf = &lcore_conf[lcore_id];
+	pl = &pipeline_lcore[lcore_id];
+
+	switch (pl->role) {
+	case PIPELINE_RX:
+		RTE_LOG(INFO, L3FWD, "entering pipeline rx loop on lcore %u\n",
+			lcore_id);
+		return pipeline_rx_loop(qconf, pl);
+	case PIPELINE_WORKER:
+		RTE_LOG(INFO, L3FWD,
+			"entering pipeline worker loop on lcore %u\n",
+			lcore_id);
+		return pipeline_worker_loop(qconf, pl);
+	case PIPELINE_TX:
+		RTE_LOG(INFO, L3FWD, "entering pipeline tx loop on lcore %u\n",
+			lcore_id);
+		return pipeline_tx_loop(qconf, pl);
+	default:
+		RTE_LOG(INFO, L3FWD, "lcore %u has nothing to do\n", lcore_id);
+		return 0;
+	}
+}
+
+void
+l3fwd_pipeline_print_stats(void)
+{
+	struct pipeline_stats sum;
+	uint64_t tx_drops;
+	unsigned int role;
+
+	printf("\nPipeline stages:\n");
+	for (role = PIPELINE_RX; role <= PIPELINE_TX; role++) {
+		pipeline_stats_sum(role, &sum, &tx_drops);
+		printf("  %-6s avg occupancy %"PRIu64" stalls %"PRIu64,
+			pipeline_stage_name[role], sum.polls ? sum.occupancy / sum.polls : 0,
+			sum.stalls + (role == PIPELINE_RX ? 0 : tx_drops));
+		if (role == PIPELINE_TX)
+			printf(" late %"PRIu64" gaps %"PRIu64,
+				sum.late, sum.gaps);
+		printf("\n");
+	}
+}
@@ -0,0 +1,134 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+#ifndef __L3FWD_PTYPE_H__
+#define __L3FWD_PTYPE_H__
+
+/*
+ * Burst software packet type parser for --parse-ptype, the rx callback
+ * of ports without ptype offload.
+ *
+ * Two 32-bit words are read from each frame: bytes 12-15 (ether_type,
+ * IPv4 version/IHL) and bytes 20-23 (IPv6 next header, IPv4 protocol in
+ * the last byte). They are packed four packets to a vector and the
+ * whole classification is compares and selects, without a branch per
+ * packet. The result matches lpm_parse_ptype() (L3 only) and
+ * em_parse_ptype() (L3 and L4) bit for bit.
+ *
+ * SSE on x86, NEON on Arm; both are little endian, which the lane
+ * layout relies on. Other architectures keep the per packet parsers.
+ */
+
+#include <limits.h>
+
+#include <rte_vect.h>
+
+#if defined(RTE_ARCH_X86) || defined(__ARM_NEON)
+#define L3FWD_PTYPE_VEC	1
+#endif
+
+#ifdef L3FWD_PTYPE_VEC
+
+#define PTYPE_STEP	4
+
+#if defined(RTE_ARCH_X86)
+typedef __m128i ptype_vec_t;
+#define PT_LOAD(p)	_mm_loadu_si128((const __m128i *)(p))
+#define PT_STORE(p, v)	_mm_storeu_si128((__m128i *)(p), (v))
+#define PT_SET1(x)	_mm_set1_epi32(x)
+#define PT_EQ(a, b)	_mm_cmpeq_epi32((a), (b))
+#define PT_AND(a, b)	_mm_and_si128((a), (b))
+#define PT_OR(a, b)	_mm_or_si128((a), (b))
+#define PT_SHR(a, n)	_mm_srli_epi32((a), (n))
+/* mask ? a : b */
+#define PT_SEL(m, a, b)	_mm_or_si128(_mm_and_si128((m), (a)), \
+				_mm_andnot_si128((m), (b)))
+#else
+typedef uint32x4_t ptype_vec_t;
+#define PT_LOAD(p)	vld1q_u32(p)
+#define PT_STORE(p, v)	vst1q_u32((p), (v))
+#define PT_SET1(x)	vdupq_n_u32(x)
+#define PT_EQ(a, b)	vceqq_u32((a), (b))
+#define PT_AND(a, b)	vandq_u32((a), (b))
+#define PT_OR(a, b)	vorrq_u32((a), (b))
+#define PT_SHR(a, n)	vshrq_n_u32((a), (n))
+#define PT_SEL(m, a, b)	vbslq_u32((m), (a), (b))
+#endif
+
+#define PTYPE_W0_OFF	offsetof(struct rte_ether_hdr, ether_type)
+#define PTYPE_W1_OFF	(sizeof(struct rte_ether_hdr) + \
+			 offsetof(struct rte_ipv6_hdr, proto))
+/* byte of the IPv4 protocol in the second word */
+#define PTYPE_W1_PROTO4	(offsetof(struct rte_ipv4_hdr, next_proto_id) - \
+			 offsetof(struct rte_ipv6_hdr, proto))
+
+/* Classify up to PTYPE_STEP packets, l4 as em_parse_ptype(). */
+static __rte_always_inline void
+l3fwd_parse_ptype_x4(struct rte_mbuf **pkts, uint32_t n, int l4)
+{
+	uint32_t w0[PTYPE_STEP] = { 0 }, w1[PTYPE_STEP] = { 0 };
+	uint32_t ptype[PTYPE_STEP];
+	ptype_vec_t v0, v1, et, is4, is6, ihl5, proto, tcp, udp, pt;
+	const uint8_t *p;
+	uint32_t i;
+
+	for (i = 0; i < n; i++) {
+		p = rte_pktmbuf_mtod(pkts[i], const uint8_t *);
+		memcpy(&w0[i], p + PTYPE_W0_OFF, sizeof(w0[i]));
+		memcpy(&w1[i], p + PTYPE_W1_OFF, sizeof(w1[i]));
+	}
+	v0 = PT_LOAD(w0);
+	v1 = PT_LOAD(w1);
+
+	et = PT_AND(v0, PT_SET1(UINT16_MAX));
+	is4 = PT_EQ(et, PT_SET1(rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4)));
+	is6 = PT_EQ(et, PT_SET1(rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV6)));
+
+	if (!l4) {
+		pt = PT_OR(PT_AND(is4, PT_SET1(RTE_PTYPE_L3_IPV4_EXT_UNKNOWN)),
+			PT_AND(is6, PT_SET1(RTE_PTYPE_L3_IPV6_EXT_UNKNOWN)));
+	} else {
+		/* IHL of 5: no options, the L4 header follows */
+		ihl5 = PT_EQ(PT_AND(PT_SHR(v0, 16),
+				PT_SET1(RTE_IPV4_HDR_IHL_MASK)),
+			PT_SET1(sizeof(struct rte_ipv4_hdr) /
+				RTE_IPV4_IHL_MULTIPLIER));
+		proto = PT_SEL(is4, PT_SHR(v1, PTYPE_W1_PROTO4 * CHAR_BIT),
+			PT_AND(v1, PT_SET1(UINT8_MAX)));
+		tcp = PT_EQ(proto, PT_SET1(IPPROTO_TCP));
+		udp = PT_EQ(proto, PT_SET1(IPPROTO_UDP));
+
+		pt = PT_OR(PT_AND(is4, PT_SEL(ihl5, PT_SET1(RTE_PTYPE_L3_IPV4),
+				PT_SET1(RTE_PTYPE_L3_IPV4_EXT))),
+			PT_AND(is6, PT_SEL(PT_OR(tcp, udp),
+				PT_SET1(RTE_PTYPE_L3_IPV6),
+				PT_SET1(RTE_PTYPE_L3_IPV6_EXT_UNKNOWN))));
+		pt = PT_OR(pt, PT_AND(PT_OR(PT_AND(is4, ihl5), is6),
+			PT_OR(PT_AND(tcp, PT_SET1(RTE_PTYPE_L4_TCP)),
+				PT_AND(udp, PT_SET1(RTE_PTYPE_L4_UDP)))));
+	}
+
+	PT_STORE(ptype, pt);
+	for (i = 0; i < n; i++)
+		pkts[i]->packet_type = ptype[i];
+}
+
+/* Set packet_type of a whole burst. */
+static inline void
+l3fwd_parse_ptype_burst(struct rte_mbuf **pkts, uint16_t nb_pkts, int l4)
+{
+	uint16_t i;
+
+	for (i = 0; i < nb_pkts; i++)
+		rte_prefetch0(rte_pktmbuf_mtod(pkts[i], void *));
+
+	for (i = 0; i + PTYPE_STEP <= nb_pkts; i += PTYPE_STEP)
+		l3fwd_parse_ptype_x4(&pkts[i], PTYPE_STEP, l4);
+	if (i != nb_pkts)
+		l3fwd_parse_ptype_x4(&pkts[i], nb_pkts - i, l4);
+}
+
+#endif /* L3FWD_PTYPE_VEC */
+
+#endif /* __L3FWD_PTYPE_H__ */
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2010-2016 Intel Corporation
+ * Copyright(c) 2021 yockgen
+ */
+
+#ifndef __L3FWD_ROUTE_H__
+#define __L3FWD_ROUTE_H__
+
+/*
+ * Prefix routes shared by the LPM and FIB lookup methods.
+ */
+
+#define IPV4_L3FWD_NUM_ROUTES 8
+#define IPV6_L3FWD_NUM_ROUTES 8
+
+struct ipv4_l3fwd_route {
+	uint32_t ip;
+	uint8_t  depth;
+	uint8_t  if_out;
+};
+
+struct ipv6_l3fwd_route {
+	uint8_t ip[16];
+	uint8_t  depth;
+	uint8_t  if_out;
+};
+
+extern const struct ipv4_l3fwd_route
+	ipv4_l3fwd_route_array[IPV4_L3FWD_NUM_ROUTES];
+extern const struct ipv6_l3fwd_route
+	ipv6_l3fwd_route_array[IPV6_L3FWD_NUM_ROUTES];
+
+/*
+ * Routes added on the command line with --route. Their next hop is an
+ * adjacency id (port, next hop or ECMP group), see l3fwd_adj_get().
+ */
+#define L3FWD_MAX_NH_ROUTES 256
+
+struct ipv4_l3fwd_nh_route {
+	uint32_t ip;
+	uint8_t  depth;
+	uint16_t nh;
+};
+
+struct ipv6_l3fwd_nh_route {
+	uint8_t ip[16];
+	uint8_t  depth;
+	uint16_t nh;
+};
+
+extern struct ipv4_l3fwd_nh_route
+	ipv4_l3fwd_nh_route_array[L3FWD_MAX_NH_ROUTES];
+extern unsigned int ipv4_l3fwd_nh_route_num;
+extern struct ipv6_l3fwd_nh_route
+	ipv6_l3fwd_nh_route_array[L3FWD_MAX_NH_ROUTES];
+extern unsigned int ipv6_l3fwd_nh_route_num;
+
+#endif /* __L3FWD_ROUTE_H__ */
@@ -10,12 +10,15 @@
 #include "l3fwd_common.h"
 
 /*
- * Update source and destination MAC addresses in the ethernet header.
+ * Resolve the next hops in dst_port to their adjacencies, replace them
+ * with the egress ports and update source and destination MAC addresses
+ * in the ethernet header from the adjacency.
  * Perform RFC1812 checks and updates for IPV4 packets.
  */
 static inline void
 processx4_step3(struct rte_mbuf *pkt[FWDSTEP], uint16_t dst_port[FWDSTEP])
 {
+	const struct l3fwd_adj *adj[FWDSTEP];
 	__m128i te[FWDSTEP];
 	__m128i ve[FWDSTEP];
 	__m128i *p[FWDSTEP];
@@ -25,16 +28,27 @@ processx4_step3(struct rte_mbuf *pkt[FWDSTEP], uint16_t dst_port[FWDSTEP])
 	p[2] = rte_pktmbuf_mtod(pkt[2], __m128i *);
 	p[3] = rte_pktmbuf_mtod(pkt[3], __m128i *);
 
-	ve[0] = val_eth[dst_port[0]];
+	/* Resolve next hops to adjacencies and their egress ports. */
+	adj[0] = l3fwd_adj_get_enabled(dst_port[0], pkt[0]);
+	adj[1] = l3fwd_adj_get_enabled(dst_port[1], pkt[1]);
+	adj[2] = l3fwd_adj_get_enabled(dst_port[2], pkt[2]);
+	adj[3] = l3fwd_adj_get_enabled(dst_port[3], pkt[3]);
+
+	dst_port[0] = adj[0]->port;
+	dst_port[1] = adj[1]->port;
+	dst_port[2] = adj[2]->port;
+	dst_port[3] = adj[3]->port;
+
+	ve[0] = adj[0]->val_eth;
 	te[0] = _mm_loadu_si128(p[0]);
 
-	ve[1] = val_eth[dst_port[1]];
+	ve[1] = adj[1]->val_eth;
 	te[1] = _mm_loadu_si128(p[1]);
 
-	ve[2] = val_eth[dst_port[2]];
+	ve[2] = adj[2]->val_eth;
 	te[2] = _mm_loadu_si128(p[2]);
 
-	ve[3] = val_eth[dst_port[3]];
+	ve[3] = adj[3]->val_eth;
 	te[3] = _mm_loadu_si128(p[3]);
 
 	/* Update first 12 bytes, keep rest bytes intact. */
@@ -99,19 +113,24 @@ port_groupx4(uint16_t pn[FWDSTEP + 1], uint16_t *lp, __m128i dp1, __m128i dp2)
 
 /**
  * Process one packet:
+ * Resolve the next hop to its adjacency and egress port.
  * Update source and destination MAC addresses in the ethernet header.
  * Perform RFC1812 checks and updates for IPV4 packets.
  */
 static inline void
 process_packet(struct rte_mbuf *pkt, uint16_t *dst_port)
 {
+	const struct l3fwd_adj *adj;
 	struct rte_ether_hdr *eth_hdr;
 	__m128i te, ve;
 
 	eth_hdr = rte_pktmbuf_mtod(pkt, struct rte_ether_hdr *);
 
+	adj = l3fwd_adj_get_enabled(dst_port[0], pkt);
+	dst_port[0] = adj->port;
+
 	te = _mm_loadu_si128((__m128i *)eth_hdr);
-	ve = val_eth[dst_port[0]];
+	ve = adj->val_eth;
 
 	rfc1812_process((struct rte_ipv4_hdr *)(eth_hdr + 1), dst_port,
 			pkt->packet_type);
@@ -209,11 +228,10 @@ send_packets_multi(struct lcore_conf *qconf, struct rte_mbuf **pkts_burst,
 	 * Consecutive packets with the same destination port
 	 * are already grouped together.
 	 * If destination port for the packet equals BAD_PORT,
-	 * then free the packet without sending it out.
+	 * then drop the packet without sending it out.
 	 */
 	for (j = 0; j < nb_rx; j += k) {
 
-		int32_t m;
 		uint16_t pn;
 
 		pn = dst_port[j];
@@ -221,9 +239,10 @@ send_packets_multi(struct lcore_conf *qconf, struct rte_mbuf **pkts_burst,
 
 		if (likely(pn != BAD_PORT))
 			send_packetsx4(qconf, pn, pkts_burst + j, k);
-		else
-			for (m = j; m != j + k; m++)
-				rte_pktmbuf_free(pkts_burst[m]);
+		else {
+			qconf->stats->bad_port_drops += k;
+			l3fwd_drop_bulk(qconf, pkts_burst + j, k);
+		}
 
 	}
 }
@@ -0,0 +1,172 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <rte_common.h>
+#include <rte_lcore.h>
+#include <rte_telemetry.h>
+
+#include "l3fwd.h"
+
+struct l3fwd_lcore_stats l3fwd_lcore_stats[RTE_MAX_LCORE];
+
+/* Sum the counters of one lcore into *sum. */
+static void
+stats_add(struct l3fwd_lcore_stats *sum, const struct l3fwd_lcore_stats *st)
+{
+	unsigned int i;
+
+	sum->rx_pkts += st->rx_pkts;
+	sum->tx_pkts += st->tx_pkts;
+	sum->tx_drops += st->tx_drops;
+	sum->lookup_miss += st->lookup_miss;
+	sum->bad_port_drops += st->bad_port_drops;
+	sum->dist_drops += st->dist_drops;
+	sum->empty_polls += st->empty_polls;
+	sum->busy_cycles += st->busy_cycles;
+	sum->idle_cycles += st->idle_cycles;
+	sum->flow_cache_hits += st->flow_cache_hits;
+	sum->flow_cache_misses += st->flow_cache_misses;
+	sum->idle_sleeps += st->idle_sleeps;
+	sum->idle_wakeups += st->idle_wakeups;
+	sum->drain_ticks += st->drain_ticks;
+	for (i = 0; i < L3FWD_BURST_HIST_SZ; i++)
+		sum->burst_hist[i] += st->burst_hist[i];
+}
+
+static int
+stats_to_dict(const struct l3fwd_lcore_stats *st, struct rte_tel_data *d)
+{
+	struct rte_tel_data *hist;
+	unsigned int i;
+
+	hist = rte_tel_data_alloc();
+	if (hist == NULL)
+		return -ENOMEM;
+
+	rte_tel_data_start_dict(d);
+	rte_tel_data_add_dict_u64(d, "rx_pkts", st->rx_pkts);
+	rte_tel_data_add_dict_u64(d, "tx_pkts", st->tx_pkts);
+	rte_tel_data_add_dict_u64(d, "tx_drops", st->tx_drops);
+	rte_tel_data_add_dict_u64(d, "lookup_miss", st->lookup_miss);
+	rte_tel_data_add_dict_u64(d, "bad_port_drops", st->bad_port_drops);
+	rte_tel_data_add_dict_u64(d, "dist_drops", st->dist_drops);
+	rte_tel_data_add_dict_u64(d, "empty_polls", st->empty_polls);
+	rte_tel_data_add_dict_u64(d, "busy_cycles", st->busy_cycles);
+	rte_tel_data_add_dict_u64(d, "idle_cycles", st->idle_cycles);
+	rte_tel_data_add_dict_u64(d, "flow_cache_hits", st->flow_cache_hits);
+	rte_tel_data_add_dict_u64(d, "flow_cache_misses",
+		st->flow_cache_misses);
+	rte_tel_data_add_dict_u64(d, "idle_sleeps", st->idle_sleeps);
+	rte_tel_data_add_dict_u64(d, "idle_wakeups", st->idle_wakeups);
+	rte_tel_data_add_dict_u64(d, "drain_ticks", st->drain_ticks);
+
+	/* bucket i counts bursts of 2^i to 2^(i+1) - 1 packets */
+	rte_tel_data_start_array(hist, RTE_TEL_U64_VAL);
+	for (i = 0; i < L3FWD_BURST_HIST_SZ; i++)
+		rte_tel_data_add_array_u64(hist, st->burst_hist[i]);
+	rte_tel_data_add_dict_container(d, "burst_hist", hist, 0);
+
+	return 0;
+}
+
+static int
+handle_lcores(const char *cmd __rte_unused, const char *params __rte_unused,
+		struct rte_tel_data *d)
+{
+	unsigned int lcore_id;
+
+	rte_tel_data_start_array(d, RTE_TEL_INT_VAL);
+	RTE_LCORE_FOREACH(lcore_id)
+		rte_tel_data_add_array_int(d, lcore_id);
+
+	return 0;
+}
+
+static int
+handle_lcore_stats(const char *cmd __rte_unused, const char *params,
+		struct rte_tel_data *d)
+{
+	unsigned long lcore_id;
+	char *end;
+
+	if (params == NULL || *params == '\0')
+		return -EINVAL;
+
+	errno = 0;
+	lcore_id = strtoul(params, &end, 10);
+	if (errno != 0 || *end != '\0' || lcore_id >= RTE_MAX_LCORE ||
+			!rte_lcore_is_enabled(lcore_id))
+		return -EINVAL;
+
+	return stats_to_dict(&l3fwd_lcore_stats[lcore_id], d);
+}
+
+static int
+handle_stats(const char *cmd __rte_unused, const char *params __rte_unused,
+		struct rte_tel_data *d)
+{
+	struct l3fwd_lcore_stats sum;
+	unsigned int lcore_id;
+
+	memset(&sum, 0, sizeof(sum));
+	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++)
+		stats_add(&sum, &l3fwd_lcore_stats[lcore_id]);
+
+	return stats_to_dict(&sum, d);
+}
+
+static int
+handle_tx_stats(const char *cmd __rte_unused, const char *params,
+		struct rte_tel_data *d)
+{
+	uint64_t drops = 0, retries = 0, parked = 0;
+	unsigned int lcore_id;
+	unsigned long port;
+	char *end;
+
+	if (params == NULL || *params == '\0')
+		return -EINVAL;
+
+	errno = 0;
+	port = strtoul(params, &end, 10);
+	if (errno != 0 || *end != '\0' || port >= RTE_MAX_ETHPORTS)
+		return -EINVAL;
+
+	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+		drops += l3fwd_lcore_stats[lcore_id].tx_port_drops[port];
+		retries += l3fwd_lcore_stats[lcore_id].tx_port_retries[port];
+		parked += l3fwd_lcore_stats[lcore_id].tx_port_parked[port];
+	}
+
+	rte_tel_data_start_dict(d);
+	rte_tel_data_add_dict_u64(d, "drops", drops);
+	rte_tel_data_add_dict_u64(d, "retries", retries);
+	rte_tel_data_add_dict_u64(d, "parked", parked);
+
+	return 0;
+}
+
+void
+l3fwd_stats_init(void)
+{
+	unsigned int lcore_id;
+
+	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++)
+		lcore_conf[lcore_id].stats = &l3fwd_lcore_stats[lcore_id];
+
+	rte_telemetry_register_cmd("/l3fwd/lcores", handle_lcores,
+		"Returns the enabled lcores. No parameters");
+	rte_telemetry_register_cmd("/l3fwd/lcore_stats", handle_lcore_stats,
+		"Returns forwarding counters of an lcore. Parameters: int lcore_id");
+	rte_telemetry_register_cmd("/l3fwd/stats", handle_stats,
+		"Returns forwarding counters summed over all lcores. No parameters");
+	rte_telemetry_register_cmd("/l3fwd/tx_stats", handle_tx_stats,
+		"Returns tx backpressure counters of a port. Parameters: int port_id");
+}
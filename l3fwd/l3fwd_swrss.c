@@ -0,0 +1,377 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+/*
+ * Software RSS for NICs with a single rx queue.
+ *
+ * The lcore polling a port (the rx lcore) hashes the 5-tuple of every
+ * packet and hands it to one of the worker lcores (enabled lcores without
+ * rx queues) through a single-producer/single-consumer ring. Packets of a
+ * flow always hash to the same worker, so per-flow order is kept.
+ * Workers run the normal LPM/EM/FIB burst processing. A port that cannot
+ * give every lcore its own tx queue is transmitted by its rx lcore only;
+ * the workers feed it through a multi-producer tx ring.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <rte_common.h>
+#include <rte_lcore.h>
+#include <rte_cycles.h>
+#include <rte_ether.h>
+#include <rte_ethdev.h>
+#include <rte_mbuf.h>
+#include <rte_pause.h>
+#include <rte_ring.h>
+
+#include "l3fwd.h"
+
+#define SWRSS_MAX_WORKERS 32
+
+struct swrss_in {
+	struct rte_ring *ring;
+	uint16_t port_id;	/* rx port of the packets in ring */
+};
+
+struct swrss_lcore {
+	/* rx lcore: one ring per worker and rx queue */
+	struct rte_ring *out[MAX_RX_QUEUE_PER_LCORE][SWRSS_MAX_WORKERS];
+	/* worker: one ring per rx queue of every rx lcore */
+	struct swrss_in in[RTE_MAX_ETHPORTS];
+	uint16_t n_in;
+} __rte_cache_aligned;
+
+static struct swrss_lcore swrss_lcore[RTE_MAX_LCORE];
+static struct rte_ring *swrss_tx_ring[RTE_MAX_ETHPORTS];
+static unsigned int swrss_worker[SWRSS_MAX_WORKERS];
+static unsigned int nb_swrss_workers;
+static unsigned int swrss_workers_running;	/* until they flushed at exit */
+static l3fwd_process_burst_t swrss_process_burst;
+
+/*
+ * Return the shared tx ring of a port, creating it on first use.
+ * Only the rx lcore of the port dequeues from it.
+ */
+struct rte_ring *
+l3fwd_swrss_tx_ring(uint16_t portid, int socketid)
+{
+	char s[64];
+
+	if (swrss_tx_ring[portid] != NULL)
+		return swrss_tx_ring[portid];
+
+	snprintf(s, sizeof(s), "swrss_tx_%u", portid);
+	swrss_tx_ring[portid] = rte_ring_create(s, SWRSS_TX_RING_SZ, socketid,
+			RING_F_SC_DEQ);
+	if (swrss_tx_ring[portid] == NULL)
+		rte_exit(EXIT_FAILURE, "Cannot create tx ring for port %u\n",
+			portid);
+
+	return swrss_tx_ring[portid];
+}
+
+/*
+ * Connect every rx queue to every worker. Called after the ports are set
+ * up, with the burst function of the selected lookup method.
+ */
+void
+l3fwd_swrss_setup(l3fwd_process_burst_t process_burst, int numa_on)
+{
+	struct swrss_lcore *rx, *wk;
+	struct lcore_conf *qconf;
+	unsigned int lcore_id, w;
+	int socketid;
+	uint16_t i;
+	char s[64];
+
+	swrss_process_burst = process_burst;
+
+	RTE_LCORE_FOREACH(lcore_id) {
+		if (lcore_conf[lcore_id].n_rx_queue != 0)
+			continue;
+		if (nb_swrss_workers == SWRSS_MAX_WORKERS)
+			rte_exit(EXIT_FAILURE,
+				"sw-rss supports at most %u workers\n",
+				SWRSS_MAX_WORKERS);
+		swrss_worker[nb_swrss_workers++] = lcore_id;
+	}
+	if (nb_swrss_workers == 0)
+		rte_exit(EXIT_FAILURE,
+			"sw-rss needs at least one lcore without rx queues\n");
+	swrss_workers_running = nb_swrss_workers;
+
+	RTE_LCORE_FOREACH(lcore_id) {
+		qconf = &lcore_conf[lcore_id];
+		rx = &swrss_lcore[lcore_id];
+
+		for (i = 0; i < qconf->n_rx_queue; i++) {
+			for (w = 0; w < nb_swrss_workers; w++) {
+				wk = &swrss_lcore[swrss_worker[w]];
+				socketid = numa_on ?
+					(int)rte_lcore_to_socket_id(
+						swrss_worker[w]) : 0;
+
+				snprintf(s, sizeof(s), "swrss_%u_%u_%u",
+					lcore_id, i, swrss_worker[w]);
+				rx->out[i][w] = rte_ring_create(s,
+					SWRSS_RING_SZ, socketid,
+					RING_F_SP_ENQ | RING_F_SC_DEQ);
+				if (rx->out[i][w] == NULL)
+					rte_exit(EXIT_FAILURE,
+						"Cannot create ring %s\n", s);
+
+				if (wk->n_in == RTE_DIM(wk->in))
+					rte_exit(EXIT_FAILURE,
+						"Too many rx queues for sw-rss\n");
+				wk->in[wk->n_in].ring = rx->out[i][w];
+				wk->in[wk->n_in].port_id =
+					qconf->rx_queue_list[i].port_id;
+				wk->n_in++;
+			}
+		}
+	}
+
+	printf("sw-rss: %u workers:", nb_swrss_workers);
+	for (w = 0; w < nb_swrss_workers; w++)
+		printf(" %u", swrss_worker[w]);
+	printf("\n");
+}
+
+/* Spread one rx burst over the worker rings of an rx queue. */
+static inline void
+swrss_distribute(struct lcore_conf *qconf, struct rte_ring **out,
+		struct rte_mbuf **pkts, uint16_t nb_rx)
+{
+	struct rte_mbuf *burst[SWRSS_MAX_WORKERS][MAX_PKT_BURST];
+	uint16_t len[SWRSS_MAX_WORKERS] = {0};
+	uint32_t hash[MAX_PKT_BURST];
+	unsigned int n, w;
+	uint16_t i;
+
+	/* Hash the whole burst first so the CRC chains can overlap. */
+	for (i = 0; i < nb_rx; i++)
+		rte_prefetch0(rte_pktmbuf_mtod(pkts[i], void *));
+	for (i = 0; i < nb_rx; i++)
+		hash[i] = l3fwd_flow_hash(pkts[i]);
+
+	for (i = 0; i < nb_rx; i++) {
+		/* Scale the hash onto the workers without a division. */
+		w = ((uint64_t)hash[i] * nb_swrss_workers) >> 32;
+		burst[w][len[w]++] = pkts[i];
+	}
+
+	for (w = 0; w < nb_swrss_workers; w++) {
+		if (len[w] == 0)
+			continue;
+		n = rte_ring_sp_enqueue_burst(out[w], (void **)burst[w],
+				len[w], NULL);
+		if (unlikely(n < len[w])) {
+			qconf->stats->dist_drops += len[w] - n;
+			rte_pktmbuf_free_bulk(burst[w] + n, len[w] - n);
+		}
+	}
+}
+
+/*
+ * Transmit what the workers queued for a single tx queue port. Packets
+ * the PMD refuses stay at the head of the ring.
+ */
+static inline void
+swrss_tx_flush(struct rte_ring *r, uint16_t port, uint16_t queue)
+{
+	struct rte_mbuf *m[MAX_PKT_BURST];
+	unsigned int n, sent;
+
+	do {
+		n = rte_ring_dequeue_burst_start(r, (void **)m,
+				MAX_PKT_BURST, NULL);
+		if (n == 0)
+			return;
+		sent = rte_eth_tx_burst(port, queue, m, n);
+		rte_ring_dequeue_finish(r, sent);
+	} while (sent == n);
+}
+
+/* Free what is left in a ring at exit, returns the number of packets. */
+static unsigned int
+swrss_ring_free_pkts(struct rte_ring *r)
+{
+	struct rte_mbuf *m[MAX_PKT_BURST];
+	unsigned int n, total = 0;
+
+	while ((n = rte_ring_dequeue_burst(r, (void **)m, MAX_PKT_BURST,
+			NULL)) != 0) {
+		rte_pktmbuf_free_bulk(m, n);
+		total += n;
+	}
+
+	return total;
+}
+
+/*
+ * Exit of an rx lcore, once every worker flushed its tx buffers: send
+ * what the workers queued for the single tx queue ports and free what
+ * they did not read from the worker rings.
+ */
+static void
+swrss_rx_stop(struct lcore_conf *qconf, struct swrss_lcore *sl)
+{
+	unsigned int w;
+	uint16_t portid;
+	int i;
+
+	while (__atomic_load_n(&swrss_workers_running, __ATOMIC_ACQUIRE) != 0)
+		rte_pause();
+
+	for (i = 0; i < qconf->n_rx_queue; ++i) {
+		portid = qconf->rx_queue_list[i].port_id;
+
+		for (w = 0; w < nb_swrss_workers; w++)
+			qconf->stats->dist_drops +=
+				swrss_ring_free_pkts(sl->out[i][w]);
+
+		if (swrss_tx_ring[portid] != NULL) {
+			swrss_tx_flush(swrss_tx_ring[portid], portid,
+				l3fwd_tx_port(qconf, portid)->queue_id);
+			qconf->stats->tx_drops +=
+				swrss_ring_free_pkts(swrss_tx_ring[portid]);
+		}
+	}
+}
+
+static int
+swrss_rx_loop(struct lcore_conf *qconf, struct swrss_lcore *sl)
+{
+	struct rte_mbuf *pkts_burst[MAX_PKT_BURST];
+	uint64_t loop_tsc;
+	uint16_t portid;
+	uint8_t queueid;
+	int i, nb_rx;
+	int busy = 0;
+
+	loop_tsc = rte_rdtsc();
+	while (!force_quit) {
+
+		l3fwd_stats_loop(qconf->stats, rte_rdtsc(), &loop_tsc, busy);
+		busy = 0;
+
+		for (i = 0; i < qconf->n_rx_queue; ++i) {
+			portid = qconf->rx_queue_list[i].port_id;
+			queueid = qconf->rx_queue_list[i].queue_id;
+
+			if (swrss_tx_ring[portid] != NULL)
+				swrss_tx_flush(swrss_tx_ring[portid], portid,
+					l3fwd_tx_port(qconf, portid)->queue_id);
+
+			nb_rx = rte_eth_rx_burst(portid, queueid, pkts_burst,
+				MAX_PKT_BURST);
+			l3fwd_stats_rx(qconf->stats, nb_rx);
+			if (nb_rx == 0)
+				continue;
+			busy = 1;
+
+			swrss_distribute(qconf, sl->out[i], pkts_burst, nb_rx);
+		}
+	}
+
+	swrss_rx_stop(qconf, sl);
+
+	return 0;
+}
+
+static int
+swrss_worker_loop(struct lcore_conf *qconf, struct swrss_lcore *sl)
+{
+	struct rte_mbuf *pkts_burst[MAX_PKT_BURST];
+	uint64_t prev_tsc, diff_tsc, cur_tsc;
+	uint64_t loop_tsc;
+	int acl_on;
+	int i, nb_rx;
+	int busy = 0;
+	const uint64_t drain_tsc = (rte_get_tsc_hz() + US_PER_S - 1) /
+		US_PER_S * BURST_TX_DRAIN_US;
+
+	prev_tsc = 0;
+	acl_on = qconf->acl4_ctx != NULL || qconf->acl6_ctx != NULL;
+
+	loop_tsc = rte_rdtsc();
+	while (!force_quit) {
+
+		cur_tsc = rte_rdtsc();
+		l3fwd_stats_loop(qconf->stats, cur_tsc, &loop_tsc, busy);
+		busy = 0;
+
+		/*
+		 * TX burst queue drain
+		 */
+		diff_tsc = cur_tsc - prev_tsc;
+		if (unlikely(diff_tsc > drain_tsc)) {
+
+			l3fwd_tx_drain(qconf);
+
+			prev_tsc = cur_tsc;
+		}
+
+		/*
+		 * Read packets handed over by the rx lcores. They were
+		 * counted on rx there, so rx_pkts is not bumped again.
+		 */
+		for (i = 0; i < sl->n_in; ++i) {
+			nb_rx = rte_ring_sc_dequeue_burst(sl->in[i].ring,
+				(void **)pkts_burst, MAX_PKT_BURST, NULL);
+			if (nb_rx == 0)
+				continue;
+			busy = 1;
+
+			/* Optional ACL stage, denied packets are freed here. */
+			if (acl_on) {
+				nb_rx = l3fwd_acl_filter(qconf, pkts_burst,
+						nb_rx);
+				if (nb_rx == 0)
+					continue;
+			}
+
+			swrss_process_burst(nb_rx, pkts_burst,
+				sl->in[i].port_id, qconf);
+		}
+	}
+
+	/* the rx lcores send what this leaves in the shared tx rings */
+	l3fwd_tx_flush(qconf);
+	__atomic_sub_fetch(&swrss_workers_running, 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/* main processing loop */
+int
+swrss_main_loop(__rte_unused void *dummy)
+{
+	struct swrss_lcore *sl;
+	struct lcore_conf *qconf;
+	unsigned int lcore_id;
+	int i;
+
+	lcore_id = rte_lcore_id();
+	qconf = &lcore_conf[lcore_id];
+	sl = &swrss_lcore[lcore_id];
+
+	if (qconf->n_rx_queue != 0) {
+		RTE_LOG(INFO, L3FWD, "entering sw-rss rx loop on lcore %u\n",
+			lcore_id);
+		for (i = 0; i < qconf->n_rx_queue; i++)
+			RTE_LOG(INFO, L3FWD,
+				" -- lcoreid=%u portid=%u rxqueueid=%hhu\n",
+				lcore_id, qconf->rx_queue_list[i].port_id,
+				qconf->rx_queue_list[i].queue_id);
+		return swrss_rx_loop(qconf, sl);
+	}
+
+	RTE_LOG(INFO, L3FWD, "entering sw-rss worker loop on lcore %u\n",
+		lcore_id);
+	return swrss_worker_loop(qconf, sl);
+}
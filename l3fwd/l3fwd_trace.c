@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+/*
+ * Registration of the l3fwd.* tracepoints. The register header must
+ * come before any other include of rte_trace_point.h, so this file
+ * does not include l3fwd.h.
+ */
+
+#include <rte_trace_point_register.h>
+
+#include "l3fwd_trace.h"
+
+RTE_TRACE_POINT_DEFINE(l3fwd_trace_rx_burst);
+RTE_TRACE_POINT_DEFINE(l3fwd_trace_lookup);
+RTE_TRACE_POINT_DEFINE(l3fwd_trace_tx_burst);
+RTE_TRACE_POINT_DEFINE(l3fwd_trace_tx_drain);
+
+RTE_INIT(l3fwd_trace_init)
+{
+	RTE_TRACE_POINT_REGISTER(l3fwd_trace_rx_burst, l3fwd.rx_burst);
+	RTE_TRACE_POINT_REGISTER(l3fwd_trace_lookup, l3fwd.lookup);
+	RTE_TRACE_POINT_REGISTER(l3fwd_trace_tx_burst, l3fwd.tx_burst);
+	RTE_TRACE_POINT_REGISTER(l3fwd_trace_tx_drain, l3fwd.tx_drain);
+}
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+#ifndef __L3FWD_TRACE_H__
+#define __L3FWD_TRACE_H__
+
+/*
+ * Burst level tracepoints of the poll loops, registered as l3fwd.* in
+ * l3fwd_trace.c. They are of the slow path type on purpose: always
+ * compiled in, so they can be turned on at runtime with the EAL option
+ * --trace=l3fwd (--trace-dir=DIR for the CTF output) without a DPDK
+ * built with enable_trace_fp. Disabled, each costs one load and a not
+ * taken branch. The event timestamps give the timings, the loop does
+ * not read the TSC for them.
+ *
+ * scripts/trace_report.py turns the CTF trace into per-lcore timelines
+ * and burst size and processing time histograms.
+ */
+
+#include <rte_trace_point.h>
+
+/* A non empty rx burst. */
+RTE_TRACE_POINT(
+	l3fwd_trace_rx_burst,
+	RTE_TRACE_POINT_ARGS(uint16_t port_id, uint8_t queue_id,
+		uint16_t nb_rx),
+	rte_trace_point_emit_u16(port_id);
+	rte_trace_point_emit_u8(queue_id);
+	rte_trace_point_emit_u16(nb_rx);
+)
+
+/* The lookup of the burst received last is done. */
+RTE_TRACE_POINT(
+	l3fwd_trace_lookup,
+	RTE_TRACE_POINT_ARGS(uint16_t port_id, uint16_t nb_pkts),
+	rte_trace_point_emit_u16(port_id);
+	rte_trace_point_emit_u16(nb_pkts);
+)
+
+/* nb_pkts handed to the PMD of port_id, which took sent. */
+RTE_TRACE_POINT(
+	l3fwd_trace_tx_burst,
+	RTE_TRACE_POINT_ARGS(uint16_t port_id, uint16_t nb_pkts,
+		uint16_t sent),
+	rte_trace_point_emit_u16(port_id);
+	rte_trace_point_emit_u16(nb_pkts);
+	rte_trace_point_emit_u16(sent);
+)
+
+/* Drain tick, pending: tx staging entries holding packets. */
+RTE_TRACE_POINT(
+	l3fwd_trace_tx_drain,
+	RTE_TRACE_POINT_ARGS(uint32_t pending),
+	rte_trace_point_emit_u32(pending);
+)
+
+#endif /* __L3FWD_TRACE_H__ */
@@ -0,0 +1,209 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+/*
+ * Warm restart through a primary/secondary handover.
+ *
+ * The primary l3fwd owns the hugepages: mempools, LPM/ACL tables and the
+ * configured and started ports. A newer l3fwd started with
+ * --proc-type=secondary (same --file-prefix and application arguments)
+ * attaches to them instead of rebuilding, then takes forwarding over:
+ *
+ *   1. it takes the next generation number and makes it the owner in
+ *      the shared state;
+ *   2. the current owner notices within L3FWD_WARM_POLL_US, leaves its
+ *      loops, sends or frees what its lcores still hold for tx and
+ *      acknowledges;
+ *   3. the new instance launches its loops on the same rx queues.
+ *
+ * A secondary that handed over exits without touching the ports. The
+ * primary stays as the keeper of the memory until the instance that
+ * forwards last stops without a successor; then it closes the ports.
+ *
+ * EM and FIB tables hold function pointers into the binary that built
+ * them, so only LPM (with the optional ACL stage) can be attached.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <rte_common.h>
+#include <rte_alarm.h>
+#include <rte_cycles.h>
+#include <rte_eal.h>
+#include <rte_hash_crc.h>
+#include <rte_memzone.h>
+#include <rte_pause.h>
+
+#include "l3fwd.h"
+
+#define L3FWD_WARM_MZ		"l3fwd_warm"
+#define L3FWD_WARM_POLL_US	1000
+#define L3FWD_WARM_TIMEOUT_S	5
+#define L3FWD_WARM_NONE		0	/* nobody forwards */
+
+struct l3fwd_warm_state {
+	uint32_t args_crc;	/**< application arguments of the primary */
+	uint32_t last_gen;	/**< last generation handed out */
+	uint32_t owner;		/**< generation that forwards */
+	uint32_t stopped;	/**< last generation that left its loops */
+};
+
+static struct l3fwd_warm_state *warm;
+static uint32_t warm_gen;	/* ours */
+static uint32_t warm_prev;	/* the owner we take over from */
+static volatile int warm_handed_over;
+
+static uint32_t
+warm_args_crc(int argc, char **argv)
+{
+	uint32_t crc = 0;
+	int i;
+
+	for (i = 1; i < argc; i++)
+		crc = rte_hash_crc(argv[i], strlen(argv[i]) + 1, crc);
+
+	return crc;
+}
+
+/* Stop the loops once another instance owns forwarding. */
+static void
+warm_watch(__rte_unused void *arg)
+{
+	if (__atomic_load_n(&warm->owner, __ATOMIC_ACQUIRE) != warm_gen) {
+		warm_handed_over = 1;
+		force_quit = true;
+		return;
+	}
+
+	rte_eal_alarm_set(L3FWD_WARM_POLL_US, warm_watch, NULL);
+}
+
+/*
+ * Called with the application arguments, before anything is set up.
+ * The primary publishes the shared state, a secondary checks that it
+ * runs with the same configuration.
+ */
+void
+l3fwd_warm_init(int argc, char **argv)
+{
+	const struct rte_memzone *mz;
+	uint32_t crc = warm_args_crc(argc, argv);
+
+	if (rte_eal_process_type() == RTE_PROC_PRIMARY) {
+		mz = rte_memzone_reserve(L3FWD_WARM_MZ, sizeof(*warm),
+			SOCKET_ID_ANY, 0);
+		if (mz == NULL)
+			rte_exit(EXIT_FAILURE, "Cannot reserve %s\n",
+				L3FWD_WARM_MZ);
+		warm = mz->addr;
+		memset(warm, 0, sizeof(*warm));
+		warm->args_crc = crc;
+		warm->last_gen = warm_gen = 1;
+		warm->owner = warm_gen;
+		return;
+	}
+
+	mz = rte_memzone_lookup(L3FWD_WARM_MZ);
+	if (mz == NULL)
+		rte_exit(EXIT_FAILURE,
+			"warm restart: no l3fwd primary to attach to\n");
+	warm = mz->addr;
+	if (warm->args_crc != crc)
+		rte_exit(EXIT_FAILURE, "warm restart: application arguments "
+			"differ from those of the primary\n");
+
+	warm_gen = __atomic_add_fetch(&warm->last_gen, 1, __ATOMIC_RELAXED);
+	printf("warm restart: attaching as generation %u\n", warm_gen);
+}
+
+int
+l3fwd_warm_secondary(void)
+{
+	return rte_eal_process_type() != RTE_PROC_PRIMARY;
+}
+
+/*
+ * Right before launching the loops: become the owner and, as a
+ * secondary, wait until the previous owner left the rx queues.
+ */
+void
+l3fwd_warm_takeover(void)
+{
+	uint64_t start, deadline;
+
+	if (l3fwd_warm_secondary()) {
+		start = rte_get_timer_cycles();
+		deadline = start + rte_get_timer_hz() * L3FWD_WARM_TIMEOUT_S;
+
+		warm_prev = __atomic_exchange_n(&warm->owner, warm_gen,
+			__ATOMIC_ACQ_REL);
+		while (warm_prev != L3FWD_WARM_NONE &&
+				__atomic_load_n(&warm->stopped,
+					__ATOMIC_ACQUIRE) < warm_prev) {
+			if (rte_get_timer_cycles() > deadline)
+				rte_exit(EXIT_FAILURE, "warm restart: "
+					"generation %u did not stop\n",
+					warm_prev);
+			rte_pause();
+		}
+
+		printf("warm restart: took over from generation %u in "
+			"%.3f ms\n", warm_prev,
+			(rte_get_timer_cycles() - start) * 1e3 /
+			rte_get_timer_hz());
+	}
+
+	rte_eal_alarm_set(L3FWD_WARM_POLL_US, warm_watch, NULL);
+}
+
+/*
+ * Called once the loops returned. Returns 1 when the ports must be left
+ * alone: they are in use by a successor, or owned by the primary.
+ */
+int
+l3fwd_warm_stop(void)
+{
+	uint32_t owner;
+
+	rte_eal_alarm_cancel(warm_watch, NULL);
+
+	if (warm_handed_over) {
+		__atomic_store_n(&warm->stopped, warm_gen, __ATOMIC_RELEASE);
+		printf("warm restart: handed over to generation %u\n",
+			__atomic_load_n(&warm->owner, __ATOMIC_RELAXED));
+	} else {
+		/* stopped without a successor: the primary may close down */
+		owner = warm_gen;
+		__atomic_compare_exchange_n(&warm->owner, &owner,
+			L3FWD_WARM_NONE, 0, __ATOMIC_RELEASE,
+			__ATOMIC_RELAXED);
+		__atomic_store_n(&warm->stopped, warm_gen, __ATOMIC_RELEASE);
+	}
+
+	if (l3fwd_warm_secondary())
+		return 1;
+
+	/*
+	 * primary: keep the memory until the last instance stops, or until
+	 * we are signalled again.
+	 */
+	if (warm_handed_over) {
+		printf("warm restart: keeping tables and ports until the "
+			"forwarding instance stops\n");
+		force_quit = false;
+		while (__atomic_load_n(&warm->owner, __ATOMIC_ACQUIRE) !=
+				L3FWD_WARM_NONE && !force_quit)
+			usleep(100 * 1000);
+		if (force_quit)
+			printf("warm restart: generation %u still forwarding, "
+				"closing the ports\n",
+				__atomic_load_n(&warm->owner, __ATOMIC_RELAXED));
+	}
+
+	return 0;
+}
@@ -11,6 +11,7 @@
 #include <sys/queue.h>
 #include <stdarg.h>
 #include <errno.h>
+#include <limits.h>
 #include <getopt.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -60,9 +61,44 @@ static uint16_t nb_txd = RTE_TEST_TX_DESC_DEFAULT;
 /**< Ports set in promiscuous mode off by default. */
 static int promiscuous_on;
 
-/* Select Longest-Prefix or Exact match. */
+/* Select Longest-Prefix, Exact match or FIB. */
 static int l3fwd_lpm_on;
 static int l3fwd_em_on;
+static int l3fwd_fib_on;
+
+/* ACL stage in front of the lookup; enabled by --acl-rules. */
+static int l3fwd_acl_on;
+
+/* Software RSS: rx lcores hash flows onto worker lcores (--sw-rss). */
+static int sw_rss_on;
+
+/* Pipeline mode: separate rx, worker and tx lcores (--pipeline). */
+static int pipeline_on;
+
+/* Offline lookup benchmark on synthetic packets (--bench). */
+static int bench_on;
+
+/* Per-lcore flow cache in front of the lookup (--flow-cache). */
+static int flow_cache_on;
+
+/* Pause, then sleep on rx interrupts when idle (--adaptive-poll). */
+static int adaptive_poll_on;
+
+/* Drain interval follows the rx burst sizes (--adaptive-drain). */
+static int adaptive_drain_on;
+
+/* Sampled rx to tx latency (--latency). */
+static int latency_on;
+
+/* Expected traffic, L3FWD_LOOP_IPV4/IPV6 (--ip-family); 0: per method. */
+static uint8_t ip_family;
+
+/* The poll loop instance parses packet types, no rx callback needed. */
+static int loop_parses_ptype;
+
+/* Place rx queues on lcores of the port's socket (--auto-config). */
+static int auto_config_on;
+static uint16_t auto_config_queues; /**< per port, 0: one per core */
 
 /* Global variables. */
 
@@ -80,6 +116,11 @@ struct rte_ether_addr ports_eth_addr[RTE_MAX_ETHPORTS];
 
 xmm_t val_eth[RTE_MAX_ETHPORTS];
 
+/* TX backpressure policy and, for retry, its budget. */
+enum l3fwd_tx_policy tx_policy = L3FWD_TX_DROP;
+uint64_t tx_retry_tsc;
+static uint32_t tx_retry_us = BURST_TX_RETRY_US;
+
 /* mask of enabled ports */
 uint32_t enabled_port_mask;
 
@@ -134,10 +175,16 @@ static struct rte_mempool *pktmbuf_pool[RTE_MAX_ETHPORTS][NB_SOCKETS];
 static uint8_t lkp_per_socket[NB_SOCKETS];
 
 struct l3fwd_lkp_mode {
+	void  (*setup_begin)(void);
 	void  (*setup)(int);
+	void  (*setup_end)(void);
+	void  (*attach)(int);
 	int   (*check_ptype)(int);
 	rte_rx_callback_fn cb_parse_ptype;
 	int   (*main_loop)(void *);
+	const l3fwd_main_loop_t *main_loops;
+	l3fwd_process_burst_t process_burst;
+	l3fwd_bench_flow_t bench_flow;
 	void* (*get_ipv4_lookup_struct)(int);
 	void* (*get_ipv6_lookup_struct)(int);
 };
@@ -145,27 +192,45 @@ struct l3fwd_lkp_mode {
 static struct l3fwd_lkp_mode l3fwd_lkp;
 
 static struct l3fwd_lkp_mode l3fwd_em_lkp = {
+	.setup_begin            = em_setup_flows,
 	.setup                  = setup_hash,
+	.setup_end              = em_free_flows,
 	.check_ptype		= em_check_ptype,
 	.cb_parse_ptype		= em_cb_parse_ptype,
-	.main_loop              = em_main_loop,
+	.main_loops             = em_main_loops,
+	.process_burst          = em_process_burst,
+	.bench_flow             = em_bench_flow,
 	.get_ipv4_lookup_struct = em_get_ipv4_l3fwd_lookup_struct,
 	.get_ipv6_lookup_struct = em_get_ipv6_l3fwd_lookup_struct,
 };
 
 static struct l3fwd_lkp_mode l3fwd_lpm_lkp = {
 	.setup                  = setup_lpm,
+	.attach                 = attach_lpm,
 	.check_ptype		= lpm_check_ptype,
 	.cb_parse_ptype		= lpm_cb_parse_ptype,
-	.main_loop              = lpm_main_loop,
+	.main_loops             = lpm_main_loops,
+	.process_burst          = lpm_process_burst,
+	.bench_flow             = lpm_bench_flow,
 	.get_ipv4_lookup_struct = lpm_get_ipv4_l3fwd_lookup_struct,
 	.get_ipv6_lookup_struct = lpm_get_ipv6_l3fwd_lookup_struct,
 };
 
+static struct l3fwd_lkp_mode l3fwd_fib_lkp = {
+	.setup                  = setup_fib,
+	.check_ptype		= lpm_check_ptype,
+	.cb_parse_ptype		= lpm_cb_parse_ptype,
+	.main_loops             = fib_main_loops,
+	.process_burst          = fib_process_burst,
+	.bench_flow             = lpm_bench_flow,
+	.get_ipv4_lookup_struct = fib_get_ipv4_l3fwd_lookup_struct,
+	.get_ipv6_lookup_struct = fib_get_ipv6_l3fwd_lookup_struct,
+};
+
 /*
  * Setup lookup methods for forwarding.
- * Currently exact-match and longest-prefix-match
- * are supported ones.
+ * Currently exact-match, longest-prefix-match
+ * and FIB (DIR-24-8/trie) are supported ones.
  */
 static void
 setup_l3fwd_lookup_tables(void)
@@ -173,6 +238,9 @@ setup_l3fwd_lookup_tables(void)
 	/* Setup HASH lookup functions. */
 	if (l3fwd_em_on)
 		l3fwd_lkp = l3fwd_em_lkp;
+	/* Setup FIB lookup functions. */
+	else if (l3fwd_fib_on)
+		l3fwd_lkp = l3fwd_fib_lkp;
 	/* Setup LPM lookup functions. */
 	else
 		l3fwd_lkp = l3fwd_lpm_lkp;
@@ -225,6 +293,37 @@ check_port_config(void)
 	return 0;
 }
 
+/* With --sw-rss every port is polled through its queue 0 only. */
+static int
+check_sw_rss_config(void)
+{
+	uint16_t i;
+
+	for (i = 0; i < nb_lcore_params; ++i) {
+		if (lcore_params[i].queue_id != 0) {
+			printf("sw-rss allows only rx queue 0, got queue %u "
+				"on port %u\n", lcore_params[i].queue_id,
+				lcore_params[i].port_id);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/* lcore polling the rx queue 0 of a port, RTE_MAX_LCORE if none */
+static unsigned int
+get_port_rx_lcore(const uint16_t port)
+{
+	uint16_t i;
+
+	for (i = 0; i < nb_lcore_params; ++i)
+		if (lcore_params[i].port_id == port &&
+				lcore_params[i].queue_id == 0)
+			return lcore_params[i].lcore_id;
+
+	return RTE_MAX_LCORE;
+}
+
 static uint8_t
 get_port_n_rx_queues(const uint16_t port)
 {
@@ -277,6 +376,7 @@ print_usage(const char *prgname)
 		" [-P]"
 		" [-E]"
 		" [-L]"
+		" [-F]"
 		" --config (port,queue,lcore)[,(port,queue,lcore)]"
 		" [--eth-dest=X,MM:MM:MM:MM:MM:MM]"
 		" [--enable-jumbo [--max-pkt-len PKTLEN]]"
@@ -286,12 +386,31 @@ print_usage(const char *prgname)
 		" [--parse-ptype]"
 		" [--per-port-pool]"
 		" [--mode]"
-		" [--eventq-sched]\n\n"
+		" [--eventq-sched]"
+		" [--event-deq-depth=N]"
+		" [--event-enq-depth=N]"
+		" [--event-new-threshold=N]"
+		" [--event-prio=dscp|pcp]"
+		" [--nh=N,PORT,MM:MM:MM:MM:MM:MM]"
+		" [--ecmp=G,N[,N...]]"
+		" [--route=PREFIX/DEPTH,TARGET]"
+		" [--acl-rules=FILE]"
+		" [--tx-policy=drop|retry|park [--tx-retry-us=N]]"
+		" [--sw-rss]"
+		" [--pipeline=LCORE[,LCORE...]]"
+		" [--bench=DIST[,FLOWS[,SECONDS]]]"
+		" [--flow-cache[=ENTRIES]]"
+		" [--adaptive-poll[=PAUSE[,SLEEP]]]"
+		" [--ip-family=ipv4|ipv6|dual]"
+		" [--auto-config[=QUEUES]]"
+		" [--adaptive-drain[=CAP_US]]"
+		" [--latency[=N]]\n\n"
 
 		"  -p PORTMASK: Hexadecimal bitmask of ports to configure\n"
 		"  -P : Enable promiscuous mode\n"
 		"  -E : Enable exact match\n"
 		"  -L : Enable longest prefix match (default)\n"
+		"  -F : Enable FIB lookup (DIR-24-8 for IPv4, trie for IPv6)\n"
 		"  --config (port,queue,lcore): Rx queue configuration\n"
 		"  --eth-dest=X,MM:MM:MM:MM:MM:MM: Ethernet destination for port X\n"
 		"  --enable-jumbo: Enable jumbo frames\n"
@@ -310,8 +429,74 @@ print_usage(const char *prgname)
 		"                  Valid only if --mode=eventdev\n"
 		"  --event-eth-rxqs: Number of ethernet RX queues per device.\n"
 		"                    Default: 1\n"
-		"                    Valid only if --mode=eventdev\n\n",
-		prgname);
+		"                    Valid only if --mode=eventdev\n"
+		"  --event-deq-depth: Event port dequeue depth, 1-%d.\n"
+		"                     Default: %d\n"
+		"  --event-enq-depth: Event port enqueue depth. Default: %d\n"
+		"  --event-new-threshold: Event port new event threshold.\n"
+		"                         Default: %d\n"
+		"                    Event port tunables are valid only if\n"
+		"                    --mode=eventdev and are capped by the\n"
+		"                    event device limits\n"
+		"  --event-prio=dscp|pcp: Classify packets by DSCP or VLAN PCP into\n"
+		"                         high, normal and low priority event queues.\n"
+		"                         Valid only if --mode=eventdev with a SW Rx\n"
+		"                         adapter\n"
+		"  --nh=N,PORT,MM:MM:MM:MM:MM:MM: Next hop N out of PORT to MAC\n"
+		"  --ecmp=G,N[,N...]: ECMP group G over next hops N, chosen by flow hash\n"
+		"  --route=PREFIX/DEPTH,TARGET: IPv4 or IPv6 route for LPM and FIB,\n"
+		"                               TARGET is PORT, nhN or ecmpG\n"
+		"  --acl-rules=FILE: Filter rx bursts with the ACL rules in FILE\n"
+		"                    before the lookup, valid only in poll mode\n"
+		"  --tx-policy: What to do with packets the PMD does not accept:\n"
+		"               drop them (default), retry for a while or park\n"
+		"               them until the next drain tick, poll mode only\n"
+		"  --tx-retry-us: Retry budget in microseconds for\n"
+		"                 --tx-policy=retry. Default: %d\n"
+		"  --sw-rss: Hash flows in software from the rx lcore of each\n"
+		"            port onto the lcores without rx queues, for NICs\n"
+		"            with a single rx queue, poll mode only\n"
+		"  --pipeline=LCORE[,LCORE...]: Run rx, lookup and tx on separate\n"
+		"            lcores: rx on the --config lcores, tx on LCOREs with\n"
+		"            rx order restored, lookup on all other lcores\n"
+		"  --bench=DIST[,FLOWS[,SECONDS]]: Benchmark the IPv4 lookup on\n"
+		"            synthetic packets instead of forwarding: the --config\n"
+		"            lcores replay FLOWS flows (default 1024) picked by\n"
+		"            DIST (seq, uniform or zipf[:S]) for SECONDS (default\n"
+		"            10) with tx stubbed out, then print cycles/pkt and\n"
+		"            cache misses, poll mode only\n"
+		"  --flow-cache[=ENTRIES]: Per-lcore direct-mapped cache of\n"
+		"            IPv4 next hops in front of the LPM or EM lookup,\n"
+		"            ENTRIES a power of 2 (default 4096), poll mode only\n"
+		"  --adaptive-poll[=PAUSE[,SLEEP]]: After PAUSE consecutive empty\n"
+		"            polls (default 100) back off with rte_pause(), after\n"
+		"            SLEEP (default 1000) sleep on rx interrupts until\n"
+		"            traffic comes back; LPM, EM and FIB poll mode only\n"
+		"  --ip-family=ipv4|ipv6|dual: Traffic the poll loop is built\n"
+		"            for, packets of another family are still forwarded\n"
+		"            on a slower path. Default: dual, or the family of\n"
+		"            the EM table (--ipv6)\n"
+		"  --auto-config[=QUEUES]: Instead of --config, give every port\n"
+		"            QUEUES rx queues (default: one per physical core of\n"
+		"            its socket) and spread them over the lcores of the\n"
+		"            port's socket, hyperthread siblings last; plain poll\n"
+		"            mode only\n"
+		"  --adaptive-drain[=CAP_US]: Scale the tx drain interval with\n"
+		"            the rx burst sizes, from CAP_US/%d with small bursts\n"
+		"            to CAP_US (default %d) with full ones; LPM, EM and\n"
+		"            FIB poll mode only\n"
+		"  --latency[=N]: Timestamp 1 in N received packets (default\n"
+		"            1024) and report their rx to tx time inside l3fwd\n"
+		"            as percentiles through /l3fwd/latency telemetry\n\n"
+
+		"Warm restart: start a new l3fwd with the EAL option\n"
+		"--proc-type=secondary, the --file-prefix of the running one and\n"
+		"the same application options. It attaches to the mbuf pools,\n"
+		"LPM/ACL tables and ports in hugepages and takes forwarding over\n"
+		"from the instance that forwards now (LPM poll mode only).\n\n",
+		prgname, MAX_PKT_BURST, L3FWD_EVENT_DEQ_DEPTH,
+		L3FWD_EVENT_ENQ_DEPTH, L3FWD_EVENT_NEW_THRESHOLD,
+		BURST_TX_RETRY_US, MAX_PKT_BURST, BURST_TX_DRAIN_US);
 }
 
 static int
@@ -415,6 +600,146 @@ parse_config(const char *q_arg)
 	return 0;
 }
 
+/* Physical core of the first cpu of an lcore, the cpu if not known. */
+static unsigned int
+lcore_core_id(unsigned int lcore_id)
+{
+	rte_cpuset_t cpuset = rte_lcore_cpuset(lcore_id);
+	unsigned int cpu, core;
+	char path[PATH_MAX];
+	FILE *f;
+
+	for (cpu = 0; cpu < CPU_SETSIZE - 1; cpu++)
+		if (CPU_ISSET(cpu, &cpuset))
+			break;
+
+	snprintf(path, sizeof(path),
+		"/sys/devices/system/cpu/cpu%u/topology/core_id", cpu);
+	f = fopen(path, "r");
+	if (f == NULL)
+		return cpu;
+	if (fscanf(f, "%u", &core) != 1)
+		core = cpu;
+	fclose(f);
+
+	return core;
+}
+
+struct auto_lcore {
+	uint8_t lcore_id;
+	uint8_t socket_id;
+	uint16_t thread;	/**< 0 for the first lcore of its core */
+	unsigned int core;
+};
+
+/*
+ * --auto-config: build lcore_params from the topology. The enabled
+ * lcores are grouped by socket, the first lcore of each physical core
+ * ahead of its hyperthread siblings. The queues of a port go round
+ * robin over the physical cores of its socket, over the siblings too
+ * only when there are more queues than cores, and the next port of the
+ * socket starts where the previous one stopped. The mbuf pools and
+ * lookup tables follow the lcores, as with --config.
+ */
+static void
+auto_config(void)
+{
+	static struct auto_lcore lc[RTE_MAX_LCORE];
+	unsigned int next[NB_SOCKETS + 1] = { 0 };
+	struct rte_eth_dev_info dev_info;
+	unsigned int nb_lc = 0, nb_cores, first, n, m, i, j, k;
+	struct auto_lcore tmp;
+	unsigned int lcore_id;
+	uint16_t portid, queues, q;
+	int socketid, ret;
+
+	RTE_LCORE_FOREACH(lcore_id) {
+		if (lcore_id > UINT8_MAX)
+			break;
+		lc[nb_lc].lcore_id = lcore_id;
+		lc[nb_lc].socket_id = rte_lcore_to_socket_id(lcore_id);
+		lc[nb_lc].core = lcore_core_id(lcore_id);
+		lc[nb_lc].thread = 0;
+		for (i = 0; i < nb_lc; i++)
+			if (lc[i].socket_id == lc[nb_lc].socket_id &&
+					lc[i].core == lc[nb_lc].core)
+				lc[nb_lc].thread++;
+		nb_lc++;
+	}
+
+	/* stable sort by socket, then sibling rank */
+	for (i = 1; i < nb_lc; i++) {
+		tmp = lc[i];
+		for (j = i; j > 0 && (lc[j - 1].socket_id > tmp.socket_id ||
+				(lc[j - 1].socket_id == tmp.socket_id &&
+				 lc[j - 1].thread > tmp.thread)); j--)
+			lc[j] = lc[j - 1];
+		lc[j] = tmp;
+	}
+
+	nb_lcore_params = 0;
+	printf("Auto config:\n");
+	RTE_ETH_FOREACH_DEV(portid) {
+		if ((enabled_port_mask & (1 << portid)) == 0)
+			continue;
+
+		ret = rte_eth_dev_info_get(portid, &dev_info);
+		if (ret != 0)
+			rte_exit(EXIT_FAILURE,
+				"Error during getting device (port %u) info: %s\n",
+				portid, strerror(-ret));
+
+		/* the lcores of the port's socket */
+		socketid = rte_eth_dev_socket_id(portid);
+		for (first = 0; first < nb_lc &&
+				lc[first].socket_id != socketid; first++)
+			;
+		for (n = 0; first + n < nb_lc &&
+				lc[first + n].socket_id == socketid; n++)
+			;
+		if (n == 0) {
+			if (socketid >= 0)
+				printf("  port %u: no lcore on socket %d, "
+					"polled from remote lcores\n",
+					portid, socketid);
+			socketid = NB_SOCKETS;
+			first = 0;
+			n = nb_lc;
+		} else if (socketid >= NB_SOCKETS) {
+			socketid = NB_SOCKETS;
+		}
+		for (nb_cores = 0; nb_cores < n &&
+				lc[first + nb_cores].thread == 0; nb_cores++)
+			;
+		if (nb_cores == 0)
+			nb_cores = n;
+
+		queues = auto_config_queues ? auto_config_queues : nb_cores;
+		queues = RTE_MIN(queues, RTE_MAX(dev_info.max_rx_queues, 1));
+		queues = RTE_MIN(queues, MAX_RX_QUEUE_PER_PORT);
+		m = queues <= nb_cores ? nb_cores : n;
+
+		for (q = 0; q < queues; q++) {
+			if (nb_lcore_params >= MAX_LCORE_PARAMS)
+				rte_exit(EXIT_FAILURE, "auto-config: more than "
+					"%d rx queues\n", MAX_LCORE_PARAMS);
+			k = first + (next[socketid] + q) % m;
+			lcore_params_array[nb_lcore_params].port_id = portid;
+			lcore_params_array[nb_lcore_params].queue_id = q;
+			lcore_params_array[nb_lcore_params].lcore_id =
+				lc[k].lcore_id;
+			nb_lcore_params++;
+
+			printf("  port %u queue %u -> lcore %u (socket %u, "
+				"core %u%s)\n", portid, q, lc[k].lcore_id,
+				lc[k].socket_id, lc[k].core,
+				lc[k].thread ? ", sibling" : "");
+		}
+		next[socketid] += queues;
+	}
+	lcore_params = lcore_params_array;
+}
+
 static void
 parse_eth_dest(const char *optarg)
 {
@@ -485,6 +810,91 @@ parse_event_eth_rx_queues(const char *eth_rx_queues)
 	evt_rsrc->eth_rx_queues = num_eth_rx_queues;
 }
 
+/* Event port tunable in [min, max]. */
+static int
+parse_event_port_param(const char *arg, unsigned long min, unsigned long max,
+		unsigned long *val)
+{
+	char *end = NULL;
+
+	errno = 0;
+	*val = strtoul(arg, &end, 10);
+	if (errno != 0 || arg[0] == '\0' || end == NULL || *end != '\0')
+		return -1;
+
+	if (*val < min || *val > max)
+		return -1;
+
+	return 0;
+}
+
+static int
+parse_ip_family(const char *optarg)
+{
+	if (!strcmp(optarg, "ipv4"))
+		ip_family = L3FWD_LOOP_IPV4;
+	else if (!strcmp(optarg, "ipv6"))
+		ip_family = L3FWD_LOOP_IPV6;
+	else if (!strcmp(optarg, "dual"))
+		ip_family = L3FWD_LOOP_AF;
+	else
+		return -1;
+
+	return 0;
+}
+
+/* [QUEUES]: rx queues per port */
+static int
+parse_auto_config(const char *arg)
+{
+	unsigned long n;
+	char *end;
+
+	if (arg == NULL)
+		return 0;
+
+	errno = 0;
+	n = strtoul(arg, &end, 10);
+	if (errno != 0 || *arg == '\0' || *end != '\0' || n == 0 ||
+			n > MAX_RX_QUEUE_PER_PORT)
+		return -1;
+
+	auto_config_queues = n;
+	return 0;
+}
+
+static int
+parse_tx_policy(const char *optarg)
+{
+	if (!strcmp(optarg, "drop"))
+		tx_policy = L3FWD_TX_DROP;
+	else if (!strcmp(optarg, "retry"))
+		tx_policy = L3FWD_TX_RETRY;
+	else if (!strcmp(optarg, "park"))
+		tx_policy = L3FWD_TX_PARK;
+	else
+		return -1;
+
+	return 0;
+}
+
+static int
+parse_tx_retry_us(const char *arg)
+{
+	char *end = NULL;
+	unsigned long us;
+
+	/* parse decimal string */
+	us = strtoul(arg, &end, 10);
+	if ((arg[0] == '\0') || (end == NULL) || (*end != '\0'))
+		return -1;
+	if (us == 0 || us > US_PER_S)
+		return -1;
+
+	tx_retry_us = us;
+	return 0;
+}
+
 #define MAX_JUMBO_PKT_LEN  9600
 
 static const char short_options[] =
@@ -492,6 +902,7 @@ static const char short_options[] =
 	"P"   /* promiscuous */
 	"L"   /* enable long prefix match */
 	"E"   /* enable exact match */
+	"F"   /* enable FIB lookup */
 	;
 
 #define CMD_LINE_OPT_CONFIG "config"
@@ -505,6 +916,25 @@ static const char short_options[] =
 #define CMD_LINE_OPT_MODE "mode"
 #define CMD_LINE_OPT_EVENTQ_SYNC "eventq-sched"
 #define CMD_LINE_OPT_EVENT_ETH_RX_QUEUES "event-eth-rxqs"
+#define CMD_LINE_OPT_EVENT_DEQ_DEPTH "event-deq-depth"
+#define CMD_LINE_OPT_EVENT_ENQ_DEPTH "event-enq-depth"
+#define CMD_LINE_OPT_EVENT_NEW_THRESHOLD "event-new-threshold"
+#define CMD_LINE_OPT_EVENT_PRIO "event-prio"
+#define CMD_LINE_OPT_NH "nh"
+#define CMD_LINE_OPT_ECMP "ecmp"
+#define CMD_LINE_OPT_ROUTE "route"
+#define CMD_LINE_OPT_ACL_RULES "acl-rules"
+#define CMD_LINE_OPT_TX_POLICY "tx-policy"
+#define CMD_LINE_OPT_TX_RETRY_US "tx-retry-us"
+#define CMD_LINE_OPT_SW_RSS "sw-rss"
+#define CMD_LINE_OPT_PIPELINE "pipeline"
+#define CMD_LINE_OPT_BENCH "bench"
+#define CMD_LINE_OPT_FLOW_CACHE "flow-cache"
+#define CMD_LINE_OPT_ADAPTIVE_POLL "adaptive-poll"
+#define CMD_LINE_OPT_IP_FAMILY "ip-family"
+#define CMD_LINE_OPT_AUTO_CONFIG "auto-config"
+#define CMD_LINE_OPT_ADAPTIVE_DRAIN "adaptive-drain"
+#define CMD_LINE_OPT_LATENCY "latency"
 enum {
 	/* long options mapped to a short option */
 
@@ -522,6 +952,25 @@ enum {
 	CMD_LINE_OPT_MODE_NUM,
 	CMD_LINE_OPT_EVENTQ_SYNC_NUM,
 	CMD_LINE_OPT_EVENT_ETH_RX_QUEUES_NUM,
+	CMD_LINE_OPT_EVENT_DEQ_DEPTH_NUM,
+	CMD_LINE_OPT_EVENT_ENQ_DEPTH_NUM,
+	CMD_LINE_OPT_EVENT_NEW_THRESHOLD_NUM,
+	CMD_LINE_OPT_EVENT_PRIO_NUM,
+	CMD_LINE_OPT_NH_NUM,
+	CMD_LINE_OPT_ECMP_NUM,
+	CMD_LINE_OPT_ROUTE_NUM,
+	CMD_LINE_OPT_ACL_RULES_NUM,
+	CMD_LINE_OPT_TX_POLICY_NUM,
+	CMD_LINE_OPT_TX_RETRY_US_NUM,
+	CMD_LINE_OPT_SW_RSS_NUM,
+	CMD_LINE_OPT_PIPELINE_NUM,
+	CMD_LINE_OPT_BENCH_NUM,
+	CMD_LINE_OPT_FLOW_CACHE_NUM,
+	CMD_LINE_OPT_ADAPTIVE_POLL_NUM,
+	CMD_LINE_OPT_IP_FAMILY_NUM,
+	CMD_LINE_OPT_AUTO_CONFIG_NUM,
+	CMD_LINE_OPT_ADAPTIVE_DRAIN_NUM,
+	CMD_LINE_OPT_LATENCY_NUM,
 };
 
 static const struct option lgopts[] = {
@@ -537,6 +986,26 @@ static const struct option lgopts[] = {
 	{CMD_LINE_OPT_EVENTQ_SYNC, 1, 0, CMD_LINE_OPT_EVENTQ_SYNC_NUM},
 	{CMD_LINE_OPT_EVENT_ETH_RX_QUEUES, 1, 0,
 					CMD_LINE_OPT_EVENT_ETH_RX_QUEUES_NUM},
+	{CMD_LINE_OPT_EVENT_DEQ_DEPTH, 1, 0, CMD_LINE_OPT_EVENT_DEQ_DEPTH_NUM},
+	{CMD_LINE_OPT_EVENT_ENQ_DEPTH, 1, 0, CMD_LINE_OPT_EVENT_ENQ_DEPTH_NUM},
+	{CMD_LINE_OPT_EVENT_NEW_THRESHOLD, 1, 0,
+					CMD_LINE_OPT_EVENT_NEW_THRESHOLD_NUM},
+	{CMD_LINE_OPT_EVENT_PRIO, 1, 0, CMD_LINE_OPT_EVENT_PRIO_NUM},
+	{CMD_LINE_OPT_NH, 1, 0, CMD_LINE_OPT_NH_NUM},
+	{CMD_LINE_OPT_ECMP, 1, 0, CMD_LINE_OPT_ECMP_NUM},
+	{CMD_LINE_OPT_ROUTE, 1, 0, CMD_LINE_OPT_ROUTE_NUM},
+	{CMD_LINE_OPT_ACL_RULES, 1, 0, CMD_LINE_OPT_ACL_RULES_NUM},
+	{CMD_LINE_OPT_TX_POLICY, 1, 0, CMD_LINE_OPT_TX_POLICY_NUM},
+	{CMD_LINE_OPT_TX_RETRY_US, 1, 0, CMD_LINE_OPT_TX_RETRY_US_NUM},
+	{CMD_LINE_OPT_SW_RSS, 0, 0, CMD_LINE_OPT_SW_RSS_NUM},
+	{CMD_LINE_OPT_PIPELINE, 1, 0, CMD_LINE_OPT_PIPELINE_NUM},
+	{CMD_LINE_OPT_BENCH, 1, 0, CMD_LINE_OPT_BENCH_NUM},
+	{CMD_LINE_OPT_FLOW_CACHE, 2, 0, CMD_LINE_OPT_FLOW_CACHE_NUM},
+	{CMD_LINE_OPT_ADAPTIVE_POLL, 2, 0, CMD_LINE_OPT_ADAPTIVE_POLL_NUM},
+	{CMD_LINE_OPT_IP_FAMILY, 1, 0, CMD_LINE_OPT_IP_FAMILY_NUM},
+	{CMD_LINE_OPT_AUTO_CONFIG, 2, 0, CMD_LINE_OPT_AUTO_CONFIG_NUM},
+	{CMD_LINE_OPT_ADAPTIVE_DRAIN, 2, 0, CMD_LINE_OPT_ADAPTIVE_DRAIN_NUM},
+	{CMD_LINE_OPT_LATENCY, 2, 0, CMD_LINE_OPT_LATENCY_NUM},
 	{NULL, 0, 0, 0}
 };
 
@@ -551,7 +1020,11 @@ static const struct option lgopts[] = {
 	(nports*nb_rx_queue*nb_rxd +		\
 	nports*nb_lcores*MAX_PKT_BURST +	\
 	nports*n_tx_queue*nb_txd +		\
-	nb_lcores*MEMPOOL_CACHE_SIZE),		\
+	nb_lcores*MEMPOOL_CACHE_SIZE +		\
+	(sw_rss_on ? nports*(nb_lcores*SWRSS_RING_SZ +	\
+		SWRSS_TX_RING_SZ) : 0) +		\
+	(pipeline_on ? nports*nb_rx_queue*((nb_lcores + 1) *	\
+		PIPELINE_RING_SZ + PIPELINE_REORDER_SZ) : 0)),	\
 	(unsigned)8192)
 
 /* Parse the argument given in the command line of the application */
@@ -565,6 +1038,9 @@ parse_args(int argc, char **argv)
 	uint8_t lcore_params = 0;
 	uint8_t eventq_sched = 0;
 	uint8_t eth_rx_q = 0;
+	uint8_t evt_port_param = 0;
+	uint8_t routes = 0;
+	unsigned long val;
 	struct l3fwd_event_resources *evt_rsrc = l3fwd_get_eventdev_rsrc();
 
 	argvopt = argv;
@@ -596,6 +1072,10 @@ parse_args(int argc, char **argv)
 			l3fwd_lpm_on = 1;
 			break;
 
+		case 'F':
+			l3fwd_fib_on = 1;
+			break;
+
 		/* long options */
 		case CMD_LINE_OPT_CONFIG_NUM:
 			ret = parse_config(optarg);
@@ -680,15 +1160,306 @@ parse_args(int argc, char **argv)
 			eth_rx_q = 1;
 			break;
 
+		case CMD_LINE_OPT_EVENT_DEQ_DEPTH_NUM:
+			if (parse_event_port_param(optarg, 1, MAX_PKT_BURST,
+					&val) < 0) {
+				fprintf(stderr, "Invalid event dequeue depth\n");
+				print_usage(prgname);
+				return -1;
+			}
+			evt_rsrc->port_deq_depth = val;
+			evt_port_param = 1;
+			break;
+
+		case CMD_LINE_OPT_EVENT_ENQ_DEPTH_NUM:
+			if (parse_event_port_param(optarg, 1, UINT16_MAX,
+					&val) < 0) {
+				fprintf(stderr, "Invalid event enqueue depth\n");
+				print_usage(prgname);
+				return -1;
+			}
+			evt_rsrc->port_enq_depth = val;
+			evt_port_param = 1;
+			break;
+
+		case CMD_LINE_OPT_EVENT_NEW_THRESHOLD_NUM:
+			if (parse_event_port_param(optarg, 1, INT32_MAX,
+					&val) < 0) {
+				fprintf(stderr, "Invalid event new threshold\n");
+				print_usage(prgname);
+				return -1;
+			}
+			evt_rsrc->new_event_threshold = val;
+			evt_port_param = 1;
+			break;
+
+		case CMD_LINE_OPT_EVENT_PRIO_NUM:
+			if (l3fwd_event_prio_parse(optarg) < 0) {
+				fprintf(stderr, "Invalid event prio: %s\n",
+					optarg);
+				print_usage(prgname);
+				return -1;
+			}
+			evt_port_param = 1;
+			break;
+
+		case CMD_LINE_OPT_NH_NUM:
+			if (l3fwd_adj_parse_nh(optarg) < 0) {
+				fprintf(stderr, "Invalid next hop: %s\n",
+					optarg);
+				print_usage(prgname);
+				return -1;
+			}
+			break;
+
+		case CMD_LINE_OPT_ECMP_NUM:
+			if (l3fwd_adj_parse_ecmp(optarg) < 0) {
+				fprintf(stderr, "Invalid ECMP group: %s\n",
+					optarg);
+				print_usage(prgname);
+				return -1;
+			}
+			break;
+
+		case CMD_LINE_OPT_ROUTE_NUM:
+			if (l3fwd_adj_parse_route(optarg) < 0) {
+				fprintf(stderr, "Invalid route: %s\n", optarg);
+				print_usage(prgname);
+				return -1;
+			}
+			routes = 1;
+			break;
+
+		case CMD_LINE_OPT_ACL_RULES_NUM:
+			if (l3fwd_acl_load_rules(optarg) < 0) {
+				print_usage(prgname);
+				return -1;
+			}
+			l3fwd_acl_on = 1;
+			break;
+
+		case CMD_LINE_OPT_TX_POLICY_NUM:
+			if (parse_tx_policy(optarg) < 0) {
+				fprintf(stderr, "Invalid tx policy: %s\n",
+					optarg);
+				print_usage(prgname);
+				return -1;
+			}
+			break;
+
+		case CMD_LINE_OPT_TX_RETRY_US_NUM:
+			if (parse_tx_retry_us(optarg) < 0) {
+				fprintf(stderr, "Invalid tx retry budget: %s\n",
+					optarg);
+				print_usage(prgname);
+				return -1;
+			}
+			break;
+
+		case CMD_LINE_OPT_SW_RSS_NUM:
+			sw_rss_on = 1;
+			break;
+
+		case CMD_LINE_OPT_PIPELINE_NUM:
+			if (l3fwd_pipeline_parse(optarg) < 0) {
+				fprintf(stderr, "Invalid pipeline tx lcores: %s\n",
+					optarg);
+				print_usage(prgname);
+				return -1;
+			}
+			pipeline_on = 1;
+			break;
+
+		case CMD_LINE_OPT_BENCH_NUM:
+			if (l3fwd_bench_parse(optarg) < 0) {
+				fprintf(stderr, "Invalid bench parameters: %s\n",
+					optarg);
+				print_usage(prgname);
+				return -1;
+			}
+			bench_on = 1;
+			break;
+
+		case CMD_LINE_OPT_FLOW_CACHE_NUM:
+			if (l3fwd_flow_cache_parse(optarg) < 0) {
+				fprintf(stderr, "Invalid flow cache size: %s\n",
+					optarg);
+				print_usage(prgname);
+				return -1;
+			}
+			flow_cache_on = 1;
+			break;
+
+		case CMD_LINE_OPT_ADAPTIVE_POLL_NUM:
+			if (l3fwd_idle_parse(optarg) < 0) {
+				fprintf(stderr, "Invalid adaptive poll "
+					"thresholds: %s\n", optarg);
+				print_usage(prgname);
+				return -1;
+			}
+			adaptive_poll_on = 1;
+			port_conf.intr_conf.rxq = 1;
+			break;
+
+		case CMD_LINE_OPT_ADAPTIVE_DRAIN_NUM:
+			if (l3fwd_drain_parse(optarg) < 0) {
+				fprintf(stderr, "Invalid adaptive drain cap: "
+					"%s\n", optarg);
+				print_usage(prgname);
+				return -1;
+			}
+			adaptive_drain_on = 1;
+			break;
+
+		case CMD_LINE_OPT_LATENCY_NUM:
+			if (l3fwd_latency_parse(optarg) < 0) {
+				fprintf(stderr, "Invalid latency sample rate: "
+					"%s\n", optarg);
+				print_usage(prgname);
+				return -1;
+			}
+			latency_on = 1;
+			break;
+
+		case CMD_LINE_OPT_IP_FAMILY_NUM:
+			if (parse_ip_family(optarg) < 0) {
+				fprintf(stderr, "Invalid ip family: %s\n",
+					optarg);
+				print_usage(prgname);
+				return -1;
+			}
+			break;
+
+		case CMD_LINE_OPT_AUTO_CONFIG_NUM:
+			if (parse_auto_config(optarg) < 0) {
+				fprintf(stderr, "Invalid auto-config queues: %s\n",
+					optarg);
+				print_usage(prgname);
+				return -1;
+			}
+			auto_config_on = 1;
+			break;
+
 		default:
 			print_usage(prgname);
 			return -1;
 		}
 	}
 
-	/* If both LPM and EM are selected, return error. */
-	if (l3fwd_lpm_on && l3fwd_em_on) {
-		fprintf(stderr, "LPM and EM are mutually exclusive, select only one\n");
+	/* If more than one of LPM, EM and FIB is selected, return error. */
+	if (l3fwd_lpm_on + l3fwd_em_on + l3fwd_fib_on > 1) {
+		fprintf(stderr, "LPM, EM and FIB are mutually exclusive, select only one\n");
+		return -1;
+	}
+
+	if (l3fwd_em_on && routes) {
+		fprintf(stderr, "--route is valid only with LPM or FIB lookup\n");
+		return -1;
+	}
+
+	if (evt_rsrc->enabled && l3fwd_acl_on) {
+		fprintf(stderr, "ACL stage is not supported in event mode\n");
+		return -1;
+	}
+
+	if (evt_rsrc->enabled && tx_policy != L3FWD_TX_DROP) {
+		fprintf(stderr, "tx policy is valid only in poll mode\n");
+		return -1;
+	}
+
+	if (evt_rsrc->enabled && sw_rss_on) {
+		fprintf(stderr, "sw-rss is valid only in poll mode\n");
+		return -1;
+	}
+
+	if (evt_rsrc->enabled && pipeline_on) {
+		fprintf(stderr, "pipeline is valid only in poll mode\n");
+		return -1;
+	}
+
+	if (sw_rss_on && pipeline_on) {
+		fprintf(stderr, "sw-rss and pipeline are mutually exclusive\n");
+		return -1;
+	}
+
+	if (bench_on && (evt_rsrc->enabled || sw_rss_on || pipeline_on)) {
+		fprintf(stderr, "bench is valid only in plain poll mode\n");
+		return -1;
+	}
+
+	if (flow_cache_on && (evt_rsrc->enabled || l3fwd_fib_on)) {
+		fprintf(stderr, "flow-cache is valid only with LPM or EM lookup "
+			"in poll mode\n");
+		return -1;
+	}
+
+	/*
+	 * The other loops do not poll rx queues of their own; the rx
+	 * interrupts of a secondary would be those of the primary.
+	 */
+	if (adaptive_poll_on && (evt_rsrc->enabled || sw_rss_on ||
+			pipeline_on || bench_on || l3fwd_warm_secondary())) {
+		fprintf(stderr, "adaptive-poll is valid only in plain poll "
+			"mode, without warm restart\n");
+		return -1;
+	}
+
+	if (adaptive_drain_on && (evt_rsrc->enabled || sw_rss_on ||
+			pipeline_on || bench_on)) {
+		fprintf(stderr, "adaptive-drain is valid only in plain poll "
+			"mode\n");
+		return -1;
+	}
+
+	/* the bench replays packets without rx or tx bursts */
+	if (latency_on && bench_on) {
+		fprintf(stderr, "latency is not valid with bench\n");
+		return -1;
+	}
+
+	if (bench_on && l3fwd_em_on && ipv6) {
+		fprintf(stderr, "bench generates IPv4 packets only\n");
+		return -1;
+	}
+
+	/*
+	 * Warm restart attaches to LPM tables only: EM and FIB tables hold
+	 * function pointers into the primary. Rings are not shared either.
+	 */
+	if (l3fwd_warm_secondary() && (evt_rsrc->enabled || l3fwd_em_on ||
+			l3fwd_fib_on || sw_rss_on || pipeline_on || bench_on ||
+			tx_policy == L3FWD_TX_PARK)) {
+		fprintf(stderr, "secondary process (warm restart) supports "
+			"LPM poll mode only, without tx policy park\n");
+		return -1;
+	}
+
+	/* Parked packets would miss the tx stage of their rx queue. */
+	if (pipeline_on && tx_policy == L3FWD_TX_PARK) {
+		fprintf(stderr, "tx policy park is not supported with pipeline\n");
+		return -1;
+	}
+
+	if (evt_rsrc->enabled && l3fwd_fib_on) {
+		fprintf(stderr, "FIB lookup is not supported in event mode\n");
+		return -1;
+	}
+
+	if (auto_config_on && lcore_params) {
+		fprintf(stderr, "config and auto-config are mutually exclusive\n");
+		return -1;
+	}
+
+	/* sw-rss, pipeline and bench give the lcores other roles */
+	if (auto_config_on && (evt_rsrc->enabled || sw_rss_on ||
+			pipeline_on || bench_on)) {
+		fprintf(stderr, "auto-config is valid only in plain poll mode\n");
+		return -1;
+	}
+
+	if (auto_config_on && !numa_on) {
+		fprintf(stderr, "auto-config places queues by socket, it "
+			"needs NUMA awareness (no --no-numa)\n");
 		return -1;
 	}
 
@@ -707,21 +1478,26 @@ parse_args(int argc, char **argv)
 		return -1;
 	}
 
+	if (!evt_rsrc->enabled && evt_port_param) {
+		fprintf(stderr, "event port tunables and event prio are valid only when event mode is selected\n");
+		return -1;
+	}
+
 	/*
 	 * Nothing is selected, pick longest-prefix match
 	 * as default match.
 	 */
-	if (!l3fwd_lpm_on && !l3fwd_em_on) {
-		fprintf(stderr, "LPM or EM none selected, default LPM on\n");
+	if (!l3fwd_lpm_on && !l3fwd_em_on && !l3fwd_fib_on) {
+		fprintf(stderr, "LPM, EM or FIB none selected, default LPM on\n");
 		l3fwd_lpm_on = 1;
 	}
 
 	/*
 	 * ipv6 and hash flags are valid only for
 	 * exact macth, reset them to default for
-	 * longest-prefix match.
+	 * longest-prefix match and FIB.
 	 */
-	if (l3fwd_lpm_on) {
+	if (l3fwd_lpm_on || l3fwd_fib_on) {
 		ipv6 = 0;
 		hash_entry_number = HASH_ENTRY_NUMBER_DEFAULT;
 	}
@@ -734,6 +1510,79 @@ parse_args(int argc, char **argv)
 	return ret;
 }
 
+static int
+setup_lookup_socket(void *arg)
+{
+	const int socketid = (int)(uintptr_t)arg;
+
+	l3fwd_lkp.setup(socketid);
+	if (l3fwd_acl_on)
+		setup_acl(socketid);
+
+	return 0;
+}
+
+/*
+ * Build the lookup tables of all sockets at the same time, each on an
+ * lcore of its own socket, instead of one socket after the other from
+ * init_mem(). The main lcore builds the table of its socket. What the
+ * builds share (the EM keys and out_if) is set up before they start.
+ */
+static void
+setup_lookup_tables(void)
+{
+	const unsigned int main_lcore = rte_get_main_lcore();
+	unsigned int builder[NB_SOCKETS];
+	unsigned int lcore_id, nb_sockets = 0;
+	uint64_t start;
+	int socketid;
+
+	for (socketid = 0; socketid < NB_SOCKETS; socketid++)
+		builder[socketid] = RTE_MAX_LCORE;
+
+	RTE_LCORE_FOREACH(lcore_id) {
+		socketid = numa_on ? (int)rte_lcore_to_socket_id(lcore_id) : 0;
+		if (socketid >= NB_SOCKETS)
+			rte_exit(EXIT_FAILURE,
+				"Socket %d of lcore %u is out of range %d\n",
+				socketid, lcore_id, NB_SOCKETS);
+		if (builder[socketid] == RTE_MAX_LCORE ||
+				lcore_id == main_lcore)
+			builder[socketid] = lcore_id;
+	}
+
+	start = rte_get_timer_cycles();
+	if (l3fwd_lkp.setup_begin != NULL)
+		l3fwd_lkp.setup_begin();
+
+	for (socketid = 0; socketid < NB_SOCKETS; socketid++) {
+		if (builder[socketid] == RTE_MAX_LCORE)
+			continue;
+		nb_sockets++;
+		if (builder[socketid] != main_lcore &&
+				rte_eal_remote_launch(setup_lookup_socket,
+					(void *)(uintptr_t)socketid,
+					builder[socketid]) != 0)
+			rte_exit(EXIT_FAILURE,
+				"Cannot launch the table build on lcore %u\n",
+				builder[socketid]);
+	}
+
+	socketid = numa_on ? (int)rte_lcore_to_socket_id(main_lcore) : 0;
+	setup_lookup_socket((void *)(uintptr_t)socketid);
+	rte_eal_mp_wait_lcore();
+
+	if (l3fwd_lkp.setup_end != NULL)
+		l3fwd_lkp.setup_end();
+
+	for (socketid = 0; socketid < NB_SOCKETS; socketid++)
+		if (builder[socketid] != RTE_MAX_LCORE)
+			lkp_per_socket[socketid] = 1;
+
+	printf("Lookup tables of %u socket(s) built in %.3f s\n", nb_sockets,
+		(double)(rte_get_timer_cycles() - start) / rte_get_timer_hz());
+}
+
 static void
 print_ethaddr(const char *name, const struct rte_ether_addr *eth_addr)
 {
@@ -768,10 +1617,15 @@ init_mem(uint16_t portid, unsigned int nb_mbuf)
 		if (pktmbuf_pool[portid][socketid] == NULL) {
 			snprintf(s, sizeof(s), "mbuf_pool_%d:%d",
 				 portid, socketid);
-			pktmbuf_pool[portid][socketid] =
-				rte_pktmbuf_pool_create(s, nb_mbuf,
-					MEMPOOL_CACHE_SIZE, 0,
-					RTE_MBUF_DEFAULT_BUF_SIZE, socketid);
+			if (l3fwd_warm_secondary())
+				pktmbuf_pool[portid][socketid] =
+					rte_mempool_lookup(s);
+			else
+				pktmbuf_pool[portid][socketid] =
+					rte_pktmbuf_pool_create(s, nb_mbuf,
+						MEMPOOL_CACHE_SIZE, 0,
+						RTE_MBUF_DEFAULT_BUF_SIZE,
+						socketid);
 			if (pktmbuf_pool[portid][socketid] == NULL)
 				rte_exit(EXIT_FAILURE,
 					"Cannot init mbuf pool on socket %d\n",
@@ -783,8 +1637,16 @@ init_mem(uint16_t portid, unsigned int nb_mbuf)
 			/* Setup either LPM or EM(f.e Hash). But, only once per
 			 * available socket.
 			 */
-			if (!lkp_per_socket[socketid]) {
+			if (!lkp_per_socket[socketid] &&
+					l3fwd_warm_secondary()) {
+				l3fwd_lkp.attach(socketid);
+				if (l3fwd_acl_on)
+					attach_acl(socketid);
+				lkp_per_socket[socketid] = 1;
+			} else if (!lkp_per_socket[socketid]) {
 				l3fwd_lkp.setup(socketid);
+				if (l3fwd_acl_on)
+					setup_acl(socketid);
 				lkp_per_socket[socketid] = 1;
 			}
 		}
@@ -793,6 +1655,8 @@ init_mem(uint16_t portid, unsigned int nb_mbuf)
 			l3fwd_lkp.get_ipv4_lookup_struct(socketid);
 		qconf->ipv6_lookup_struct =
 			l3fwd_lkp.get_ipv6_lookup_struct(socketid);
+		qconf->acl4_ctx = acl_get_ipv4_ctx(socketid);
+		qconf->acl6_ctx = acl_get_ipv6_ctx(socketid);
 	}
 	return 0;
 }
@@ -876,6 +1740,8 @@ prepare_ptype_parser(uint16_t portid, uint16_t queueid)
 {
 	if (parse_ptype) {
 		printf("Port %d: softly parse packet type info\n", portid);
+		if (loop_parses_ptype)
+			return 1;
 		if (rte_eth_add_rx_callback(portid, queueid,
 					    l3fwd_lkp.cb_parse_ptype,
 					    NULL))
@@ -893,6 +1759,39 @@ prepare_ptype_parser(uint16_t portid, uint16_t queueid)
 	return 0;
 }
 
+/*
+ * Poll loop instance of the configuration: expected address family,
+ * packet types parsed in the loop instead of an rx callback, and
+ * whether any optional stage is on.
+ */
+static l3fwd_main_loop_t
+select_main_loop(void)
+{
+	uint8_t flags = ip_family;
+
+	if (flags == 0)
+		flags = !l3fwd_em_on ? L3FWD_LOOP_AF :
+			ipv6 ? L3FWD_LOOP_IPV6 : L3FWD_LOOP_IPV4;
+	if (parse_ptype)
+		flags |= L3FWD_LOOP_SW_PTYPE;
+	if (l3fwd_acl_on || flow_cache_on || adaptive_poll_on ||
+			adaptive_drain_on)
+		flags |= L3FWD_LOOP_EXTRA;
+
+	/* FIB has dual-stack instances only */
+	if (l3fwd_lkp.main_loops[flags] == NULL)
+		flags |= L3FWD_LOOP_AF;
+
+	loop_parses_ptype = (flags & L3FWD_LOOP_SW_PTYPE) != 0;
+	printf("Poll loop: %s%s%s\n",
+		(flags & L3FWD_LOOP_AF) == L3FWD_LOOP_AF ? "dual-stack" :
+		flags & L3FWD_LOOP_IPV4 ? "IPv4" : "IPv6",
+		loop_parses_ptype ? ", packet types parsed in the loop" : "",
+		flags & L3FWD_LOOP_EXTRA ? ", optional stages" : "");
+
+	return l3fwd_lkp.main_loops[flags];
+}
+
 static void
 l3fwd_poll_resource_setup(void)
 {
@@ -900,12 +1799,18 @@ l3fwd_poll_resource_setup(void)
 	struct rte_eth_dev_info dev_info;
 	uint32_t n_tx_queue, nb_lcores;
 	struct rte_eth_txconf *txconf;
+	struct l3fwd_tx_port *txp;
+	unsigned int tx_lcore;
 	struct lcore_conf *qconf;
 	uint16_t queueid, portid;
 	unsigned int nb_ports;
 	unsigned int lcore_id;
+	char s[64];
 	int ret;
 
+	if (auto_config_on)
+		auto_config();
+
 	if (check_lcore_params() < 0)
 		rte_exit(EXIT_FAILURE, "check_lcore_params failed\n");
 
@@ -918,8 +1823,28 @@ l3fwd_poll_resource_setup(void)
 	if (check_port_config() < 0)
 		rte_exit(EXIT_FAILURE, "check_port_config failed\n");
 
+	if (sw_rss_on && check_sw_rss_config() < 0)
+		rte_exit(EXIT_FAILURE, "check_sw_rss_config failed\n");
+
 	nb_lcores = rte_lcore_count();
 
+	/* tx staging of every lcore, one entry per enabled port */
+	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+		if (rte_lcore_is_enabled(lcore_id) == 0)
+			continue;
+
+		socketid = numa_on ? rte_lcore_to_socket_id(lcore_id) : 0;
+		qconf = &lcore_conf[lcore_id];
+		qconf->tx_port = rte_zmalloc_socket("tx_port",
+			sizeof(*qconf->tx_port) *
+			__builtin_popcount(enabled_port_mask),
+			RTE_CACHE_LINE_SIZE, socketid);
+		if (qconf->tx_port == NULL)
+			rte_exit(EXIT_FAILURE,
+				"Cannot allocate tx staging for lcore %u\n",
+				lcore_id);
+	}
+
 	/* initialize all ports */
 	RTE_ETH_FOREACH_DEV(portid) {
 		struct rte_eth_conf local_port_conf = port_conf;
@@ -938,8 +1863,6 @@ l3fwd_poll_resource_setup(void)
 		n_tx_queue = nb_lcores;
 		if (n_tx_queue > MAX_TX_QUEUE_PER_PORT)
 			n_tx_queue = MAX_TX_QUEUE_PER_PORT;
-		printf("Creating queues: nb_rxq=%d nb_txq=%u... ",
-			nb_rx_queue, (unsigned)n_tx_queue );
 
 		ret = rte_eth_dev_info_get(portid, &dev_info);
 		if (ret != 0)
@@ -947,10 +1870,32 @@ l3fwd_poll_resource_setup(void)
 				"Error during getting device (port %u) info: %s\n",
 				portid, strerror(-ret));
 
+		/*
+		 * Without a tx queue per lcore, the rx lcore of the port owns
+		 * its only tx queue and the workers send through a ring.
+		 */
+		tx_lcore = RTE_MAX_LCORE;
+		if (sw_rss_on && dev_info.max_tx_queues < n_tx_queue) {
+			tx_lcore = get_port_rx_lcore(portid);
+			if (tx_lcore == RTE_MAX_LCORE)
+				rte_exit(EXIT_FAILURE,
+					"sw-rss: port %u has no rx lcore\n",
+					portid);
+			n_tx_queue = 1;
+		}
+		printf("Creating queues: nb_rxq=%d nb_txq=%u... ",
+			nb_rx_queue, (unsigned)n_tx_queue );
+
 		if (dev_info.tx_offload_capa & DEV_TX_OFFLOAD_MBUF_FAST_FREE)
 			local_port_conf.txmode.offloads |=
 				DEV_TX_OFFLOAD_MBUF_FAST_FREE;
 
+		/* ECMP member selection reuses the RSS hash of the NIC */
+		if (l3fwd_adj_has_ecmp() &&
+				(dev_info.rx_offload_capa & DEV_RX_OFFLOAD_RSS_HASH))
+			local_port_conf.rxmode.offloads |=
+				DEV_RX_OFFLOAD_RSS_HASH;
+
 		local_port_conf.rx_adv_conf.rss_conf.rss_hf &=
 			dev_info.flow_type_rss_offloads;
 		if (local_port_conf.rx_adv_conf.rss_conf.rss_hf !=
@@ -962,7 +1907,9 @@ l3fwd_poll_resource_setup(void)
 				local_port_conf.rx_adv_conf.rss_conf.rss_hf);
 		}
 
-		ret = rte_eth_dev_configure(portid, nb_rx_queue,
+		/* warm restart: the primary configured the port and queues */
+		ret = l3fwd_warm_secondary() ? 0 :
+			rte_eth_dev_configure(portid, nb_rx_queue,
 					(uint16_t)n_tx_queue, &local_port_conf);
 		if (ret < 0){
                        
@@ -1018,23 +1965,47 @@ l3fwd_poll_resource_setup(void)
 			else
 				socketid = 0;
 
-			printf("txq=%u,%d,%d ", lcore_id, queueid, socketid);
-			fflush(stdout);
-
-			txconf = &dev_info.default_txconf;
-			txconf->offloads = local_port_conf.txmode.offloads;
-			ret = rte_eth_tx_queue_setup(portid, queueid, nb_txd,
-						     socketid, txconf);
-			if (ret < 0)
-				rte_exit(EXIT_FAILURE,
-					"rte_eth_tx_queue_setup: err=%d, "
-					"port=%d\n", ret, portid);
-
 			qconf = &lcore_conf[lcore_id];
-			qconf->tx_queue_id[portid] = queueid;
-			queueid++;
+			txp = &qconf->tx_port[qconf->n_tx_port];
+			txp->port_id = portid;
+			if (tx_lcore != RTE_MAX_LCORE && lcore_id != tx_lcore) {
+				printf("txr=%u,%d ", lcore_id, socketid);
+				txp->ring =
+					l3fwd_swrss_tx_ring(portid, socketid);
+			} else {
+				printf("txq=%u,%d,%d ", lcore_id, queueid,
+					socketid);
+				fflush(stdout);
+
+				txconf = &dev_info.default_txconf;
+				txconf->offloads =
+					local_port_conf.txmode.offloads;
+				ret = l3fwd_warm_secondary() ? 0 :
+					rte_eth_tx_queue_setup(portid, queueid,
+						nb_txd, socketid, txconf);
+				if (ret < 0)
+					rte_exit(EXIT_FAILURE,
+						"rte_eth_tx_queue_setup: err=%d, "
+						"port=%d\n", ret, portid);
+
+				txp->queue_id = queueid;
+				queueid++;
+			}
+
+			if (tx_policy == L3FWD_TX_PARK) {
+				snprintf(s, sizeof(s), "tx_park_%u_%u",
+					lcore_id, portid);
+				txp->park = rte_ring_create(s,
+					L3FWD_TX_PARK_SZ, socketid,
+					RING_F_SP_ENQ | RING_F_SC_DEQ);
+				if (txp->park == NULL)
+					rte_exit(EXIT_FAILURE,
+						"Cannot create tx park ring "
+						"for lcore %u port %u\n",
+						lcore_id, portid);
+			}
 
-			qconf->tx_port_id[qconf->n_tx_port] = portid;
+			qconf->tx_port_idx[portid] = qconf->n_tx_port;
 			qconf->n_tx_port++;
 		}
 		printf("\n");
@@ -1062,6 +2033,9 @@ l3fwd_poll_resource_setup(void)
 			printf("rxq=%d,%d,%d ", portid, queueid, socketid);
 			fflush(stdout);
 
+			if (l3fwd_warm_secondary())
+				continue;
+
 			ret = rte_eth_dev_info_get(portid, &dev_info);
 			if (ret != 0)
 				rte_exit(EXIT_FAILURE,
@@ -1176,6 +2150,35 @@ l3fwd_event_service_setup(void)
 	}
 }
 
+/*
+ * Free the tx park rings of every lcore at exit, with the packets the
+ * loops left in them, before the ports are closed.
+ */
+static void
+l3fwd_tx_park_free(void)
+{
+	struct rte_mbuf *m[MAX_PKT_BURST];
+	struct l3fwd_tx_port *txp;
+	unsigned int lcore_id, n;
+	uint16_t i;
+
+	if (tx_policy != L3FWD_TX_PARK)
+		return;
+
+	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
+		for (i = 0; i < lcore_conf[lcore_id].n_tx_port; i++) {
+			txp = &lcore_conf[lcore_id].tx_port[i];
+			if (txp->park == NULL)
+				continue;
+			while ((n = rte_ring_dequeue_burst(txp->park,
+					(void **)m, MAX_PKT_BURST, NULL)) != 0)
+				rte_pktmbuf_free_bulk(m, n);
+			rte_ring_free(txp->park);
+			txp->park = NULL;
+		}
+	}
+}
+
 int
 main(int argc, char **argv)
 {
@@ -1214,10 +2217,24 @@ main(int argc, char **argv)
         //else
           //      rte_exit(EXIT_SUCCESS,"\n\nL3FWD param OKAY YOCKGEN\n\n");  
 
+	/* Shared state of the warm restart, checks the arguments. */
+	l3fwd_warm_init(argc, argv);
+
+	/* Per-lcore counters, readable through telemetry. */
+	l3fwd_stats_init();
+	l3fwd_latency_setup();
+
+	tx_retry_tsc = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S *
+		tx_retry_us;
+
 	/* Setup function pointers for lookup method. */
 	setup_l3fwd_lookup_tables();
         printf("\n\nsetup_l3fwd_lookup_table OKAY YOCKGEN\n\n");
 
+	/* A warm restart attaches to the tables from init_mem() instead. */
+	if (!l3fwd_warm_secondary())
+		setup_lookup_tables();
+
 	evt_rsrc->per_port_pool = per_port_pool;
 	evt_rsrc->pkt_pool = pktmbuf_pool;
 	evt_rsrc->port_mask = enabled_port_mask;
@@ -1229,15 +2246,36 @@ main(int argc, char **argv)
 		else
 			l3fwd_lkp.main_loop = evt_rsrc->ops.lpm_event_loop;
 		l3fwd_event_service_setup();
-	} else
+	} else {
 		l3fwd_poll_resource_setup();
+		l3fwd_flow_cache_setup(numa_on);
+		l3fwd_idle_setup(numa_on);
+		l3fwd_drain_setup(numa_on);
+		if (sw_rss_on) {
+			l3fwd_swrss_setup(l3fwd_lkp.process_burst, numa_on);
+			l3fwd_lkp.main_loop = swrss_main_loop;
+		} else if (pipeline_on) {
+			l3fwd_pipeline_setup(l3fwd_lkp.process_burst, numa_on);
+			l3fwd_lkp.main_loop = pipeline_main_loop;
+		} else if (bench_on) {
+			l3fwd_bench_setup(l3fwd_lkp.process_burst,
+				l3fwd_lkp.bench_flow, numa_on);
+			l3fwd_lkp.main_loop = bench_main_loop;
+		} else {
+			l3fwd_lkp.main_loop = select_main_loop();
+		}
+	}
+
+	/* Build next hop adjacencies once all port MACs are known. */
+	l3fwd_adj_setup();
 
         printf("\n\neventdev setup OKAY YOCKGEN\n\n");  
 
 
-	/* start ports */
+	/* start ports, a secondary finds them started by the primary */
 	RTE_ETH_FOREACH_DEV(portid) {
-		if ((enabled_port_mask & (1 << portid)) == 0) {
+		if ((enabled_port_mask & (1 << portid)) == 0 ||
+				l3fwd_warm_secondary()) {
 			continue;
 		}
 		/* Start device */
@@ -1262,6 +2300,12 @@ main(int argc, char **argv)
 		}
 	}
 
+	/* rx and tx callbacks are per process, a secondary adds its own */
+	RTE_ETH_FOREACH_DEV(portid) {
+		if ((enabled_port_mask & (1 << portid)) != 0)
+			l3fwd_latency_attach(portid);
+	}
+
 	printf("\n");
 
 	for (lcore_id = 0; lcore_id < RTE_MAX_LCORE; lcore_id++) {
@@ -1279,6 +2323,8 @@ main(int argc, char **argv)
 	check_all_ports_link_status(enabled_port_mask);
 
 	ret = 0;
+	if (!evt_rsrc->enabled)
+		l3fwd_warm_takeover();
 	/* launch per-lcore init on every lcore */
 	rte_eal_mp_remote_launch(l3fwd_lkp.main_loop, NULL, CALL_MAIN);
 	if (evt_rsrc->enabled) {
@@ -1308,9 +2354,31 @@ main(int argc, char **argv)
 		rte_event_dev_stop(evt_rsrc->event_d_id);
 		rte_event_dev_close(evt_rsrc->event_d_id);
 
+		if (evt_rsrc->nb_prio > 1)
+			l3fwd_event_prio_print_stats();
+		l3fwd_latency_print_stats();
+
 	} else {
 		rte_eal_mp_wait_lcore();
 
+		if (l3fwd_acl_on)
+			l3fwd_acl_print_stats();
+		if (pipeline_on)
+			l3fwd_pipeline_print_stats();
+		if (bench_on)
+			l3fwd_bench_print_stats();
+		l3fwd_flow_cache_print_stats();
+		l3fwd_idle_print_stats();
+		l3fwd_drain_print_stats();
+		l3fwd_latency_print_stats();
+
+		/* the ports stay up for the next generation */
+		if (l3fwd_warm_stop()) {
+			printf("Bye...\n");
+			return ret;
+		}
+
+		l3fwd_tx_park_free();
 		RTE_ETH_FOREACH_DEV(portid) {
 			if ((enabled_port_mask & (1 << portid)) == 0)
 				continue;
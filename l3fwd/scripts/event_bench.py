@@ -0,0 +1,221 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: BSD-3-Clause
+# Copyright(c) 2021 yockgen
+
+"""
+Run l3fwd over a matrix of event device configurations and report the
+forwarding rate of each.
+
+Every configuration is a separate l3fwd process using virtual devices only,
+so no NIC is needed:
+
+  eventdev   event_sw (scheduled on a service core) or event_dsw
+  sched      --eventq-sched value
+  deq depth  --event-deq-depth value
+  ports      null: two net_null ports, RX generates and TX frees packets
+             ring: two net_ring ports; these only carry traffic once it is
+                   injected by another process, so they measure the PMD
+                   overhead of the event path rather than a forwarding rate
+
+A poll mode run on the same ports is added as a baseline. The rates are
+computed from the /l3fwd/stats telemetry counters sampled at the start and
+end of the measurement window. Latency is taken from /l3fwd/latency when
+the binary provides it (every run passes --latency), otherwise it is
+reported as "-".
+
+Example:
+  event_bench.py ./build/l3fwd --lcores 1-4 --duration 10 --csv out.csv
+"""
+
+import argparse
+import csv
+import itertools
+import json
+import os
+import signal
+import socket
+import subprocess
+import sys
+import time
+
+TELEMETRY_SOCK = "/var/run/dpdk/{}/dpdk_telemetry.v2"
+
+
+class Telemetry:
+    """Minimal client for the DPDK telemetry v2 socket."""
+
+    def __init__(self, path, timeout):
+        deadline = time.time() + timeout
+        while True:
+            try:
+                self.sock = socket.socket(socket.AF_UNIX,
+                                          socket.SOCK_SEQPACKET)
+                self.sock.connect(path)
+                break
+            except OSError:
+                self.sock.close()
+                if time.time() > deadline:
+                    raise
+                time.sleep(0.2)
+        info = json.loads(self.sock.recv(1024).decode())
+        self.bufsz = info["max_output_len"]
+
+    def query(self, cmd):
+        self.sock.send(cmd.encode())
+        reply = json.loads(self.sock.recv(self.bufsz).decode())
+        return reply.get(cmd.split(",")[0])
+
+    def commands(self):
+        return self.query("/") or []
+
+    def close(self):
+        self.sock.close()
+
+
+def port_vdevs(kind):
+    if kind == "null":
+        return ["--vdev=net_null0", "--vdev=net_null1"]
+    return ["--vdev=net_ring0", "--vdev=net_ring1"]
+
+
+def build_cmd(args, cfg, prefix):
+    lcores = args.lcores.split("-")
+    first, last = int(lcores[0]), int(lcores[-1])
+    cmd = [args.l3fwd, "-l", args.lcores, "--file-prefix", prefix,
+           "--no-pci"] + port_vdevs(cfg["ports"])
+
+    if cfg["eventdev"] == "poll":
+        cmd += ["--", "-p", "0x3", "-P", "--latency",
+                "--config", "(0,0,{}),(1,0,{})".format(first, last)]
+        return cmd
+
+    if cfg["eventdev"] == "event_sw":
+        cmd += ["--vdev=event_sw0", "-s", "0x{:x}".format(1 << last)]
+    else:
+        cmd += ["--vdev=event_dsw0"]
+    cmd += ["--", "-p", "0x3", "-P", "--latency", "--mode=eventdev",
+            "--eventq-sched=" + cfg["sched"],
+            "--event-deq-depth={}".format(cfg["deq_depth"])]
+    return cmd
+
+
+def sample(tel, has_latency):
+    stats = tel.query("/l3fwd/stats")
+    lat = tel.query("/l3fwd/latency") if has_latency else None
+    return time.time(), stats, lat
+
+
+def run_one(args, cfg, index):
+    prefix = "l3fwd_bench{}".format(index)
+    cmd = build_cmd(args, cfg, prefix)
+    if args.verbose:
+        print(" ".join(cmd), file=sys.stderr)
+
+    proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL,
+                            stderr=None if args.verbose else
+                            subprocess.DEVNULL)
+    result = dict(cfg, mpps="-", tx_mpps="-", cycles_per_pkt="-",
+                  drops="-", latency_ns="-")
+    try:
+        tel = Telemetry(TELEMETRY_SOCK.format(prefix), args.startup)
+        has_latency = "/l3fwd/latency" in tel.commands()
+
+        time.sleep(args.warmup)
+        t0, s0, _ = sample(tel, has_latency)
+        time.sleep(args.duration)
+        t1, s1, lat = sample(tel, has_latency)
+        tel.close()
+
+        dt = t1 - t0
+        rx = s1["rx_pkts"] - s0["rx_pkts"]
+        tx = s1["tx_pkts"] - s0["tx_pkts"]
+        busy = s1["busy_cycles"] - s0["busy_cycles"]
+        drops = sum(s1[k] - s0[k] for k in
+                    ("tx_drops", "bad_port_drops", "dist_drops"))
+        result["mpps"] = "{:.3f}".format(rx / dt / 1e6)
+        result["tx_mpps"] = "{:.3f}".format(tx / dt / 1e6)
+        result["drops"] = drops
+        if rx:
+            result["cycles_per_pkt"] = "{:.1f}".format(busy / rx)
+        if lat:
+            result["latency_ns"] = lat.get("avg_ns", "-")
+    except (OSError, ValueError, KeyError, TypeError) as err:
+        print("{}: {}".format(cfg_name(cfg), err), file=sys.stderr)
+    finally:
+        proc.send_signal(signal.SIGINT)
+        try:
+            proc.wait(timeout=10)
+        except subprocess.TimeoutExpired:
+            proc.kill()
+            proc.wait()
+    return result
+
+
+def cfg_name(cfg):
+    if cfg["eventdev"] == "poll":
+        return "poll/{}".format(cfg["ports"])
+    return "{}/{}/{}/{}".format(cfg["eventdev"], cfg["sched"],
+                                cfg["deq_depth"], cfg["ports"])
+
+
+def matrix(args):
+    for ports in args.ports:
+        yield dict(eventdev="poll", sched="-", deq_depth="-", ports=ports)
+        for dev, sched, depth in itertools.product(args.eventdevs,
+                                                   args.sched,
+                                                   args.deq_depth):
+            yield dict(eventdev=dev, sched=sched, deq_depth=depth,
+                       ports=ports)
+
+
+FIELDS = ["eventdev", "sched", "deq_depth", "ports", "mpps", "tx_mpps",
+          "cycles_per_pkt", "drops", "latency_ns"]
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("l3fwd", help="path to the l3fwd binary")
+    parser.add_argument("--lcores", default="1-3",
+                        help="EAL lcore range; with event_sw the last "
+                        "lcore runs the scheduler service (default 1-3)")
+    parser.add_argument("--eventdevs", nargs="+",
+                        default=["event_sw", "event_dsw"],
+                        choices=["event_sw", "event_dsw"])
+    parser.add_argument("--sched", nargs="+",
+                        default=["atomic", "ordered", "parallel"],
+                        choices=["atomic", "ordered", "parallel"])
+    parser.add_argument("--deq-depth", nargs="+", type=int,
+                        default=[16, 32])
+    parser.add_argument("--ports", nargs="+", default=["null"],
+                        choices=["null", "ring"])
+    parser.add_argument("--duration", type=float, default=5,
+                        help="measurement window in seconds")
+    parser.add_argument("--warmup", type=float, default=2,
+                        help="seconds to run before measuring")
+    parser.add_argument("--startup", type=float, default=20,
+                        help="seconds to wait for the telemetry socket")
+    parser.add_argument("--csv", help="also write the results to a CSV file")
+    parser.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+
+    if not os.access(args.l3fwd, os.X_OK):
+        parser.error("{} is not executable".format(args.l3fwd))
+
+    results = [run_one(args, cfg, i) for i, cfg in enumerate(matrix(args))]
+
+    fmt = "{:<10} {:<9} {:>9} {:<5} {:>8} {:>8} {:>14} {:>10} {:>10}"
+    print(fmt.format(*FIELDS))
+    for r in results:
+        print(fmt.format(*[str(r[f]) for f in FIELDS]))
+
+    if args.csv:
+        with open(args.csv, "w", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=FIELDS)
+            writer.writeheader()
+            writer.writerows(results)
+
+
+if __name__ == "__main__":
+    main()
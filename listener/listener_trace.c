@@ -0,0 +1,18 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+/* Registration of the listener.* tracepoints, before rte_trace_point.h. */
+
+#include <rte_trace_point_register.h>
+
+#include "listener_trace.h"
+
+RTE_TRACE_POINT_DEFINE(listener_trace_rx_burst);
+RTE_TRACE_POINT_DEFINE(listener_trace_rx_done);
+
+RTE_INIT(listener_trace_init)
+{
+	RTE_TRACE_POINT_REGISTER(listener_trace_rx_burst, listener.rx_burst);
+	RTE_TRACE_POINT_REGISTER(listener_trace_rx_done, listener.rx_done);
+}
@@ -0,0 +1,32 @@
+/* SPDX-License-Identifier: BSD-3-Clause
+ * Copyright(c) 2021 yockgen
+ */
+
+#ifndef __LISTENER_TRACE_H__
+#define __LISTENER_TRACE_H__
+
+/*
+ * Tracepoints of the rx loop, registered as listener.* in
+ * listener_trace.c. Enabled at runtime with the EAL option
+ * --trace=listener, one load and a not taken branch otherwise.
+ */
+
+#include <rte_trace_point.h>
+
+/* A non empty rx burst. */
+RTE_TRACE_POINT(
+	listener_trace_rx_burst,
+	RTE_TRACE_POINT_ARGS(uint16_t port_id, uint16_t nb_rx),
+	rte_trace_point_emit_u16(port_id);
+	rte_trace_point_emit_u16(nb_rx);
+)
+
+/* Latency accounting and free of the burst received last are done. */
+RTE_TRACE_POINT(
+	listener_trace_rx_done,
+	RTE_TRACE_POINT_ARGS(uint16_t port_id, uint16_t nb_pkts),
+	rte_trace_point_emit_u16(port_id);
+	rte_trace_point_emit_u16(nb_pkts);
+)
+
+#endif /* __LISTENER_TRACE_H__ */
@@ -38,8 +38,13 @@
 #include <rte_ethdev.h>
 #include <rte_mempool.h>
 #include <rte_mbuf.h>
+#include <rte_ip.h>
+#include <rte_tcp.h>
+#include <rte_udp.h>
 #include <rte_string_fns.h>
 
+#include "listener_trace.h"
+
 static volatile bool force_quit;
 
 /* MAC updating enabled by default */
@@ -138,8 +143,21 @@ struct l2fwd_port_statistics {
 } __rte_cache_aligned;
 struct l2fwd_port_statistics port_statistics[RTE_MAX_ETHPORTS];
 
+/*
+ * Latency histogram: exact below 16 ns, then 16 linear buckets per
+ * power of two, so a percentile is off by 1/16 of its value at most.
+ */
+#define LAT_SUB_BITS 4
+#define LAT_SUB (1 << LAT_SUB_BITS)
+#define LAT_NB_BUCKETS ((64 - LAT_SUB_BITS + 1) << LAT_SUB_BITS)
+
 static struct stats {
 	uint64_t total_latency;
+	uint64_t samples;
+	uint64_t max_latency;
+	uint64_t first_rx_ns;	/* CLOCK_REALTIME of the first sample */
+	uint64_t last_rx_ns;
+	uint64_t hist[LAT_NB_BUCKETS];
 } latency_numbers;
 
 #define MAX_TIMER_PERIOD 86400 /* 1 day max */
@@ -175,6 +193,79 @@ static inline tsc_t *tsc_field(struct rte_mbuf *mbuf, int tsc_dynfield_offset)
 	return RTE_MBUF_DYNFIELD(p, tsc_dynfield_offset, tsc_t *);
 }
 
+static inline unsigned int lat_bucket(uint64_t ns)
+{
+	unsigned int e;
+
+	if (ns < LAT_SUB)
+		return ns;
+	e = 63 - __builtin_clzll(ns);
+	return ((e - LAT_SUB_BITS + 1) << LAT_SUB_BITS) +
+		((ns >> (e - LAT_SUB_BITS)) & (LAT_SUB - 1));
+}
+
+/* Largest latency that falls in bucket b. */
+static uint64_t lat_bucket_max(unsigned int b)
+{
+	unsigned int e;
+
+	if (b < LAT_SUB)
+		return b;
+	e = (b >> LAT_SUB_BITS) + LAT_SUB_BITS - 1;
+	return (((uint64_t)LAT_SUB + (b & (LAT_SUB - 1)) + 1) <<
+		(e - LAT_SUB_BITS)) - 1;
+}
+
+/* Latency under which pct percent of the samples are. */
+static uint64_t lat_percentile(double pct)
+{
+	uint64_t rank, seen = 0;
+	unsigned int b;
+
+	if (latency_numbers.samples == 0)
+		return 0;
+	rank = (uint64_t)(latency_numbers.samples * pct / 100.0);
+	for (b = 0; b < LAT_NB_BUCKETS; b++) {
+		seen += latency_numbers.hist[b];
+		if (seen > rank)
+			return RTE_MIN(lat_bucket_max(b),
+				latency_numbers.max_latency);
+	}
+	return latency_numbers.max_latency;
+}
+
+/*
+ * Offset of the talker timestamp: behind the L4 header of IPv4 packets
+ * (talker --flow, possibly routed by l3fwd), else behind the Ethernet
+ * header. Returns -1 when the packet is too short to carry one.
+ */
+static int stamp_offset(struct rte_mbuf *m)
+{
+	struct rte_ether_hdr *eth_hdr;
+	struct rte_ipv4_hdr *ipv4_hdr;
+	struct rte_tcp_hdr *tcp_hdr;
+	int off = sizeof(struct rte_ether_hdr);
+
+	eth_hdr = rte_pktmbuf_mtod(m, struct rte_ether_hdr *);
+	if (eth_hdr->ether_type == rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4)) {
+		if (m->data_len < off + sizeof(*ipv4_hdr) + sizeof(*tcp_hdr))
+			return -1;
+		ipv4_hdr = (struct rte_ipv4_hdr *)(eth_hdr + 1);
+		off += (ipv4_hdr->version_ihl & RTE_IPV4_HDR_IHL_MASK) *
+			RTE_IPV4_IHL_MULTIPLIER;
+		if (ipv4_hdr->next_proto_id == IPPROTO_TCP) {
+			tcp_hdr = rte_pktmbuf_mtod_offset(m,
+				struct rte_tcp_hdr *, off);
+			off += (tcp_hdr->data_off >> 4) * 4;
+		} else
+			off += sizeof(struct rte_udp_hdr);
+	}
+
+	if (m->data_len < off + sizeof(uint64_t))
+		return -1;
+	return off;
+}
+
 static void calc_sw_latency(struct rte_mbuf *m, int portid)
 {
 	int tsc_dynfield_offset;
@@ -182,13 +273,30 @@ static void calc_sw_latency(struct rte_mbuf *m, int portid)
         uint64_t tx_tsp;
 	double latency_ns;
 
-        tsc_dynfield_offset = sizeof(struct rte_ether_hdr);
+        tsc_dynfield_offset = stamp_offset(m);
+	if (tsc_dynfield_offset < 0) {
+		port_statistics[portid].timestamp_error++;
+		return;
+	}
         tx_tsp = *tsc_field(m, tsc_dynfield_offset);
+	/* stamped in the future: clocks of the two hosts disagree */
+	if (tx_tsp > rx_tsp) {
+		port_statistics[portid].timestamp_error++;
+		return;
+	}
         uint64_t diff_tsp = rx_tsp - tx_tsp;
 
 	port_statistics[portid].timestamp_us = rx_tsp;
 	port_statistics[portid].timestamp += diff_tsp;
 
+	if (latency_numbers.samples == 0)
+		latency_numbers.first_rx_ns = rx_tsp;
+	latency_numbers.last_rx_ns = rx_tsp;
+	latency_numbers.samples++;
+	latency_numbers.hist[lat_bucket(diff_tsp)]++;
+	if (diff_tsp > latency_numbers.max_latency)
+		latency_numbers.max_latency = diff_tsp;
+
 	latency_numbers.total_latency += diff_tsp;
 	latency_ns = (double)latency_numbers.total_latency / (double)port_statistics[portid].rx;
 	port_statistics[portid].latency_us = latency_ns / (1000 * 1000);
@@ -698,6 +806,9 @@ l2fwd_main_loop(void)
 
 			//port_statistics[portid].rx += nb_rx;
 			port_statistics[portid].rx_burst = nb_rx;
+			if (nb_rx == 0)
+				continue;
+			listener_trace_rx_burst(portid, nb_rx);
 
  
 			for (j = 0; j < nb_rx; j++) {
@@ -710,6 +821,7 @@ l2fwd_main_loop(void)
 				calc_sw_latency(m, portid);
 				rte_pktmbuf_free(m);
 			}
+			listener_trace_rx_done(portid, nb_rx);
 
                         //clock_gettime(CLOCK_MONOTONIC, &end);
                         //long timeElapsed = diff_us(end, start);
@@ -1325,6 +1437,29 @@ main(int argc, char **argv)
 		}
 	}
 
+	/* one line for scripts, see scripts/e2e_perf.py */
+	{
+		uint64_t rx = 0, errors = 0;
+
+		RTE_ETH_FOREACH_DEV(portid) {
+			rx += port_statistics[portid].rx;
+			errors += port_statistics[portid].timestamp_error;
+		}
+		printf("Listener summary: rx_pkts=%"PRIu64
+		       " stamp_errors=%"PRIu64" lat_samples=%"PRIu64
+		       " lat_avg_ns=%"PRIu64" lat_p50_ns=%"PRIu64
+		       " lat_p90_ns=%"PRIu64" lat_p99_ns=%"PRIu64
+		       " lat_p999_ns=%"PRIu64" lat_max_ns=%"PRIu64
+		       " rx_window_ns=%"PRIu64"\n",
+		       rx, errors, latency_numbers.samples,
+		       latency_numbers.samples ? latency_numbers.total_latency /
+				latency_numbers.samples : 0,
+		       lat_percentile(50), lat_percentile(90),
+		       lat_percentile(99), lat_percentile(99.9),
+		       latency_numbers.max_latency,
+		       latency_numbers.last_rx_ns - latency_numbers.first_rx_ns);
+	}
+
 
 
 	RTE_ETH_FOREACH_DEV(portid) {
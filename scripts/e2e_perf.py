@@ -0,0 +1,303 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: BSD-3-Clause
+# Copyright(c) 2021 yockgen
+
+"""
+One-box end-to-end performance regression suite.
+
+talker, l3fwd and listener run as three DPDK processes on this host,
+linked by net_memif pairs over unix sockets:
+
+  talker port 0 --memif s0--> l3fwd port 0
+                              l3fwd port 1 --memif s1--> listener port 0
+
+talker sends one IPv4 flow (--flow) at a fixed rate; the flow is routed
+to l3fwd port 1 by the default LPM/FIB routes or by an EM key. listener
+reports the received count and latency percentiles from the talker
+timestamps. net_ring pairs cannot be used: they only connect ports of
+one process.
+
+Every point of rate x frame size x lookup mode is a fresh set of
+processes. The results can be saved as a baseline and later runs
+compared to it; a throughput drop, loss increase or latency increase
+beyond the tolerances fails the suite (exit status 1).
+
+Example:
+  e2e_perf.py --talker talker/build/talker --l3fwd l3fwd/build/l3fwd \\
+      --listener listener/build/listener --save-baseline base.json
+  e2e_perf.py ... --baseline base.json
+"""
+
+import argparse
+import itertools
+import json
+import os
+import re
+import shutil
+import signal
+import subprocess
+import sys
+import tempfile
+import time
+
+# IPv4 flow that each lookup mode routes from l3fwd port 0 to port 1:
+# 198.18.1.0/24 is a default LPM/FIB route, the EM flow is a default key.
+FLOWS = {
+    "lpm": "198.19.0.1,198.18.1.1,1024,1024,udp",
+    "fib": "198.19.0.1,198.18.1.1,1024,1024,udp",
+    "em": "200.20.0.1,201.0.0.0,12,102,tcp",
+}
+MODE_OPT = {"lpm": "-L", "fib": "-F", "em": "-E"}
+# ethernet + IPv4 + TCP headers + timestamp and counter: the talker
+# rejects smaller frames of a tcp flow
+TCP_MIN_SIZE = 14 + 20 + 20 + 16
+
+SUMMARY_RE = re.compile(r"^(Talker|Listener) summary: (.*)$", re.M)
+
+LAT_KEYS = ["lat_p50_ns", "lat_p99_ns", "lat_p999_ns"]
+
+
+def memif(name, role, sock):
+    return "--vdev={},role={},socket={}".format(name, role, sock)
+
+
+def eal(lcore, prefix, vdevs, extra):
+    return ["-l", str(lcore), "--file-prefix", prefix, "--no-pci"] + \
+        vdevs + extra
+
+
+def parse_summary(out, who):
+    for m in SUMMARY_RE.finditer(out):
+        if m.group(1) == who:
+            return {k: int(v) for k, v in
+                    (kv.split("=") for kv in m.group(2).split())}
+    return None
+
+
+def stop(proc, timeout=10):
+    if proc.poll() is None:
+        proc.send_signal(signal.SIGINT)
+    try:
+        proc.wait(timeout=timeout)
+    except subprocess.TimeoutExpired:
+        proc.kill()
+        proc.wait()
+
+
+def start(cmd, log, verbose):
+    """Start cmd with its output in the file log; pipes could fill up."""
+    if verbose:
+        print(" ".join(cmd), file=sys.stderr)
+    with open(log, "w") as out:
+        return subprocess.Popen(cmd, stdout=out,
+                                stderr=None if verbose else
+                                subprocess.DEVNULL)
+
+
+def read(log):
+    with open(log) as f:
+        return f.read()
+
+
+def run_point(args, mode, size, rate, tmp, index):
+    s0 = os.path.join(tmp, "s0_{}.sock".format(index))
+    s1 = os.path.join(tmp, "s1_{}.sock".format(index))
+    extra = args.eal.split() if args.eal else []
+    fwd_lcore, talk_lcore, listen_lcore = args.lcores
+    if FLOWS[mode].endswith(",tcp"):
+        size = max(size, TCP_MIN_SIZE)
+
+    l3fwd = [args.l3fwd] + eal(fwd_lcore, "e2e_fwd{}".format(index),
+                               [memif("net_memif0", "server", s0),
+                                memif("net_memif1", "server", s1)],
+                               extra) + \
+        ["--", "-p", "0x3", "-P", "--parse-ptype", MODE_OPT[mode],
+         "--config", "(0,0,{0}),(1,0,{0})".format(fwd_lcore)]
+    listener = [args.listener] + eal(listen_lcore,
+                                     "e2e_lsn{}".format(index),
+                                     [memif("net_memif0", "client", s1)],
+                                     extra) + \
+        ["--", "-p", "0x1", "-T", "0"]
+    talker = [args.talker] + eal(talk_lcore, "e2e_tlk{}".format(index),
+                                 [memif("net_memif0", "client", s0)],
+                                 extra) + \
+        ["--", "-p", "0x1", "-T", "0", "-d", "02:00:00:00:00:00",
+         "--pkt-size", str(size), "--duration", str(args.duration),
+         "--flow", FLOWS[mode]]
+    if rate:
+        talker += ["--rate", str(rate)]
+
+    logs = [os.path.join(tmp, "{}_{}.log".format(n, index))
+            for n in ("l3fwd", "listener", "talker")]
+    result = {"mode": mode, "size": size, "rate": rate}
+    procs = []
+    try:
+        procs.append(start(l3fwd, logs[0], args.verbose))
+        time.sleep(args.startup)
+        lsn = start(listener, logs[1], args.verbose)
+        procs.append(lsn)
+        time.sleep(args.startup)
+        tlk = start(talker, logs[2], args.verbose)
+        procs.append(tlk)
+
+        tlk.wait(timeout=args.duration + 60)
+        time.sleep(args.drain)
+        stop(lsn)
+    except subprocess.TimeoutExpired:
+        result["error"] = "talker did not finish"
+        return result
+    finally:
+        for p in procs:
+            stop(p)
+
+    t = parse_summary(read(logs[2]), "Talker")
+    r = parse_summary(read(logs[1]), "Listener")
+    if t is None or r is None:
+        result["error"] = "no {} summary".format(
+            "talker" if t is None else "listener")
+        return result
+
+    secs = t["elapsed_ns"] / 1e9 if t["elapsed_ns"] else args.duration
+    result["tx_mpps"] = t["tx_pkts"] / secs / 1e6
+    result["rx_mpps"] = r["rx_pkts"] / secs / 1e6
+    offered = t["tx_pkts"] + t["tx_dropped"]
+    result["loss_pct"] = (100.0 * (offered - r["rx_pkts"]) / offered
+                          if offered else 100.0)
+    for k in ["lat_avg_ns"] + LAT_KEYS + ["lat_max_ns"]:
+        result[k] = r[k]
+    return result
+
+
+def key(r):
+    return "{}/{}/{}".format(r["mode"], r["size"], r["rate"])
+
+
+def compare(args, results, baseline):
+    """Return the regressions of results against baseline."""
+    failures = []
+    for r in results:
+        b = baseline.get(key(r))
+        if b is None:
+            continue
+        if "error" in r:
+            failures.append("{}: {}".format(key(r), r["error"]))
+            continue
+        if "error" in b:
+            continue
+        if r["rx_mpps"] < b["rx_mpps"] * (1 - args.tput_tol / 100.0):
+            failures.append("{}: rx {:.3f} Mpps, baseline {:.3f}".format(
+                key(r), r["rx_mpps"], b["rx_mpps"]))
+        if r["loss_pct"] > b["loss_pct"] + args.loss_tol:
+            failures.append("{}: loss {:.2f}%, baseline {:.2f}%".format(
+                key(r), r["loss_pct"], b["loss_pct"]))
+        for k in LAT_KEYS:
+            limit = max(b[k] * (1 + args.lat_tol / 100.0),
+                        b[k] + args.lat_floor)
+            if r[k] > limit:
+                failures.append("{}: {} {} ns, baseline {} ns".format(
+                    key(r), k, r[k], b[k]))
+    return failures
+
+
+def print_table(results):
+    fmt = "{:<5} {:>5} {:>10} {:>8} {:>8} {:>7} {:>9} {:>9} {:>9}"
+    print(fmt.format("mode", "size", "rate", "tx_mpps", "rx_mpps",
+                     "loss%", "p50_ns", "p99_ns", "p999_ns"))
+    for r in results:
+        if "error" in r:
+            print("{:<5} {:>5} {:>10}  {}".format(r["mode"], r["size"],
+                                                r["rate"] or "-",
+                                                r["error"]))
+            continue
+        print(fmt.format(r["mode"], r["size"], r["rate"] or "-",
+                         "{:.3f}".format(r["tx_mpps"]),
+                         "{:.3f}".format(r["rx_mpps"]),
+                         "{:.2f}".format(r["loss_pct"]),
+                         r["lat_p50_ns"], r["lat_p99_ns"],
+                         r["lat_p999_ns"]))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--talker", required=True)
+    parser.add_argument("--l3fwd", required=True)
+    parser.add_argument("--listener", required=True)
+    parser.add_argument("--lcores", nargs=3, type=int, default=[1, 2, 3],
+                        metavar=("L3FWD", "TALKER", "LISTENER"),
+                        help="lcore of each process (default 1 2 3)")
+    parser.add_argument("--modes", nargs="+", default=["lpm", "em", "fib"],
+                        choices=sorted(FLOWS))
+    parser.add_argument("--sizes", nargs="+", type=int,
+                        default=[64, 512, 1514],
+                        help="frame sizes without CRC")
+    parser.add_argument("--rates", nargs="+", type=int,
+                        default=[100000, 1000000],
+                        help="packets per second, 0 for the talker "
+                        "default of one packet per loop")
+    parser.add_argument("--duration", type=int, default=10,
+                        help="seconds of traffic per point")
+    parser.add_argument("--startup", type=float, default=3,
+                        help="seconds to let each process come up")
+    parser.add_argument("--drain", type=float, default=1,
+                        help="seconds to wait for in-flight packets")
+    parser.add_argument("--eal", help="extra EAL options for all three, "
+                        "e.g. '--in-memory -m 512'")
+    parser.add_argument("--baseline", help="compare to this baseline")
+    parser.add_argument("--save-baseline", help="write the results here")
+    parser.add_argument("--tput-tol", type=float, default=5,
+                        help="allowed rx rate drop in percent")
+    parser.add_argument("--loss-tol", type=float, default=0.1,
+                        help="allowed loss increase in percentage points")
+    parser.add_argument("--lat-tol", type=float, default=20,
+                        help="allowed latency increase in percent")
+    parser.add_argument("--lat-floor", type=int, default=2000,
+                        help="latency increase in ns always allowed, "
+                        "for noise on small values")
+    parser.add_argument("-v", "--verbose", action="store_true")
+    args = parser.parse_args()
+
+    for path in (args.talker, args.l3fwd, args.listener):
+        if not os.access(path, os.X_OK):
+            parser.error("{} is not executable".format(path))
+
+    baseline = {}
+    if args.baseline:
+        with open(args.baseline) as f:
+            baseline = json.load(f)
+
+    tmp = tempfile.mkdtemp(prefix="e2e_perf")
+    results = []
+    try:
+        points = itertools.product(args.modes, args.sizes, args.rates)
+        for i, (mode, size, rate) in enumerate(points):
+            r = run_point(args, mode, size, rate, tmp, i)
+            results.append(r)
+            if args.verbose:
+                print(json.dumps(r), file=sys.stderr)
+    finally:
+        shutil.rmtree(tmp, ignore_errors=True)
+
+    print_table(results)
+
+    if args.save_baseline:
+        with open(args.save_baseline, "w") as f:
+            json.dump({key(r): r for r in results}, f, indent=1,
+                      sort_keys=True)
+
+    if args.baseline:
+        failures = compare(args, results, baseline)
+        missing = [key(r) for r in results if key(r) not in baseline]
+        if missing:
+            print("\nnot in baseline: " + ", ".join(missing))
+        if failures:
+            print("\nREGRESSION")
+            for f in failures:
+                print("  " + f)
+            sys.exit(1)
+        print("\nno regression against " + args.baseline)
+
+
+if __name__ == "__main__":
+    main()
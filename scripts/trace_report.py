@@ -0,0 +1,258 @@
+#!/usr/bin/env python3
+# SPDX-License-Identifier: BSD-3-Clause
+# Copyright(c) 2021 yockgen
+
+"""
+Burst level report of an l3fwd or listener CTF trace.
+
+Record the trace with the EAL options --trace=l3fwd (or
+--trace=listener) and --trace-dir=DIR; DPDK writes it to a rte-*
+directory under DIR when the process exits. This script reads it with
+babeltrace2 (or babeltrace) and prints, per lcore:
+
+  - a timeline: rx bursts, packets, mean burst size, mean processing
+    time, tx packets and drain ticks per interval;
+  - a histogram of the rx burst sizes;
+  - a histogram of the processing times, from the rx burst to the end
+    of its lookup (l3fwd.lookup) or of its handling (listener.rx_done);
+  - the intervals between drain ticks.
+
+Only non empty rx bursts are traced, the empty polls are not counted.
+
+Example:
+  trace_report.py /tmp/trace/rte-2020-11-20-PM-03-12-05
+  trace_report.py --interval-ms 10 --csv out/ /tmp/trace/rte-*
+  babeltrace2 --clock-seconds DIR > t.txt; trace_report.py --text t.txt
+"""
+
+import argparse
+import collections
+import os
+import re
+import shutil
+import subprocess
+import sys
+
+EVENT_RE = re.compile(r"\b((?:l3fwd|listener)\.\w+):")
+TS_RE = re.compile(r"^\[\s*(\d+\.\d+)\]")
+FIELD_RE = re.compile(r"(\w+) = (\"[^\"]*\"|[^,}\s]+)")
+
+# rx burst and the event that closes its processing
+RX_EVENTS = ("l3fwd.rx_burst", "listener.rx_burst")
+DONE_EVENTS = ("l3fwd.lookup", "listener.rx_done")
+
+
+def babeltrace_text(trace_dir):
+    for tool in ("babeltrace2", "babeltrace"):
+        if shutil.which(tool):
+            return subprocess.run([tool, "--clock-seconds", trace_dir],
+                                  check=True, stdout=subprocess.PIPE,
+                                  universal_newlines=True).stdout
+    sys.exit("neither babeltrace2 nor babeltrace found, "
+             "convert the trace by hand and use --text")
+
+
+def parse_int(v):
+    return int(v, 0)
+
+
+def parse(lines):
+    """Yield (lcore, ts_ns, event, fields) for the l3fwd/listener events."""
+    for line in lines:
+        ev = EVENT_RE.search(line)
+        ts = TS_RE.match(line)
+        if ev is None or ts is None:
+            continue
+        fields = {}
+        for k, v in FIELD_RE.findall(line[ev.end():]):
+            fields[k] = v.strip('"')
+        # one stream per thread: cpu_id of the packet context, else name
+        lcore = fields.get("cpu_id", fields.get("name", "?"))
+        try:
+            lcore = parse_int(lcore)
+        except ValueError:
+            pass
+        yield lcore, int(round(float(ts.group(1)) * 1e9)), ev.group(1), \
+            fields
+
+
+class Lcore:
+    def __init__(self):
+        self.events = []
+        self.burst_hist = collections.Counter()
+        self.tx_hist = collections.Counter()
+        self.proc_ns = []
+        self.drain_ns = []
+
+
+def analyse(records):
+    lcores = collections.defaultdict(Lcore)
+    for lcore, ts, ev, fields in records:
+        lcores[lcore].events.append((ts, ev, fields))
+
+    for lc in lcores.values():
+        lc.events.sort(key=lambda e: e[0])
+        rx_ts = {}
+        last_drain = None
+        for ts, ev, f in lc.events:
+            if ev in RX_EVENTS:
+                lc.burst_hist[parse_int(f["nb_rx"])] += 1
+                rx_ts[f["port_id"]] = ts
+            elif ev in DONE_EVENTS:
+                start = rx_ts.pop(f["port_id"], None)
+                if start is not None:
+                    lc.proc_ns.append(ts - start)
+            elif ev == "l3fwd.tx_burst":
+                lc.tx_hist[parse_int(f["nb_pkts"])] += 1
+            elif ev == "l3fwd.tx_drain":
+                if last_drain is not None:
+                    lc.drain_ns.append(ts - last_drain)
+                last_drain = ts
+    return lcores
+
+
+def log2_bucket(ns):
+    return max(ns, 1).bit_length() - 1
+
+
+def fmt_ns(ns):
+    if ns >= 1000000:
+        return "{:.1f}ms".format(ns / 1e6)
+    if ns >= 1000:
+        return "{:.1f}us".format(ns / 1e3)
+    return "{}ns".format(ns)
+
+
+def bar(n, total, width=40):
+    return "#" * int(round(width * n / total)) if total else ""
+
+
+def print_hist(title, rows):
+    total = sum(n for _, n in rows)
+    if total == 0:
+        return
+    print("  " + title)
+    for label, n in rows:
+        print("    {:>17} {:>10} {:6.2f}% {}".format(
+            label, n, 100.0 * n / total, bar(n, total)))
+
+
+def print_ns_hist(title, values):
+    hist = collections.Counter(log2_bucket(v) for v in values)
+    print_hist(title, [("{}-{}".format(fmt_ns(1 << b), fmt_ns(2 << b)),
+                        hist[b]) for b in range(min(hist), max(hist) + 1)]
+               if hist else [])
+
+
+def percentile(values, pct):
+    s = sorted(values)
+    return s[min(len(s) - 1, int(len(s) * pct / 100))]
+
+
+def timeline(lc, t0, interval_ns):
+    """Rows of [start_ms, bursts, pkts, avg burst, avg proc, tx, drains]."""
+    rows = collections.OrderedDict()
+    rx_ts = {}
+
+    def row(ts):
+        w = (ts - t0) // interval_ns
+        if w not in rows:
+            rows[w] = [0, 0, 0, 0, 0, 0]  # bursts pkts proc nproc tx drains
+        return rows[w]
+
+    for ts, ev, f in lc.events:
+        r = row(ts)
+        if ev in RX_EVENTS:
+            r[0] += 1
+            r[1] += parse_int(f["nb_rx"])
+            rx_ts[f["port_id"]] = ts
+        elif ev in DONE_EVENTS and f["port_id"] in rx_ts:
+            r[2] += ts - rx_ts.pop(f["port_id"])
+            r[3] += 1
+        elif ev == "l3fwd.tx_burst":
+            r[4] += parse_int(f["sent"])
+        elif ev == "l3fwd.tx_drain":
+            r[5] += 1
+
+    out = []
+    for w, (bursts, pkts, proc, nproc, tx, drains) in rows.items():
+        out.append([w * interval_ns / 1e6, bursts, pkts,
+                    pkts / bursts if bursts else 0,
+                    proc // nproc if nproc else 0, tx, drains])
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("trace", nargs="?", help="CTF trace directory")
+    parser.add_argument("--text", help="babeltrace --clock-seconds output "
+                        "to read instead of a trace directory")
+    parser.add_argument("--interval-ms", type=float, default=100,
+                        help="timeline interval (default 100)")
+    parser.add_argument("--csv", metavar="DIR",
+                        help="also write timeline_lcore<N>.csv files here")
+    parser.add_argument("--no-timeline", action="store_true",
+                        help="print the histograms only")
+    args = parser.parse_args()
+
+    if args.text:
+        with open(args.text) as f:
+            lcores = analyse(parse(f))
+    elif args.trace:
+        lcores = analyse(parse(babeltrace_text(args.trace).splitlines()))
+    else:
+        parser.error("a trace directory or --text is required")
+
+    if not lcores:
+        sys.exit("no l3fwd or listener events, was the trace enabled "
+                 "with --trace=l3fwd or --trace=listener?")
+
+    t0 = min(lc.events[0][0] for lc in lcores.values())
+    interval_ns = max(int(args.interval_ms * 1e6), 1)
+    if args.csv:
+        os.makedirs(args.csv, exist_ok=True)
+
+    for lcore in sorted(lcores, key=str):
+        lc = lcores[lcore]
+        bursts = sum(lc.burst_hist.values())
+        pkts = sum(k * n for k, n in lc.burst_hist.items())
+        print("lcore {}: {} rx bursts, {} packets, {:.1f}s".format(
+            lcore, bursts, pkts,
+            (lc.events[-1][0] - lc.events[0][0]) / 1e9))
+
+        rows = timeline(lc, t0, interval_ns)
+        if args.csv:
+            path = os.path.join(args.csv, "timeline_lcore{}.csv".format(
+                lcore))
+            with open(path, "w") as f:
+                f.write("start_ms,rx_bursts,rx_pkts,avg_burst,"
+                        "avg_proc_ns,tx_pkts,drains\n")
+                for r in rows:
+                    f.write("{:.3f},{},{},{:.2f},{},{},{}\n".format(*r))
+        if not args.no_timeline:
+            print("  {:>10} {:>8} {:>9} {:>6} {:>10} {:>9} {:>7}".format(
+                "start_ms", "bursts", "pkts", "burst", "proc", "tx",
+                "drains"))
+            for r in rows:
+                print("  {:10.1f} {:8} {:9} {:6.1f} {:>10} {:9} {:7}"
+                      .format(r[0], r[1], r[2], r[3], fmt_ns(r[4]), r[5],
+                              r[6]))
+
+        print_hist("rx burst size", sorted(lc.burst_hist.items()))
+        print_hist("tx burst size", sorted(lc.tx_hist.items()))
+        if lc.proc_ns:
+            print_ns_hist("processing time (p50 {} p99 {} max {})".format(
+                fmt_ns(percentile(lc.proc_ns, 50)),
+                fmt_ns(percentile(lc.proc_ns, 99)),
+                fmt_ns(max(lc.proc_ns))), lc.proc_ns)
+        if lc.drain_ns:
+            print_ns_hist("drain tick interval (p50 {} max {})".format(
+                fmt_ns(percentile(lc.drain_ns, 50)),
+                fmt_ns(max(lc.drain_ns))), lc.drain_ns)
+        print()
+
+
+if __name__ == "__main__":
+    main()
@@ -10,6 +10,7 @@
 #include <sys/types.h>
 #include <sys/queue.h>
 #include <netinet/in.h>
+#include <arpa/inet.h>
 #include <setjmp.h>
 #include <stdarg.h>
 #include <ctype.h>
@@ -38,6 +39,9 @@
 #include <rte_ethdev.h>
 #include <rte_mempool.h>
 #include <rte_mbuf.h>
+#include <rte_ip.h>
+#include <rte_udp.h>
+#include <rte_tcp.h>
 #include <rte_string_fns.h>
 
 #include <sys/time.h>
@@ -150,6 +154,25 @@ static uint64_t timer_period = 10; /* default period is 10 seconds */
 /*Destination mac address*/
 static uint8_t dst_mac_addr[6] = {0x00,0x00,0x00,0x00,0x00,0x00};
 
+/* Scripted load: --rate, --pkt-size, --duration and --flow */
+#define TALKER_MIN_PKT_SIZE 64
+#define TALKER_MAX_PKT_SIZE 1514
+#define TALKER_PAYLOAD_SIZE 16	/* timestamp and counter behind the headers */
+static uint64_t tx_rate;	/* packets per second, 0: one per loop */
+static uint16_t tx_pkt_size;	/* 0: the smallest frame that fits */
+static uint64_t tx_duration;	/* seconds, 0: until SIGINT */
+static uint64_t tx_start_ns, tx_end_ns;
+
+/* IPv4 5-tuple of the packets; without --flow raw L2 frames are sent */
+static struct talker_flow {
+	uint32_t ip_src;
+	uint32_t ip_dst;
+	uint16_t port_src;
+	uint16_t port_dst;
+	uint8_t proto;
+} tx_flow;
+static int tx_flow_on;
+
 static void hex_dumps(struct rte_mbuf *m, unsigned portid)
 {
         unsigned char *p = rte_pktmbuf_mtod(m, unsigned char *);
@@ -477,6 +500,51 @@ static inline tsc_t *tsc_field(struct rte_mbuf *mbuf, int tsc_dynfield_offset)
         return RTE_MBUF_DYNFIELD(p, tsc_dynfield_offset, tsc_t *);
 }
 
+/*
+ * IPv4 + UDP/TCP headers of --flow after the Ethernet header.
+ * Returns the length of the headers, the timestamp goes behind them.
+ */
+static int construct_ipv4(struct rte_mbuf *m)
+{
+	struct rte_ipv4_hdr *ipv4_hdr;
+	struct rte_udp_hdr *udp_hdr;
+	struct rte_tcp_hdr *tcp_hdr;
+	uint16_t l4_len;
+
+	ipv4_hdr = rte_pktmbuf_mtod_offset(m, struct rte_ipv4_hdr *,
+			sizeof(struct rte_ether_hdr));
+	memset(ipv4_hdr, 0, sizeof(*ipv4_hdr));
+	ipv4_hdr->version_ihl = RTE_IPV4_VHL_DEF;
+	ipv4_hdr->total_length = rte_cpu_to_be_16(tx_pkt_size -
+			sizeof(struct rte_ether_hdr));
+	ipv4_hdr->time_to_live = 64;
+	ipv4_hdr->next_proto_id = tx_flow.proto;
+	ipv4_hdr->src_addr = rte_cpu_to_be_32(tx_flow.ip_src);
+	ipv4_hdr->dst_addr = rte_cpu_to_be_32(tx_flow.ip_dst);
+	ipv4_hdr->hdr_checksum = rte_ipv4_cksum(ipv4_hdr);
+
+	if (tx_flow.proto == IPPROTO_TCP) {
+		tcp_hdr = (struct rte_tcp_hdr *)(ipv4_hdr + 1);
+		memset(tcp_hdr, 0, sizeof(*tcp_hdr));
+		tcp_hdr->src_port = rte_cpu_to_be_16(tx_flow.port_src);
+		tcp_hdr->dst_port = rte_cpu_to_be_16(tx_flow.port_dst);
+		tcp_hdr->data_off = sizeof(*tcp_hdr) << 2;
+		tcp_hdr->tcp_flags = RTE_TCP_ACK_FLAG;
+		l4_len = sizeof(*tcp_hdr);
+	} else {
+		udp_hdr = (struct rte_udp_hdr *)(ipv4_hdr + 1);
+		udp_hdr->src_port = rte_cpu_to_be_16(tx_flow.port_src);
+		udp_hdr->dst_port = rte_cpu_to_be_16(tx_flow.port_dst);
+		udp_hdr->dgram_len = rte_cpu_to_be_16(tx_pkt_size -
+			sizeof(struct rte_ether_hdr) - sizeof(*ipv4_hdr));
+		udp_hdr->dgram_cksum = 0;
+		l4_len = sizeof(*udp_hdr);
+	}
+
+	return sizeof(struct rte_ether_hdr) + sizeof(*ipv4_hdr) + l4_len;
+}
+
+/* Returns the number of packets built, short when the pool runs dry. */
 static int  construct_packet(struct rte_mbuf *pkt[], const int pkt_size)
 {
 #define TIME_STAMP_MSG_SIZE 36  
@@ -539,18 +607,25 @@ static int  construct_packet(struct rte_mbuf *pkt[], const int pkt_size)
 		tx_tsp  = get_time_nanosec(CLOCK_REALTIME);
 
 		pkt[i] = rte_pktmbuf_alloc(l2fwd_pktmbuf_pool);
+		if (pkt[i] == NULL)
+			return i;
 		eth_hdr = rte_pktmbuf_mtod(pkt[i],struct rte_ether_hdr*);
 		eth_hdr->d_addr = d_addr;
 		eth_hdr->s_addr = s_addr;
 		eth_hdr->ether_type = ether_type;
 
-		// put tx timestamps after pkt counter (8 bytes)
+		// with --flow the timestamp follows the IPv4/L4 headers
                 tsc_dynfield_offset = sizeof(struct rte_ether_hdr);
+		if (tx_flow_on) {
+			eth_hdr->ether_type =
+				rte_cpu_to_be_16(RTE_ETHER_TYPE_IPV4);
+			tsc_dynfield_offset = construct_ipv4(pkt[i]);
+		}
                 *tsc_field(pkt[i], tsc_dynfield_offset) = tx_tsp;
 
 		// put counter after timestamp (8 bytes)
 		pkt_counter += 1;
-		tsc_dynfield_offset = sizeof(struct rte_ether_hdr) + sizeof(tx_tsp);
+		tsc_dynfield_offset += sizeof(tx_tsp);
 		*tsc_field(pkt[i], tsc_dynfield_offset) = pkt_counter;
 
 		/*
@@ -559,7 +634,7 @@ static int  construct_packet(struct rte_mbuf *pkt[], const int pkt_size)
 		int pkt_size = sizeof(struct Message) + sizeof(struct rte_ether_hdr);
 		*/
 
-		int pkt_size = 64;
+		int pkt_size = tx_pkt_size;
 		pkt[i]->data_len = pkt_size;
 		pkt[i]->pkt_len = pkt_size;
 
@@ -583,7 +658,7 @@ static int  construct_packet(struct rte_mbuf *pkt[], const int pkt_size)
 	*/
 
 
-        return 0;
+        return BURST_SIZE;
 
 }
 
@@ -605,6 +680,8 @@ talker_main_loop(void)
 	const uint64_t drain_tsc = (rte_get_tsc_hz() + US_PER_S - 1) / US_PER_S *
 			BURST_TX_DRAIN_US;
 	struct rte_eth_dev_tx_buffer *buffer;
+	const double pkts_per_tsc = (double)tx_rate / rte_get_tsc_hz();
+	uint64_t start_tsc, end_tsc, nb_sent = 0, due;
 
 	prev_tsc = 0;
 	timer_tsc = 0;
@@ -619,6 +696,11 @@ talker_main_loop(void)
 
 	RTE_LOG(INFO, L2FWD, "entering main loop on lcore %u\n", lcore_id);
 
+	start_tsc = rte_rdtsc();
+	end_tsc = tx_duration ? start_tsc + tx_duration * rte_get_tsc_hz() :
+		UINT64_MAX;
+	tx_start_ns = get_time_nanosec(CLOCK_MONOTONIC);
+
 	for (i = 0; i < qconf->n_rx_port; i++) {
 
 		portid = qconf->rx_port_list[i];
@@ -631,6 +713,8 @@ talker_main_loop(void)
 	while (!force_quit) {
                 //force_quit = true;//for debug purpose cause only one packet send
                 cur_tsc = rte_rdtsc();
+		if (unlikely(cur_tsc >= end_tsc))
+			break;
 		/*
 		if (icounter > 100){
                     force_quit = true;  
@@ -686,10 +770,20 @@ talker_main_loop(void)
 
         int BURST_SIZE = 1;
 
-        struct rte_mbuf *pkt[BURST_SIZE];
+	/* --rate: send what is due since the start, one burst at most */
+	if (tx_rate) {
+		due = (uint64_t)((cur_tsc - start_tsc) * pkts_per_tsc) + 1;
+		if (due <= nb_sent)
+			continue;
+		BURST_SIZE = RTE_MIN(due - nb_sent, (uint64_t)MAX_PKT_BURST);
+	}
+
+        struct rte_mbuf *pkt[MAX_PKT_BURST];
         int ret01 = construct_packet(pkt, BURST_SIZE);
-        uint16_t nb_tx = rte_eth_tx_burst(0,0,pkt,BURST_SIZE);
+        uint16_t nb_tx = rte_eth_tx_burst(0,0,pkt,ret01);
 	port_statistics[portid].tx += nb_tx;
+	port_statistics[portid].dropped += ret01 - nb_tx;
+	nb_sent += ret01;
 
 
 /*        printf("\nSending Packet (Timestamp:%s) To DESTINATION MAC address: %02X:%02X:%02X:%02X:%02X:%02X\n",
@@ -702,11 +796,14 @@ talker_main_loop(void)
                                 eth_hdr->d_addr.addr_bytes[5]);
 
 */
-        for(i=0;i<BURST_SIZE;i++)
+	/* the PMD owns what it took, free the rest */
+        for(i=nb_tx;i<(unsigned)ret01;i++)
 		rte_pktmbuf_free(pkt[i]);
 
    }
 
+	tx_end_ns = get_time_nanosec(CLOCK_MONOTONIC);
+	force_quit = true;
 }
 
 
@@ -732,8 +829,34 @@ talker_usage(const char *prgname)
 	       "       - The source MAC address is replaced by the TX port MAC address\n"
 	       "       - The destination MAC address is replaced by 02:00:00:00:00:TX_PORT_ID\n"
 	       "  --portmap: Configure forwarding port pair mapping\n"
-	       "	      Default: alternate port pairs\n\n",
-	       prgname);
+	       "	      Default: alternate port pairs\n"
+	       "  --rate PPS: Send PPS packets per second (default: one per loop)\n"
+	       "  --pkt-size BYTES: Frame size without CRC, %d-%d (default %d)\n"
+	       "      It must hold the headers and %d bytes of timestamp and counter,\n"
+	       "      %d with a tcp --flow, which is then the default\n"
+	       "  --duration SECONDS: Stop sending after SECONDS (default: until SIGINT)\n"
+	       "  --flow SRC_IP,DST_IP,SPORT,DPORT,udp|tcp: Send IPv4 packets of this\n"
+	       "      flow, with the timestamp behind the L4 header (default: raw L2)\n\n",
+	       prgname, TALKER_MIN_PKT_SIZE, TALKER_MAX_PKT_SIZE,
+	       TALKER_MIN_PKT_SIZE, TALKER_PAYLOAD_SIZE,
+	       (int)(sizeof(struct rte_ether_hdr) +
+		     sizeof(struct rte_ipv4_hdr) + sizeof(struct rte_tcp_hdr) +
+		     TALKER_PAYLOAD_SIZE));
+}
+
+/* Smallest frame that holds the headers, the timestamp and the counter */
+static uint16_t
+talker_min_pkt_size(void)
+{
+	uint16_t len = sizeof(struct rte_ether_hdr) + TALKER_PAYLOAD_SIZE;
+
+	if (tx_flow_on)
+		len += sizeof(struct rte_ipv4_hdr) +
+			(tx_flow.proto == IPPROTO_TCP ?
+			 sizeof(struct rte_tcp_hdr) :
+			 sizeof(struct rte_udp_hdr));
+
+	return RTE_MAX(len, (uint16_t)TALKER_MIN_PKT_SIZE);
 }
 
 static int
@@ -875,6 +998,69 @@ talker_parse_dst_mac(const char *q_arg)
   return n;
 }
 
+static int
+talker_parse_u64(const char *q_arg, uint64_t min, uint64_t max, uint64_t *val)
+{
+	char *end = NULL;
+	unsigned long long n;
+
+	errno = 0;
+	n = strtoull(q_arg, &end, 10);
+	if (errno != 0 || q_arg[0] == '\0' || end == NULL || *end != '\0' ||
+			n < min || n > max)
+		return -1;
+
+	*val = n;
+	return 0;
+}
+
+/* --flow SRC_IP,DST_IP,SPORT,DPORT,udp|tcp */
+static int
+talker_parse_flow(const char *q_arg)
+{
+	enum fieldnames {
+		FLD_SRC = 0,
+		FLD_DST,
+		FLD_SPORT,
+		FLD_DPORT,
+		FLD_PROTO,
+		_NUM_FLD
+	};
+	char *str_fld[_NUM_FLD];
+	struct in_addr addr;
+	uint64_t port;
+	char s[256];
+
+	if (strlcpy(s, q_arg, sizeof(s)) >= sizeof(s))
+		return -1;
+	if (rte_strsplit(s, sizeof(s), str_fld, _NUM_FLD, ',') != _NUM_FLD)
+		return -1;
+
+	if (inet_pton(AF_INET, str_fld[FLD_SRC], &addr) != 1)
+		return -1;
+	tx_flow.ip_src = rte_be_to_cpu_32(addr.s_addr);
+	if (inet_pton(AF_INET, str_fld[FLD_DST], &addr) != 1)
+		return -1;
+	tx_flow.ip_dst = rte_be_to_cpu_32(addr.s_addr);
+
+	if (talker_parse_u64(str_fld[FLD_SPORT], 0, UINT16_MAX, &port) < 0)
+		return -1;
+	tx_flow.port_src = port;
+	if (talker_parse_u64(str_fld[FLD_DPORT], 0, UINT16_MAX, &port) < 0)
+		return -1;
+	tx_flow.port_dst = port;
+
+	if (!strcmp(str_fld[FLD_PROTO], "udp"))
+		tx_flow.proto = IPPROTO_UDP;
+	else if (!strcmp(str_fld[FLD_PROTO], "tcp"))
+		tx_flow.proto = IPPROTO_TCP;
+	else
+		return -1;
+
+	tx_flow_on = 1;
+	return 0;
+}
+
 static const char short_options[] =
 	"p:"  /* portmask */
 	"q:"  /* number of queues */
@@ -885,6 +1071,10 @@ static const char short_options[] =
 #define CMD_LINE_OPT_MAC_UPDATING "mac-updating"
 #define CMD_LINE_OPT_NO_MAC_UPDATING "no-mac-updating"
 #define CMD_LINE_OPT_PORTMAP_CONFIG "portmap"
+#define CMD_LINE_OPT_RATE "rate"
+#define CMD_LINE_OPT_PKT_SIZE "pkt-size"
+#define CMD_LINE_OPT_DURATION "duration"
+#define CMD_LINE_OPT_FLOW "flow"
 
 enum {
 	/* long options mapped to a short option */
@@ -893,12 +1083,20 @@ enum {
 	 * conflict with short options */
 	CMD_LINE_OPT_MIN_NUM = 256,
 	CMD_LINE_OPT_PORTMAP_NUM,
+	CMD_LINE_OPT_RATE_NUM,
+	CMD_LINE_OPT_PKT_SIZE_NUM,
+	CMD_LINE_OPT_DURATION_NUM,
+	CMD_LINE_OPT_FLOW_NUM,
 };
 
 static const struct option lgopts[] = {
 	{ CMD_LINE_OPT_MAC_UPDATING, no_argument, &mac_updating, 1},
 	{ CMD_LINE_OPT_NO_MAC_UPDATING, no_argument, &mac_updating, 0},
 	{ CMD_LINE_OPT_PORTMAP_CONFIG, 1, 0, CMD_LINE_OPT_PORTMAP_NUM},
+	{ CMD_LINE_OPT_RATE, 1, 0, CMD_LINE_OPT_RATE_NUM},
+	{ CMD_LINE_OPT_PKT_SIZE, 1, 0, CMD_LINE_OPT_PKT_SIZE_NUM},
+	{ CMD_LINE_OPT_DURATION, 1, 0, CMD_LINE_OPT_DURATION_NUM},
+	{ CMD_LINE_OPT_FLOW, 1, 0, CMD_LINE_OPT_FLOW_NUM},
 	{NULL, 0, 0, 0}
 };
 
@@ -972,12 +1170,62 @@ talker_parse_args(int argc, char **argv)
 			}
 			break;
 
+		case CMD_LINE_OPT_RATE_NUM:
+			if (talker_parse_u64(optarg, 1, UINT32_MAX,
+					&tx_rate) < 0) {
+				fprintf(stderr, "Invalid rate\n");
+				talker_usage(prgname);
+				return -1;
+			}
+			break;
+
+		case CMD_LINE_OPT_PKT_SIZE_NUM: {
+			uint64_t size;
+
+			if (talker_parse_u64(optarg, TALKER_MIN_PKT_SIZE,
+					TALKER_MAX_PKT_SIZE, &size) < 0) {
+				fprintf(stderr, "Invalid packet size\n");
+				talker_usage(prgname);
+				return -1;
+			}
+			tx_pkt_size = size;
+			break;
+		}
+
+		case CMD_LINE_OPT_DURATION_NUM:
+			if (talker_parse_u64(optarg, 1, MAX_TIMER_PERIOD,
+					&tx_duration) < 0) {
+				fprintf(stderr, "Invalid duration\n");
+				talker_usage(prgname);
+				return -1;
+			}
+			break;
+
+		case CMD_LINE_OPT_FLOW_NUM:
+			if (talker_parse_flow(optarg) < 0) {
+				fprintf(stderr, "Invalid flow\n");
+				talker_usage(prgname);
+				return -1;
+			}
+			break;
+
 		default:
 			talker_usage(prgname);
 			return -1;
 		}
 	}
 
+	/* --pkt-size and --flow come in any order, check them together */
+	if (tx_pkt_size == 0)
+		tx_pkt_size = talker_min_pkt_size();
+	else if (tx_pkt_size < talker_min_pkt_size()) {
+		fprintf(stderr, "Packet size %u is below %u, the headers with "
+			"timestamp and counter\n", tx_pkt_size,
+			talker_min_pkt_size());
+		talker_usage(prgname);
+		return -1;
+	}
+
 	if (optind >= 0)
 		argv[optind-1] = prgname;
 
@@ -1373,6 +1621,19 @@ main(int argc, char **argv)
 		}
 	}
 
+	/* one line for scripts, see scripts/e2e_perf.py */
+	{
+		uint64_t tx = 0, dropped = 0;
+
+		RTE_ETH_FOREACH_DEV(portid) {
+			tx += port_statistics[portid].tx;
+			dropped += port_statistics[portid].dropped;
+		}
+		printf("Talker summary: tx_pkts=%"PRIu64" tx_dropped=%"PRIu64
+		       " elapsed_ns=%"PRIu64"\n", tx, dropped,
+		       tx_end_ns - tx_start_ns);
+	}
+
 
 
 	RTE_ETH_FOREACH_DEV(portid) {